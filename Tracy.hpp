@@ -33,6 +33,8 @@
 #define LockMark(x) (void)x;
 
 #define TracyPlot(x,y)
+#define TracyPlotBatch(x,y,z)
+#define TracyPlotSampled(x,y,z)
 
 #define TracyMessage(x,y)
 #define TracyMessageL(x)
@@ -53,16 +55,28 @@
 #define TracyAllocS(x,y,z)
 #define TracyFreeS(x,y)
 
+#define ZoneNamedCounters(x,y)
+#define ZoneNamedNCounters(x,y,z)
+#define ZoneNamedCCounters(x,y,z)
+#define ZoneNamedNCCounters(x,y,z,w)
+
+#define ZoneScopedCounters
+#define ZoneScopedNCounters(x)
+#define ZoneScopedCCounters(x)
+#define ZoneScopedNCCounters(x,y)
+
 #else
 
 #include "client/TracyLock.hpp"
+#include "client/TracyPlot.hpp"
 #include "client/TracyProfiler.hpp"
 #include "client/TracyScoped.hpp"
+#include "client/TracyZoneCounters.hpp"
 
-#define ZoneNamed( varname, active ) static const tracy::SourceLocationData TracyConcat(__tracy_source_location,__LINE__) { nullptr, __FUNCTION__,  __FILE__, (uint32_t)__LINE__, 0 }; tracy::ScopedZone varname( &TracyConcat(__tracy_source_location,__LINE__), active );
-#define ZoneNamedN( varname, name, active ) static const tracy::SourceLocationData TracyConcat(__tracy_source_location,__LINE__) { name, __FUNCTION__,  __FILE__, (uint32_t)__LINE__, 0 }; tracy::ScopedZone varname( &TracyConcat(__tracy_source_location,__LINE__), active );
-#define ZoneNamedC( varname, color, active ) static const tracy::SourceLocationData TracyConcat(__tracy_source_location,__LINE__) { nullptr, __FUNCTION__,  __FILE__, (uint32_t)__LINE__, color }; tracy::ScopedZone varname( &TracyConcat(__tracy_source_location,__LINE__), active );
-#define ZoneNamedNC( varname, name, color, active ) static const tracy::SourceLocationData TracyConcat(__tracy_source_location,__LINE__) { name, __FUNCTION__,  __FILE__, (uint32_t)__LINE__, color }; tracy::ScopedZone varname( &TracyConcat(__tracy_source_location,__LINE__), active );
+#define ZoneNamed( varname, active ) static const tracy::SourceLocationData TracyConcat(__tracy_source_location,__LINE__) { nullptr, __FUNCTION__,  __FILE__, (uint32_t)__LINE__, 0, {} }; tracy::ScopedZone varname( &TracyConcat(__tracy_source_location,__LINE__), active );
+#define ZoneNamedN( varname, name, active ) static const tracy::SourceLocationData TracyConcat(__tracy_source_location,__LINE__) { name, __FUNCTION__,  __FILE__, (uint32_t)__LINE__, 0, {} }; tracy::ScopedZone varname( &TracyConcat(__tracy_source_location,__LINE__), active );
+#define ZoneNamedC( varname, color, active ) static const tracy::SourceLocationData TracyConcat(__tracy_source_location,__LINE__) { nullptr, __FUNCTION__,  __FILE__, (uint32_t)__LINE__, color, {} }; tracy::ScopedZone varname( &TracyConcat(__tracy_source_location,__LINE__), active );
+#define ZoneNamedNC( varname, name, color, active ) static const tracy::SourceLocationData TracyConcat(__tracy_source_location,__LINE__) { name, __FUNCTION__,  __FILE__, (uint32_t)__LINE__, color, {} }; tracy::ScopedZone varname( &TracyConcat(__tracy_source_location,__LINE__), active );
 
 #define ZoneScoped ZoneNamed( ___tracy_scoped_zone, true )
 #define ZoneScopedN( name ) ZoneNamedN( ___tracy_scoped_zone, name, true )
@@ -77,15 +91,17 @@
 #define FrameMarkStart( name ) tracy::Profiler::SendFrameMark( name, tracy::QueueType::FrameMarkMsgStart );
 #define FrameMarkEnd( name ) tracy::Profiler::SendFrameMark( name, tracy::QueueType::FrameMarkMsgEnd );
 
-#define TracyLockable( type, varname ) tracy::Lockable<type> varname { [] () -> const tracy::SourceLocationData* { static const tracy::SourceLocationData srcloc { nullptr, #type " " #varname, __FILE__, __LINE__, 0 }; return &srcloc; }() };
-#define TracyLockableN( type, varname, desc ) tracy::Lockable<type> varname { [] () -> const tracy::SourceLocationData* { static const tracy::SourceLocationData srcloc { nullptr, desc, __FILE__, __LINE__, 0 }; return &srcloc; }() };
-#define TracySharedLockable( type, varname ) tracy::SharedLockable<type> varname { [] () -> const tracy::SourceLocationData* { static const tracy::SourceLocationData srcloc { nullptr, #type " " #varname, __FILE__, __LINE__, 0 }; return &srcloc; }() };
-#define TracySharedLockableN( type, varname, desc ) tracy::SharedLockable<type> varname { [] () -> const tracy::SourceLocationData* { static const tracy::SourceLocationData srcloc { nullptr, desc, __FILE__, __LINE__, 0 }; return &srcloc; }() };
+#define TracyLockable( type, varname ) tracy::Lockable<type> varname { [] () -> const tracy::SourceLocationData* { static const tracy::SourceLocationData srcloc { nullptr, #type " " #varname, __FILE__, __LINE__, 0, {} }; return &srcloc; }() };
+#define TracyLockableN( type, varname, desc ) tracy::Lockable<type> varname { [] () -> const tracy::SourceLocationData* { static const tracy::SourceLocationData srcloc { nullptr, desc, __FILE__, __LINE__, 0, {} }; return &srcloc; }() };
+#define TracySharedLockable( type, varname ) tracy::SharedLockable<type> varname { [] () -> const tracy::SourceLocationData* { static const tracy::SourceLocationData srcloc { nullptr, #type " " #varname, __FILE__, __LINE__, 0, {} }; return &srcloc; }() };
+#define TracySharedLockableN( type, varname, desc ) tracy::SharedLockable<type> varname { [] () -> const tracy::SourceLocationData* { static const tracy::SourceLocationData srcloc { nullptr, desc, __FILE__, __LINE__, 0, {} }; return &srcloc; }() };
 #define LockableBase( type ) tracy::Lockable<type>
 #define SharedLockableBase( type ) tracy::SharedLockable<type>
-#define LockMark( varname ) static const tracy::SourceLocationData __tracy_lock_location_##varname { nullptr, __FUNCTION__,  __FILE__, (uint32_t)__LINE__, 0 }; varname.Mark( &__tracy_lock_location_##varname );
+#define LockMark( varname ) static const tracy::SourceLocationData __tracy_lock_location_##varname { nullptr, __FUNCTION__,  __FILE__, (uint32_t)__LINE__, 0, {} }; varname.Mark( &__tracy_lock_location_##varname );
 
 #define TracyPlot( name, val ) tracy::Profiler::PlotData( name, val );
+#define TracyPlotBatch( name, data, count ) tracy::Profiler::PlotDataBatch( name, data, count );
+#define TracyPlotSampled( name, val, interval ) { static tracy::PlotSampler TracyConcat(__tracy_plot_sampler,__LINE__)( name, interval ); TracyConcat(__tracy_plot_sampler,__LINE__).Sample( val ); }
 
 #define TracyMessage( txt, size ) tracy::Profiler::Message( txt, size );
 #define TracyMessageL( txt ) tracy::Profiler::Message( txt );
@@ -94,10 +110,10 @@
 #define TracyFree( ptr ) tracy::Profiler::MemFree( ptr );
 
 #ifdef TRACY_HAS_CALLSTACK
-#  define ZoneNamedS( varname, depth, active ) static const tracy::SourceLocationData TracyConcat(__tracy_source_location,__LINE__) { nullptr, __FUNCTION__,  __FILE__, (uint32_t)__LINE__, 0 }; tracy::ScopedZone varname( &TracyConcat(__tracy_source_location,__LINE__), depth, active );
-#  define ZoneNamedNS( varname, name, depth, active ) static const tracy::SourceLocationData TracyConcat(__tracy_source_location,__LINE__) { name, __FUNCTION__,  __FILE__, (uint32_t)__LINE__, 0 }; tracy::ScopedZone varname( &TracyConcat(__tracy_source_location,__LINE__), depth, active );
-#  define ZoneNamedCS( varname, color, depth, active ) static const tracy::SourceLocationData TracyConcat(__tracy_source_location,__LINE__) { nullptr, __FUNCTION__,  __FILE__, (uint32_t)__LINE__, color }; tracy::ScopedZone varname( &TracyConcat(__tracy_source_location,__LINE__), depth, active );
-#  define ZoneNamedNCS( varname, name, color, depth, active ) static const tracy::SourceLocationData TracyConcat(__tracy_source_location,__LINE__) { name, __FUNCTION__,  __FILE__, (uint32_t)__LINE__, color }; tracy::ScopedZone varname( &TracyConcat(__tracy_source_location,__LINE__), depth, active );
+#  define ZoneNamedS( varname, depth, active ) static const tracy::SourceLocationData TracyConcat(__tracy_source_location,__LINE__) { nullptr, __FUNCTION__,  __FILE__, (uint32_t)__LINE__, 0, {} }; tracy::ScopedZone varname( &TracyConcat(__tracy_source_location,__LINE__), depth, active );
+#  define ZoneNamedNS( varname, name, depth, active ) static const tracy::SourceLocationData TracyConcat(__tracy_source_location,__LINE__) { name, __FUNCTION__,  __FILE__, (uint32_t)__LINE__, 0, {} }; tracy::ScopedZone varname( &TracyConcat(__tracy_source_location,__LINE__), depth, active );
+#  define ZoneNamedCS( varname, color, depth, active ) static const tracy::SourceLocationData TracyConcat(__tracy_source_location,__LINE__) { nullptr, __FUNCTION__,  __FILE__, (uint32_t)__LINE__, color, {} }; tracy::ScopedZone varname( &TracyConcat(__tracy_source_location,__LINE__), depth, active );
+#  define ZoneNamedNCS( varname, name, color, depth, active ) static const tracy::SourceLocationData TracyConcat(__tracy_source_location,__LINE__) { name, __FUNCTION__,  __FILE__, (uint32_t)__LINE__, color, {} }; tracy::ScopedZone varname( &TracyConcat(__tracy_source_location,__LINE__), depth, active );
 
 #  define ZoneScopedS( depth ) ZoneNamedS( ___tracy_scoped_zone, depth, true )
 #  define ZoneScopedNS( name, depth ) ZoneNamedNS( ___tracy_scoped_zone, name, depth, true )
@@ -121,6 +137,23 @@
 #  define TracyFreeS( ptr, depth ) TracyFree( ptr )
 #endif
 
+#ifdef TRACY_HAS_ZONE_COUNTERS
+#  define ZoneNamedCounters( varname, active ) static const tracy::SourceLocationData TracyConcat(__tracy_source_location,__LINE__) { nullptr, __FUNCTION__,  __FILE__, (uint32_t)__LINE__, 0, {} }; tracy::ScopedZoneCounters varname( &TracyConcat(__tracy_source_location,__LINE__), active );
+#  define ZoneNamedNCounters( varname, name, active ) static const tracy::SourceLocationData TracyConcat(__tracy_source_location,__LINE__) { name, __FUNCTION__,  __FILE__, (uint32_t)__LINE__, 0, {} }; tracy::ScopedZoneCounters varname( &TracyConcat(__tracy_source_location,__LINE__), active );
+#  define ZoneNamedCCounters( varname, color, active ) static const tracy::SourceLocationData TracyConcat(__tracy_source_location,__LINE__) { nullptr, __FUNCTION__,  __FILE__, (uint32_t)__LINE__, color, {} }; tracy::ScopedZoneCounters varname( &TracyConcat(__tracy_source_location,__LINE__), active );
+#  define ZoneNamedNCCounters( varname, name, color, active ) static const tracy::SourceLocationData TracyConcat(__tracy_source_location,__LINE__) { name, __FUNCTION__,  __FILE__, (uint32_t)__LINE__, color, {} }; tracy::ScopedZoneCounters varname( &TracyConcat(__tracy_source_location,__LINE__), active );
+#else
+#  define ZoneNamedCounters( varname, active ) ZoneNamed( varname, active )
+#  define ZoneNamedNCounters( varname, name, active ) ZoneNamedN( varname, name, active )
+#  define ZoneNamedCCounters( varname, color, active ) ZoneNamedC( varname, color, active )
+#  define ZoneNamedNCCounters( varname, name, color, active ) ZoneNamedNC( varname, name, color, active )
+#endif
+
+#define ZoneScopedCounters ZoneNamedCounters( ___tracy_scoped_zone, true )
+#define ZoneScopedNCounters( name ) ZoneNamedNCounters( ___tracy_scoped_zone, name, true )
+#define ZoneScopedCCounters( color ) ZoneNamedCCounters( ___tracy_scoped_zone, color, true )
+#define ZoneScopedNCCounters( name, color ) ZoneNamedNCCounters( ___tracy_scoped_zone, name, color, true )
+
 #endif
 
 #endif
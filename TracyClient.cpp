@@ -17,7 +17,13 @@
 
 #include "client/TracyProfiler.cpp"
 #include "client/TracyCallstack.cpp"
+#include "client/TracyFlightRecorder.cpp"
+#include "client/TracySendPipeline.cpp"
+#include "client/TracySampling.cpp"
+#include "client/TracyContextSwitch.cpp"
+#include "client/TracyZoneCounters.cpp"
 #include "common/tracy_lz4.cpp"
+#include "common/tracy_lz4hc.cpp"
 #include "common/TracySocket.cpp"
 #include "client/tracy_rpmalloc.cpp"
 
@@ -29,6 +29,7 @@ namespace tracy
 #endif
 
     DLL_IMPORT moodycamel::ConcurrentQueue<QueueItem>::ExplicitProducer* get_token();
+    DLL_IMPORT MemQueue* get_memQueue();
     DLL_IMPORT void*(*get_rpmalloc())(size_t size);
     DLL_IMPORT void(*get_rpfree())(void* ptr);
     DLL_IMPORT Profiler& get_profiler();
@@ -65,9 +66,23 @@ namespace tracy
         rpfree_fpt(ptr);
     }
 
+#ifdef TRACY_HAS_CALLSTACK
+    DLL_IMPORT void*(*get_CacheCallstack())(const uintptr_t* trace);
+
+    static void*(*CacheCallstack_fpt)(const uintptr_t* trace) = get_CacheCallstack();
+
+    void* CacheCallstack( const uintptr_t* trace )
+    {
+        return CacheCallstack_fpt( trace );
+    }
+#endif
+
     Profiler& s_profiler = get_profiler();
 
     thread_local ProducerWrapper s_token { get_token() };
+    thread_local MemQueueWrapper s_memQueue { get_memQueue() };
+    thread_local PayloadArena s_arena;
+    thread_local ZoneAggregate s_zoneAggregate {};
 }
 
 #endif
@@ -45,6 +45,9 @@ static inline char* FindEnd( char* ptr )
     return ptr;
 }
 
+static inline void LuaStartSampling( lua_State* L, int count = 1000 ) {}
+static inline void LuaStopSampling( lua_State* L ) {}
+
 static inline void LuaRemove( char* script )
 {
     while( *script )
@@ -114,6 +117,7 @@ static inline void LuaRemove( char* script )
 #include "common/TracyAlign.hpp"
 #include "common/TracySystem.hpp"
 #include "client/TracyProfiler.hpp"
+#include "client/TracySourceLocationCache.hpp"
 
 namespace tracy
 {
@@ -125,47 +129,13 @@ extern thread_local LuaZoneState s_luaZoneState;
 namespace detail
 {
 
-static inline int LuaZoneBegin( lua_State* L )
+static inline void LuaZoneBeginSrcLoc( const SourceLocationData* srcloc )
 {
-#ifdef TRACY_ON_DEMAND
-    const auto zoneCnt = s_luaZoneState.counter++;
-    if( zoneCnt != 0 && !s_luaZoneState.active ) return 0;
-    s_luaZoneState.active = s_profiler.IsConnected();
-    if( !s_luaZoneState.active ) return 0;
-#endif
-
-    const uint32_t color = Color::DeepSkyBlue3;
-
-    lua_Debug dbg;
-    lua_getstack( L, 1, &dbg );
-    lua_getinfo( L, "Snl", &dbg );
-
-    const uint32_t line = dbg.currentline;
-    const auto func = dbg.name ? dbg.name : dbg.short_src;
-    const auto fsz = strlen( func );
-    const auto ssz = strlen( dbg.source );
-
-    // Data layout:
-    //  4b  payload size
-    //  4b  color
-    //  4b  source line
-    //  fsz function name
-    //  1b  null terminator
-    //  ssz source file name
-    //  1b  null terminator
-    const uint32_t sz = uint32_t( 4 + 4 + 4 + fsz + 1 + ssz + 1 );
-    auto ptr = (char*)tracy_malloc( sz );
-    memcpy( ptr, &sz, 4 );
-    memcpy( ptr + 4, &color, 4 );
-    memcpy( ptr + 8, &line, 4 );
-    memcpy( ptr + 12, func, fsz+1 );
-    memcpy( ptr + 12 + fsz + 1, dbg.source, ssz + 1 );
-
     Magic magic;
     auto& token = s_token.ptr;
     auto& tail = token->get_tail_index();
     auto item = token->enqueue_begin<tracy::moodycamel::CanAlloc>( magic );
-    MemWrite( &item->hdr.type, QueueType::ZoneBeginAllocSrcLoc );
+    MemWrite( &item->hdr.type, QueueType::ZoneBegin );
 #ifdef TRACY_RDTSCP_OPT
     MemWrite( &item->zoneBegin.time, Profiler::GetTime( item->zoneBegin.cpu ) );
 #else
@@ -174,30 +144,20 @@ static inline int LuaZoneBegin( lua_State* L )
     MemWrite( &item->zoneBegin.cpu, cpu );
 #endif
     MemWrite( &item->zoneBegin.thread, GetThreadHandle() );
-    MemWrite( &item->zoneBegin.srcloc, (uint64_t)ptr );
+    MemWrite( &item->zoneBegin.srcloc, (uint64_t)srcloc );
     tail.store( magic + 1, std::memory_order_release );
-    return 0;
 }
 
-static inline int LuaZoneBeginN( lua_State* L )
+// Sends the source location with the zone, when it can't be cached. The "S"
+// and "l" fields of dbg must be filled.
+static inline void LuaZoneBeginAlloc( lua_State* L, lua_Debug& dbg, const char* name, size_t nsz )
 {
-#ifdef TRACY_ON_DEMAND
-    const auto zoneCnt = s_luaZoneState.counter++;
-    if( zoneCnt != 0 && !s_luaZoneState.active ) return 0;
-    s_luaZoneState.active = s_profiler.IsConnected();
-    if( !s_luaZoneState.active ) return 0;
-#endif
-
     const uint32_t color = Color::DeepSkyBlue3;
 
-    lua_Debug dbg;
-    lua_getstack( L, 1, &dbg );
-    lua_getinfo( L, "Snl", &dbg );
+    lua_getinfo( L, "n", &dbg );
 
     const uint32_t line = dbg.currentline;
     const auto func = dbg.name ? dbg.name : dbg.short_src;
-    size_t nsz;
-    const auto name = lua_tolstring( L, 1, &nsz );
     const auto fsz = strlen( func );
     const auto ssz = strlen( dbg.source );
 
@@ -209,18 +169,18 @@ static inline int LuaZoneBeginN( lua_State* L )
     //  1b  null terminator
     //  ssz source file name
     //  1b  null terminator
-    //  nsz zone name
+    //  nsz zone name (optional)
     const uint32_t sz = uint32_t( 4 + 4 + 4 + fsz + 1 + ssz + 1 + nsz );
-    auto ptr = (char*)tracy_malloc( sz );
+    Magic magic;
+    auto& token = s_token.ptr;
+    auto ptr = (char*)s_arena.Alloc( sz );
     memcpy( ptr, &sz, 4 );
     memcpy( ptr + 4, &color, 4 );
     memcpy( ptr + 8, &line, 4 );
     memcpy( ptr + 12, func, fsz+1 );
     memcpy( ptr + 12 + fsz + 1, dbg.source, ssz + 1 );
-    memcpy( ptr + 12 + fsz + 1 + ssz + 1, name, nsz );
+    if( nsz != 0 ) memcpy( ptr + 12 + fsz + 1 + ssz + 1, name, nsz );
 
-    Magic magic;
-    auto& token = s_token.ptr;
     auto& tail = token->get_tail_index();
     auto item = token->enqueue_begin<tracy::moodycamel::CanAlloc>( magic );
     MemWrite( &item->hdr.type, QueueType::ZoneBeginAllocSrcLoc );
@@ -234,6 +194,111 @@ static inline int LuaZoneBeginN( lua_State* L )
     MemWrite( &item->zoneBegin.thread, GetThreadHandle() );
     MemWrite( &item->zoneBegin.srcloc, (uint64_t)ptr );
     tail.store( magic + 1, std::memory_order_release );
+}
+
+// Lua 5.4 reports the length of the chunk source, which may be a whole script.
+static tracy_force_inline size_t LuaSourceSize( const lua_Debug& dbg )
+{
+#if LUA_VERSION_NUM >= 504
+    return dbg.srclen;
+#else
+    return strlen( dbg.source );
+#endif
+}
+
+// Hashes the chunk source of the function described by dbg. Short sources,
+// such as file chunk names ("@path"), are hashed directly. Longer ones may be
+// whole scripts, so their hash is kept in a weak keyed registry table, which
+// drops it along with the function.
+static inline uint64_t LuaSourceHash( lua_State* L, lua_Debug& dbg, size_t ssz )
+{
+    if( ssz <= 128 ) return SourceLocationCache::HashSource( dbg.source, ssz );
+
+    lua_getfield( L, LUA_REGISTRYINDEX, "tracy_source_hash" );
+    if( !lua_istable( L, -1 ) )
+    {
+        lua_pop( L, 1 );
+        lua_newtable( L );
+        lua_newtable( L );
+        lua_pushstring( L, "k" );
+        lua_setfield( L, -2, "__mode" );
+        lua_setmetatable( L, -2 );
+        lua_pushvalue( L, -1 );
+        lua_setfield( L, LUA_REGISTRYINDEX, "tracy_source_hash" );
+    }
+    lua_getinfo( L, "f", &dbg );
+    lua_pushvalue( L, -1 );
+    lua_rawget( L, -3 );
+    uint64_t hash;
+    auto cached = (const uint64_t*)lua_touserdata( L, -1 );
+    if( cached )
+    {
+        hash = *cached;
+        lua_pop( L, 3 );
+    }
+    else
+    {
+        lua_pop( L, 1 );
+        hash = SourceLocationCache::HashSource( dbg.source, ssz );
+        memcpy( lua_newuserdata( L, sizeof( hash ) ), &hash, sizeof( hash ) );
+        lua_rawset( L, -3 );
+        lua_pop( L, 1 );
+    }
+    return hash;
+}
+
+// Source locations are cached per call site, identified by the chunk name and
+// line, so that only the first zone at a given site needs the expensive
+// function name lookup. Later zones are sent like the ScopedZone ones.
+static inline void LuaZoneBeginCached( lua_State* L, const char* name, size_t nsz )
+{
+    lua_Debug dbg;
+    lua_getstack( L, 1, &dbg );
+    lua_getinfo( L, "Sl", &dbg );
+
+    const uint32_t line = dbg.currentline;
+    const auto ssz = LuaSourceSize( dbg );
+    const auto shash = LuaSourceHash( L, dbg, ssz );
+    auto srcloc = s_luaSourceLocations.Find( dbg.source, ssz, shash, line, name, nsz );
+    if( !srcloc )
+    {
+        lua_getinfo( L, "n", &dbg );
+        const auto func = dbg.name ? dbg.name : dbg.short_src;
+        srcloc = s_luaSourceLocations.Insert( func, dbg.source, ssz, shash, line, name, nsz, Color::DeepSkyBlue3 );
+        if( !srcloc )
+        {
+            LuaZoneBeginAlloc( L, dbg, name, nsz );
+            return;
+        }
+    }
+    LuaZoneBeginSrcLoc( srcloc );
+}
+
+static inline int LuaZoneBegin( lua_State* L )
+{
+#ifdef TRACY_ON_DEMAND
+    const auto zoneCnt = s_luaZoneState.counter++;
+    if( zoneCnt != 0 && !s_luaZoneState.active ) return 0;
+    s_luaZoneState.active = s_profiler.IsConnected();
+    if( !s_luaZoneState.active ) return 0;
+#endif
+
+    LuaZoneBeginCached( L, nullptr, 0 );
+    return 0;
+}
+
+static inline int LuaZoneBeginN( lua_State* L )
+{
+#ifdef TRACY_ON_DEMAND
+    const auto zoneCnt = s_luaZoneState.counter++;
+    if( zoneCnt != 0 && !s_luaZoneState.active ) return 0;
+    s_luaZoneState.active = s_profiler.IsConnected();
+    if( !s_luaZoneState.active ) return 0;
+#endif
+
+    size_t nsz;
+    const auto name = lua_tolstring( L, 1, &nsz );
+    LuaZoneBeginCached( L, name, nsz );
     return 0;
 }
 
@@ -283,14 +348,12 @@ static inline int LuaZoneText( lua_State* L )
 
     Magic magic;
     auto& token = s_token.ptr;
-    auto ptr = (char*)tracy_malloc( size+1 );
-    memcpy( ptr, txt, size );
-    ptr[size] = '\0';
+    const auto ptr = Profiler::CopyString( txt, size );
     auto& tail = token->get_tail_index();
     auto item = token->enqueue_begin<tracy::moodycamel::CanAlloc>( magic );
     MemWrite( &item->hdr.type, QueueType::ZoneText );
     MemWrite( &item->zoneText.thread, GetThreadHandle() );
-    MemWrite( &item->zoneText.text, (uint64_t)ptr );
+    MemWrite( &item->zoneText.text, ptr );
     tail.store( magic + 1, std::memory_order_release );
     return 0;
 }
@@ -311,14 +374,12 @@ static inline int LuaZoneName( lua_State* L )
 
     Magic magic;
     auto& token = s_token.ptr;
-    auto ptr = (char*)tracy_malloc( size+1 );
-    memcpy( ptr, txt, size );
-    ptr[size] = '\0';
+    const auto ptr = Profiler::CopyString( txt, size );
     auto& tail = token->get_tail_index();
     auto item = token->enqueue_begin<tracy::moodycamel::CanAlloc>( magic );
     MemWrite( &item->hdr.type, QueueType::ZoneName );
     MemWrite( &item->zoneText.thread, GetThreadHandle() );
-    MemWrite( &item->zoneText.text, (uint64_t)ptr );
+    MemWrite( &item->zoneText.text, ptr );
     tail.store( magic + 1, std::memory_order_release );
     return 0;
 }
@@ -334,19 +395,74 @@ static inline int LuaMessage( lua_State* L )
 
     Magic magic;
     auto& token = s_token.ptr;
-    auto ptr = (char*)tracy_malloc( size+1 );
-    memcpy( ptr, txt, size );
-    ptr[size] = '\0';
+    const auto ptr = Profiler::CopyString( txt, size );
     auto& tail = token->get_tail_index();
     auto item = token->enqueue_begin<tracy::moodycamel::CanAlloc>( magic );
     MemWrite( &item->hdr.type, QueueType::Message );
     MemWrite( &item->message.time, Profiler::GetTime() );
     MemWrite( &item->message.thread, GetThreadHandle() );
-    MemWrite( &item->message.text, (uint64_t)ptr );
+    MemWrite( &item->message.text, ptr );
     tail.store( magic + 1, std::memory_order_release );
     return 0;
 }
 
+#ifdef TRACY_HAS_CALLSTACK
+enum { LuaSampleDepth = 32 };
+
+// Records the Lua callstack. Lua functions are identified by their source and
+// definition line, and are described once, when first seen. Native functions
+// called from Lua are recorded by address, like the frames of native
+// callstacks.
+static inline void LuaSampleHook( lua_State* L, lua_Debug* )
+{
+#ifdef TRACY_ON_DEMAND
+    if( !s_profiler.IsConnected() ) return;
+#endif
+
+    uintptr_t trace[1 + LuaSampleDepth];
+    uintptr_t num = 0;
+    lua_Debug dbg;
+    for( int level = 0; num < LuaSampleDepth && lua_getstack( L, level, &dbg ); level++ )
+    {
+        lua_getinfo( L, "S", &dbg );
+        if( *dbg.what == 'C' )
+        {
+            lua_getinfo( L, "f", &dbg );
+            const auto func = lua_tocfunction( L, -1 );
+            lua_pop( L, 1 );
+            if( func ) trace[1 + num++] = (uintptr_t)func;
+            continue;
+        }
+
+        const uint32_t line = dbg.linedefined;
+        const auto ssz = LuaSourceSize( dbg );
+        const auto shash = LuaSourceHash( L, dbg, ssz );
+        auto frame = s_luaSampleFrames.Find( dbg.source, ssz, shash, line, nullptr, 0 );
+        if( !frame )
+        {
+            lua_getinfo( L, "n", &dbg );
+            const auto name = dbg.name ? dbg.name : ( *dbg.what == 'm' ? "main chunk" : "anonymous function" );
+            frame = s_luaSampleFrames.Insert( name, dbg.source, ssz, shash, line, nullptr, 0, 0 );
+            if( !frame ) continue;
+        }
+        trace[1 + num++] = (uintptr_t)frame;
+    }
+    if( num == 0 ) return;
+    *trace = num;
+
+    Magic magic;
+    auto& token = s_token.ptr;
+    const auto ptr = CacheCallstack( trace );
+    auto& tail = token->get_tail_index();
+    auto item = token->enqueue_begin<tracy::moodycamel::CanAlloc>( magic );
+    MemWrite( &item->hdr.type, QueueType::LuaSample );
+    MemWrite( &item->luaSample.time, Profiler::GetTime() );
+    MemWrite( &item->luaSample.thread, GetThreadHandle() );
+    MemWrite( &item->luaSample.ptr, (uint64_t)ptr );
+    tail.store( magic + 1, std::memory_order_release );
+}
+#endif
+
 }
 
 static inline void LuaRegister( lua_State* L )
@@ -367,6 +483,22 @@ static inline void LuaRegister( lua_State* L )
     lua_setglobal( L, "tracy" );
 }
 
+// Samples the Lua callstack every count virtual machine instructions executed
+// by L. Coroutines created afterwards inherit the hook.
+static inline void LuaStartSampling( lua_State* L, int count = 1000 )
+{
+#ifdef TRACY_HAS_CALLSTACK
+    lua_sethook( L, detail::LuaSampleHook, LUA_MASKCOUNT, count );
+#endif
+}
+
+static inline void LuaStopSampling( lua_State* L )
+{
+#ifdef TRACY_HAS_CALLSTACK
+    lua_sethook( L, nullptr, 0, 0 );
+#endif
+}
+
 static inline void LuaRemove( char* script ) {}
 
 }
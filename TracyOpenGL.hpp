@@ -30,15 +30,15 @@
 #include "common/TracyAlloc.hpp"
 
 #define TracyGpuContext tracy::s_gpuCtx.ptr = (tracy::GpuCtx*)tracy::tracy_malloc( sizeof( tracy::GpuCtx ) ); new(tracy::s_gpuCtx.ptr) tracy::GpuCtx;
-#define TracyGpuNamedZone( varname, name ) static const tracy::SourceLocationData TracyConcat(__tracy_gpu_source_location,__LINE__) { name, __FUNCTION__,  __FILE__, (uint32_t)__LINE__, 0 }; tracy::GpuCtxScope varname( &TracyConcat(__tracy_gpu_source_location,__LINE__) );
-#define TracyGpuNamedZoneC( varname, name, color ) static const tracy::SourceLocationData TracyConcat(__tracy_gpu_source_location,__LINE__) { name, __FUNCTION__,  __FILE__, (uint32_t)__LINE__, color }; tracy::GpuCtxScope varname( &TracyConcat(__tracy_gpu_source_location,__LINE__) );
+#define TracyGpuNamedZone( varname, name ) static const tracy::SourceLocationData TracyConcat(__tracy_gpu_source_location,__LINE__) { name, __FUNCTION__,  __FILE__, (uint32_t)__LINE__, 0, {} }; tracy::GpuCtxScope varname( &TracyConcat(__tracy_gpu_source_location,__LINE__) );
+#define TracyGpuNamedZoneC( varname, name, color ) static const tracy::SourceLocationData TracyConcat(__tracy_gpu_source_location,__LINE__) { name, __FUNCTION__,  __FILE__, (uint32_t)__LINE__, color, {} }; tracy::GpuCtxScope varname( &TracyConcat(__tracy_gpu_source_location,__LINE__) );
 #define TracyGpuZone( name ) TracyGpuNamedZone( ___tracy_gpu_zone, name )
 #define TracyGpuZoneC( name, color ) TracyGpuNamedZoneC( ___tracy_gpu_zone, name, color )
 #define TracyGpuCollect tracy::s_gpuCtx.ptr->Collect();
 
 #ifdef TRACY_HAS_CALLSTACK
-#  define TracyGpuNamedZoneS( varname, name, depth ) static const tracy::SourceLocationData TracyConcat(__tracy_gpu_source_location,__LINE__) { name, __FUNCTION__,  __FILE__, (uint32_t)__LINE__, 0 }; tracy::GpuCtxScope varname( &TracyConcat(__tracy_gpu_source_location,__LINE__), depth );
-#  define TracyGpuNamedZoneCS( varname, name, color, depth ) static const tracy::SourceLocationData TracyConcat(__tracy_gpu_source_location,__LINE__) { name, __FUNCTION__,  __FILE__, (uint32_t)__LINE__, color }; tracy::GpuCtxScope varname( &TracyConcat(__tracy_gpu_source_location,__LINE__), depth );
+#  define TracyGpuNamedZoneS( varname, name, depth ) static const tracy::SourceLocationData TracyConcat(__tracy_gpu_source_location,__LINE__) { name, __FUNCTION__,  __FILE__, (uint32_t)__LINE__, 0, {} }; tracy::GpuCtxScope varname( &TracyConcat(__tracy_gpu_source_location,__LINE__), depth );
+#  define TracyGpuNamedZoneCS( varname, name, color, depth ) static const tracy::SourceLocationData TracyConcat(__tracy_gpu_source_location,__LINE__) { name, __FUNCTION__,  __FILE__, (uint32_t)__LINE__, color, {} }; tracy::GpuCtxScope varname( &TracyConcat(__tracy_gpu_source_location,__LINE__), depth );
 #  define TracyGpuZoneS( name, depth ) TracyGpuNamedZoneS( ___tracy_gpu_zone, name, depth )
 #  define TracyGpuZoneCS( name, color, depth ) TracyGpuNamedZoneCS( ___tracy_gpu_zone, name, color, depth )
 #else
@@ -131,22 +131,32 @@ public:
 
         start %= QueryCount;
 
+        // OpenGL can only read the queries one by one, but the results of the
+        // ready range are passed on in batches.
         Magic magic;
         auto& token = s_token.ptr;
-        auto& tail = token->get_tail_index();
-
         while( m_tail != start )
         {
-            uint64_t time;
-            glGetQueryObjectui64v( m_query[m_tail], GL_QUERY_RESULT, &time );
+            auto cnt = ( start + QueryCount - m_tail ) % QueryCount;
+            if( cnt > GpuTimeBatchSize ) cnt = GpuTimeBatchSize;
+
+            auto batch = (int64_t*)s_arena.Alloc( cnt * sizeof( int64_t ) );
+            for( unsigned int i=0; i<cnt; i++ )
+            {
+                uint64_t time;
+                glGetQueryObjectui64v( m_query[( m_tail + i ) % QueryCount], GL_QUERY_RESULT, &time );
+                batch[i] = (int64_t)time;
+            }
 
+            auto& tail = token->get_tail_index();
             auto item = token->enqueue_begin<tracy::moodycamel::CanAlloc>( magic );
-            MemWrite( &item->hdr.type, QueueType::GpuTime );
-            MemWrite( &item->gpuTime.gpuTime, (int64_t)time );
-            MemWrite( &item->gpuTime.queryId, (uint16_t)m_tail );
-            MemWrite( &item->gpuTime.context, m_context );
+            MemWrite( &item->hdr.type, QueueType::GpuTimeBatch );
+            MemWrite( &item->gpuTimeBatch.ptr, (uint64_t)batch );
+            MemWrite( &item->gpuTimeBatch.queryId, (uint16_t)m_tail );
+            MemWrite( &item->gpuTimeBatch.count, (uint16_t)cnt );
+            MemWrite( &item->gpuTimeBatch.context, m_context );
             tail.store( magic + 1, std::memory_order_release );
-            m_tail = ( m_tail + 1 ) % QueryCount;
+            m_tail = ( m_tail + cnt ) % QueryCount;
         }
     }
 
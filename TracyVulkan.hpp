@@ -27,15 +27,15 @@
 
 #define TracyVkContext( physdev, device, queue, cmdbuf ) tracy::s_vkCtx.ptr = (tracy::VkCtx*)tracy::tracy_malloc( sizeof( tracy::VkCtx ) ); new(tracy::s_vkCtx.ptr) tracy::VkCtx( physdev, device, queue, cmdbuf );
 #define TracyVkDestroy tracy::s_vkCtx.ptr->~VkCtx(); tracy::tracy_free( tracy::s_vkCtx.ptr ); tracy::s_vkCtx.ptr = nullptr;
-#define TracyVkNamedZone( varname, cmdbuf, name ) static const tracy::SourceLocationData TracyConcat(__tracy_gpu_source_location,__LINE__) { name, __FUNCTION__,  __FILE__, (uint32_t)__LINE__, 0 }; tracy::VkCtxScope varname( &TracyConcat(__tracy_gpu_source_location,__LINE__), cmdbuf );
-#define TracyVkNamedZoneC( varname, cmdbuf, name, color ) static const tracy::SourceLocationData TracyConcat(__tracy_gpu_source_location,__LINE__) { name, __FUNCTION__,  __FILE__, (uint32_t)__LINE__, color }; tracy::VkCtxScope varname( &TracyConcat(__tracy_gpu_source_location,__LINE__), cmdbuf );
+#define TracyVkNamedZone( varname, cmdbuf, name ) static const tracy::SourceLocationData TracyConcat(__tracy_gpu_source_location,__LINE__) { name, __FUNCTION__,  __FILE__, (uint32_t)__LINE__, 0, {} }; tracy::VkCtxScope varname( &TracyConcat(__tracy_gpu_source_location,__LINE__), cmdbuf );
+#define TracyVkNamedZoneC( varname, cmdbuf, name, color ) static const tracy::SourceLocationData TracyConcat(__tracy_gpu_source_location,__LINE__) { name, __FUNCTION__,  __FILE__, (uint32_t)__LINE__, color, {} }; tracy::VkCtxScope varname( &TracyConcat(__tracy_gpu_source_location,__LINE__), cmdbuf );
 #define TracyVkZone( cmdbuf, name ) TracyVkNamedZone( ___tracy_gpu_zone, cmdbuf, name )
 #define TracyVkZoneC( cmdbuf, name, color ) TracyVkNamedZoneC( ___tracy_gpu_zone, cmdbuf, name, color )
 #define TracyVkCollect( cmdbuf ) tracy::s_vkCtx.ptr->Collect( cmdbuf );
 
 #ifdef TRACY_HAS_CALLSTACK
-#  define TracyVkNamedZoneS( varname, cmdbuf, name, depth ) static const tracy::SourceLocationData TracyConcat(__tracy_gpu_source_location,__LINE__) { name, __FUNCTION__,  __FILE__, (uint32_t)__LINE__, 0 }; tracy::VkCtxScope varname( &TracyConcat(__tracy_gpu_source_location,__LINE__), cmdbuf, depth );
-#  define TracyVkNamedZoneCS( varname, cmdbuf, name, color, depth ) static const tracy::SourceLocationData TracyConcat(__tracy_gpu_source_location,__LINE__) { name, __FUNCTION__,  __FILE__, (uint32_t)__LINE__, color }; tracy::VkCtxScope varname( &TracyConcat(__tracy_gpu_source_location,__LINE__), cmdbuf, depth );
+#  define TracyVkNamedZoneS( varname, cmdbuf, name, depth ) static const tracy::SourceLocationData TracyConcat(__tracy_gpu_source_location,__LINE__) { name, __FUNCTION__,  __FILE__, (uint32_t)__LINE__, 0, {} }; tracy::VkCtxScope varname( &TracyConcat(__tracy_gpu_source_location,__LINE__), cmdbuf, depth );
+#  define TracyVkNamedZoneCS( varname, cmdbuf, name, color, depth ) static const tracy::SourceLocationData TracyConcat(__tracy_gpu_source_location,__LINE__) { name, __FUNCTION__,  __FILE__, (uint32_t)__LINE__, color, {} }; tracy::VkCtxScope varname( &TracyConcat(__tracy_gpu_source_location,__LINE__), cmdbuf, depth );
 #  define TracyVkZoneS( cmdbuf, name, depth ) TracyVkNamedZoneS( ___tracy_gpu_zone, cmdbuf, name, depth )
 #  define TracyVkZoneCS( cmdbuf, name, color, depth ) TracyVkNamedZoneCS( ___tracy_gpu_zone, cmdbuf, name, color, depth )
 #else
@@ -63,7 +63,7 @@ public:
         , m_context( s_gpuCtxCounter.fetch_add( 1, std::memory_order_relaxed ) )
         , m_head( 0 )
         , m_tail( 0 )
-        , m_oldCnt( 0 )
+        , m_res( (int64_t*)tracy_malloc( GpuTimeBatchSize * 2 * sizeof( int64_t ) ) )
     {
         assert( m_context != 255 );
 
@@ -129,6 +129,7 @@ public:
 
     ~VkCtx()
     {
+        tracy_free( m_res );
         vkDestroyQueryPool( m_device, m_query, nullptr );
     }
 
@@ -147,42 +148,42 @@ public:
         }
 #endif
 
-        unsigned int cnt;
-        if( m_oldCnt != 0 )
-        {
-            cnt = m_oldCnt;
-            m_oldCnt = 0;
-        }
-        else
-        {
-            cnt = m_head < m_tail ? QueryCount - m_tail : m_head - m_tail;
-        }
-
-        int64_t res[QueryCount];
-        if( vkGetQueryPoolResults( m_device, m_query, m_tail, cnt, sizeof( res ), res, sizeof( *res ), VK_QUERY_RESULT_64_BIT ) == VK_NOT_READY )
-        {
-            m_oldCnt = cnt;
-            return;
-        }
-
+        // The results are read along with their availability, so that the
+        // ready part of the range can be collected in a single call.
         Magic magic;
         auto& token = s_token.ptr;
-        auto& tail = token->get_tail_index();
-
-        for( unsigned int idx=0; idx<cnt; idx++ )
+        while( m_tail != m_head )
         {
+            unsigned int cnt = m_head < m_tail ? QueryCount - m_tail : m_head - m_tail;
+            if( cnt > GpuTimeBatchSize ) cnt = GpuTimeBatchSize;
+
+            // VK_NOT_READY only tells that some of the results are not
+            // available yet. Any other failure (e.g. a lost device) leaves
+            // the results undefined.
+            const auto res = vkGetQueryPoolResults( m_device, m_query, m_tail, cnt, cnt * 2 * sizeof( int64_t ), m_res, 2 * sizeof( int64_t ), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT );
+            if( res != VK_SUCCESS && res != VK_NOT_READY ) return;
+            unsigned int ready = 0;
+            while( ready < cnt && m_res[ready*2+1] != 0 ) ready++;
+            if( ready == 0 ) return;
+
+            auto batch = (int64_t*)s_arena.Alloc( ready * sizeof( int64_t ) );
+            for( unsigned int i=0; i<ready; i++ ) batch[i] = m_res[i*2];
+
+            auto& tail = token->get_tail_index();
             auto item = token->enqueue_begin<tracy::moodycamel::CanAlloc>( magic );
-            MemWrite( &item->hdr.type, QueueType::GpuTime );
-            MemWrite( &item->gpuTime.gpuTime, res[idx] );
-            MemWrite( &item->gpuTime.queryId, uint16_t( m_tail + idx ) );
-            MemWrite( &item->gpuTime.context, m_context );
+            MemWrite( &item->hdr.type, QueueType::GpuTimeBatch );
+            MemWrite( &item->gpuTimeBatch.ptr, (uint64_t)batch );
+            MemWrite( &item->gpuTimeBatch.queryId, uint16_t( m_tail ) );
+            MemWrite( &item->gpuTimeBatch.count, uint16_t( ready ) );
+            MemWrite( &item->gpuTimeBatch.context, m_context );
             tail.store( magic + 1, std::memory_order_release );
-        }
 
-        vkCmdResetQueryPool( cmdbuf, m_query, m_tail, cnt );
+            vkCmdResetQueryPool( cmdbuf, m_query, m_tail, ready );
 
-        m_tail += cnt;
-        if( m_tail == QueryCount ) m_tail = 0;
+            m_tail += ready;
+            if( m_tail == QueryCount ) m_tail = 0;
+            if( ready != cnt ) return;
+        }
     }
 
 private:
@@ -206,7 +207,7 @@ private:
 
     unsigned int m_head;
     unsigned int m_tail;
-    unsigned int m_oldCnt;
+    int64_t* m_res;     // result and availability pairs
 };
 
 extern VkCtxWrapper s_vkCtx;
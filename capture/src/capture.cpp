@@ -4,10 +4,13 @@
 
 #include <chrono>
 #include <inttypes.h>
+#include <memory>
 #include <mutex>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string>
+#include <vector>
 
 #include "../../server/TracyFileWrite.hpp"
 #include "../../server/TracyMemory.hpp"
@@ -98,7 +101,10 @@ static const char* RealToString( double val, bool separator )
 
 void Usage()
 {
-    printf( "Usage: capture -a address -o output.tracy\n" );
+    printf( "Usage: capture -a address[:port] [-a address[:port]...] -o output.tracy [-t rate:time] [-r stream]\n" );
+    printf( "  -a  client address, may be repeated to capture several processes at once\n" );
+    printf( "  -r  record the decompressed data stream of a single client, for replaybench\n" );
+    printf( "  -t  aggregate zones shorter than time (ns), seen more than rate times per second\n" );
     exit( 1 );
 }
 
@@ -112,42 +118,103 @@ int main( int argc, char** argv )
     }
 #endif
 
-    const char* address = nullptr;
+    std::vector<std::pair<std::string, std::string>> addresses;
     const char* output = nullptr;
+    const char* record = nullptr;
+    uint32_t throttleRate = 0;
+    int64_t throttleTime = 0;
 
     int c;
-    while( ( c = getopt( argc, argv, "a:o:" ) ) != -1 )
+    while( ( c = getopt( argc, argv, "a:o:t:r:" ) ) != -1 )
     {
         switch( c )
         {
         case 'a':
-            address = optarg;
+        {
+            // IPv6 addresses contain colons too, those can't have a port.
+            // Shared memory channels are selected with the shm:name address.
+            std::string addr = optarg;
+            std::string port = "8086";
+            const auto colon = addr.find( ':' );
+            if( addr.compare( 0, 4, "shm:" ) != 0 && colon != std::string::npos && addr.find( ':', colon+1 ) == std::string::npos )
+            {
+                port = addr.substr( colon+1 );
+                addr.resize( colon );
+            }
+            addresses.emplace_back( addr, port );
             break;
+        }
         case 'o':
             output = optarg;
             break;
+        case 'r':
+            record = optarg;
+            break;
+        case 't':
+        {
+            unsigned int rate;
+            long long time;
+            if( sscanf( optarg, "%u:%lld", &rate, &time ) != 2 || rate == 0 || time <= 0 ) Usage();
+            throttleRate = rate;
+            throttleTime = time;
+            break;
+        }
         default:
             Usage();
             break;
         }
     }
 
-    if( !address || !output ) Usage();
+    if( addresses.empty() || !output ) Usage();
+    if( record && addresses.size() != 1 ) Usage();
 
-    printf( "Connecting to %s...", address );
-    fflush( stdout );
-    tracy::Worker worker( address );
-    while( !worker.HasData() ) std::this_thread::sleep_for( std::chrono::milliseconds( 100 ) );
-    printf( "\nQueue delay: %s\nTimer resolution: %s\n", TimeToString( worker.GetDelay() ), TimeToString( worker.GetResolution() ) );
+    FILE* recordFile = nullptr;
+    if( record )
+    {
+        recordFile = fopen( record, "wb" );
+        if( !recordFile )
+        {
+            printf( "Cannot open %s for writing\n", record );
+            return 1;
+        }
+    }
 
-    auto& lock = worker.GetMbpsDataLock();
+    // Each client has its own worker, so that data is received and processed
+    // in parallel. The captures are merged when all clients disconnect.
+    std::vector<std::unique_ptr<tracy::Worker>> workers;
+    for( auto& v : addresses )
+    {
+        printf( "Connecting to %s:%s...\n", v.first.c_str(), v.second.c_str() );
+        workers.emplace_back( std::make_unique<tracy::Worker>( v.first.c_str(), v.second.c_str(), recordFile ) );
+        if( throttleRate != 0 )
+        {
+            std::lock_guard<tracy::TracyMutex> lock( workers.back()->GetDataLock() );
+            workers.back()->SetZoneThrottle( throttleRate, throttleTime );
+        }
+    }
+    for( auto& worker : workers )
+    {
+        while( !worker->HasData() ) std::this_thread::sleep_for( std::chrono::milliseconds( 100 ) );
+        printf( "%s\nQueue delay: %s\nTimer resolution: %s\n", worker->GetCaptureName().c_str(), TimeToString( worker->GetDelay() ), TimeToString( worker->GetResolution() ) );
+    }
 
-    while( worker.IsConnected() )
+    for(;;)
     {
-        lock.lock();
-        const auto mbps = worker.GetMbpsData().back();
-        const auto compRatio = worker.GetCompRatio();
-        lock.unlock();
+        bool connected = false;
+        float mbps = 0;
+        float compRatio = 0;
+        for( auto& worker : workers )
+        {
+            if( worker->IsConnected() ) connected = true;
+            auto& lock = worker->GetMbpsDataLock();
+            lock.lock();
+            const auto wmbps = worker->GetMbpsData().back();
+            mbps += wmbps;
+            compRatio += wmbps * worker->GetCompRatio();
+            lock.unlock();
+        }
+        if( !connected ) break;
+        compRatio = mbps > 0 ? compRatio / mbps : 1.f;
 
         if( mbps < 0.1f )
         {
@@ -157,13 +224,39 @@ int main( int argc, char** argv )
         {
             printf( "\33[2K\r\033[36;1m%7.2f Mbps", mbps );
         }
-        printf( " \033[0m| Ratio: \033[36;1m%5.1f%% \033[0m| Real: \033[33;1m%7.2f Mbps \033[0m| Mem: \033[31;1m%.2f MB\033[0m", compRatio * 100.f, mbps / compRatio, tracy::memUsage.load( std::memory_order_relaxed ) / ( 1024.f * 1024.f ) );
+        printf( " \033[0m| Ratio: \033[36;1m%5.1f%% ", compRatio * 100.f );
+        if( workers.size() == 1 )
+        {
+            auto& worker = workers.front();
+            if( worker->GetCompressionLevel() == 0 )
+            {
+                printf( "\033[0m(%s) ", worker->GetCompressionName() );
+            }
+            else
+            {
+                printf( "\033[0m(%s %i) ", worker->GetCompressionName(), worker->GetCompressionLevel() );
+            }
+        }
+        printf( "\033[0m| Real: \033[33;1m%7.2f Mbps \033[0m| Mem: \033[31;1m%.2f MB\033[0m", mbps / compRatio, tracy::memUsage.load( std::memory_order_relaxed ) / ( 1024.f * 1024.f ) );
         fflush( stdout );
 
         std::this_thread::sleep_for( std::chrono::milliseconds( 100 ) );
     }
 
-    printf( "\nFrames: %" PRIu64 "\nTime span: %s\nZones: %s\nSaving trace...", worker.GetFrameCount( *worker.GetFramesBase() ), TimeToString( worker.GetLastTime() - worker.GetTimeBegin() ), RealToString( worker.GetZoneCount(), true ) );
+    if( recordFile ) fclose( recordFile );
+
+    auto& worker = *workers[0];
+    for( size_t i=1; i<workers.size(); i++ ) worker.Merge( std::move( workers[i] ) );
+
+    printf( "\nFrames: %" PRIu64 "\nTime span: %s\nZones: %s\n", worker.GetFrameCount( *worker.GetFramesBase() ), TimeToString( worker.GetLastTime() - worker.GetTimeBegin() ), RealToString( worker.GetZoneCount(), true ) );
+    auto& dropped = worker.GetDroppedEvents();
+    if( !dropped.empty() )
+    {
+        uint64_t cnt = 0;
+        for( auto& v : dropped ) cnt += v.count;
+        printf( "\033[31;1mDropped events: %s\033[0m\n", RealToString( cnt, true ) );
+    }
+    printf( "Saving trace..." );
     fflush( stdout );
     auto f = std::unique_ptr<tracy::FileWrite>( tracy::FileWrite::Open( output ) );
     if( f )
@@ -0,0 +1,132 @@
+#ifndef __TRACYARENA_HPP__
+#define __TRACYARENA_HPP__
+
+#include <atomic>
+#include <new>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../common/TracyAlloc.hpp"
+#include "../common/TracyForceInline.hpp"
+
+namespace tracy
+{
+
+// Per-thread bump allocator for the payloads of queued events: copied
+// strings, allocated source locations, callstacks and batches. Payloads are
+// carved out of chunks by the producer thread and released by the profiler
+// thread once the event is sent, so the allocator is called once per chunk
+// instead of once per event. Each payload is preceded by a pointer to its
+// chunk, or null for payloads too large for a chunk, which are allocated
+// separately.
+//
+// Chunk references start at a bias, so that the chunk can't be freed by the
+// releases before the producer retires it, which removes the bias less the
+// number of payloads it has carved. Whichever side drops the last reference
+// frees the chunk. The producer doesn't touch the counter otherwise.
+class PayloadArena
+{
+    enum { ChunkSize = 64 * 1024 };
+    enum { MaxSize = ChunkSize / 8 };
+    enum : uint32_t { Bias = 1u << 30 };
+
+    struct Chunk
+    {
+        std::atomic<uint32_t> refs;
+    };
+
+    enum { Header = sizeof( Chunk* ) };
+    enum { DataOffset = ( sizeof( Chunk ) + 7 ) & ~7 };
+
+public:
+    PayloadArena()
+        : m_ptr( nullptr )
+        , m_end( nullptr )
+        , m_chunk( nullptr )
+        , m_count( 0 )
+        , m_exited( false )
+    {
+    }
+
+    PayloadArena( const PayloadArena& ) = delete;
+    PayloadArena( PayloadArena&& ) = delete;
+
+    ~PayloadArena()
+    {
+        Retire();
+        m_exited = true;
+    }
+
+    PayloadArena& operator=( const PayloadArena& ) = delete;
+    PayloadArena& operator=( PayloadArena&& ) = delete;
+
+    // Payloads are 8 byte aligned. Not safe to use in signal handlers.
+    tracy_force_inline void* Alloc( size_t size )
+    {
+        size = ( size + Header + 7 ) & ~size_t( 7 );
+        if( size_t( m_end - m_ptr ) < size ) return AllocSlow( size );
+        auto ptr = m_ptr;
+        m_ptr += size;
+        m_count++;
+        *(Chunk**)ptr = m_chunk;
+        return ptr + Header;
+    }
+
+    // May be called from any thread.
+    static tracy_force_inline void Free( void* ptr )
+    {
+        auto base = (char*)ptr - Header;
+        auto chunk = *(Chunk**)base;
+        if( !chunk )
+        {
+            tracy_free( base );
+        }
+        else if( chunk->refs.fetch_sub( 1, std::memory_order_acq_rel ) == 1 )
+        {
+            tracy_free( chunk );
+        }
+    }
+
+private:
+    tracy_no_inline void* AllocSlow( size_t size )
+    {
+        // A thread may still send events from destructors of other thread
+        // local objects, after its arena is gone.
+        if( size > MaxSize || m_exited )
+        {
+            auto base = (char*)tracy_malloc( size );
+            *(Chunk**)base = nullptr;
+            return base + Header;
+        }
+
+        Retire();
+        m_chunk = (Chunk*)tracy_malloc( ChunkSize );
+        new( &m_chunk->refs ) std::atomic<uint32_t>( Bias );
+        m_ptr = (char*)m_chunk + DataOffset;
+        m_end = (char*)m_chunk + ChunkSize;
+        m_count = 0;
+        return Alloc( size - Header );
+    }
+
+    void Retire()
+    {
+        if( !m_chunk ) return;
+        const auto unused = Bias - m_count;
+        if( m_chunk->refs.fetch_sub( unused, std::memory_order_acq_rel ) == unused ) tracy_free( m_chunk );
+        m_chunk = nullptr;
+        m_ptr = nullptr;
+        m_end = nullptr;
+    }
+
+    char* m_ptr;
+    char* m_end;
+    Chunk* m_chunk;
+    uint32_t m_count;
+    bool m_exited;
+};
+
+extern thread_local PayloadArena s_arena;
+
+}
+
+#endif
@@ -1,3 +1,5 @@
+#include <atomic>
+#include <new>
 #include <stdio.h>
 #include "TracyCallstack.hpp"
 
@@ -17,6 +19,111 @@
 namespace tracy
 {
 
+enum { CallstackCacheSize = 1024 };
+enum { CallstackCacheWays = 8 };
+
+// Set associative cache of the callstacks recently captured by a thread. A
+// callstack which doesn't fit in its set replaces one which wasn't used since
+// the clock hand last passed it. Only the owning thread accesses the table,
+// the profiler thread only sees the callstacks referenced by the events.
+class CallstackCache
+{
+public:
+    CallstackCache() : m_slots( nullptr ), m_hand( 0 ) {}
+
+    ~CallstackCache()
+    {
+        if( !m_slots ) return;
+        for( int i=0; i<CallstackCacheSize; i++ )
+        {
+            if( m_slots[i] ) Evict( m_slots[i] );
+        }
+        tracy_free( m_slots );
+        m_slots = nullptr;
+    }
+
+    uintptr_t* Get( const uintptr_t* trace )
+    {
+        if( !m_slots )
+        {
+            m_slots = (CallstackCacheEntry**)tracy_malloc( CallstackCacheSize * sizeof( CallstackCacheEntry* ) );
+            memset( m_slots, 0, CallstackCacheSize * sizeof( CallstackCacheEntry* ) );
+        }
+
+        const auto num = *trace;
+        const auto hash = Hash( trace+1, num );
+        auto set = m_slots + ( hash & ( CallstackCacheSize / CallstackCacheWays - 1 ) ) * CallstackCacheWays;
+
+        CallstackCacheEntry** slot = nullptr;
+        for( int i=0; i<CallstackCacheWays; i++ )
+        {
+            auto entry = set[i];
+            if( !entry )
+            {
+                if( !slot ) slot = set + i;
+                continue;
+            }
+            if( entry->hash == hash && GetCallstackSize( &entry->num ) == num && memcmp( &entry->num + 1, trace+1, num * sizeof( uintptr_t ) ) == 0 )
+            {
+                entry->used = true;
+                entry->refs.fetch_add( 1, std::memory_order_relaxed );
+                return &entry->num;
+            }
+        }
+
+        if( !slot )
+        {
+            for(;;)
+            {
+                slot = set + ( m_hand++ & ( CallstackCacheWays - 1 ) );
+                if( !(*slot)->used ) break;
+                (*slot)->used = false;
+            }
+            Evict( *slot );
+        }
+
+        auto entry = (CallstackCacheEntry*)tracy_malloc( sizeof( CallstackCacheEntry ) + num * sizeof( uintptr_t ) );
+        new( &entry->refs ) std::atomic<uint32_t>( 1 );
+        entry->connection = 0;
+        entry->id = 0;
+        entry->used = false;
+        entry->hash = hash;
+        entry->num = num | CallstackCachedBit;
+        memcpy( &entry->num + 1, trace+1, num * sizeof( uintptr_t ) );
+        *slot = entry;
+        return &entry->num;
+    }
+
+private:
+    static tracy_force_inline uintptr_t Hash( const uintptr_t* frames, uintptr_t num )
+    {
+        uint64_t hash = 0xcbf29ce484222325ull ^ num;
+        for( uintptr_t i=0; i<num; i++ )
+        {
+            hash ^= uint64_t( frames[i] );
+            hash *= 0x100000001b3ull;
+            hash ^= hash >> 29;
+        }
+        return uintptr_t( hash );
+    }
+
+    // Events still waiting in the queues keep the callstack alive.
+    static void Evict( CallstackCacheEntry* entry )
+    {
+        if( entry->refs.fetch_or( CallstackCacheEntry::Evicted, std::memory_order_acq_rel ) == 0 ) tracy_free( entry );
+    }
+
+    CallstackCacheEntry** m_slots;
+    uint32_t m_hand;
+};
+
+static thread_local CallstackCache s_callstackCache;
+
+void* CacheCallstack( const uintptr_t* trace )
+{
+    return s_callstackCache.Get( trace );
+}
+
 #if TRACY_HAS_CALLSTACK == 1
 
 extern "C" t_RtlWalkFrameChain RtlWalkFrameChain = 0;
@@ -15,21 +15,72 @@ extern "C"
 #  if defined _GNU_SOURCE && defined __GLIBC__
 #    define TRACY_HAS_CALLSTACK 3
 #    include <execinfo.h>
+#    include <unwind.h>
 #  else
 #    define TRACY_HAS_CALLSTACK 2
 #    include <unwind.h>
 #  endif
 #endif
 
-
-#ifdef TRACY_HAS_CALLSTACK
-
 #include <assert.h>
+#include <atomic>
+#include <stddef.h>
 #include <stdint.h>
 #include <string.h>
 
 #include "../common/TracyAlloc.hpp"
 #include "../common/TracyForceInline.hpp"
+#include "TracyArena.hpp"
+
+namespace tracy
+{
+
+// Callstacks are stored as the number of frames, followed by the frames. The
+// top bit of the frame count is set in callstacks kept by the callstack cache.
+// These may be referenced by their identifier after the first transfer.
+enum : uintptr_t { CallstackCachedBit = uintptr_t( 1 ) << ( sizeof( uintptr_t ) * 8 - 1 ) };
+enum { CallstackCacheDepth = 62 };
+
+static tracy_force_inline bool IsCallstackCached( uint64_t ptr ) { return ( *(const uintptr_t*)ptr & CallstackCachedBit ) != 0; }
+static tracy_force_inline uintptr_t GetCallstackSize( const uintptr_t* ptr ) { return *ptr & ~CallstackCachedBit; }
+
+// Header of a cached callstack, which starts at the frame count. Each queued
+// event carrying the callstack holds a reference. The callstack is freed when
+// it was evicted from the cache, and the last of its events was serialized.
+// The identifier is only used by the profiler thread, and is valid for the
+// connection it was assigned in.
+struct CallstackCacheEntry
+{
+    enum : uint32_t { Evicted = 1u << 31 };
+
+    std::atomic<uint32_t> refs;
+    uint32_t connection;
+    uint32_t id;
+    bool used;
+    uintptr_t hash;
+    uintptr_t num;
+};
+
+static tracy_force_inline CallstackCacheEntry* GetCallstackCacheEntry( uint64_t ptr )
+{
+    return (CallstackCacheEntry*)( ptr - offsetof( CallstackCacheEntry, num ) );
+}
+
+// Releases the callstack of an event which was serialized, or discarded.
+static tracy_force_inline void FreeCallstack( uint64_t ptr )
+{
+    if( !IsCallstackCached( ptr ) )
+    {
+        PayloadArena::Free( (void*)ptr );
+        return;
+    }
+    auto entry = GetCallstackCacheEntry( ptr );
+    if( entry->refs.fetch_sub( 1, std::memory_order_acq_rel ) == ( CallstackCacheEntry::Evicted | 1 ) ) tracy_free( entry );
+}
+
+}
+
+#ifdef TRACY_HAS_CALLSTACK
 
 namespace tracy
 {
@@ -43,25 +94,46 @@ struct CallstackEntry
 
 CallstackEntry DecodeCallstackPtr( uint64_t ptr );
 
+// Returns the copy of the callstack in trace kept by the cache of the calling
+// thread, with a reference taken for the event which will carry it.
+void* CacheCallstack( const uintptr_t* trace );
+
 #if TRACY_HAS_CALLSTACK == 1
 
 void InitCallstack();
 
-static tracy_force_inline void* Callstack( int depth )
+static tracy_force_inline uintptr_t UnwindCallstack( uintptr_t* trace, int depth )
 {
     assert( depth >= 1 && depth < 63 );
+    return RtlWalkFrameChain( (void**)trace, depth, 0 );
+}
 
-    auto trace = (uintptr_t*)tracy_malloc( ( 1 + depth ) * sizeof( uintptr_t ) );
-    const auto num = RtlWalkFrameChain( (void**)( trace + 1 ), depth, 0 );
-    *trace = num;
+#elif TRACY_HAS_CALLSTACK == 2
 
-    return trace;
+static tracy_force_inline void InitCallstack() {}
+
+static tracy_force_inline uintptr_t UnwindBacktrace( uintptr_t* trace, int depth );
+
+static tracy_force_inline uintptr_t UnwindCallstack( uintptr_t* trace, int depth )
+{
+    assert( depth >= 1 && depth < 63 );
+    return UnwindBacktrace( trace, depth );
 }
 
-#elif TRACY_HAS_CALLSTACK == 2
+#elif TRACY_HAS_CALLSTACK == 3
 
 static tracy_force_inline void InitCallstack() {}
 
+static tracy_force_inline uintptr_t UnwindCallstack( uintptr_t* trace, int depth )
+{
+    assert( depth >= 1 );
+    return backtrace( (void**)trace, depth );
+}
+
+#endif
+
+#if TRACY_HAS_CALLSTACK >= 2
+
 struct BacktraceState
 {
     void** current;
@@ -80,36 +152,35 @@ static _Unwind_Reason_Code tracy_unwind_callback( struct _Unwind_Context* ctx, v
     return _URC_NO_REASON;
 }
 
-static tracy_force_inline void* Callstack( int depth )
+// Doesn't allocate memory, so it can be also used by the sampling signal handler.
+static tracy_force_inline uintptr_t UnwindBacktrace( uintptr_t* trace, int depth )
 {
-    assert( depth >= 1 && depth < 63 );
-
-    auto trace = (uintptr_t*)tracy_malloc( ( 1 + depth ) * sizeof( uintptr_t ) );
-    BacktraceState state = { (void**)(trace+1), (void**)(trace+1+depth) };
+    BacktraceState state = { (void**)trace, (void**)(trace+depth) };
     _Unwind_Backtrace( tracy_unwind_callback, &state );
 
-    *trace = (uintptr_t*)state.current - trace + 1;
-
-    return trace;
+    return (uintptr_t*)state.current - trace;
 }
 
-#elif TRACY_HAS_CALLSTACK == 3
+#endif
 
-static tracy_force_inline void InitCallstack() {}
+// Always returns a callstack allocated in the payload arena, which may be
+// modified.
+static tracy_force_inline void* CallstackUncached( int depth )
+{
+    auto trace = (uintptr_t*)s_arena.Alloc( ( 1 + depth ) * sizeof( uintptr_t ) );
+    *trace = UnwindCallstack( trace+1, depth );
+    return trace;
+}
 
 static tracy_force_inline void* Callstack( int depth )
 {
-    assert( depth >= 1 );
-
-    auto trace = (uintptr_t*)tracy_malloc( ( 1 + depth ) * sizeof( uintptr_t ) );
-    const auto num = backtrace( (void**)(trace+1), depth );
-    *trace = num;
+    if( depth > CallstackCacheDepth ) return CallstackUncached( depth );
 
-    return trace;
+    uintptr_t trace[1 + CallstackCacheDepth];
+    *trace = UnwindCallstack( trace+1, depth );
+    return CacheCallstack( trace );
 }
 
-#endif
-
 }
 
 #endif
@@ -0,0 +1,280 @@
+#include "TracyContextSwitch.hpp"
+
+#ifdef TRACY_HAS_CONTEXT_SWITCH
+
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <mutex>
+#include <new>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../common/TracyAlloc.hpp"
+#include "../common/TracySystem.hpp"
+#include "TracyProfiler.hpp"
+
+#ifndef PERF_RECORD_MISC_SWITCH_OUT_PREEMPT
+#  define PERF_RECORD_MISC_SWITCH_OUT_PREEMPT ( 1 << 14 )
+#endif
+
+namespace tracy
+{
+
+// Data pages of the ring buffer, must be a power of two. Each context switch
+// takes 32 bytes, so 64 KB hold 2048 switches.
+enum { ContextSwitchPages = 16 };
+
+static std::atomic<ContextSwitchBuffer*> s_ctxSwitchBuffers( nullptr );
+static std::once_flag s_ctxSwitchOnce;
+static std::atomic<bool> s_ctxSwitchAvailable( false );
+static size_t s_ctxSwitchPageSize = 0;
+
+static thread_local ContextSwitchBuffer* s_ctxSwitchBuffer = nullptr;
+static thread_local bool s_ctxSwitchDisabled = false;
+
+// Kernel timestamps are taken from CLOCK_MONOTONIC_RAW and mapped to the
+// profiler timer by pairs of readings of both clocks. The rate is measured
+// from the first pair, the offset is taken from the most recent one.
+static int64_t s_clockBaseTime;
+static int64_t s_clockBaseNs;
+static int64_t s_clockTime;
+static int64_t s_clockNs;
+static double s_clockRate;
+
+static int64_t GetClockNs()
+{
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC_RAW, &ts );
+    return int64_t( ts.tv_sec ) * 1000000000ll + ts.tv_nsec;
+}
+
+static void InitContextSwitch()
+{
+    const char* env = getenv( "TRACY_NO_CONTEXT_SWITCH" );
+    if( env && env[0] == '1' ) return;
+
+    s_ctxSwitchPageSize = sysconf( _SC_PAGESIZE );
+    s_clockBaseNs = GetClockNs();
+    s_clockBaseTime = Profiler::GetTime();
+    s_ctxSwitchAvailable.store( true, std::memory_order_relaxed );
+}
+
+static int OpenContextSwitchEvent()
+{
+    // Dummy event, which doesn't count anything, but records switches of the
+    // calling thread as side band data.
+    struct perf_event_attr attr;
+    memset( &attr, 0, sizeof( attr ) );
+    attr.size = sizeof( attr );
+    attr.type = PERF_TYPE_SOFTWARE;
+    attr.config = PERF_COUNT_SW_DUMMY;
+    attr.sample_type = PERF_SAMPLE_TID | PERF_SAMPLE_TIME | PERF_SAMPLE_CPU;
+    attr.sample_id_all = 1;
+    attr.context_switch = 1;
+    attr.use_clockid = 1;
+    attr.clockid = CLOCK_MONOTONIC_RAW;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall( SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC );
+}
+
+static ContextSwitchBuffer* AcquireContextSwitchBuffer()
+{
+    auto head = s_ctxSwitchBuffers.load( std::memory_order_acquire );
+    for( auto buf = head; buf; buf = buf->next )
+    {
+        uint8_t expected = ContextSwitchBuffer::Free;
+        if( buf->state.compare_exchange_strong( expected, ContextSwitchBuffer::Acquired, std::memory_order_acquire, std::memory_order_relaxed ) ) return buf;
+    }
+
+    auto buf = (ContextSwitchBuffer*)tracy_malloc( sizeof( ContextSwitchBuffer ) );
+    buf->next = head;
+    new( &buf->state ) std::atomic<uint8_t>( ContextSwitchBuffer::Acquired );
+    while( !s_ctxSwitchBuffers.compare_exchange_weak( head, buf, std::memory_order_release, std::memory_order_acquire ) )
+    {
+        buf->next = head;
+    }
+    return buf;
+}
+
+static void ReleaseContextSwitchBuffer( ContextSwitchBuffer* buf )
+{
+    munmap( buf->page, ( 1 + ContextSwitchPages ) * s_ctxSwitchPageSize );
+    buf->state.store( ContextSwitchBuffer::Free, std::memory_order_release );
+}
+
+void StartThreadContextSwitch()
+{
+    if( s_ctxSwitchBuffer || s_ctxSwitchDisabled ) return;
+    std::call_once( s_ctxSwitchOnce, InitContextSwitch );
+    if( !s_ctxSwitchAvailable.load( std::memory_order_relaxed ) ) return;
+
+    const auto fd = OpenContextSwitchEvent();
+    if( fd < 0 )
+    {
+        // Not permitted by perf_event_paranoid, or not supported by the kernel.
+        if( errno != EMFILE && errno != ENFILE ) s_ctxSwitchAvailable.store( false, std::memory_order_relaxed );
+        return;
+    }
+    // The mapping keeps the event alive, so that threads waiting to be
+    // drained don't hold file descriptors.
+    const auto size = ( 1 + ContextSwitchPages ) * s_ctxSwitchPageSize;
+    auto page = mmap( nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+    close( fd );
+    if( page == MAP_FAILED ) return;
+
+    rpmalloc_thread_initialize();
+    auto buf = AcquireContextSwitchBuffer();
+    buf->thread = GetThreadHandle();
+    buf->tid = (uint32_t)syscall( SYS_gettid );
+    buf->page = (perf_event_mmap_page*)page;
+    buf->start = Profiler::GetTime();
+    buf->stop = 0;
+    buf->last = buf->start;
+    const auto cpu = sched_getcpu();
+    buf->cpu = cpu < 0 ? 0 : cpu;
+    buf->pendingStart = true;
+    buf->running = false;
+    buf->state.store( ContextSwitchBuffer::Active, std::memory_order_release );
+    s_ctxSwitchBuffer = buf;
+}
+
+void StopThreadContextSwitch()
+{
+    auto buf = s_ctxSwitchBuffer;
+    if( !buf ) return;
+    buf->stop = Profiler::GetTime();
+    buf->state.store( ContextSwitchBuffer::Exited, std::memory_order_release );
+    s_ctxSwitchBuffer = nullptr;
+}
+
+void DisableThreadContextSwitch()
+{
+    s_ctxSwitchDisabled = true;
+    auto buf = s_ctxSwitchBuffer;
+    if( !buf ) return;
+    buf->state.store( ContextSwitchBuffer::Discarded, std::memory_order_release );
+    s_ctxSwitchBuffer = nullptr;
+}
+
+ContextSwitchBuffer* GetContextSwitchBuffers()
+{
+    return s_ctxSwitchBuffers.load( std::memory_order_acquire );
+}
+
+void UpdateContextSwitchClock( double timerMul )
+{
+    s_clockTime = Profiler::GetTime();
+    s_clockNs = GetClockNs();
+    const auto dn = s_clockNs - s_clockBaseNs;
+    // Timer calibration is more precise than a short measurement.
+    s_clockRate = dn < 1000000000ll ? 1. / timerMul : double( s_clockTime - s_clockBaseTime ) / dn;
+}
+
+static tracy_force_inline int64_t ConvertClock( int64_t ns )
+{
+    return s_clockTime + int64_t( ( ns - s_clockNs ) * s_clockRate );
+}
+
+static tracy_force_inline void WriteContextSwitch( QueueItem* item, const ContextSwitchBuffer* buf, int64_t time, uint32_t cpu, ContextSwitchState state )
+{
+    MemWrite( &item->hdr.type, QueueType::ContextSwitch );
+    MemWrite( &item->contextSwitch.time, time );
+    MemWrite( &item->contextSwitch.thread, buf->thread );
+    MemWrite( &item->contextSwitch.cpu, cpu );
+    MemWrite( &item->contextSwitch.state, state );
+}
+
+uint32_t ReadContextSwitches( ContextSwitchBuffer* buf, QueueItem* out, uint32_t max )
+{
+    const auto state = buf->state.load( std::memory_order_acquire );
+    if( state == ContextSwitchBuffer::Discarded )
+    {
+        ReleaseContextSwitchBuffer( buf );
+        return 0;
+    }
+    if( state != ContextSwitchBuffer::Active && state != ContextSwitchBuffer::Exited ) return 0;
+
+    // Everything the kernel will record for a thread is in the buffer when
+    // the thread is gone. The switch out at exit is not recorded.
+    const auto gone = state == ContextSwitchBuffer::Exited && syscall( SYS_tgkill, getpid(), buf->tid, 0 ) != 0 && errno == ESRCH;
+
+    uint32_t num = 0;
+    if( buf->pendingStart )
+    {
+        WriteContextSwitch( out + num++, buf, buf->start, buf->cpu, ContextSwitchState::Running );
+        buf->pendingStart = false;
+        buf->running = true;
+    }
+
+    struct SwitchRecord
+    {
+        perf_event_header hdr;
+        uint32_t pid, tid;
+        uint64_t time;
+        uint32_t cpu, res;
+    };
+
+    const auto page = buf->page;
+    const auto data = (const char*)page + s_ctxSwitchPageSize;
+    const auto mask = ContextSwitchPages * s_ctxSwitchPageSize - 1;
+    const auto head = __atomic_load_n( &page->data_head, __ATOMIC_ACQUIRE );
+    auto tail = page->data_tail;
+    while( tail != head && num < max )
+    {
+        const auto offset = tail & mask;
+        perf_event_header hdr;
+        memcpy( &hdr, data + offset, sizeof( hdr ) );
+        if( hdr.type == PERF_RECORD_SWITCH && hdr.size >= sizeof( SwitchRecord ) )
+        {
+            // Records may wrap around the end of the buffer.
+            SwitchRecord rec;
+            const auto part = std::min<size_t>( sizeof( SwitchRecord ), mask + 1 - offset );
+            memcpy( &rec, data + offset, part );
+            memcpy( (char*)&rec + part, data, sizeof( SwitchRecord ) - part );
+
+            const auto time = ConvertClock( rec.time );
+            if( ( hdr.misc & PERF_RECORD_MISC_SWITCH_OUT ) == 0 )
+            {
+                WriteContextSwitch( out + num++, buf, time, rec.cpu, ContextSwitchState::Running );
+                buf->running = true;
+            }
+            else
+            {
+                const auto reason = ( hdr.misc & PERF_RECORD_MISC_SWITCH_OUT_PREEMPT ) ? ContextSwitchState::Preempted : ContextSwitchState::Waiting;
+                WriteContextSwitch( out + num++, buf, time, rec.cpu, reason );
+                buf->running = false;
+            }
+            buf->last = time;
+            buf->cpu = rec.cpu;
+        }
+        else if( hdr.type == PERF_RECORD_LOST )
+        {
+            // The ring was full. The interval in progress is closed at the
+            // last known time, and nothing is known until the next record.
+            WriteContextSwitch( out + num++, buf, buf->last, buf->cpu, ContextSwitchState::Unknown );
+            buf->running = false;
+        }
+        tail += hdr.size;
+    }
+    __atomic_store_n( &page->data_tail, tail, __ATOMIC_RELEASE );
+
+    if( gone && tail == head && num < max )
+    {
+        if( buf->running )
+        {
+            WriteContextSwitch( out + num++, buf, std::max( buf->stop, buf->last ), buf->cpu, ContextSwitchState::Waiting );
+        }
+        ReleaseContextSwitchBuffer( buf );
+    }
+    return num;
+}
+
+}
+
+#endif
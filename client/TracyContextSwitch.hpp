@@ -0,0 +1,73 @@
+#ifndef __TRACYCONTEXTSWITCH_HPP__
+#define __TRACYCONTEXTSWITCH_HPP__
+
+#if defined TRACY_CONTEXT_SWITCH && defined __linux__
+#  define TRACY_HAS_CONTEXT_SWITCH
+#endif
+
+#ifdef TRACY_HAS_CONTEXT_SWITCH
+
+#include <atomic>
+#include <stdint.h>
+
+#include "../common/TracyQueue.hpp"
+
+struct perf_event_mmap_page;
+
+namespace tracy
+{
+
+// Context switches of a single thread, written by the kernel to a perf event
+// ring buffer and read by the profiler thread. The kernel stops recording when
+// the thread exits. Buffers of exited threads are drained, unmapped and reused
+// by new threads.
+struct ContextSwitchBuffer
+{
+    enum State : uint8_t
+    {
+        Free,
+        Acquired,       // being set up by the owning thread
+        Active,
+        Exited,         // thread is exiting, drain when it's gone
+        Discarded       // internal profiler thread, release without draining
+    };
+
+    ContextSwitchBuffer* next;
+    std::atomic<uint8_t> state;
+    uint64_t thread;
+    uint32_t tid;
+    perf_event_mmap_page* page;
+
+    // Accessed only by the profiler thread, after the buffer is active. The
+    // thread is running when recording starts, which is reported before the
+    // first record.
+    int64_t start;
+    int64_t stop;
+    int64_t last;
+    uint32_t cpu;
+    bool pendingStart;
+    bool running;
+};
+
+void StartThreadContextSwitch();
+void StopThreadContextSwitch();
+void DisableThreadContextSwitch();
+ContextSwitchBuffer* GetContextSwitchBuffers();
+
+// Must be called by the profiler thread before reading the buffers, to update
+// the mapping of the kernel timestamps to the profiler timer.
+void UpdateContextSwitchClock( double timerMul );
+// Reads up to max ContextSwitch events. Returns zero when the buffer is empty.
+uint32_t ReadContextSwitches( ContextSwitchBuffer* buf, QueueItem* out, uint32_t max );
+
+struct ContextSwitchThreadInit
+{
+    ContextSwitchThreadInit() { StartThreadContextSwitch(); }
+    ~ContextSwitchThreadInit() { StopThreadContextSwitch(); }
+};
+
+}
+
+#endif
+
+#endif
@@ -0,0 +1,121 @@
+#ifndef __TRACYFASTMAP_HPP__
+#define __TRACYFASTMAP_HPP__
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "../common/TracyAlloc.hpp"
+#include "../common/TracyForceInline.hpp"
+
+namespace tracy
+{
+
+// Open addressing hash map with 64-bit keys, used by the profiler thread.
+// Memory comes from tracy_malloc, so that it doesn't show up in the
+// profiled program's allocation statistics. Key value 0 is reserved.
+template<typename T>
+class FastMap
+{
+    struct Entry
+    {
+        uint64_t key;
+        T val;
+    };
+
+public:
+    FastMap( size_t capacity )
+        : m_size( 0 )
+        , m_mask( capacity - 1 )
+        , m_ptr( (Entry*)tracy_malloc( sizeof( Entry ) * capacity ) )
+    {
+        assert( capacity != 0 && ( capacity & ( capacity - 1 ) ) == 0 );
+        memset( m_ptr, 0, sizeof( Entry ) * capacity );
+    }
+
+    FastMap( const FastMap& ) = delete;
+    FastMap( FastMap&& ) = delete;
+
+    ~FastMap()
+    {
+        tracy_free( m_ptr );
+    }
+
+    FastMap& operator=( const FastMap& ) = delete;
+    FastMap& operator=( FastMap&& ) = delete;
+
+    bool empty() const { return m_size == 0; }
+    size_t size() const { return m_size; }
+
+    tracy_force_inline T* find( uint64_t key )
+    {
+        assert( key != 0 );
+        auto idx = Hash( key ) & m_mask;
+        for(;;)
+        {
+            auto& e = m_ptr[idx];
+            if( e.key == key ) return &e.val;
+            if( e.key == 0 ) return nullptr;
+            idx = ( idx + 1 ) & m_mask;
+        }
+    }
+
+    tracy_force_inline void emplace( uint64_t key, const T& val )
+    {
+        assert( key != 0 );
+        if( ( m_size + 1 ) * 2 > m_mask + 1 ) Grow();
+        Insert( m_ptr, m_mask, key, val );
+        m_size++;
+    }
+
+    void clear()
+    {
+        memset( m_ptr, 0, sizeof( Entry ) * ( m_mask + 1 ) );
+        m_size = 0;
+    }
+
+private:
+    static tracy_force_inline uint64_t Hash( uint64_t key )
+    {
+        key ^= key >> 33;
+        key *= 0xff51afd7ed558ccdull;
+        key ^= key >> 33;
+        return key;
+    }
+
+    static tracy_force_inline void Insert( Entry* ptr, size_t mask, uint64_t key, const T& val )
+    {
+        auto idx = Hash( key ) & mask;
+        while( ptr[idx].key != 0 )
+        {
+            assert( ptr[idx].key != key );
+            idx = ( idx + 1 ) & mask;
+        }
+        ptr[idx].key = key;
+        ptr[idx].val = val;
+    }
+
+    tracy_no_inline void Grow()
+    {
+        const auto cap = ( m_mask + 1 ) * 2;
+        const auto mask = cap - 1;
+        auto ptr = (Entry*)tracy_malloc( sizeof( Entry ) * cap );
+        memset( ptr, 0, sizeof( Entry ) * cap );
+        for( size_t i=0; i<=m_mask; i++ )
+        {
+            if( m_ptr[i].key != 0 ) Insert( ptr, mask, m_ptr[i].key, m_ptr[i].val );
+        }
+        tracy_free( m_ptr );
+        m_ptr = ptr;
+        m_mask = mask;
+    }
+
+    size_t m_size;
+    size_t m_mask;
+    Entry* m_ptr;
+};
+
+}
+
+#endif
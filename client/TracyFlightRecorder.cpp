@@ -0,0 +1,136 @@
+#include <algorithm>
+#include <assert.h>
+#include <atomic>
+#include <string.h>
+
+#ifdef __linux__
+#  include <errno.h>
+#  include <fcntl.h>
+#  include <unistd.h>
+#endif
+
+#include "TracyFlightRecorder.hpp"
+#include "../common/TracyAlloc.hpp"
+#include "../common/TracyProtocol.hpp"
+
+namespace tracy
+{
+
+FlightRecorder::FlightRecorder( const char* path, size_t size )
+    : m_path( path )
+    , m_ring( (char*)tracy_malloc( size ) )
+    , m_size( size )
+    , m_head( 0 )
+    , m_tail( 0 )
+    , m_defs( (char*)tracy_malloc( 64*1024 ) )
+    , m_defsSize( 0 )
+    , m_defsCapacity( 64*1024 )
+    , m_defsBuffersNum( 1 )
+{
+    assert( size >= LZ4Size + sizeof( lz4sz_t ) );
+    m_defsBuffers[0] = m_defs.load( std::memory_order_relaxed );
+}
+
+FlightRecorder::~FlightRecorder()
+{
+    for( int i=0; i<m_defsBuffersNum; i++ ) tracy_free( m_defsBuffers[i] );
+    tracy_free( m_ring );
+}
+
+// Dump() reads the size before the buffer pointer. A newer buffer always
+// holds a copy of the older contents, so the pair it sees is valid.
+void FlightRecorder::Define( const void* data, size_t len )
+{
+    const auto size = m_defsSize.load( std::memory_order_relaxed );
+    auto defs = m_defs.load( std::memory_order_relaxed );
+    if( size + len > m_defsCapacity )
+    {
+        assert( m_defsBuffersNum < MaxDefsBuffers );
+        const auto capacity = std::max( m_defsCapacity * 2, size + len );
+        auto grown = (char*)tracy_malloc( capacity );
+        memcpy( grown, defs, size );
+        m_defsBuffers[m_defsBuffersNum++] = grown;
+        m_defsCapacity = capacity;
+        defs = grown;
+        m_defs.store( defs, std::memory_order_release );
+    }
+    memcpy( defs + size, data, len );
+    m_defsSize.store( size + len, std::memory_order_release );
+}
+
+// The data is a single stream frame: its size, followed by the compressed data.
+// Dropping the oldest frames first keeps the ring contents valid at all times,
+// even if the profiler thread crashes while it's in here.
+void FlightRecorder::Record( const void* data, size_t len )
+{
+    assert( len <= m_size );
+    const auto head = m_head.load( std::memory_order_relaxed );
+    auto tail = m_tail.load( std::memory_order_relaxed );
+    if( head + len - tail > m_size )
+    {
+        do
+        {
+            lz4sz_t sz;
+            RingRead( tail, &sz, sizeof( sz ) );
+            tail += sizeof( sz ) + sz;
+        }
+        while( head + len - tail > m_size );
+        m_tail.store( tail, std::memory_order_release );
+    }
+    RingWrite( head, data, len );
+    m_head.store( head + len, std::memory_order_release );
+}
+
+void FlightRecorder::RingRead( uint64_t pos, void* dst, size_t len ) const
+{
+    const auto start = pos % m_size;
+    const auto first = std::min<uint64_t>( len, m_size - start );
+    memcpy( dst, m_ring + start, first );
+    memcpy( (char*)dst + first, m_ring, len - first );
+}
+
+void FlightRecorder::RingWrite( uint64_t pos, const void* src, size_t len )
+{
+    const auto start = pos % m_size;
+    const auto first = std::min<uint64_t>( len, m_size - start );
+    memcpy( m_ring + start, src, first );
+    memcpy( m_ring, (const char*)src + first, len - first );
+}
+
+#ifdef __linux__
+static void WriteAll( int fd, const char* data, size_t len )
+{
+    while( len > 0 )
+    {
+        const auto ret = write( fd, data, len );
+        if( ret < 0 )
+        {
+            if( errno == EINTR ) continue;
+            return;
+        }
+        data += ret;
+        len -= ret;
+    }
+}
+
+void FlightRecorder::Dump() const
+{
+    const auto fd = open( m_path, O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+    if( fd < 0 ) return;
+
+    const auto defsSize = m_defsSize.load( std::memory_order_acquire );
+    WriteAll( fd, m_defs.load( std::memory_order_acquire ), defsSize );
+
+    const auto head = m_head.load( std::memory_order_acquire );
+    const auto tail = m_tail.load( std::memory_order_acquire );
+    const auto start = tail % m_size;
+    const auto len = head - tail;
+    const auto first = std::min<uint64_t>( len, m_size - start );
+    WriteAll( fd, m_ring + start, first );
+    WriteAll( fd, m_ring, len - first );
+
+    close( fd );
+}
+#endif
+
+}
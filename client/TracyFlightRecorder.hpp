@@ -0,0 +1,59 @@
+#ifndef __TRACYFLIGHTRECORDER_HPP__
+#define __TRACYFLIGHTRECORDER_HPP__
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace tracy
+{
+
+// Keeps the data stream in memory instead of sending it, so that it can be
+// written to a file if the program crashes. Frames with event data are kept
+// in a ring buffer, which drops the oldest ones when it's full. Frames with
+// definitions (strings, source locations, callstacks, locks, GPU contexts)
+// may be referenced by any later event, so they are always kept.
+class FlightRecorder
+{
+public:
+    FlightRecorder( const char* path, size_t size );
+    ~FlightRecorder();
+
+    FlightRecorder( const FlightRecorder& ) = delete;
+    FlightRecorder& operator=( const FlightRecorder& ) = delete;
+
+    void Define( const void* data, size_t len );
+    void Record( const void* data, size_t len );
+
+#ifdef __linux__
+    // Only async-signal-safe calls are used here.
+    void Dump() const;
+#endif
+
+private:
+    void RingRead( uint64_t pos, void* dst, size_t len ) const;
+    void RingWrite( uint64_t pos, const void* src, size_t len );
+
+    // The buffer capacity at least doubles on each growth, so this covers
+    // any possible size.
+    enum { MaxDefsBuffers = 48 };
+
+    const char* m_path;
+
+    char* m_ring;
+    uint64_t m_size;
+    std::atomic<uint64_t> m_head;
+    std::atomic<uint64_t> m_tail;
+
+    // Dump() may run on another thread at any time, so replaced definition
+    // buffers are only freed in the destructor.
+    std::atomic<char*> m_defs;
+    std::atomic<size_t> m_defsSize;
+    size_t m_defsCapacity;
+    char* m_defsBuffers[MaxDefsBuffers];
+    int m_defsBuffersNum;
+};
+
+}
+
+#endif
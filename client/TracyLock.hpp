@@ -13,12 +13,22 @@ namespace tracy
 
 extern std::atomic<uint32_t> s_lockCounter;
 
+#ifdef TRACY_LOCK_CONTENTION
+enum { LockContention = 1 };
+#else
+enum { LockContention = 0 };
+#endif
+
 template<class T>
 class Lockable
 {
 public:
     tracy_force_inline Lockable( const SourceLocationData* srcloc )
         : m_id( s_lockCounter.fetch_add( 1, std::memory_order_relaxed ) )
+#ifdef TRACY_LOCK_CONTENTION
+        , m_depth( 0 )
+        , m_contended( false )
+#endif
 #ifdef TRACY_ON_DEMAND
         , m_lockCount( 0 )
         , m_active( false )
@@ -34,6 +44,7 @@ public:
         MemWrite( &item->lockAnnounce.id, m_id );
         MemWrite( &item->lockAnnounce.lckloc, (uint64_t)srcloc );
         MemWrite( &item->lockAnnounce.type, LockType::Lockable );
+        MemWrite( &item->lockAnnounce.contention, uint8_t( LockContention ) );
 
 #ifdef TRACY_ON_DEMAND
         s_profiler.DeferItem( *item );
@@ -47,7 +58,21 @@ public:
 
     tracy_force_inline void lock()
     {
-#ifdef TRACY_ON_DEMAND
+#ifdef TRACY_LOCK_CONTENTION
+        if( m_lockable.try_lock() )
+        {
+            m_depth++;
+            return;
+        }
+#  ifdef TRACY_ON_DEMAND
+        if( !s_profiler.IsConnected() )
+        {
+            m_lockable.lock();
+            m_depth++;
+            return;
+        }
+#  endif
+#elif defined TRACY_ON_DEMAND
         bool queue = false;
         const auto locks = m_lockCount.fetch_add( 1, std::memory_order_relaxed );
         const auto active = m_active.load( std::memory_order_relaxed );
@@ -90,13 +115,33 @@ public:
             MemWrite( &item->lockObtain.time, Profiler::GetTime() );
             tail.store( magic + 1, std::memory_order_release );
         }
+
+#ifdef TRACY_LOCK_CONTENTION
+        m_depth++;
+        m_contended = true;
+#endif
     }
 
     tracy_force_inline void unlock()
     {
+#ifdef TRACY_LOCK_CONTENTION
+        // The owner state is read before the lock is released. A recursive
+        // acquisition is reported as released with its outermost unlock.
+        bool contended = false;
+        if( --m_depth == 0 )
+        {
+            contended = m_contended;
+            m_contended = false;
+        }
+        m_lockable.unlock();
+        if( !contended ) return;
+#  ifdef TRACY_ON_DEMAND
+        if( !s_profiler.IsConnected() ) return;
+#  endif
+#else
         m_lockable.unlock();
 
-#ifdef TRACY_ON_DEMAND
+#  ifdef TRACY_ON_DEMAND
         m_lockCount.fetch_sub( 1, std::memory_order_relaxed );
         if( !m_active.load( std::memory_order_relaxed ) ) return;
         if( !s_profiler.IsConnected() )
@@ -104,6 +149,7 @@ public:
             m_active.store( false, std::memory_order_relaxed );
             return;
         }
+#  endif
 #endif
 
         Magic magic;
@@ -121,7 +167,11 @@ public:
     {
         const auto ret = m_lockable.try_lock();
 
-#ifdef TRACY_ON_DEMAND
+#ifdef TRACY_LOCK_CONTENTION
+        // A try lock never waits, so there is no contention to report.
+        if( ret ) m_depth++;
+#else
+#  ifdef TRACY_ON_DEMAND
         if( !ret ) return ret;
 
         bool queue = false;
@@ -134,7 +184,7 @@ public:
             if( connected ) queue = true;
         }
         if( !queue ) return ret;
-#endif
+#  endif
 
         if( ret )
         {
@@ -148,13 +198,21 @@ public:
             MemWrite( &item->lockObtain.time, Profiler::GetTime() );
             tail.store( magic + 1, std::memory_order_release );
         }
+#endif
 
         return ret;
     }
 
     tracy_force_inline void Mark( const SourceLocationData* srcloc )
     {
-#ifdef TRACY_ON_DEMAND
+#ifdef TRACY_LOCK_CONTENTION
+        // Only marks made while holding a reported acquisition can be placed
+        // on the timeline.
+        if( !m_contended ) return;
+#  ifdef TRACY_ON_DEMAND
+        if( !s_profiler.IsConnected() ) return;
+#  endif
+#elif defined TRACY_ON_DEMAND
         const auto active = m_active.load( std::memory_order_relaxed );
         if( !active ) return;
         const auto connected = s_profiler.IsConnected();
@@ -180,6 +238,12 @@ private:
     T m_lockable;
     uint32_t m_id;
 
+#ifdef TRACY_LOCK_CONTENTION
+    // Accessed only by the lock owner.
+    uint32_t m_depth;
+    bool m_contended;
+#endif
+
 #ifdef TRACY_ON_DEMAND
     std::atomic<uint32_t> m_lockCount;
     std::atomic<bool> m_active;
@@ -193,6 +257,10 @@ class SharedLockable
 public:
     tracy_force_inline SharedLockable( const SourceLocationData* srcloc )
         : m_id( s_lockCounter.fetch_add( 1, std::memory_order_relaxed ) )
+#ifdef TRACY_LOCK_CONTENTION
+        , m_depth( 0 )
+        , m_contended( false )
+#endif
 #ifdef TRACY_ON_DEMAND
         , m_lockCount( 0 )
         , m_active( false )
@@ -208,6 +276,7 @@ public:
         MemWrite( &item->lockAnnounce.id, m_id );
         MemWrite( &item->lockAnnounce.lckloc, (uint64_t)srcloc );
         MemWrite( &item->lockAnnounce.type, LockType::SharedLockable );
+        MemWrite( &item->lockAnnounce.contention, uint8_t( LockContention ) );
 
 #ifdef TRACY_ON_DEMAND
         s_profiler.DeferItem( *item );
@@ -221,7 +290,21 @@ public:
 
     tracy_force_inline void lock()
     {
-#ifdef TRACY_ON_DEMAND
+#ifdef TRACY_LOCK_CONTENTION
+        if( m_lockable.try_lock() )
+        {
+            m_depth++;
+            return;
+        }
+#  ifdef TRACY_ON_DEMAND
+        if( !s_profiler.IsConnected() )
+        {
+            m_lockable.lock();
+            m_depth++;
+            return;
+        }
+#  endif
+#elif defined TRACY_ON_DEMAND
         bool queue = false;
         const auto locks = m_lockCount.fetch_add( 1, std::memory_order_relaxed );
         const auto active = m_active.load( std::memory_order_relaxed );
@@ -264,13 +347,33 @@ public:
             MemWrite( &item->lockObtain.time, Profiler::GetTime() );
             tail.store( magic + 1, std::memory_order_release );
         }
+
+#ifdef TRACY_LOCK_CONTENTION
+        m_depth++;
+        m_contended = true;
+#endif
     }
 
     tracy_force_inline void unlock()
     {
+#ifdef TRACY_LOCK_CONTENTION
+        // The owner state is read before the lock is released. A recursive
+        // acquisition is reported as released with its outermost unlock.
+        bool contended = false;
+        if( --m_depth == 0 )
+        {
+            contended = m_contended;
+            m_contended = false;
+        }
+        m_lockable.unlock();
+        if( !contended ) return;
+#  ifdef TRACY_ON_DEMAND
+        if( !s_profiler.IsConnected() ) return;
+#  endif
+#else
         m_lockable.unlock();
 
-#ifdef TRACY_ON_DEMAND
+#  ifdef TRACY_ON_DEMAND
         m_lockCount.fetch_sub( 1, std::memory_order_relaxed );
         if( !m_active.load( std::memory_order_relaxed ) ) return;
         if( !s_profiler.IsConnected() )
@@ -278,6 +381,7 @@ public:
             m_active.store( false, std::memory_order_relaxed );
             return;
         }
+#  endif
 #endif
 
         Magic magic;
@@ -295,7 +399,11 @@ public:
     {
         const auto ret = m_lockable.try_lock();
 
-#ifdef TRACY_ON_DEMAND
+#ifdef TRACY_LOCK_CONTENTION
+        // A try lock never waits, so there is no contention to report.
+        if( ret ) m_depth++;
+#else
+#  ifdef TRACY_ON_DEMAND
         if( !ret ) return ret;
 
         bool queue = false;
@@ -308,7 +416,7 @@ public:
             if( connected ) queue = true;
         }
         if( !queue ) return ret;
-#endif
+#  endif
 
         if( ret )
         {
@@ -322,6 +430,7 @@ public:
             MemWrite( &item->lockObtain.time, Profiler::GetTime() );
             tail.store( magic + 1, std::memory_order_release );
         }
+#endif
 
         return ret;
     }
@@ -435,7 +544,14 @@ public:
 
     tracy_force_inline void Mark( const SourceLocationData* srcloc )
     {
-#ifdef TRACY_ON_DEMAND
+#ifdef TRACY_LOCK_CONTENTION
+        // Only marks made while holding a reported acquisition can be placed
+        // on the timeline.
+        if( !m_contended ) return;
+#  ifdef TRACY_ON_DEMAND
+        if( !s_profiler.IsConnected() ) return;
+#  endif
+#elif defined TRACY_ON_DEMAND
         const auto active = m_active.load( std::memory_order_relaxed );
         if( !active ) return;
         const auto connected = s_profiler.IsConnected();
@@ -461,6 +577,12 @@ private:
     T m_lockable;
     uint32_t m_id;
 
+#ifdef TRACY_LOCK_CONTENTION
+    // Accessed only by the lock owner.
+    uint32_t m_depth;
+    bool m_contended;
+#endif
+
 #ifdef TRACY_ON_DEMAND
     std::atomic<uint32_t> m_lockCount;
     std::atomic<bool> m_active;
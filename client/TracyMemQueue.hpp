@@ -0,0 +1,209 @@
+#ifndef __TRACYMEMQUEUE_HPP__
+#define __TRACYMEMQUEUE_HPP__
+
+#include <assert.h>
+#include <atomic>
+#include <new>
+#include <stdint.h>
+
+#include "../common/TracyAlloc.hpp"
+#include "../common/TracyForceInline.hpp"
+#include "../common/TracyQueue.hpp"
+#include "TracyQueueLimit.hpp"
+
+namespace tracy
+{
+
+// Single producer, single consumer queue of memory events. Each thread that
+// reports allocations writes to its own queue, so that the hot path doesn't
+// need a lock. Events are time ordered within a queue, the profiler thread
+// merges all queues into one stream.
+//
+// The in-flight marker tells the consumer which timestamp is currently being
+// written by the producer. It is set to Entering before the timestamp is
+// retrieved, then to the timestamp itself, and finally back to Idle, after
+// the event is committed.
+class MemQueue
+{
+    enum { BlockSize = 1024 };
+
+    struct Block
+    {
+        std::atomic<Block*> next;
+        QueueItem data[BlockSize];
+    };
+
+public:
+    enum : int64_t { Idle = 0, Entering = 1 };
+
+    MemQueue( bool shared )
+        : m_next( nullptr )
+        , m_shared( shared )
+        , m_owned( true )
+        , m_inflight( Idle )
+        , m_tail( 0 )
+        , m_spare( nullptr )
+        , m_tailBlock( AllocBlock() )
+        , m_tailIdx( 0 )
+        , m_tailLocal( 0 )
+        , m_headBlock( m_tailBlock )
+        , m_headIdx( 0 )
+        , m_head( 0 )
+        , m_headEnd( 0 )
+    {
+    }
+
+    MemQueue( const MemQueue& ) = delete;
+    MemQueue( MemQueue&& ) = delete;
+
+    ~MemQueue()
+    {
+        auto block = m_headBlock;
+        while( block )
+        {
+            auto next = block->next.load( std::memory_order_relaxed );
+            if( next ) MemQueueBacklogSub( sizeof( Block ) );
+            FreeBlock( block );
+            block = next;
+        }
+        auto spare = m_spare.load( std::memory_order_relaxed );
+        if( spare ) FreeBlock( spare );
+    }
+
+    MemQueue& operator=( const MemQueue& ) = delete;
+    MemQueue& operator=( MemQueue&& ) = delete;
+
+    // Producer side.
+
+    tracy_force_inline void Enter()
+    {
+        // Must be visible before the timestamp is taken, hence the full barrier.
+        m_inflight.store( Entering, std::memory_order_seq_cst );
+    }
+
+    tracy_force_inline void SetTime( int64_t time )
+    {
+        assert( time > Entering );
+        m_inflight.store( time, std::memory_order_release );
+    }
+
+    tracy_force_inline QueueItem* PrepareNext()
+    {
+        if( m_tailIdx == BlockSize ) NextBlock();
+        return m_tailBlock->data + m_tailIdx;
+    }
+
+    tracy_force_inline void CommitNext()
+    {
+        m_tailIdx++;
+        m_tailLocal++;
+    }
+
+    tracy_force_inline void Leave()
+    {
+        m_tail.store( m_tailLocal, std::memory_order_release );
+        m_inflight.store( Idle, std::memory_order_release );
+    }
+
+    // Consumer side.
+
+    tracy_force_inline int64_t GetInflight() const { return m_inflight.load( std::memory_order_acquire ); }
+
+    // Makes all committed events available to Peek().
+    tracy_force_inline void Refresh() { m_headEnd = m_tail.load( std::memory_order_acquire ); }
+
+    tracy_force_inline bool Empty() const { return m_head == m_headEnd; }
+
+    tracy_force_inline QueueItem* Peek()
+    {
+        assert( !Empty() );
+        if( m_headIdx == BlockSize ) ReleaseBlock();
+        return m_headBlock->data + m_headIdx;
+    }
+
+    tracy_force_inline void Pop()
+    {
+        assert( !Empty() );
+        m_headIdx++;
+        m_head++;
+    }
+
+    // Registry of all queues, maintained by the profiler.
+
+    bool IsShared() const { return m_shared; }
+    MemQueue* Next() const { return m_next; }
+    void SetNext( MemQueue* next ) { m_next = next; }
+
+    bool Claim()
+    {
+        bool expected = false;
+        return m_owned.compare_exchange_strong( expected, true, std::memory_order_acquire, std::memory_order_relaxed );
+    }
+
+    void Release() { m_owned.store( false, std::memory_order_release ); }
+
+private:
+    static Block* AllocBlock()
+    {
+        auto block = (Block*)tracy_malloc( sizeof( Block ) );
+        new( &block->next ) std::atomic<Block*>( nullptr );
+        return block;
+    }
+
+    static void FreeBlock( Block* block )
+    {
+        tracy_free( block );
+    }
+
+    tracy_no_inline void NextBlock()
+    {
+        auto block = m_spare.exchange( nullptr, std::memory_order_acquire );
+        if( block )
+        {
+            block->next.store( nullptr, std::memory_order_relaxed );
+        }
+        else
+        {
+            block = AllocBlock();
+        }
+        m_tailBlock->next.store( block, std::memory_order_release );
+        m_tailBlock = block;
+        m_tailIdx = 0;
+        MemQueueBacklogAdd( sizeof( Block ) );
+    }
+
+    tracy_no_inline void ReleaseBlock()
+    {
+        auto block = m_headBlock;
+        m_headBlock = block->next.load( std::memory_order_acquire );
+        assert( m_headBlock );
+        m_headIdx = 0;
+        MemQueueBacklogSub( sizeof( Block ) );
+        auto prev = m_spare.exchange( block, std::memory_order_release );
+        if( prev ) FreeBlock( prev );
+    }
+
+    MemQueue* m_next;
+    bool m_shared;
+    std::atomic<bool> m_owned;
+
+    char m_pad0[64];
+    std::atomic<int64_t> m_inflight;
+    std::atomic<uint64_t> m_tail;
+    std::atomic<Block*> m_spare;
+
+    char m_pad1[64];
+    Block* m_tailBlock;
+    uint32_t m_tailIdx;
+    uint64_t m_tailLocal;
+
+    char m_pad2[64];
+    Block* m_headBlock;
+    uint32_t m_headIdx;
+    uint64_t m_head;
+    uint64_t m_headEnd;
+};
+
+}
+
+#endif
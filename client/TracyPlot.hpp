@@ -0,0 +1,58 @@
+#ifndef __TRACYPLOT_HPP__
+#define __TRACYPLOT_HPP__
+
+#include <atomic>
+#include <stdint.h>
+#include <string.h>
+
+#include "TracyProfiler.hpp"
+
+namespace tracy
+{
+
+// Plot fed from a hot loop. A value is sent only if it differs from the last
+// sent one, and no sooner than the given number of microseconds after it (0
+// sends every change).
+class PlotSampler
+{
+public:
+    PlotSampler( const char* name, uint32_t interval )
+        : m_name( name )
+        , m_interval( interval )
+        , m_lastTime( 0 )
+        , m_lastValue( UnsetValue )
+    {
+    }
+
+    PlotSampler( const PlotSampler& ) = delete;
+    PlotSampler( PlotSampler&& ) = delete;
+
+    PlotSampler& operator=( const PlotSampler& ) = delete;
+    PlotSampler& operator=( PlotSampler&& ) = delete;
+
+    tracy_force_inline void Sample( double val )
+    {
+        uint64_t bits;
+        memcpy( &bits, &val, sizeof( bits ) );
+        if( bits == m_lastValue.load( std::memory_order_relaxed ) ) return;
+        const auto time = Profiler::GetTime();
+        auto last = m_lastTime.load( std::memory_order_relaxed );
+        if( time - last < m_interval * Profiler::GetTicksPerMicrosecond() ) return;
+        // Only one of the threads racing for the interval sends its value.
+        if( !m_lastTime.compare_exchange_strong( last, time, std::memory_order_relaxed ) ) return;
+        m_lastValue.store( bits, std::memory_order_relaxed );
+        Profiler::PlotData( m_name, val );
+    }
+
+private:
+    enum : uint64_t { UnsetValue = 0x7FF8DEADBEEF0000 };     // NaN payload not produced by arithmetic
+
+    const char* m_name;
+    int64_t m_interval;
+    std::atomic<int64_t> m_lastTime;
+    std::atomic<uint64_t> m_lastValue;
+};
+
+}
+
+#endif
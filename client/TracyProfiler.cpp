@@ -23,12 +23,14 @@
 #  include <sys/syscall.h>
 #endif
 
+#include <algorithm>
 #include <atomic>
 #include <assert.h>
 #include <chrono>
 #include <limits>
 #include <memory>
 #include <mutex>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -38,8 +40,13 @@
 #include "../common/TracySystem.hpp"
 #include "tracy_rpmalloc.hpp"
 #include "TracyCallstack.hpp"
+#include "TracyFlightRecorder.hpp"
+#include "TracySendPipeline.hpp"
+#include "TracySampling.hpp"
+#include "TracyContextSwitch.hpp"
 #include "TracyScoped.hpp"
 #include "TracyProfiler.hpp"
+#include "TracySourceLocationCache.hpp"
 #include "TracyThread.hpp"
 
 #ifdef __GNUC__
@@ -406,7 +413,7 @@ LONG WINAPI CrashFilter( PEXCEPTION_POINTERS pExp )
 
     do
     {
-        if( te.th32OwnerProcessID == pid && te.th32ThreadID != tid && te.th32ThreadID != s_profilerThreadId )
+        if( te.th32OwnerProcessID == pid && te.th32ThreadID != tid && te.th32ThreadID != s_profilerThreadId && !s_profiler.IsPipelineThread( te.th32ThreadID ) )
         {
             HANDLE th = OpenThread( THREAD_SUSPEND_RESUME, FALSE, te.th32ThreadID );
             if( th != INVALID_HANDLE_VALUE )
@@ -639,7 +646,7 @@ static void CrashHandler( int signal, siginfo_t* info, void* ucontext )
     {
         if( ep->d_name[0] == '.' ) continue;
         int tid = atoi( ep->d_name );
-        if( tid != selfTid && tid != s_profilerTid )
+        if( tid != selfTid && tid != s_profilerTid && !s_profiler.IsPipelineThread( tid ) )
         {
             syscall( SYS_tkill, tid, SIGPWR );
         }
@@ -655,9 +662,15 @@ static void CrashHandler( int signal, siginfo_t* info, void* ucontext )
         tail.store( magic + 1, std::memory_order_release );
     }
 
-    std::this_thread::sleep_for( std::chrono::milliseconds( 500 ) );
-    s_profiler.RequestShutdown();
-    while( !s_profiler.HasShutdownFinished() ) { std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) ); };
+    // The profiler thread can't drain the queues if it's the one which crashed.
+    if( selfTid != s_profilerTid )
+    {
+        std::this_thread::sleep_for( std::chrono::milliseconds( 500 ) );
+        s_profiler.RequestShutdown();
+        while( !s_profiler.HasShutdownFinished() ) { std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) ); };
+    }
+
+    s_profiler.DumpFlightRecord();
 
     abort();
 }
@@ -679,6 +692,15 @@ static thread_local RPMallocThreadInit init_order(106) s_rpmalloc_thread_init;
 // 2. If these variables would be in the .CRT$XCB section, they would be initialized only in main thread.
 static thread_local moodycamel::ProducerToken init_order(107) s_token_detail( s_queue );
 thread_local ProducerWrapper init_order(108) s_token { s_queue.get_explicit_producer( s_token_detail ) };
+thread_local MemQueueWrapper init_order(108) s_memQueue { Profiler::AcquireMemQueue() };
+thread_local PayloadArena init_order(108) s_arena;
+thread_local ZoneAggregateWrapper init_order(109) s_zoneAggregate { nullptr };
+#ifdef TRACY_HAS_SAMPLING
+static thread_local SamplingThreadInit init_order(109) s_samplingThreadInit;
+#endif
+#ifdef TRACY_HAS_CONTEXT_SWITCH
+static thread_local ContextSwitchThreadInit init_order(109) s_ctxSwitchThreadInit;
+#endif
 
 #ifdef _MSC_VER
 // 1. Initialize these static variables before all other variables.
@@ -691,6 +713,8 @@ static RPMallocInit init_order(102) s_rpmalloc_init;
 moodycamel::ConcurrentQueue<QueueItem> init_order(103) s_queue( QueuePrealloc );
 std::atomic<uint32_t> init_order(104) s_lockCounter( 0 );
 std::atomic<uint8_t> init_order(104) s_gpuCtxCounter( 0 );
+static std::atomic<MemQueue*> init_order(104) s_memQueues( nullptr );
+static std::atomic<ZoneAggregate*> init_order(104) s_zoneAggregates( nullptr );
 
 thread_local GpuCtxWrapper init_order(104) s_gpuCtx { nullptr };
 VkCtxWrapper init_order(104) s_vkCtx { nullptr };
@@ -704,6 +728,10 @@ std::atomic<ThreadNameData*>& s_threadNameData = s_threadNameDataInstance;
 #ifdef TRACY_ON_DEMAND
 thread_local LuaZoneState init_order(104) s_luaZoneState { 0, false };
 #endif
+static SourceLocationCache init_order(104) s_luaSourceLocationsInstance;
+SourceLocationCache& s_luaSourceLocations = s_luaSourceLocationsInstance;
+static SourceLocationCache init_order(104) s_luaSampleFramesInstance;
+SourceLocationCache& s_luaSampleFrames = s_luaSampleFramesInstance;
 
 static Profiler init_order(105) s_profilerInstance;
 Profiler& s_profiler = s_profilerInstance;
@@ -721,6 +749,11 @@ DLL_EXPORT moodycamel::ConcurrentQueue<QueueItem>::ExplicitProducer* get_token()
     return s_token.ptr;
 }
 
+DLL_EXPORT MemQueue* get_memQueue()
+{
+    return s_memQueue.ptr;
+}
+
 DLL_EXPORT void*(*get_rpmalloc())(size_t size)
 {
     return rpmalloc;
@@ -738,6 +771,13 @@ DLL_EXPORT int64_t(*get_GetTimeImpl())()
 }
 #endif
 
+#ifdef TRACY_HAS_CALLSTACK
+DLL_EXPORT void*(*get_CacheCallstack())(const uintptr_t* trace)
+{
+    return CacheCallstack;
+}
+#endif
+
 DLL_EXPORT Profiler& get_profiler()
 {
     return s_profiler;
@@ -758,6 +798,19 @@ DLL_EXPORT void(*get_rpmalloc_thread_initialize())()
 
 enum { BulkSize = TargetFrameSize / QueueItemSize };
 
+// Older servers do not expect the contention flag of the lock announce.
+static inline size_t ItemDataSize( uint8_t idx, uint8_t protocol )
+{
+    if( idx == (uint8_t)QueueType::LockAnnounce && protocol < ProtocolLockContention ) return QueueDataSize[idx] - sizeof( QueueLockAnnounce::contention );
+    return QueueDataSize[idx];
+}
+
+static size_t GetQueueLimit()
+{
+    const char* limit = getenv( "TRACY_QUEUE_LIMIT" );
+    return limit ? size_t( atol( limit ) ) * 1024 * 1024 : 0;
+}
+
 Profiler::Profiler()
     : m_timeBegin( 0 )
     , m_mainThread( GetThreadHandle() )
@@ -766,6 +819,15 @@ Profiler::Profiler()
     , m_shutdownManual( false )
     , m_shutdownFinished( false )
     , m_sock( nullptr )
+    , m_captureFile( nullptr )
+    , m_flight( nullptr )
+    , m_pipeline( nullptr )
+    , m_streamBuffer( nullptr )
+    , m_compression( 0 )
+    , m_flightDefine( 0 )
+    , m_flightStash( nullptr )
+    , m_flightStashSize( 0 )
+    , m_localQueries( false )
     , m_noExit( false )
     , m_stream( LZ4_createStream() )
     , m_buffer( (char*)tracy_malloc( TargetFrameSize*3 ) )
@@ -773,8 +835,28 @@ Profiler::Profiler()
     , m_bufferStart( 0 )
     , m_itemBuf( (QueueItem*)tracy_malloc( sizeof( QueueItem ) * BulkSize ) )
     , m_lz4Buf( (char*)tracy_malloc( LZ4Size + sizeof( lz4sz_t ) ) )
-    , m_serialQueue( 1024*1024 )
-    , m_serialDequeue( 1024*1024 )
+    , m_protocol( ProtocolBase )
+    , m_refTime( 0 )
+    , m_refThread( 0 )
+    , m_srclocId( 1024 )
+    , m_callstackConnection( 1 )
+    , m_callstackIdNext( 0 )
+    , m_internedSent( 1024 )
+    , m_fileQueries( 1024 )
+    , m_modifiedSrcloc( 16 )
+    , m_aggregatePeriod( 0 )
+    , m_aggregateSendTime( 0 )
+    , m_ticksPerMicrosecond( 0 )
+    , m_queueLimit( GetQueueLimit() )
+    , m_memQueueBacklog( 0 )
+    , m_queueFull( false )
+    , m_dropBegin( 0 )
+    , m_droppedEvents( 0 )
+    , m_memQueueShared( true )
+    , m_memMerge( 64 )
+#if defined TRACY_CONTEXT_SWITCH && !defined TRACY_ON_DEMAND
+    , m_ctxSwitchStash( 1024 )
+#endif
 #ifdef TRACY_ON_DEMAND
     , m_isConnected( false )
     , m_frameCount( 0 )
@@ -788,10 +870,23 @@ Profiler::Profiler()
     // 3. But these variables need to be initialized in main thread within the .CRT$XCB section. Do it here.
     s_token_detail = moodycamel::ProducerToken( s_queue );
     s_token = ProducerWrapper { s_queue.get_explicit_producer( s_token_detail ) };
+    s_memQueue.ptr = AcquireMemQueue();
 #endif
 
+    auto head = s_memQueues.load( std::memory_order_relaxed );
+    do
+    {
+        m_memQueueShared.SetNext( head );
+    }
+    while( !s_memQueues.compare_exchange_weak( head, &m_memQueueShared, std::memory_order_release, std::memory_order_relaxed ) );
+
+#ifndef TRACY_ASYNC_CALIBRATION
     CalibrateTimer();
     CalibrateDelay();
+#endif
+
+    const char* noInternEnv = getenv( "TRACY_NO_STRING_INTERN" );
+    if( noInternEnv && noInternEnv[0] == '1' ) m_stringIntern.Disable();
 
 #ifndef TRACY_NO_EXIT
     const char* noExitEnv = getenv( "TRACY_NO_EXIT" );
@@ -829,6 +924,13 @@ Profiler::Profiler()
     InitCallstack();
 #endif
 
+#ifdef TRACY_HAS_SAMPLING
+    StartThreadSampling();
+#endif
+#ifdef TRACY_HAS_CONTEXT_SWITCH
+    StartThreadContextSwitch();
+#endif
+
     m_timeBegin.store( GetTime(), std::memory_order_relaxed );
 }
 
@@ -849,6 +951,13 @@ Profiler::~Profiler()
         tracy_free( m_sock );
     }
 
+    if( m_flight )
+    {
+        m_flight->~FlightRecorder();
+        tracy_free( m_flight );
+        tracy_free( m_flightStash );
+    }
+
     assert( s_instance );
     s_instance = nullptr;
 }
@@ -863,6 +972,12 @@ void Profiler::Worker()
 #ifdef __linux__
     s_profilerTid = syscall( SYS_gettid );
 #endif
+#ifdef TRACY_HAS_SAMPLING
+    DisableThreadSampling();
+#endif
+#ifdef TRACY_HAS_CONTEXT_SWITCH
+    DisableThreadContextSwitch();
+#endif
 
     rpmalloc_thread_initialize();
 
@@ -874,13 +989,33 @@ void Profiler::Worker()
 
     while( m_timeBegin.load( std::memory_order_relaxed ) == 0 ) std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
 
+#ifdef TRACY_ASYNC_CALIBRATION
+    // Events are already being recorded in raw timer ticks. The server can only
+    // interpret them after receiving the welcome message, which is not sent
+    // until calibration is finished.
+    CalibrateTimer();
+#  ifndef TRACY_NO_EXIT
+    if( !m_noExit && ShouldExit() )
+    {
+        m_shutdownFinished.store( true, std::memory_order_relaxed );
+        return;
+    }
+#  endif
+    CalibrateDelay();
+#endif
+
 #ifdef TRACY_ON_DEMAND
     uint8_t onDemand = 1;
 #else
     uint8_t onDemand = 0;
 #endif
 
+    enum { AggregatePeriod = 10 * 1000 * 1000 };
+    m_aggregatePeriod = int64_t( AggregatePeriod / m_timerMul );
+    m_ticksPerMicrosecond.store( std::max<int64_t>( 1, int64_t( 1000 / m_timerMul ) ), std::memory_order_relaxed );
+
     WelcomeMessage welcome;
+    MemWrite( &welcome.protocol, uint8_t( ProtocolBase ) );
     MemWrite( &welcome.timerMul, m_timerMul );
     MemWrite( &welcome.initBegin, s_initTime.val );
     MemWrite( &welcome.initEnd, m_timeBegin.load( std::memory_order_relaxed ) );
@@ -895,11 +1030,68 @@ void Profiler::Worker()
 
     moodycamel::ConsumerToken token( s_queue );
 
+    const char* capturePath = getenv( "TRACY_CAPTURE_FILE" );
+    if( capturePath )
+    {
+        m_captureFile = fopen( capturePath, "wb" );
+        if( m_captureFile )
+        {
+            CaptureToFile( welcome, token );
+            return;
+        }
+    }
+
+#ifdef __linux__
+    const char* flightPath = getenv( "TRACY_FLIGHT_RECORDER" );
+    if( flightPath )
+    {
+        long size = 16;
+        const char* sizeEnv = getenv( "TRACY_FLIGHT_RECORDER_SIZE" );
+        if( sizeEnv ) size = std::max( atol( sizeEnv ), 1l );
+        m_flight = (FlightRecorder*)tracy_malloc( sizeof( FlightRecorder ) );
+        new(m_flight) FlightRecorder( flightPath, size_t( size ) * 1024 * 1024 );
+        m_flightStash = (char*)tracy_malloc( TargetFrameSize );
+        CaptureToFile( welcome, token );
+        return;
+    }
+#endif
+
+    // Several profiled processes running on one host need different ports.
+    const char* port = getenv( "TRACY_PORT" );
+    const char* shmName = getenv( "TRACY_SHM" );
+    const char* shmCompress = getenv( "TRACY_SHM_COMPRESS" );
+    const char* noPipeline = getenv( "TRACY_NO_PIPELINE" );
     ListenSocket listen;
-    listen.Listen( "8086", 8 );
+    if( !shmName || !listen.ListenShm( shmName, shmCompress && shmCompress[0] == '1' ) )
+    {
+        listen.Listen( port ? port : "8086", 8 );
+    }
+
+    // A peer which connects and doesn't send the handshake (a port scanner, a
+    // health check) is dropped after a while, so that it can't stall the
+    // profiler thread.
+    std::chrono::steady_clock::time_point handshakeDeadline;
+    auto HandshakeShouldExit = [this, &handshakeDeadline]
+    {
+        if( std::chrono::steady_clock::now() > handshakeDeadline ) return true;
+#ifndef TRACY_NO_EXIT
+        return !m_noExit && ShouldExit();
+#else
+        return false;
+#endif
+    };
 
     for(;;)
     {
+        StopPipeline();
+        if( m_sock )
+        {
+            m_sock->~Socket();
+            tracy_free( m_sock );
+            m_sock = nullptr;
+        }
+
+        HandshakeMessage handshake;
         for(;;)
         {
 #ifndef TRACY_NO_EXIT
@@ -909,10 +1101,31 @@ void Profiler::Worker()
                 return;
             }
 #endif
+            StashContextSwitches();
             m_sock = listen.Accept();
-            if( m_sock ) break;
+            if( m_sock )
+            {
+                timeval tv;
+                tv.tv_sec = 0;
+                tv.tv_usec = 10000;
+
+                handshakeDeadline = std::chrono::steady_clock::now() + std::chrono::seconds( 2 );
+                if( m_sock->Read( &handshake, sizeof( handshake ), &tv, HandshakeShouldExit ) ) break;
+                m_sock->~Socket();
+                tracy_free( m_sock );
+                m_sock = nullptr;
+            }
         }
 
+        m_protocol = std::min<uint8_t>( handshake.protocol, ProtocolVersion );
+        m_refTime = 0;
+        m_refThread = 0;
+        m_srclocId.clear();
+        m_callstackConnection++;
+        m_callstackIdNext = 0;
+        m_internedSent.clear();
+        MemWrite( &welcome.protocol, m_protocol );
+
 #ifdef TRACY_ON_DEMAND
         ClearQueues( token );
         m_isConnected.store( true, std::memory_order_relaxed );
@@ -926,12 +1139,16 @@ void Profiler::Worker()
         onDemand.frames = m_frameCount.load( std::memory_order_relaxed );
 
         m_sock->Send( &onDemand, sizeof( onDemand ) );
+#endif
 
+        if( !noPipeline || noPipeline[0] != '1' ) StartPipeline();
+
+#ifdef TRACY_ON_DEMAND
         m_deferredLock.lock();
         for( auto& item : m_deferredQueue )
         {
             const auto idx = MemRead<uint8_t>( &item.hdr.idx );
-            AppendData( &item, QueueDataSize[idx] );
+            AppendData( &item, ItemDataSize( idx, m_protocol ) );
         }
         m_deferredLock.unlock();
 #endif
@@ -939,13 +1156,17 @@ void Profiler::Worker()
         int keepAlive = 0;
         for(;;)
         {
+            const auto dequeueStart = std::chrono::high_resolution_clock::now();
             const auto status = Dequeue( token );
             const auto serialStatus = DequeueSerial();
-            if( status == ConnectionLost || serialStatus == ConnectionLost )
+            const auto sampleStatus = DequeueSamples();
+            const auto ctxSwitchStatus = DequeueContextSwitches();
+            if( m_pipeline ) m_pipeline->AccountDequeue( std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::high_resolution_clock::now() - dequeueStart ).count() );
+            if( status == ConnectionLost || serialStatus == ConnectionLost || sampleStatus == ConnectionLost || ctxSwitchStatus == ConnectionLost || !SendDroppedEvents() || !SendCompressionMode() || !SendZoneAggregates( false ) )
             {
                 break;
             }
-            else if( status == QueueEmpty && serialStatus == QueueEmpty )
+            else if( status == QueueEmpty && serialStatus == QueueEmpty && sampleStatus == QueueEmpty && ctxSwitchStatus == QueueEmpty )
             {
                 if( ShouldExit() ) break;
                 if( m_bufferOffset != m_bufferStart )
@@ -977,22 +1198,27 @@ void Profiler::Worker()
                 if( !HandleServerQuery() ) break;
             }
         }
+        EnableAllSourceLocations();
         if( ShouldExit() ) break;
+        ClearZoneAggregates();
 
 #ifdef TRACY_ON_DEMAND
         m_isConnected.store( false, std::memory_order_relaxed );
 #endif
     }
 
+    SendZoneAggregates( true );
     for(;;)
     {
         const auto status = Dequeue( token );
         const auto serialStatus = DequeueSerial();
-        if( status == ConnectionLost || serialStatus == ConnectionLost )
+        const auto sampleStatus = DequeueSamples();
+        const auto ctxSwitchStatus = DequeueContextSwitches();
+        if( status == ConnectionLost || serialStatus == ConnectionLost || sampleStatus == ConnectionLost || ctxSwitchStatus == ConnectionLost || !SendDroppedEvents() || !SendCompressionMode() )
         {
             break;
         }
-        else if( status == QueueEmpty && serialStatus == QueueEmpty )
+        else if( status == QueueEmpty && serialStatus == QueueEmpty && sampleStatus == QueueEmpty && ctxSwitchStatus == QueueEmpty )
         {
             if( m_bufferOffset != m_bufferStart ) CommitData();
             break;
@@ -1006,8 +1232,10 @@ void Profiler::Worker()
 
     QueueItem terminate;
     MemWrite( &terminate.hdr.type, QueueType::Terminate );
-    if( !SendData( (const char*)&terminate, 1 ) )
+    AppendData( &terminate, 1 );
+    if( !CommitData() )
     {
+        StopPipeline();
         m_shutdownFinished.store( true, std::memory_order_relaxed );
         return;
     }
@@ -1020,16 +1248,20 @@ void Profiler::Worker()
                 if( !HandleServerQuery() )
                 {
                     if( m_bufferOffset != m_bufferStart ) CommitData();
+                    StopPipeline();
                     m_shutdownFinished.store( true, std::memory_order_relaxed );
                     return;
                 }
             }
             while( Dequeue( token ) == Success ) {}
             while( DequeueSerial() == Success ) {}
+            while( DequeueSamples() == Success ) {}
+            while( DequeueContextSwitches() == Success ) {}
             if( m_bufferOffset != m_bufferStart )
             {
                 if( !CommitData() )
                 {
+                    StopPipeline();
                     m_shutdownFinished.store( true, std::memory_order_relaxed );
                     return;
                 }
@@ -1045,7 +1277,7 @@ void Profiler::Worker()
 
 static void FreeAssociatedMemory( const QueueItem& item )
 {
-    if( item.hdr.idx >= (int)QueueType::Terminate ) return;
+    if( !IsQueueItemWithPayload( item.hdr.type ) ) return;
 
     uint64_t ptr;
     switch( item.hdr.type )
@@ -1053,23 +1285,35 @@ static void FreeAssociatedMemory( const QueueItem& item )
     case QueueType::ZoneText:
     case QueueType::ZoneName:
         ptr = MemRead<uint64_t>( &item.zoneText.text );
-        tracy_free( (void*)ptr );
+        if( !StringIntern::IsInterned( ptr ) ) PayloadArena::Free( (void*)ptr );
         break;
     case QueueType::Message:
         ptr = MemRead<uint64_t>( &item.message.text );
-        tracy_free( (void*)ptr );
+        if( !StringIntern::IsInterned( ptr ) ) PayloadArena::Free( (void*)ptr );
         break;
     case QueueType::ZoneBeginAllocSrcLoc:
         ptr = MemRead<uint64_t>( &item.zoneBegin.srcloc );
-        tracy_free( (void*)ptr );
+        PayloadArena::Free( (void*)ptr );
         break;
     case QueueType::CallstackMemory:
         ptr = MemRead<uint64_t>( &item.callstackMemory.ptr );
-        tracy_free( (void*)ptr );
+        FreeCallstack( ptr );
         break;
     case QueueType::Callstack:
         ptr = MemRead<uint64_t>( &item.callstack.ptr );
-        tracy_free( (void*)ptr );
+        FreeCallstack( ptr );
+        break;
+    case QueueType::PlotDataBatch:
+        ptr = MemRead<uint64_t>( &item.plotDataBatch.ptr );
+        PayloadArena::Free( (void*)ptr );
+        break;
+    case QueueType::LuaSample:
+        ptr = MemRead<uint64_t>( &item.luaSample.ptr );
+        FreeCallstack( ptr );
+        break;
+    case QueueType::GpuTimeBatch:
+        ptr = MemRead<uint64_t>( &item.gpuTimeBatch.ptr );
+        PayloadArena::Free( (void*)ptr );
         break;
     default:
         assert( false );
@@ -1077,6 +1321,73 @@ static void FreeAssociatedMemory( const QueueItem& item )
     }
 }
 
+void Profiler::CaptureToFile( WelcomeMessage& welcome, moodycamel::ConsumerToken& token )
+{
+    m_protocol = ProtocolVersion;
+    m_localQueries = true;
+    MemWrite( &welcome.protocol, m_protocol );
+    MemWrite( &welcome.onDemand, uint8_t( 0 ) );
+
+    if( m_flight )
+    {
+        m_flight->Define( FlightCaptureHeader, RawCaptureHeaderSize );
+        m_flight->Define( &welcome, sizeof( welcome ) );
+    }
+    else
+    {
+        fwrite( RawCaptureHeader, 1, RawCaptureHeaderSize, m_captureFile );
+        fwrite( &welcome, 1, sizeof( welcome ), m_captureFile );
+    }
+
+#ifdef TRACY_ON_DEMAND
+    m_isConnected.store( true, std::memory_order_relaxed );
+
+    m_deferredLock.lock();
+    FlightDefineBegin();
+    for( auto& item : m_deferredQueue )
+    {
+        const auto idx = MemRead<uint8_t>( &item.hdr.idx );
+        AppendData( &item, QueueDataSize[idx] );
+        FileQueries( &item );
+    }
+    FlightDefineEnd();
+    m_deferredLock.unlock();
+#endif
+
+    for(;;)
+    {
+        const auto status = Dequeue( token );
+        const auto serialStatus = DequeueSerial();
+        const auto sampleStatus = DequeueSamples();
+        const auto ctxSwitchStatus = DequeueContextSwitches();
+        if( status == ConnectionLost || serialStatus == ConnectionLost || sampleStatus == ConnectionLost || ctxSwitchStatus == ConnectionLost || !SendDroppedEvents() )
+        {
+            break;
+        }
+        else if( status == QueueEmpty && serialStatus == QueueEmpty && sampleStatus == QueueEmpty && ctxSwitchStatus == QueueEmpty )
+        {
+            if( m_bufferOffset != m_bufferStart )
+            {
+                if( !CommitData() ) break;
+            }
+            if( ShouldExit() ) break;
+            std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+        }
+    }
+
+    // The flight record is written only if the program crashes.
+    if( m_captureFile )
+    {
+        QueueItem terminate;
+        MemWrite( &terminate.hdr.type, QueueType::Terminate );
+        SendData( (const char*)&terminate, 1 );
+
+        fclose( m_captureFile );
+        m_captureFile = nullptr;
+    }
+    m_shutdownFinished.store( true, std::memory_order_relaxed );
+}
+
 void Profiler::ClearQueues( moodycamel::ConsumerToken& token )
 {
     for(;;)
@@ -1086,13 +1397,77 @@ void Profiler::ClearQueues( moodycamel::ConsumerToken& token )
         for( size_t i=0; i<sz; i++ ) FreeAssociatedMemory( m_itemBuf[i] );
     }
 
-    std::lock_guard<TracyMutex> lock( m_serialLock );
+    ClearMemQueues();
+    ClearSamples();
+    ClearContextSwitches();
+}
 
-    for( auto& v : m_serialDequeue ) FreeAssociatedMemory( v );
-    m_serialDequeue.clear();
+void Profiler::ClearZoneAggregates()
+{
+    for( auto agg = GetZoneAggregates(); agg; agg = agg->next )
+    {
+        agg->Lock();
+        for( auto& e : agg->data ) e.srcloc = nullptr;
+        agg->Unlock();
+    }
+}
+
+void Profiler::ClearMemQueues()
+{
+    for( auto queue = s_memQueues.load( std::memory_order_acquire ); queue; queue = queue->Next() )
+    {
+        queue->Refresh();
+        while( !queue->Empty() )
+        {
+            FreeAssociatedMemory( *queue->Peek() );
+            queue->Pop();
+        }
+    }
+}
 
-    for( auto& v : m_serialQueue ) FreeAssociatedMemory( v );
-    m_serialQueue.clear();
+void Profiler::ClearSamples()
+{
+#ifdef TRACY_HAS_SAMPLING
+    for( auto buf = GetSampleBuffers(); buf; buf = buf->next )
+    {
+        buf->head.store( buf->tail.load( std::memory_order_acquire ), std::memory_order_release );
+        buf->dropped.store( 0, std::memory_order_relaxed );
+    }
+#endif
+}
+
+void Profiler::ClearContextSwitches()
+{
+#ifdef TRACY_HAS_CONTEXT_SWITCH
+    for( auto buf = GetContextSwitchBuffers(); buf; buf = buf->next )
+    {
+        while( ReadContextSwitches( buf, m_itemBuf, BulkSize ) != 0 ) {}
+    }
+#  ifndef TRACY_ON_DEMAND
+    m_ctxSwitchStash.clear();
+#  endif
+#endif
+}
+
+// The rings are small and would overflow while waiting for a server. Their
+// contents are kept until the connection is made, or dropped in on-demand mode.
+void Profiler::StashContextSwitches()
+{
+#ifdef TRACY_HAS_CONTEXT_SWITCH
+#  ifdef TRACY_ON_DEMAND
+    ClearContextSwitches();
+#  else
+    UpdateContextSwitchClock( m_timerMul );
+    for( auto buf = GetContextSwitchBuffers(); buf; buf = buf->next )
+    {
+        uint32_t num;
+        while( ( num = ReadContextSwitches( buf, m_itemBuf, BulkSize ) ) != 0 )
+        {
+            for( uint32_t i=0; i<num; i++ ) *m_ctxSwitchStash.push_next() = m_itemBuf[i];
+        }
+    }
+#  endif
+#endif
 }
 
 Profiler::DequeueStatus Profiler::Dequeue( moodycamel::ConsumerToken& token )
@@ -1106,37 +1481,78 @@ Profiler::DequeueStatus Profiler::Dequeue( moodycamel::ConsumerToken& token )
         {
             uint64_t ptr;
             const auto idx = MemRead<uint8_t>( &item->hdr.idx );
-            if( idx < (int)QueueType::Terminate )
+            if( IsQueueItemWithPayload( (QueueType)idx ) )
             {
                 switch( (QueueType)idx )
                 {
                 case QueueType::ZoneText:
                 case QueueType::ZoneName:
-                    ptr = MemRead<uint64_t>( &item->zoneText.text );
-                    SendString( ptr, (const char*)ptr, QueueType::CustomStringData );
-                    tracy_free( (void*)ptr );
+                    SendCustomString( &item->zoneText.text );
                     break;
                 case QueueType::Message:
-                    ptr = MemRead<uint64_t>( &item->message.text );
-                    SendString( ptr, (const char*)ptr, QueueType::CustomStringData );
-                    tracy_free( (void*)ptr );
+                    SendCustomString( &item->message.text );
                     break;
                 case QueueType::ZoneBeginAllocSrcLoc:
                     ptr = MemRead<uint64_t>( &item->zoneBegin.srcloc );
                     SendSourceLocationPayload( ptr );
-                    tracy_free( (void*)ptr );
+                    PayloadArena::Free( (void*)ptr );
                     break;
                 case QueueType::Callstack:
                     ptr = MemRead<uint64_t>( &item->callstack.ptr );
-                    SendCallstackPayload( ptr );
-                    tracy_free( (void*)ptr );
+                    if( IsCallstackCached( ptr ) && m_protocol >= ProtocolCallstackId )
+                    {
+                        QueueItem cached;
+                        MemWrite( &cached.hdr.type, QueueType::CallstackCached );
+                        MemWrite( &cached.callstackCached.id, GetCallstackId( ptr ) );
+                        MemWrite( &cached.callstackCached.thread, MemRead<uint64_t>( &item->callstack.thread ) );
+                        FreeCallstack( ptr );
+                        if( !AppendData( &cached, QueueDataSize[(int)QueueType::CallstackCached] ) ) return ConnectionLost;
+                        item++;
+                        continue;
+                    }
+                    SendCallstackPayload( ptr, ptr, QueueType::CallstackPayload );
+                    FreeCallstack( ptr );
                     break;
+                case QueueType::PlotDataBatch:
+                    if( !SendPlotBatch( *item ) ) return ConnectionLost;
+                    item++;
+                    continue;
+                case QueueType::LuaSample:
+                    if( !SendLuaSample( *item ) ) return ConnectionLost;
+                    item++;
+                    continue;
+                case QueueType::GpuTimeBatch:
+                    if( !SendGpuTimeBatch( *item ) ) return ConnectionLost;
+                    item++;
+                    continue;
                 default:
                     assert( false );
                     break;
                 }
             }
-            if( !AppendData( item, QueueDataSize[idx] ) ) return ConnectionLost;
+            else if( idx <= (int)QueueType::ZoneEnd && idx >= (int)QueueType::ZoneBegin && m_protocol >= ProtocolCompact )
+            {
+                if( !AppendCompact( *item, idx ) ) return ConnectionLost;
+                if( m_localQueries ) FileQueries( item );
+                item++;
+                continue;
+            }
+            if( m_flight && ( idx == (int)QueueType::LockAnnounce || idx == (int)QueueType::GpuNewContext ) )
+            {
+                FlightDefineBegin();
+                AppendData( item, QueueDataSize[idx] );
+                FileQueries( item );
+                FlightDefineEnd();
+                item++;
+                continue;
+            }
+            if( ( idx == (int)QueueType::ZoneCounters || idx == (int)QueueType::ZoneCountersHw ) && m_protocol < ProtocolZoneCounters )
+            {
+                item++;
+                continue;
+            }
+            if( !AppendData( item, ItemDataSize( idx, m_protocol ) ) ) return ConnectionLost;
+            if( m_localQueries ) FileQueries( item );
             item++;
         }
     }
@@ -1147,58 +1563,229 @@ Profiler::DequeueStatus Profiler::Dequeue( moodycamel::ConsumerToken& token )
     return Success;
 }
 
+MemQueue* Profiler::AcquireMemQueue()
+{
+    rpmalloc_thread_initialize();
+
+    // Reuse a queue released by a thread that has exited.
+    auto head = s_memQueues.load( std::memory_order_acquire );
+    for( auto queue = head; queue; queue = queue->Next() )
+    {
+        if( !queue->IsShared() && queue->Claim() ) return queue;
+    }
+
+    auto queue = (MemQueue*)tracy_malloc( sizeof( MemQueue ) );
+    new(queue) MemQueue( false );
+    do
+    {
+        queue->SetNext( head );
+    }
+    while( !s_memQueues.compare_exchange_weak( head, queue, std::memory_order_release, std::memory_order_acquire ) );
+    return queue;
+}
+
+ZoneAggregate* AcquireZoneAggregate()
+{
+    rpmalloc_thread_initialize();
+
+    // Reuse a buffer released by a thread that has exited.
+    auto head = s_zoneAggregates.load( std::memory_order_acquire );
+    for( auto agg = head; agg; agg = agg->next )
+    {
+        bool expected = false;
+        if( agg->owned.compare_exchange_strong( expected, true, std::memory_order_acquire, std::memory_order_relaxed ) ) return agg;
+    }
+
+    auto agg = (ZoneAggregate*)tracy_malloc( sizeof( ZoneAggregate ) );
+    new( &agg->owned ) std::atomic<bool>( true );
+    new( &agg->lock ) std::atomic<bool>( false );
+    for( auto& e : agg->data ) e.srcloc = nullptr;
+    do
+    {
+        agg->next = head;
+    }
+    while( !s_zoneAggregates.compare_exchange_weak( head, agg, std::memory_order_release, std::memory_order_acquire ) );
+    return agg;
+}
+
+ZoneAggregate* GetZoneAggregates()
+{
+    return s_zoneAggregates.load( std::memory_order_acquire );
+}
+
 Profiler::DequeueStatus Profiler::DequeueSerial()
 {
+    // Memory events must reach the server in global time order. Each queue is
+    // ordered, so events can be merged, but only up to the point in time before
+    // which no thread can commit any more events. A thread which is writing an
+    // event limits this point to the event's timestamp. Threads which are idle
+    // will retrieve timestamps later than the one read here.
+    auto limit = GetTime();
+    std::atomic_thread_fence( std::memory_order_seq_cst );
+
+    m_memMerge.clear();
+    for( auto queue = s_memQueues.load( std::memory_order_acquire ); queue; queue = queue->Next() )
     {
-        bool lockHeld = true;
-        while( !m_serialLock.try_lock() )
+        auto inflight = queue->GetInflight();
+        while( inflight == MemQueue::Entering )
+        {
+            // The window between Enter() and SetTime() is a few instructions long.
+            if( m_shutdownManual.load( std::memory_order_relaxed ) ) break;
+            std::this_thread::yield();
+            inflight = queue->GetInflight();
+        }
+        if( inflight > MemQueue::Entering && inflight < limit ) limit = inflight;
+
+        queue->Refresh();
+        if( !queue->Empty() )
         {
-            if( m_shutdownManual.load( std::memory_order_relaxed ) )
+            auto head = m_memMerge.push_next();
+            head->time = MemRead<int64_t>( &queue->Peek()->memAlloc.time );
+            head->queue = queue;
+        }
+    }
+
+    // Inverted, std heap functions keep the largest element on top.
+    const auto cmp = []( const MemQueueHead& lhs, const MemQueueHead& rhs ) { return lhs.time > rhs.time; };
+
+    auto begin = m_memMerge.begin();
+    auto end = m_memMerge.end();
+    std::make_heap( begin, end, cmp );
+
+    bool sent = false;
+    while( begin != end && begin->time < limit )
+    {
+        std::pop_heap( begin, end, cmp );
+        auto queue = (end-1)->queue;
+
+        auto item = queue->Peek();
+        const auto idx = MemRead<uint8_t>( &item->hdr.idx );
+        if( !AppendData( item, QueueDataSize[idx] ) ) return ConnectionLost;
+        if( m_localQueries ) FileQueries( item );
+        queue->Pop();
+        if( idx == (uint8_t)QueueType::MemAllocCallstack || idx == (uint8_t)QueueType::MemFreeCallstack )
+        {
+            // Committed together with the memory event.
+            item = queue->Peek();
+            assert( item->hdr.type == QueueType::CallstackMemory );
+            const auto ptr = MemRead<uint64_t>( &item->callstackMemory.ptr );
+            queue->Pop();
+            if( IsCallstackCached( ptr ) && m_protocol >= ProtocolCallstackId )
             {
-                lockHeld = false;
-                break;
+                QueueItem cached;
+                MemWrite( &cached.hdr.type, QueueType::CallstackMemoryCached );
+                MemWrite( &cached.callstackMemoryCached.id, GetCallstackId( ptr ) );
+                FreeCallstack( ptr );
+                if( !AppendData( &cached, QueueDataSize[(int)QueueType::CallstackMemoryCached] ) ) return ConnectionLost;
+            }
+            else
+            {
+                SendCallstackPayload( ptr, ptr, QueueType::CallstackPayload );
+                FreeCallstack( ptr );
+                if( !AppendData( item, QueueDataSize[(int)QueueType::CallstackMemory] ) ) return ConnectionLost;
             }
         }
-        m_serialQueue.swap( m_serialDequeue );
-        if( lockHeld )
+        sent = true;
+
+        if( queue->Empty() )
         {
-            m_serialLock.unlock();
+            end--;
+        }
+        else
+        {
+            (end-1)->time = MemRead<int64_t>( &queue->Peek()->memAlloc.time );
+            std::push_heap( begin, end, cmp );
         }
     }
 
-    const auto sz = m_serialDequeue.size();
-    if( sz > 0 )
+    return sent ? Success : QueueEmpty;
+}
+
+Profiler::DequeueStatus Profiler::DequeueSamples()
+{
+#ifdef TRACY_HAS_SAMPLING
+    bool sent = false;
+    for( auto buf = GetSampleBuffers(); buf; buf = buf->next )
     {
-        auto item = m_serialDequeue.data();
-        auto end = item + sz;
-        while( item != end )
+        const auto dropped = buf->dropped.exchange( 0, std::memory_order_acquire );
+        if( dropped != 0 && !SendDroppedSamples( buf->dropBegin.load( std::memory_order_relaxed ), dropped ) ) return ConnectionLost;
+
+        auto head = buf->head.load( std::memory_order_relaxed );
+        const auto tail = buf->tail.load( std::memory_order_acquire );
+        while( head != tail )
         {
-            uint64_t ptr;
-            const auto idx = MemRead<uint8_t>( &item->hdr.idx );
-            if( idx < (int)QueueType::Terminate )
+            auto& sample = buf->data[head % SampleBuffer::Size];
+            if( m_protocol >= ProtocolSampling )
             {
-                switch( (QueueType)idx )
+                // Samples repeat the same callstacks over and over, so these
+                // are sent by id, from the callstack cache of the profiler thread.
+                const auto ptr = (uint64_t)CacheCallstack( &sample.num );
+                if( IsCallstackCached( ptr ) )
                 {
-                case QueueType::CallstackMemory:
-                    ptr = MemRead<uint64_t>( &item->callstackMemory.ptr );
-                    SendCallstackPayload( ptr );
-                    tracy_free( (void*)ptr );
-                    break;
-                default:
-                    assert( false );
-                    break;
+                    QueueItem item;
+                    MemWrite( &item.hdr.type, QueueType::CallstackSample );
+                    MemWrite( &item.callstackSample.time, sample.time );
+                    MemWrite( &item.callstackSample.thread, sample.thread );
+                    MemWrite( &item.callstackSample.id, GetCallstackId( ptr ) );
+                    FreeCallstack( ptr );
+                    if( !AppendData( &item, QueueDataSize[(int)QueueType::CallstackSample] ) ) return ConnectionLost;
+                    if( m_localQueries ) FileQueries( &item );
                 }
+                else if( !SendSamplePayload( sample.time, sample.thread, ptr ) )
+                {
+                    return ConnectionLost;
+                }
+                sent = true;
             }
-            if( !AppendData( item, QueueDataSize[idx] ) ) return ConnectionLost;
-            item++;
+            head++;
+            buf->head.store( head, std::memory_order_release );
         }
-        m_serialDequeue.clear();
     }
-    else
+    return sent ? Success : QueueEmpty;
+#else
+    return QueueEmpty;
+#endif
+}
+
+Profiler::DequeueStatus Profiler::DequeueContextSwitches()
+{
+#ifdef TRACY_HAS_CONTEXT_SWITCH
+    if( m_protocol < ProtocolContextSwitch )
     {
+        ClearContextSwitches();
         return QueueEmpty;
     }
-    return Success;
+    bool sent = false;
+#  ifndef TRACY_ON_DEMAND
+    if( !m_ctxSwitchStash.empty() )
+    {
+        for( auto& item : m_ctxSwitchStash )
+        {
+            if( !AppendData( &item, QueueDataSize[(int)QueueType::ContextSwitch] ) ) return ConnectionLost;
+            if( m_localQueries ) FileQueries( &item );
+        }
+        m_ctxSwitchStash.clear();
+        sent = true;
+    }
+#  endif
+    UpdateContextSwitchClock( m_timerMul );
+    for( auto buf = GetContextSwitchBuffers(); buf; buf = buf->next )
+    {
+        uint32_t num;
+        while( ( num = ReadContextSwitches( buf, m_itemBuf, BulkSize ) ) != 0 )
+        {
+            for( uint32_t i=0; i<num; i++ )
+            {
+                if( !AppendData( m_itemBuf + i, QueueDataSize[(int)QueueType::ContextSwitch] ) ) return ConnectionLost;
+                if( m_localQueries ) FileQueries( m_itemBuf + i );
+            }
+            sent = true;
+        }
+    }
+    return sent ? Success : QueueEmpty;
+#else
+    return QueueEmpty;
+#endif
 }
 
 bool Profiler::AppendData( const void* data, size_t len )
@@ -1209,11 +1796,91 @@ bool Profiler::AppendData( const void* data, size_t len )
     return ret;
 }
 
+bool Profiler::AppendCompact( const QueueItem& item, uint8_t idx )
+{
+    enum { MaxSize = sizeof( QueueHeader ) + sizeof( QueueThreadContext ) + sizeof( QueueHeader ) + VarintMaxSize * 3 + sizeof( uint64_t ) };
+    char buf[MaxSize];
+    auto ptr = buf;
+
+    // The encoding depends on the state of the current frame, so the frame
+    // must not change after that.
+    if( !NeedDataSize( MaxSize ) ) return false;
+
+    const bool isEnd = idx == (int)QueueType::ZoneEnd;
+    const auto thread = isEnd ? MemRead<uint64_t>( &item.zoneEnd.thread ) : MemRead<uint64_t>( &item.zoneBegin.thread );
+    if( thread != m_refThread )
+    {
+        m_refThread = thread;
+        *ptr++ = (char)QueueType::ThreadContext;
+        memcpy( ptr, &thread, sizeof( thread ) );
+        ptr += sizeof( thread );
+    }
+
+    const auto time = isEnd ? MemRead<int64_t>( &item.zoneEnd.time ) : MemRead<int64_t>( &item.zoneBegin.time );
+    const auto cpu = isEnd ? MemRead<uint32_t>( &item.zoneEnd.cpu ) : MemRead<uint32_t>( &item.zoneBegin.cpu );
+
+    switch( (QueueType)idx )
+    {
+    case QueueType::ZoneBegin:
+        *ptr++ = (char)QueueType::ZoneBeginCompact;
+        break;
+    case QueueType::ZoneBeginCallstack:
+        *ptr++ = (char)QueueType::ZoneBeginCallstackCompact;
+        break;
+    case QueueType::ZoneEnd:
+        *ptr++ = (char)QueueType::ZoneEndCompact;
+        break;
+    default:
+        assert( false );
+        break;
+    }
+
+    ptr = WriteVarintSigned( ptr, time - m_refTime );
+    m_refTime = time;
+    ptr = WriteVarint( ptr, uint32_t( cpu + 1 ) );
+
+    if( !isEnd )
+    {
+        const auto srcloc = MemRead<uint64_t>( &item.zoneBegin.srcloc );
+        auto id = m_srclocId.find( srcloc );
+        if( id )
+        {
+            ptr = WriteVarint( ptr, uint64_t( *id ) + 1 );
+        }
+        else
+        {
+            m_srclocId.emplace( srcloc, uint32_t( m_srclocId.size() ) );
+            *ptr++ = 0;
+            memcpy( ptr, &srcloc, sizeof( srcloc ) );
+            ptr += sizeof( srcloc );
+        }
+    }
+
+    assert( ptr - buf <= MaxSize );
+    AppendDataUnsafe( buf, ptr - buf );
+    return true;
+}
+
 bool Profiler::CommitData()
 {
+    if( m_pipeline )
+    {
+        const auto ret = m_pipeline->Submit( m_bufferOffset );
+        m_buffer = m_pipeline->Frame();
+        m_bufferOffset = 0;
+        m_bufferStart = 0;
+        return ret;
+    }
     bool ret = SendData( m_buffer + m_bufferStart, m_bufferOffset - m_bufferStart );
     if( m_bufferOffset > TargetFrameSize * 2 ) m_bufferOffset = 0;
     m_bufferStart = m_bufferOffset;
+    if( m_flight && m_flightDefine == 0 )
+    {
+        // The previous frame may be dropped from the flight record.
+        m_refTime = 0;
+        m_refThread = 0;
+        m_srclocId.clear();
+    }
     return ret;
 }
 
@@ -1229,14 +1896,220 @@ bool Profiler::NeedDataSize( size_t len )
 
 bool Profiler::SendData( const char* data, size_t len )
 {
+    if( m_sock && !m_sock->IsCompressed() )
+    {
+        const lz4sz_t sz = lz4sz_t( len );
+        return m_sock->Send( &sz, sizeof( sz ) ) != -1 && m_sock->Send( data, int( len ) ) != -1;
+    }
+    if( m_flight ) LZ4_resetStream( m_stream );
     const lz4sz_t lz4sz = LZ4_compress_fast_continue( m_stream, data, m_lz4Buf + sizeof( lz4sz_t ), (int)len, LZ4Size, 1 );
     memcpy( m_lz4Buf, &lz4sz, sizeof( lz4sz ) );
+    if( m_flight )
+    {
+        if( m_flightDefine != 0 )
+        {
+            m_flight->Define( m_lz4Buf, lz4sz + sizeof( lz4sz_t ) );
+        }
+        else
+        {
+            m_flight->Record( m_lz4Buf, lz4sz + sizeof( lz4sz_t ) );
+        }
+        return true;
+    }
+    if( m_captureFile ) return fwrite( m_lz4Buf, 1, lz4sz + sizeof( lz4sz_t ), m_captureFile ) == lz4sz + sizeof( lz4sz_t );
     return m_sock->Send( m_lz4Buf, lz4sz + sizeof( lz4sz_t ) ) != -1;
 }
 
+// Frames are written directly to the pipeline slots while it's running. Data
+// which was not committed when it's stopped is discarded.
+void Profiler::StartPipeline()
+{
+    m_pipeline = (SendPipeline*)tracy_malloc( sizeof( SendPipeline ) );
+    new(m_pipeline) SendPipeline( m_sock );
+    m_streamBuffer = m_buffer;
+    m_buffer = m_pipeline->Frame();
+    m_compression = m_pipeline->GetCompression();
+    m_bufferOffset = 0;
+    m_bufferStart = 0;
+}
+
+void Profiler::StopPipeline()
+{
+    if( !m_pipeline ) return;
+    m_pipeline->~SendPipeline();
+    tracy_free( m_pipeline );
+    m_pipeline = nullptr;
+    m_buffer = m_streamBuffer;
+    m_bufferOffset = 0;
+    m_bufferStart = 0;
+}
+
+void Profiler::GetPipelineStats( PipelineStats& stats )
+{
+    SendPipeline::GetStats( stats );
+}
+
+bool Profiler::IsPipelineThread( uint64_t tid ) const
+{
+    return m_pipeline && m_pipeline->IsStageThread( tid );
+}
+
+// Items waiting in the main queue, plus memory queue blocks not yet drained.
+size_t Profiler::QueueBacklog() const
+{
+    return s_queue.size_approx() * sizeof( QueueItem ) + m_memQueueBacklog.load( std::memory_order_relaxed );
+}
+
+// Dropping stops when the profiler thread catches up with the producers. The
+// server is then told which time range is incomplete.
+bool Profiler::SendDroppedEvents()
+{
+    if( !m_queueFull.load( std::memory_order_acquire ) )
+    {
+        // Producers only check the backlog when a queue takes another block.
+        QueueBacklogCheck();
+        return true;
+    }
+    if( QueueBacklog() > m_queueLimit / 2 ) return true;
+
+    const auto begin = m_dropBegin.load( std::memory_order_relaxed );
+    m_queueFull.store( false, std::memory_order_relaxed );
+    const auto count = m_droppedEvents.exchange( 0, std::memory_order_relaxed );
+    if( m_protocol < ProtocolDroppedEvents ) return true;
+
+    QueueItem item;
+    MemWrite( &item.hdr.type, QueueType::DroppedEvents );
+    MemWrite( &item.droppedEvents.begin, begin );
+    MemWrite( &item.droppedEvents.end, GetTime() );
+    MemWrite( &item.droppedEvents.count, count );
+    return AppendData( &item, QueueDataSize[(int)QueueType::DroppedEvents] );
+}
+
+// Reports samples which couldn't be sent, taken from the begin time up to now.
+bool Profiler::SendDroppedSamples( int64_t begin, uint32_t count )
+{
+    if( m_protocol < ProtocolDroppedEvents ) return true;
+
+    QueueItem item;
+    MemWrite( &item.hdr.type, QueueType::DroppedEvents );
+    MemWrite( &item.droppedEvents.begin, begin );
+    MemWrite( &item.droppedEvents.end, GetTime() );
+    MemWrite( &item.droppedEvents.count, uint64_t( count ) );
+    return AppendData( &item, QueueDataSize[(int)QueueType::DroppedEvents] );
+}
+
+// Sends the summaries older than the aggregation period, or all of them, so
+// that they don't wait for the owning thread to end another zone. The buffers
+// are scanned once per period.
+bool Profiler::SendZoneAggregates( bool all )
+{
+    const auto now = GetTime();
+    if( !all && now - m_aggregateSendTime < m_aggregatePeriod ) return true;
+    m_aggregateSendTime = now;
+
+    for( auto agg = GetZoneAggregates(); agg; agg = agg->next )
+    {
+        ZoneAggregate::Entry data[ZoneAggregate::Size];
+        int num = 0;
+        agg->Lock();
+        for( auto& e : agg->data )
+        {
+            if( !e.srcloc || ( !all && now - e.begin <= m_aggregatePeriod ) ) continue;
+            data[num++] = e;
+            e.srcloc = nullptr;
+        }
+        agg->Unlock();
+
+        for( int i=0; i<num; i++ )
+        {
+            auto& e = data[i];
+            QueueItem item;
+            MemWrite( &item.hdr.type, QueueType::ZoneAggregate );
+            MemWrite( &item.zoneAggregate.time, e.end );
+            MemWrite( &item.zoneAggregate.srcloc, (uint64_t)e.srcloc );
+            MemWrite( &item.zoneAggregate.total, e.total );
+            MemWrite( &item.zoneAggregate.count, e.count );
+            if( !AppendData( &item, QueueDataSize[(int)QueueType::ZoneAggregate] ) ) return false;
+            if( m_localQueries ) FileQueries( &item );
+        }
+    }
+    return true;
+}
+
+// Sends a sample with a callstack which didn't fit in the callstack cache,
+// along with the callstack. Releases the callstack memory.
+bool Profiler::SendSamplePayload( int64_t time, uint64_t thread, uint64_t ptr )
+{
+    bool ret;
+    if( m_protocol >= ProtocolSamplePayload )
+    {
+        SendCallstackPayload( ptr, ptr, QueueType::CallstackPayload );
+        QueueItem item;
+        MemWrite( &item.hdr.type, QueueType::CallstackSamplePayload );
+        MemWrite( &item.callstackSamplePayload.time, time );
+        MemWrite( &item.callstackSamplePayload.thread, thread );
+        MemWrite( &item.callstackSamplePayload.ptr, ptr );
+        ret = AppendData( &item, QueueDataSize[(int)QueueType::CallstackSamplePayload] );
+        if( m_localQueries ) FileQueries( &item );
+    }
+    else
+    {
+        ret = SendDroppedSamples( time, 1 );
+    }
+    PayloadArena::Free( (void*)ptr );
+    return ret;
+}
+
+// Tells the server how the data stream is compressed after the pipeline has
+// changed the compression setting.
+bool Profiler::SendCompressionMode()
+{
+    if( !m_pipeline ) return true;
+    const auto compression = m_pipeline->GetCompression();
+    if( compression == m_compression ) return true;
+    m_compression = compression;
+    if( m_protocol < ProtocolCompressionMode ) return true;
+
+    QueueItem item;
+    MemWrite( &item.hdr.type, QueueType::CompressionMode );
+    MemWrite( &item.compressionMode.mode, uint8_t( compression & 0xFF ) );
+    MemWrite( &item.compressionMode.level, uint8_t( compression >> 8 ) );
+    return AppendData( &item, QueueDataSize[(int)QueueType::CompressionMode] );
+}
+
+// Data sent between these calls goes to separate frames, which are kept in the
+// flight record for the whole run. Events which are not committed yet are set
+// aside in the meantime.
+void Profiler::FlightDefineBegin()
+{
+    if( !m_flight || m_flightDefine++ != 0 ) return;
+    m_flightStashSize = m_bufferOffset - m_bufferStart;
+    memcpy( m_flightStash, m_buffer + m_bufferStart, m_flightStashSize );
+    m_bufferOffset = m_bufferStart;
+}
+
+void Profiler::FlightDefineEnd()
+{
+    if( !m_flight || --m_flightDefine != 0 ) return;
+    if( m_bufferOffset != m_bufferStart )
+    {
+        m_flightDefine++;
+        CommitData();
+        m_flightDefine--;
+    }
+    AppendDataUnsafe( m_flightStash, m_flightStashSize );
+}
+
+#ifdef __linux__
+void Profiler::DumpFlightRecord() const
+{
+    if( m_flight ) m_flight->Dump();
+}
+#endif
+
 void Profiler::SendString( uint64_t str, const char* ptr, QueueType type )
 {
-    assert( type == QueueType::StringData || type == QueueType::ThreadName || type == QueueType::CustomStringData || type == QueueType::PlotName || type == QueueType::FrameName );
+    assert( type == QueueType::StringData || type == QueueType::ThreadName || type == QueueType::CustomStringData || type == QueueType::PlotName || type == QueueType::FrameName || type == QueueType::InternedStringData );
 
     QueueItem item;
     MemWrite( &item.hdr.type, type );
@@ -1246,15 +2119,152 @@ void Profiler::SendString( uint64_t str, const char* ptr, QueueType type )
     assert( len <= std::numeric_limits<uint16_t>::max() );
     auto l16 = uint16_t( len );
 
-    NeedDataSize( QueueDataSize[(int)type] + sizeof( l16 ) + l16 );
+    // Custom strings are kept in the same frame as the event which uses them.
+    const auto next = type == QueueType::CustomStringData ? QueueDataSize[(int)QueueType::Message] : 0;
+    NeedDataSize( QueueDataSize[(int)type] + sizeof( l16 ) + l16 + next );
 
     AppendDataUnsafe( &item, QueueDataSize[(int)type] );
     AppendDataUnsafe( &l16, sizeof( l16 ) );
     AppendDataUnsafe( ptr, l16 );
 }
 
+// Text of a message, zone text or zone name event. Copied strings are sent
+// with each event, interned ones only the first time they are used on the
+// connection. Older servers get the interned string copy with each event.
+void Profiler::SendCustomString( void* text )
+{
+    const auto ptr = MemRead<uint64_t>( text );
+    if( !StringIntern::IsInterned( ptr ) )
+    {
+        SendString( ptr, (const char*)ptr, QueueType::CustomStringData );
+        PayloadArena::Free( (void*)ptr );
+        return;
+    }
+    const auto str = StringIntern::GetEntry( ptr )->Data();
+    if( m_protocol < ProtocolStringIntern )
+    {
+        MemWrite( text, (uint64_t)str );
+        SendString( (uint64_t)str, str, QueueType::CustomStringData );
+        return;
+    }
+    if( m_internedSent.find( ptr ) ) return;
+    m_internedSent.emplace( ptr, 1 );
+    FlightDefineBegin();
+    SendString( ptr, str, QueueType::InternedStringData );
+    FlightDefineEnd();
+}
+
+// Batches are sent as a single payload, or as separate plot events to servers
+// which don't support them.
+bool Profiler::SendPlotBatch( const QueueItem& item )
+{
+    const auto name = MemRead<uint64_t>( &item.plotDataBatch.name );
+    const auto ptr = (const char*)MemRead<uint64_t>( &item.plotDataBatch.ptr );
+    const auto num = MemRead<uint32_t>( ptr );
+    const auto data = ptr + sizeof( uint32_t );
+    assert( num <= PlotBatchSize );
+
+    bool ret = true;
+    if( m_protocol < ProtocolPlotBatch )
+    {
+        QueueItem plot;
+        MemWrite( &plot.hdr.type, QueueType::PlotData );
+        MemWrite( &plot.plotData.name, name );
+        MemWrite( &plot.plotData.type, PlotDataType::Double );
+        for( uint32_t i=0; i<num && ret; i++ )
+        {
+            auto sample = data + i * sizeof( PlotSample );
+            MemWrite( &plot.plotData.time, MemRead<int64_t>( sample + offsetof( PlotSample, time ) ) );
+            MemWrite( &plot.plotData.data.d, MemRead<double>( sample + offsetof( PlotSample, val ) ) );
+            ret = AppendData( &plot, QueueDataSize[(int)QueueType::PlotData] );
+        }
+    }
+    else
+    {
+        QueueItem payload;
+        MemWrite( &payload.hdr.type, QueueType::PlotBatchPayload );
+        MemWrite( &payload.stringTransfer.ptr, name );
+        const auto l16 = uint16_t( num * sizeof( PlotSample ) );
+        ret = NeedDataSize( QueueDataSize[(int)QueueType::PlotBatchPayload] + sizeof( l16 ) + l16 );
+        AppendDataUnsafe( &payload, QueueDataSize[(int)QueueType::PlotBatchPayload] );
+        AppendDataUnsafe( &l16, sizeof( l16 ) );
+        AppendDataUnsafe( data, l16 );
+    }
+    if( m_localQueries ) FileQuery( ServerQueryPlotName, name );
+    PayloadArena::Free( (void*)ptr );
+    return ret;
+}
+
+// Timestamps read together are sent as a single payload, or as separate
+// events to servers which don't support it.
+bool Profiler::SendGpuTimeBatch( const QueueItem& item )
+{
+    const auto ptr = (const int64_t*)MemRead<uint64_t>( &item.gpuTimeBatch.ptr );
+    const auto queryId = MemRead<uint16_t>( &item.gpuTimeBatch.queryId );
+    const auto num = MemRead<uint16_t>( &item.gpuTimeBatch.count );
+    const auto context = MemRead<uint8_t>( &item.gpuTimeBatch.context );
+    assert( num <= GpuTimeBatchSize );
+
+    bool ret = true;
+    if( m_protocol < ProtocolGpuTimeBatch )
+    {
+        QueueItem gpu;
+        MemWrite( &gpu.hdr.type, QueueType::GpuTime );
+        MemWrite( &gpu.gpuTime.context, context );
+        for( uint16_t i=0; i<num && ret; i++ )
+        {
+            MemWrite( &gpu.gpuTime.gpuTime, MemRead<int64_t>( ptr + i ) );
+            MemWrite( &gpu.gpuTime.queryId, uint16_t( queryId + i ) );
+            ret = AppendData( &gpu, QueueDataSize[(int)QueueType::GpuTime] );
+        }
+    }
+    else
+    {
+        QueueItem payload;
+        MemWrite( &payload.hdr.type, QueueType::GpuTimePayload );
+        MemWrite( &payload.stringTransfer.ptr, ( uint64_t( context ) << 16 ) | queryId );
+        const auto l16 = uint16_t( num * sizeof( int64_t ) );
+        ret = NeedDataSize( QueueDataSize[(int)QueueType::GpuTimePayload] + sizeof( l16 ) + l16 );
+        AppendDataUnsafe( &payload, QueueDataSize[(int)QueueType::GpuTimePayload] );
+        AppendDataUnsafe( &l16, sizeof( l16 ) );
+        AppendDataUnsafe( ptr, l16 );
+    }
+    PayloadArena::Free( (void*)ptr );
+    return ret;
+}
+
+// Lua callstacks are sent like the sampled native callstacks.
+bool Profiler::SendLuaSample( const QueueItem& item )
+{
+    const auto ptr = MemRead<uint64_t>( &item.luaSample.ptr );
+    if( m_protocol < ProtocolSampling )
+    {
+        FreeCallstack( ptr );
+        return true;
+    }
+    if( !IsCallstackCached( ptr ) ) return SendSamplePayload( MemRead<int64_t>( &item.luaSample.time ), MemRead<uint64_t>( &item.luaSample.thread ), ptr );
+
+    QueueItem sample;
+    MemWrite( &sample.hdr.type, QueueType::CallstackSample );
+    MemWrite( &sample.callstackSample.time, MemRead<int64_t>( &item.luaSample.time ) );
+    MemWrite( &sample.callstackSample.thread, MemRead<uint64_t>( &item.luaSample.thread ) );
+    MemWrite( &sample.callstackSample.id, GetCallstackId( ptr ) );
+    FreeCallstack( ptr );
+    if( !AppendData( &sample, QueueDataSize[(int)QueueType::CallstackSample] ) ) return false;
+    if( m_localQueries ) FileQueries( &sample );
+    return true;
+}
+
 void Profiler::SendSourceLocation( uint64_t ptr )
 {
+    if( m_flight )
+    {
+        QueueItem key;
+        MemWrite( &key.hdr.type, QueueType::SourceLocationKey );
+        MemWrite( &key.srclocKey.ptr, ptr );
+        AppendData( &key, QueueDataSize[(int)QueueType::SourceLocationKey] );
+    }
+
     auto srcloc = (const SourceLocationData*)ptr;
     QueueItem item;
     MemWrite( &item.hdr.type, QueueType::SourceLocation );
@@ -1281,28 +2291,33 @@ void Profiler::SendSourceLocationPayload( uint64_t _ptr )
     assert( len > 4 );
     const auto l16 = uint16_t( len - 4 );
 
-    NeedDataSize( QueueDataSize[(int)QueueType::SourceLocationPayload] + sizeof( l16 ) + l16 );
+    // Kept in the same frame as the zone begin event.
+    NeedDataSize( QueueDataSize[(int)QueueType::SourceLocationPayload] + sizeof( l16 ) + l16 + QueueDataSize[(int)QueueType::ZoneBeginAllocSrcLoc] );
 
     AppendDataUnsafe( &item, QueueDataSize[(int)QueueType::SourceLocationPayload] );
     AppendDataUnsafe( &l16, sizeof( l16 ) );
     AppendDataUnsafe( ptr + 4, l16 );
 }
 
-void Profiler::SendCallstackPayload( uint64_t _ptr )
+void Profiler::SendCallstackPayload( uint64_t _ptr, uint64_t key, QueueType type )
 {
+    assert( type == QueueType::CallstackPayload || type == QueueType::CallstackPayloadCached );
+
     auto ptr = (uintptr_t*)_ptr;
 
     QueueItem item;
-    MemWrite( &item.hdr.type, QueueType::CallstackPayload );
-    MemWrite( &item.stringTransfer.ptr, _ptr );
+    MemWrite( &item.hdr.type, type );
+    MemWrite( &item.stringTransfer.ptr, key );
 
-    const auto sz = *ptr++;
+    const auto sz = GetCallstackSize( ptr++ );
     const auto len = sz * sizeof( uint64_t );
     const auto l16 = uint16_t( len );
 
-    NeedDataSize( QueueDataSize[(int)QueueType::CallstackPayload] + sizeof( l16 ) + l16 );
+    // Uncached callstacks are kept in the same frame as the event using them.
+    const auto next = type == QueueType::CallstackPayload ? std::max( QueueDataSize[(int)QueueType::Callstack], QueueDataSize[(int)QueueType::CallstackSamplePayload] ) : 0;
+    NeedDataSize( QueueDataSize[(int)type] + sizeof( l16 ) + l16 + next );
 
-    AppendDataUnsafe( &item, QueueDataSize[(int)QueueType::CallstackPayload] );
+    AppendDataUnsafe( &item, QueueDataSize[(int)type] );
     AppendDataUnsafe( &l16, sizeof( l16 ) );
 
     if( compile_time_condition<sizeof( uintptr_t ) == sizeof( uint64_t )>::value )
@@ -1317,11 +2332,50 @@ void Profiler::SendCallstackPayload( uint64_t _ptr )
             AppendDataUnsafe( &val, sizeof( uint64_t ) );
         }
     }
+
+    if( m_localQueries )
+    {
+        auto frames = (uintptr_t*)_ptr + 1;
+        for( uintptr_t i=0; i<sz; i++ ) FileQuery( ServerQueryCallstackFrame, uint64_t( frames[i] ) );
+    }
+}
+
+uint32_t Profiler::GetCallstackId( uint64_t ptr )
+{
+    auto entry = GetCallstackCacheEntry( ptr );
+    if( entry->connection == m_callstackConnection ) return entry->id;
+
+    // Ids are never reused within a connection, an evicted callstack which is
+    // captured again gets a new one.
+    const auto ret = m_callstackIdNext++;
+    entry->connection = m_callstackConnection;
+    entry->id = ret;
+    FlightDefineBegin();
+    SendCallstackPayload( ptr, ret, QueueType::CallstackPayloadCached );
+    FlightDefineEnd();
+    return ret;
 }
 
 void Profiler::SendCallstackFrame( uint64_t ptr )
 {
 #ifdef TRACY_HAS_CALLSTACK
+    if( s_luaSampleFrames.Contains( ptr ) )
+    {
+        // Lua function frames point to their description, which is never freed.
+        auto frame = (const SourceLocationData*)ptr;
+        SendString( uint64_t( frame->function ), frame->function, QueueType::CustomStringData );
+        SendString( uint64_t( frame->file ), frame->file, QueueType::CustomStringData );
+
+        QueueItem item;
+        MemWrite( &item.hdr.type, QueueType::CallstackFrame );
+        MemWrite( &item.callstackFrame.ptr, ptr );
+        MemWrite( &item.callstackFrame.name, uint64_t( frame->function ) );
+        MemWrite( &item.callstackFrame.file, uint64_t( frame->file ) );
+        MemWrite( &item.callstackFrame.line, frame->line );
+        AppendData( &item, QueueDataSize[(int)QueueType::CallstackFrame] );
+        return;
+    }
+
     auto frame = DecodeCallstackPtr( ptr );
 
     SendString( uint64_t( frame.name ), frame.name, QueueType::CustomStringData );
@@ -1344,6 +2398,29 @@ void Profiler::SendCallstackFrame( uint64_t ptr )
 
 static bool DontExit() { return false; }
 
+void Profiler::SetSourceLocationMode( uint64_t ptr, SourceLocationMode mode )
+{
+    auto srcloc = (const SourceLocationData*)ptr;
+    srcloc->mode.store( mode, std::memory_order_relaxed );
+    if( mode == SourceLocationEnabled ) return;
+
+    // Remembered, so that a new connection starts with all zones enabled.
+    for( auto& v : m_modifiedSrcloc )
+    {
+        if( v == srcloc ) return;
+    }
+    *m_modifiedSrcloc.push_next() = srcloc;
+}
+
+void Profiler::EnableAllSourceLocations()
+{
+    for( auto& v : m_modifiedSrcloc )
+    {
+        v->mode.store( SourceLocationEnabled, std::memory_order_relaxed );
+    }
+    m_modifiedSrcloc.clear();
+}
+
 bool Profiler::HandleServerQuery()
 {
     timeval tv;
@@ -1356,6 +2433,11 @@ bool Profiler::HandleServerQuery()
     uint64_t ptr;
     if( !m_sock->Read( &ptr, sizeof( ptr ), &tv, DontExit ) ) return false;
 
+    return HandleQuery( type, ptr );
+}
+
+bool Profiler::HandleQuery( uint8_t type, uint64_t ptr )
+{
     switch( type )
     {
     case ServerQueryString:
@@ -1385,6 +2467,15 @@ bool Profiler::HandleServerQuery()
     case ServerQueryFrameName:
         SendString( ptr, (const char*)ptr, QueueType::FrameName );
         break;
+    case ServerQueryDisableSourceLocation:
+        SetSourceLocationMode( ptr, SourceLocationDisabled );
+        break;
+    case ServerQueryEnableSourceLocation:
+        SetSourceLocationMode( ptr, SourceLocationEnabled );
+        break;
+    case ServerQueryAggregateSourceLocation:
+        SetSourceLocationMode( ptr, SourceLocationAggregated );
+        break;
     default:
         assert( false );
         break;
@@ -1393,6 +2484,104 @@ bool Profiler::HandleServerQuery()
     return true;
 }
 
+// There's no server which would ask for the data referenced by events written
+// to a capture file. Answer the queries it would make, once for each pointer.
+void Profiler::FileQuery( uint8_t type, uint64_t ptr )
+{
+    if( ptr == 0 ) return;
+    const auto key = ptr ^ ( uint64_t( type ) << 56 );
+    if( m_fileQueries.find( key ) ) return;
+    m_fileQueries.emplace( key, type );
+    FlightDefineBegin();
+    HandleQuery( type, ptr );
+
+    if( type == ServerQuerySourceLocation )
+    {
+        auto srcloc = (const SourceLocationData*)ptr;
+        FileQuery( ServerQueryString, (uint64_t)srcloc->name );
+        FileQuery( ServerQueryString, (uint64_t)srcloc->function );
+        FileQuery( ServerQueryString, (uint64_t)srcloc->file );
+    }
+    FlightDefineEnd();
+}
+
+void Profiler::FileQueries( const QueueItem* item )
+{
+    switch( (QueueType)MemRead<uint8_t>( &item->hdr.idx ) )
+    {
+    case QueueType::ZoneBegin:
+    case QueueType::ZoneBeginCallstack:
+        FileQuery( ServerQueryThreadString, MemRead<uint64_t>( &item->zoneBegin.thread ) );
+        FileQuery( ServerQuerySourceLocation, MemRead<uint64_t>( &item->zoneBegin.srcloc ) );
+        break;
+    case QueueType::ZoneBeginAllocSrcLoc:
+        FileQuery( ServerQueryThreadString, MemRead<uint64_t>( &item->zoneBegin.thread ) );
+        break;
+    case QueueType::ZoneAggregate:
+        FileQuery( ServerQuerySourceLocation, MemRead<uint64_t>( &item->zoneAggregate.srcloc ) );
+        break;
+    case QueueType::FrameMarkMsg:
+    case QueueType::FrameMarkMsgStart:
+    case QueueType::FrameMarkMsgEnd:
+        FileQuery( ServerQueryFrameName, MemRead<uint64_t>( &item->frameMark.name ) );
+        break;
+    case QueueType::LockAnnounce:
+        FileQuery( ServerQuerySourceLocation, MemRead<uint64_t>( &item->lockAnnounce.lckloc ) );
+        break;
+    case QueueType::LockWait:
+    case QueueType::LockSharedWait:
+        FileQuery( ServerQueryThreadString, MemRead<uint64_t>( &item->lockWait.thread ) );
+        break;
+    case QueueType::LockObtain:
+    case QueueType::LockSharedObtain:
+        FileQuery( ServerQueryThreadString, MemRead<uint64_t>( &item->lockObtain.thread ) );
+        break;
+    case QueueType::LockRelease:
+    case QueueType::LockSharedRelease:
+        FileQuery( ServerQueryThreadString, MemRead<uint64_t>( &item->lockRelease.thread ) );
+        break;
+    case QueueType::LockMark:
+        FileQuery( ServerQuerySourceLocation, MemRead<uint64_t>( &item->lockMark.srcloc ) );
+        break;
+    case QueueType::PlotData:
+        FileQuery( ServerQueryPlotName, MemRead<uint64_t>( &item->plotData.name ) );
+        break;
+    case QueueType::Message:
+        FileQuery( ServerQueryThreadString, MemRead<uint64_t>( &item->message.thread ) );
+        break;
+    case QueueType::MessageLiteral:
+        FileQuery( ServerQueryThreadString, MemRead<uint64_t>( &item->message.thread ) );
+        FileQuery( ServerQueryString, MemRead<uint64_t>( &item->message.text ) );
+        break;
+    case QueueType::GpuZoneBegin:
+    case QueueType::GpuZoneBeginCallstack:
+        FileQuery( ServerQuerySourceLocation, MemRead<uint64_t>( &item->gpuZoneBegin.srcloc ) );
+        break;
+    case QueueType::MemAlloc:
+    case QueueType::MemAllocCallstack:
+        FileQuery( ServerQueryThreadString, MemRead<uint64_t>( &item->memAlloc.thread ) );
+        break;
+    case QueueType::MemFree:
+    case QueueType::MemFreeCallstack:
+        FileQuery( ServerQueryThreadString, MemRead<uint64_t>( &item->memFree.thread ) );
+        break;
+    case QueueType::CallstackSample:
+        FileQuery( ServerQueryThreadString, MemRead<uint64_t>( &item->callstackSample.thread ) );
+        break;
+    case QueueType::CallstackSamplePayload:
+        FileQuery( ServerQueryThreadString, MemRead<uint64_t>( &item->callstackSamplePayload.thread ) );
+        break;
+    case QueueType::ContextSwitch:
+        FileQuery( ServerQueryThreadString, MemRead<uint64_t>( &item->contextSwitch.thread ) );
+        break;
+    case QueueType::CrashReport:
+        FileQuery( ServerQueryString, MemRead<uint64_t>( &item->crashReport.text ) );
+        break;
+    default:
+        break;
+    }
+}
+
 void Profiler::CalibrateTimer()
 {
 #ifdef TRACY_HW_TIMER
@@ -1408,7 +2597,18 @@ void Profiler::CalibrateTimer()
     const auto t0 = std::chrono::high_resolution_clock::now();
     const auto r0 = GetTime();
     std::atomic_signal_fence( std::memory_order_acq_rel );
+#ifdef TRACY_ASYNC_CALIBRATION
+    // Don't hold up application exit. A shorter measurement interval is still valid.
+    for( int i=0; i<20; i++ )
+    {
+#  ifndef TRACY_NO_EXIT
+        if( !m_noExit && ShouldExit() ) break;
+#  endif
+        std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+    }
+#else
     std::this_thread::sleep_for( std::chrono::milliseconds( 200 ) );
+#endif
     std::atomic_signal_fence( std::memory_order_acq_rel );
     const auto t1 = std::chrono::high_resolution_clock::now();
     const auto r1 = GetTime();
@@ -1439,11 +2639,18 @@ void Profiler::CalibrateDelay()
     enum { Events = Iterations * 2 };   // start + end
     static_assert( Events * 2 < QueuePrealloc, "Delay calibration loop will allocate memory in queue" );
 
-    moodycamel::ProducerToken ptoken_detail( s_queue );
-    moodycamel::ConcurrentQueue<QueueItem>::ExplicitProducer* ptoken = s_queue.get_explicit_producer( ptoken_detail );
+#ifdef TRACY_ASYNC_CALIBRATION
+    // Application threads may already be producing events into s_queue.
+    moodycamel::ConcurrentQueue<QueueItem> queue( Events * 2 );
+#else
+    auto& queue = s_queue;
+#endif
+
+    moodycamel::ProducerToken ptoken_detail( queue );
+    moodycamel::ConcurrentQueue<QueueItem>::ExplicitProducer* ptoken = queue.get_explicit_producer( ptoken_detail );
     for( int i=0; i<Iterations; i++ )
     {
-        static const tracy::SourceLocationData __tracy_source_location { nullptr, __FUNCTION__,  __FILE__, (uint32_t)__LINE__, 0 };
+        static const tracy::SourceLocationData __tracy_source_location { nullptr, __FUNCTION__,  __FILE__, (uint32_t)__LINE__, 0, {} };
         {
             Magic magic;
             auto& tail = ptoken->get_tail_index();
@@ -1479,13 +2686,13 @@ void Profiler::CalibrateDelay()
     const auto f0 = GetTime();
     for( int i=0; i<Iterations; i++ )
     {
-        static const tracy::SourceLocationData __tracy_source_location { nullptr, __FUNCTION__,  __FILE__, (uint32_t)__LINE__, 0 };
+        static const tracy::SourceLocationData __tracy_source_location { nullptr, __FUNCTION__,  __FILE__, (uint32_t)__LINE__, 0, {} };
         FakeZone ___tracy_scoped_zone( &__tracy_source_location );
     }
     const auto t0 = GetTime();
     for( int i=0; i<Iterations; i++ )
     {
-        static const tracy::SourceLocationData __tracy_source_location { nullptr, __FUNCTION__,  __FILE__, (uint32_t)__LINE__, 0 };
+        static const tracy::SourceLocationData __tracy_source_location { nullptr, __FUNCTION__,  __FILE__, (uint32_t)__LINE__, 0, {} };
         {
             Magic magic;
             auto& tail = ptoken->get_tail_index();
@@ -1535,21 +2742,30 @@ void Profiler::CalibrateDelay()
     m_resolution = mindiff;
 
     enum { Bulk = 1000 };
-    moodycamel::ConsumerToken token( s_queue );
+    moodycamel::ConsumerToken token( queue );
     int left = Events * 2;
     QueueItem item[Bulk];
     while( left != 0 )
     {
-        const auto sz = s_queue.try_dequeue_bulk( token, item, std::min( left, (int)Bulk ) );
+        const auto sz = queue.try_dequeue_bulk( token, item, std::min( left, (int)Bulk ) );
         assert( sz > 0 );
         left -= (int)sz;
     }
+
+#ifndef TRACY_ASYNC_CALIBRATION
+    // The calibration events are not a backlog, even if they crossed the limit.
+    if( m_queueFull.load( std::memory_order_relaxed ) && QueueBacklog() <= m_queueLimit / 2 )
+    {
+        m_queueFull.store( false, std::memory_order_relaxed );
+        m_droppedEvents.store( 0, std::memory_order_relaxed );
+    }
+#endif
 }
 
 void Profiler::SendCallstack( int depth, uint64_t thread, const char* skipBefore )
 {
 #ifdef TRACY_HAS_CALLSTACK
-    auto ptr = Callstack( depth );
+    auto ptr = CallstackUncached( depth );
     auto data = (uintptr_t*)ptr;
     const auto sz = *data++;
     uintptr_t i;
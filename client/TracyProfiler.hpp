@@ -5,11 +5,16 @@
 #include <atomic>
 #include <chrono>
 #include <stdint.h>
+#include <stdio.h>
 #include <string.h>
 
 #include "concurrentqueue.h"
+#include "TracyArena.hpp"
 #include "TracyCallstack.hpp"
+#include "TracyFastMap.hpp"
 #include "TracyFastVector.hpp"
+#include "TracyMemQueue.hpp"
+#include "TracyStringIntern.hpp"
 #include "../common/tracy_lz4.hpp"
 #include "../common/TracyQueue.hpp"
 #include "../common/TracyAlign.hpp"
@@ -36,7 +41,17 @@
 namespace tracy
 {
 
+class FlightRecorder;
+class SendPipeline;
 class Socket;
+struct WelcomeMessage;
+
+enum SourceLocationMode : uint8_t
+{
+    SourceLocationEnabled,
+    SourceLocationDisabled,
+    SourceLocationAggregated,   // only zone count and total time are collected
+};
 
 struct SourceLocationData
 {
@@ -45,6 +60,8 @@ struct SourceLocationData
     const char* file;
     uint32_t line;
     uint32_t color;
+    // Zone collection mode may be changed by the server at run time.
+    mutable std::atomic<uint8_t> mode;
 };
 
 struct ProducerWrapper
@@ -54,6 +71,73 @@ struct ProducerWrapper
 
 extern thread_local ProducerWrapper s_token;
 
+struct MemQueueWrapper
+{
+    ~MemQueueWrapper();
+
+    MemQueue* ptr;
+};
+
+extern thread_local MemQueueWrapper s_memQueue;
+
+// Per-thread summaries of zones with aggregated source locations, direct
+// mapped by the source location address. The profiler thread also sends the
+// summaries which the owning thread doesn't update anymore. The buffers are
+// reused by new threads and never freed.
+// Summaries are kept in sets of a few entries, so that hot source locations
+// which map to the same set don't keep evicting each other.
+struct ZoneAggregate
+{
+    enum { Ways = 4 };
+    enum { SetBits = 4 };
+    enum { Size = Ways << SetBits };
+
+    struct Entry
+    {
+        const SourceLocationData* srcloc;
+        uint32_t count;
+        int64_t begin;
+        int64_t end;
+        int64_t total;
+    };
+
+    tracy_force_inline void Lock() { while( lock.exchange( true, std::memory_order_acquire ) ) {} }
+    tracy_force_inline void Unlock() { lock.store( false, std::memory_order_release ); }
+
+    ZoneAggregate* next;
+    std::atomic<bool> owned;
+    std::atomic<bool> lock;
+    Entry data[Size];
+};
+
+ZoneAggregate* AcquireZoneAggregate();
+ZoneAggregate* GetZoneAggregates();
+
+struct ZoneAggregateWrapper
+{
+    ~ZoneAggregateWrapper();
+    ZoneAggregate* ptr;
+};
+
+extern thread_local ZoneAggregateWrapper s_zoneAggregate;
+
+// Data transfer counters, cumulative over all connections. Times are in
+// nanoseconds. Stall is the time a stage waits for the next one to catch up.
+struct PipelineStats
+{
+    struct Stage
+    {
+        uint64_t frames;
+        uint64_t bytes;
+        uint64_t busy;
+        uint64_t stall;
+    };
+
+    Stage dequeue;
+    Stage compress;
+    Stage send;
+};
+
 class GpuCtx;
 struct GpuCtxWrapper
 {
@@ -165,6 +249,7 @@ public:
 #ifdef TRACY_ON_DEMAND
         if( !s_profiler.IsConnected() ) return;
 #endif
+        if( s_profiler.DropEvents( 1 ) ) return;
         Magic magic;
         auto& token = s_token.ptr;
         auto& tail = token->get_tail_index();
@@ -182,6 +267,7 @@ public:
 #ifdef TRACY_ON_DEMAND
         if( !s_profiler.IsConnected() ) return;
 #endif
+        if( s_profiler.DropEvents( 1 ) ) return;
         Magic magic;
         auto& token = s_token.ptr;
         auto& tail = token->get_tail_index();
@@ -199,6 +285,7 @@ public:
 #ifdef TRACY_ON_DEMAND
         if( !s_profiler.IsConnected() ) return;
 #endif
+        if( s_profiler.DropEvents( 1 ) ) return;
         Magic magic;
         auto& token = s_token.ptr;
         auto& tail = token->get_tail_index();
@@ -216,25 +303,73 @@ public:
 #ifdef TRACY_ON_DEMAND
         if( !s_profiler.IsConnected() ) return;
 #endif
+        if( s_profiler.DropEvents( 1 ) ) return;
         Magic magic;
         auto& token = s_token.ptr;
-        auto ptr = (char*)tracy_malloc( size+1 );
-        memcpy( ptr, txt, size );
-        ptr[size] = '\0';
+        const auto ptr = CopyString( txt, size );
         auto& tail = token->get_tail_index();
         auto item = token->enqueue_begin<tracy::moodycamel::CanAlloc>( magic );
         MemWrite( &item->hdr.type, QueueType::Message );
         MemWrite( &item->message.time, GetTime() );
         MemWrite( &item->message.thread, GetThreadHandle() );
-        MemWrite( &item->message.text, (uint64_t)ptr );
+        MemWrite( &item->message.text, ptr );
         tail.store( magic + 1, std::memory_order_release );
     }
 
+    // Sample times are GetTime() values. Larger batches are split into
+    // payloads of PlotBatchSize samples.
+    static void PlotDataBatch( const char* name, const PlotSample* data, size_t count )
+    {
+#ifdef TRACY_ON_DEMAND
+        if( !s_profiler.IsConnected() ) return;
+#endif
+        while( count > 0 )
+        {
+            const auto num = count < PlotBatchSize ? count : size_t( PlotBatchSize );
+            if( !s_profiler.DropEvents( uint32_t( num ) ) )
+            {
+                Magic magic;
+                auto& token = s_token.ptr;
+                auto ptr = (char*)s_arena.Alloc( sizeof( uint32_t ) + num * sizeof( PlotSample ) );
+                MemWrite( ptr, uint32_t( num ) );
+                memcpy( ptr + sizeof( uint32_t ), data, num * sizeof( PlotSample ) );
+                auto& tail = token->get_tail_index();
+                auto item = token->enqueue_begin<tracy::moodycamel::CanAlloc>( magic );
+                MemWrite( &item->hdr.type, QueueType::PlotDataBatch );
+                MemWrite( &item->plotDataBatch.name, (uint64_t)name );
+                MemWrite( &item->plotDataBatch.ptr, (uint64_t)ptr );
+                tail.store( magic + 1, std::memory_order_release );
+            }
+            data += num;
+            count -= num;
+        }
+    }
+
+    // Zero until the timer is calibrated.
+    static tracy_force_inline int64_t GetTicksPerMicrosecond()
+    {
+        return s_profiler.m_ticksPerMicrosecond.load( std::memory_order_relaxed );
+    }
+
+    // Dynamic strings passed with events. Repeated strings are interned, other
+    // ones are copied to the payload arena and released by the profiler thread
+    // once they are sent.
+    static tracy_force_inline uint64_t CopyString( const char* txt, size_t size )
+    {
+        const auto interned = s_profiler.m_stringIntern.Lookup( txt, size );
+        if( interned != 0 ) return interned;
+        auto ptr = (char*)s_arena.Alloc( size+1 );
+        memcpy( ptr, txt, size );
+        ptr[size] = '\0';
+        return (uint64_t)ptr;
+    }
+
     static tracy_force_inline void Message( const char* txt )
     {
 #ifdef TRACY_ON_DEMAND
         if( !s_profiler.IsConnected() ) return;
 #endif
+        if( s_profiler.DropEvents( 1 ) ) return;
         Magic magic;
         auto& token = s_token.ptr;
         auto& tail = token->get_tail_index();
@@ -251,11 +386,12 @@ public:
 #ifdef TRACY_ON_DEMAND
         if( !s_profiler.IsConnected() ) return;
 #endif
+        if( s_profiler.DropEvents( 1 ) ) return;
         const auto thread = GetThreadHandle();
 
-        s_profiler.m_serialLock.lock();
-        SendMemAlloc( QueueType::MemAlloc, thread, ptr, size );
-        s_profiler.m_serialLock.unlock();
+        auto queue = BeginMemEvent();
+        SendMemAlloc( queue, QueueType::MemAlloc, thread, ptr, size );
+        EndMemEvent( queue );
     }
 
     static tracy_force_inline void MemFree( const void* ptr )
@@ -265,9 +401,9 @@ public:
 #endif
         const auto thread = GetThreadHandle();
 
-        s_profiler.m_serialLock.lock();
-        SendMemFree( QueueType::MemFree, thread, ptr );
-        s_profiler.m_serialLock.unlock();
+        auto queue = BeginMemEvent();
+        SendMemFree( queue, QueueType::MemFree, thread, ptr );
+        EndMemEvent( queue );
     }
 
     static tracy_force_inline void MemAllocCallstack( const void* ptr, size_t size, int depth )
@@ -276,15 +412,16 @@ public:
 #  ifdef TRACY_ON_DEMAND
         if( !s_profiler.IsConnected() ) return;
 #  endif
+        if( s_profiler.DropEvents( 1 ) ) return;
         const auto thread = GetThreadHandle();
 
         rpmalloc_thread_initialize();
         auto callstack = Callstack( depth );
 
-        s_profiler.m_serialLock.lock();
-        SendMemAlloc( QueueType::MemAllocCallstack, thread, ptr, size );
-        SendCallstackMemory( callstack );
-        s_profiler.m_serialLock.unlock();
+        auto queue = BeginMemEvent();
+        SendMemAlloc( queue, QueueType::MemAllocCallstack, thread, ptr, size );
+        SendCallstackMemory( queue, callstack );
+        EndMemEvent( queue );
 #else
         MemAlloc( ptr, size );
 #endif
@@ -301,15 +438,70 @@ public:
         rpmalloc_thread_initialize();
         auto callstack = Callstack( depth );
 
-        s_profiler.m_serialLock.lock();
-        SendMemFree( QueueType::MemFreeCallstack, thread, ptr );
-        SendCallstackMemory( callstack );
-        s_profiler.m_serialLock.unlock();
+        auto queue = BeginMemEvent();
+        SendMemFree( queue, QueueType::MemFreeCallstack, thread, ptr );
+        SendCallstackMemory( queue, callstack );
+        EndMemEvent( queue );
 #else
         MemFree( ptr );
 #endif
     }
 
+    static tracy_force_inline void AggregateZone( const SourceLocationData* srcloc, int64_t begin, int64_t end )
+    {
+        auto agg = s_zoneAggregate.ptr;
+        if( !agg ) agg = s_zoneAggregate.ptr = AcquireZoneAggregate();
+
+        // Finished summaries are enqueued after the lock is released, as the
+        // profiler thread may be waiting for it.
+        ZoneAggregate::Entry flush[2];
+        int num = 0;
+        agg->Lock();
+        // Source locations are often placed at regular, large strides.
+        const auto hash = ( uint64_t( uintptr_t( srcloc ) ) * 0x9E3779B97F4A7C15ull ) >> ( 64 - ZoneAggregate::SetBits );
+        auto set = agg->data + hash * ZoneAggregate::Ways;
+        auto e = set;
+        while( e->srcloc != srcloc && ++e != set + ZoneAggregate::Ways ) {}
+        if( e == set + ZoneAggregate::Ways )
+        {
+            // Evict the oldest summary, unless there is a free entry.
+            e = set;
+            for( int i=0; i<ZoneAggregate::Ways && e->srcloc; i++ )
+            {
+                if( !set[i].srcloc || set[i].begin < e->begin ) e = set + i;
+            }
+            if( e->srcloc ) flush[num++] = *e;
+            e->srcloc = srcloc;
+            e->count = 0;
+            e->begin = begin;
+            e->total = 0;
+        }
+        e->count++;
+        e->end = end;
+        e->total += end - begin;
+        if( end - e->begin > s_profiler.m_aggregatePeriod )
+        {
+            flush[num++] = *e;
+            e->srcloc = nullptr;
+        }
+        agg->Unlock();
+        for( int i=0; i<num; i++ ) FlushZoneAggregate( flush[i] );
+    }
+
+    static tracy_no_inline void FlushZoneAggregate( const ZoneAggregate::Entry& e )
+    {
+        Magic magic;
+        auto& token = s_token.ptr;
+        auto& tail = token->get_tail_index();
+        auto item = token->enqueue_begin<tracy::moodycamel::CanAlloc>( magic );
+        MemWrite( &item->hdr.type, QueueType::ZoneAggregate );
+        MemWrite( &item->zoneAggregate.time, e.end );
+        MemWrite( &item->zoneAggregate.srcloc, (uint64_t)e.srcloc );
+        MemWrite( &item->zoneAggregate.total, e.total );
+        MemWrite( &item->zoneAggregate.count, e.count );
+        tail.store( magic + 1, std::memory_order_release );
+    }
+
     static tracy_force_inline void SendCallstack( int depth, uint64_t thread )
     {
 #ifdef TRACY_HAS_CALLSTACK
@@ -344,19 +536,71 @@ public:
     }
 #endif
 
+    // While the queues are over the memory limit, events which begin something
+    // (zones, allocations) are dropped, along with plots and messages. Events
+    // which end something are always sent, so that the data stays consistent.
+    tracy_force_inline bool DropEvents( uint32_t count )
+    {
+        if( !m_queueFull.load( std::memory_order_relaxed ) ) return false;
+        m_droppedEvents.fetch_add( count, std::memory_order_relaxed );
+        return true;
+    }
+
+    void QueueBacklogCheck()
+    {
+        if( m_queueLimit == 0 || m_queueFull.load( std::memory_order_relaxed ) ) return;
+        if( QueueBacklog() <= m_queueLimit ) return;
+        m_dropBegin.store( GetTime(), std::memory_order_relaxed );
+        m_queueFull.store( true, std::memory_order_release );
+    }
+
+    void MemQueueBacklogAdd( size_t size )
+    {
+        m_memQueueBacklog.fetch_add( size, std::memory_order_relaxed );
+        QueueBacklogCheck();
+    }
+
+    void MemQueueBacklogSub( size_t size ) { m_memQueueBacklog.fetch_sub( size, std::memory_order_relaxed ); }
+
     void RequestShutdown() { m_shutdown.store( true, std::memory_order_relaxed ); m_shutdownManual.store( true, std::memory_order_relaxed ); }
     bool HasShutdownFinished() const { return m_shutdownFinished.load( std::memory_order_relaxed ); }
+#ifdef __linux__
+    void DumpFlightRecord() const;
+#endif
+
+    static void GetPipelineStats( PipelineStats& stats );
+    bool IsPipelineThread( uint64_t tid ) const;
+
+    static MemQueue* AcquireMemQueue();
+    MemQueue* GetSharedMemQueue() { return &m_memQueueShared; }
 
 private:
     enum DequeueStatus { Success, ConnectionLost, QueueEmpty };
 
+    struct MemQueueHead
+    {
+        int64_t time;
+        MemQueue* queue;
+    };
+
     static void LaunchWorker( void* ptr ) { ((Profiler*)ptr)->Worker(); }
     void Worker();
+    void CaptureToFile( WelcomeMessage& welcome, tracy::moodycamel::ConsumerToken& token );
+    void StartPipeline();
+    void StopPipeline();
 
     void ClearQueues( tracy::moodycamel::ConsumerToken& token );
     DequeueStatus Dequeue( tracy::moodycamel::ConsumerToken& token );
     DequeueStatus DequeueSerial();
+    DequeueStatus DequeueSamples();
+    DequeueStatus DequeueContextSwitches();
+    void ClearMemQueues();
+    void ClearSamples();
+    void ClearZoneAggregates();
+    void ClearContextSwitches();
+    void StashContextSwitches();
     bool AppendData( const void* data, size_t len );
+    bool AppendCompact( const QueueItem& item, uint8_t idx );
     bool CommitData();
     bool NeedDataSize( size_t len );
 
@@ -367,34 +611,71 @@ private:
     }
 
     bool SendData( const char* data, size_t len );
+    size_t QueueBacklog() const;
+    bool SendDroppedEvents();
+    bool SendDroppedSamples( int64_t begin, uint32_t count );
+    bool SendZoneAggregates( bool all );
+    bool SendSamplePayload( int64_t time, uint64_t thread, uint64_t ptr );
+    bool SendCompressionMode();
+    void FlightDefineBegin();
+    void FlightDefineEnd();
     void SendString( uint64_t ptr, const char* str, QueueType type );
+    void SendCustomString( void* text );
+    bool SendPlotBatch( const QueueItem& item );
+    bool SendLuaSample( const QueueItem& item );
+    bool SendGpuTimeBatch( const QueueItem& item );
     void SendSourceLocation( uint64_t ptr );
     void SendSourceLocationPayload( uint64_t ptr );
-    void SendCallstackPayload( uint64_t ptr );
+    void SendCallstackPayload( uint64_t ptr, uint64_t key, QueueType type );
+    uint32_t GetCallstackId( uint64_t ptr );
     void SendCallstackFrame( uint64_t ptr );
+    void SetSourceLocationMode( uint64_t ptr, SourceLocationMode mode );
+    void EnableAllSourceLocations();
 
     bool HandleServerQuery();
+    bool HandleQuery( uint8_t type, uint64_t ptr );
+    void FileQuery( uint8_t type, uint64_t ptr );
+    void FileQueries( const QueueItem* item );
 
     void CalibrateTimer();
     void CalibrateDelay();
 
-    static tracy_force_inline void SendCallstackMemory( void* ptr )
+    // Memory events go to a per-thread queue. Threads which have already
+    // released their queue (on exit) use a shared one, guarded by a lock.
+    static tracy_force_inline MemQueue* BeginMemEvent()
+    {
+        auto queue = s_memQueue.ptr;
+        if( queue->IsShared() ) s_profiler.m_memQueueLock.lock();
+        queue->Enter();
+        return queue;
+    }
+
+    static tracy_force_inline void EndMemEvent( MemQueue* queue )
+    {
+        queue->Leave();
+        if( queue->IsShared() ) s_profiler.m_memQueueLock.unlock();
+    }
+
+    static tracy_force_inline void SendCallstackMemory( MemQueue* queue, void* ptr )
     {
 #ifdef TRACY_HAS_CALLSTACK
-        auto item = s_profiler.m_serialQueue.prepare_next();
+        auto item = queue->PrepareNext();
         MemWrite( &item->hdr.type, QueueType::CallstackMemory );
         MemWrite( &item->callstackMemory.ptr, (uint64_t)ptr );
-        s_profiler.m_serialQueue.commit_next();
+        queue->CommitNext();
 #endif
     }
 
-    static tracy_force_inline void SendMemAlloc( QueueType type, const uint64_t thread, const void* ptr, size_t size )
+    static tracy_force_inline void SendMemAlloc( MemQueue* queue, QueueType type, const uint64_t thread, const void* ptr, size_t size )
     {
         assert( type == QueueType::MemAlloc || type == QueueType::MemAllocCallstack );
 
-        auto item = s_profiler.m_serialQueue.prepare_next();
+        const auto time = GetTime();
+        queue->SetTime( time );
+
+        auto item = queue->PrepareNext();
         MemWrite( &item->hdr.type, type );
-        MemWrite( &item->memAlloc.time, GetTime() );
+        MemWrite( &item->memAlloc.time, time );
         MemWrite( &item->memAlloc.thread, thread );
         MemWrite( &item->memAlloc.ptr, (uint64_t)ptr );
         if( compile_time_condition<sizeof( size ) == 4>::value )
@@ -407,19 +688,22 @@ private:
             assert( sizeof( size ) == 8 );
             memcpy( &item->memAlloc.size, &size, 6 );
         }
-        s_profiler.m_serialQueue.commit_next();
+        queue->CommitNext();
     }
 
-    static tracy_force_inline void SendMemFree( QueueType type, const uint64_t thread, const void* ptr )
+    static tracy_force_inline void SendMemFree( MemQueue* queue, QueueType type, const uint64_t thread, const void* ptr )
     {
         assert( type == QueueType::MemFree || type == QueueType::MemFreeCallstack );
 
-        auto item = s_profiler.m_serialQueue.prepare_next();
+        const auto time = GetTime();
+        queue->SetTime( time );
+
+        auto item = queue->PrepareNext();
         MemWrite( &item->hdr.type, type );
-        MemWrite( &item->memFree.time, GetTime() );
+        MemWrite( &item->memFree.time, time );
         MemWrite( &item->memFree.thread, thread );
         MemWrite( &item->memFree.ptr, (uint64_t)ptr );
-        s_profiler.m_serialQueue.commit_next();
+        queue->CommitNext();
     }
 
     double m_timerMul;
@@ -432,6 +716,15 @@ private:
     std::atomic<bool> m_shutdownManual;
     std::atomic<bool> m_shutdownFinished;
     Socket* m_sock;
+    FILE* m_captureFile;
+    FlightRecorder* m_flight;
+    SendPipeline* m_pipeline;
+    char* m_streamBuffer;
+    uint16_t m_compression;
+    int m_flightDefine;
+    char* m_flightStash;
+    int m_flightStashSize;
+    bool m_localQueries;
     bool m_noExit;
 
     LZ4_stream_t* m_stream;
@@ -442,8 +735,34 @@ private:
     QueueItem* m_itemBuf;
     char* m_lz4Buf;
 
-    FastVector<QueueItem> m_serialQueue, m_serialDequeue;
-    TracyMutex m_serialLock;
+    uint8_t m_protocol;
+    int64_t m_refTime;
+    uint64_t m_refThread;
+    FastMap<uint32_t> m_srclocId;
+    uint32_t m_callstackConnection;
+    uint32_t m_callstackIdNext;
+    FastMap<uint8_t> m_internedSent;
+    StringIntern m_stringIntern;
+    FastMap<uint8_t> m_fileQueries;
+    FastVector<const SourceLocationData*> m_modifiedSrcloc;
+    int64_t m_aggregatePeriod;
+    int64_t m_aggregateSendTime;
+    std::atomic<int64_t> m_ticksPerMicrosecond;
+
+    size_t m_queueLimit;
+    std::atomic<size_t> m_memQueueBacklog;
+    std::atomic<bool> m_queueFull;
+    std::atomic<int64_t> m_dropBegin;
+    std::atomic<uint64_t> m_droppedEvents;
+
+    MemQueue m_memQueueShared;
+    TracyMutex m_memQueueLock;
+    FastVector<MemQueueHead> m_memMerge;
+
+#if defined TRACY_CONTEXT_SWITCH && !defined TRACY_ON_DEMAND
+    // Context switches read from the rings while no server is connected.
+    FastVector<QueueItem> m_ctxSwitchStash;
+#endif
 
 #ifdef TRACY_ON_DEMAND
     std::atomic<bool> m_isConnected;
@@ -454,6 +773,25 @@ private:
 #endif
 };
 
+inline MemQueueWrapper::~MemQueueWrapper()
+{
+    if( ptr && !ptr->IsShared() )
+    {
+        ptr->Release();
+        ptr = s_profiler.GetSharedMemQueue();
+    }
+}
+
+inline void QueueBacklogCheck() { s_profiler.QueueBacklogCheck(); }
+inline void MemQueueBacklogAdd( size_t size ) { s_profiler.MemQueueBacklogAdd( size ); }
+inline void MemQueueBacklogSub( size_t size ) { s_profiler.MemQueueBacklogSub( size ); }
+
+// The remaining summaries are sent by the profiler thread.
+inline ZoneAggregateWrapper::~ZoneAggregateWrapper()
+{
+    if( ptr ) ptr->owned.store( false, std::memory_order_release );
+}
+
 };
 
 #endif
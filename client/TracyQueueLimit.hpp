@@ -0,0 +1,20 @@
+#ifndef __TRACYQUEUELIMIT_HPP__
+#define __TRACYQUEUELIMIT_HPP__
+
+#include <stddef.h>
+
+namespace tracy
+{
+
+// The profiler starts dropping events when the backlog of the event queues
+// reaches the TRACY_QUEUE_LIMIT ceiling. The backlog is made of the items in
+// the main queue and of the memory queue blocks which wait for the profiler
+// thread. It is checked whenever a queue takes another block.
+// Defined in TracyProfiler.hpp.
+inline void QueueBacklogCheck();
+inline void MemQueueBacklogAdd( size_t size );
+inline void MemQueueBacklogSub( size_t size );
+
+}
+
+#endif
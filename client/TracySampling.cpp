@@ -0,0 +1,194 @@
+#include "TracySampling.hpp"
+
+#ifdef TRACY_HAS_SAMPLING
+
+#include <errno.h>
+#include <mutex>
+#include <new>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#include "../common/TracyAlloc.hpp"
+#include "../common/TracySystem.hpp"
+#include "TracyProfiler.hpp"
+
+#ifndef TRACY_SAMPLING_HZ
+#  define TRACY_SAMPLING_HZ 1000
+#endif
+
+namespace tracy
+{
+
+static std::atomic<SampleBuffer*> s_sampleBuffers( nullptr );
+static std::once_flag s_samplingOnce;
+static long s_samplingPeriod = 0;
+
+static thread_local SampleBuffer* s_sampleBuffer = nullptr;
+static thread_local bool s_samplingDisabled = false;
+
+static uintptr_t GetSignalPc( void* ctx )
+{
+    auto uc = (ucontext_t*)ctx;
+#if defined __x86_64__
+    return uintptr_t( uc->uc_mcontext.gregs[REG_RIP] );
+#elif defined __i386__
+    return uintptr_t( uc->uc_mcontext.gregs[REG_EIP] );
+#elif defined __aarch64__
+    return uintptr_t( uc->uc_mcontext.pc );
+#elif defined __arm__
+    return uintptr_t( uc->uc_mcontext.arm_pc );
+#else
+    (void)uc;
+    return 0;
+#endif
+}
+
+static void SampleHandler( int, siginfo_t*, void* ctx )
+{
+    auto buf = s_sampleBuffer;
+    if( !buf ) return;
+
+    const auto err = errno;
+    const auto tail = buf->tail.load( std::memory_order_relaxed );
+    if( tail - buf->head.load( std::memory_order_acquire ) == SampleBuffer::Size )
+    {
+        if( buf->dropped.load( std::memory_order_relaxed ) == 0 ) buf->dropBegin.store( Profiler::GetTime(), std::memory_order_relaxed );
+        buf->dropped.fetch_add( 1, std::memory_order_release );
+        errno = err;
+        return;
+    }
+
+    auto& sample = buf->data[tail % SampleBuffer::Size];
+    sample.time = Profiler::GetTime();
+    sample.thread = buf->thread;
+
+    // The first frames belong to the signal handler and the signal trampoline.
+    // Skip them, up to the interrupted instruction.
+    enum { Skip = 8 };
+    uintptr_t trace[SampleDepth + Skip];
+    const auto num = UnwindBacktrace( trace, SampleDepth + Skip );
+    const auto pc = GetSignalPc( ctx );
+    uintptr_t first = 0;
+    while( first < num && trace[first] != pc ) first++;
+    if( first == num ) first = num < 2 ? num : 2;
+
+    const auto cnt = std::min<uintptr_t>( num - first, SampleDepth );
+    memcpy( sample.frames, trace + first, cnt * sizeof( uintptr_t ) );
+    sample.num = cnt;
+
+    buf->tail.store( tail + 1, std::memory_order_release );
+    errno = err;
+}
+
+static void InitSampling()
+{
+    long hz = TRACY_SAMPLING_HZ;
+    const char* env = getenv( "TRACY_SAMPLING_HZ" );
+    if( env ) hz = atol( env );
+    if( hz <= 0 ) return;
+
+    // The first unwind may need to initialize unwinder state, which is not
+    // safe to do in a signal handler.
+    uintptr_t trace[SampleDepth];
+    UnwindBacktrace( trace, SampleDepth );
+
+    struct sigaction act;
+    memset( &act, 0, sizeof( act ) );
+    act.sa_sigaction = SampleHandler;
+    act.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset( &act.sa_mask );
+    if( sigaction( SIGPROF, &act, nullptr ) != 0 ) return;
+
+    s_samplingPeriod = std::max( 1000000000l / hz, 1l );
+}
+
+static SampleBuffer* AcquireSampleBuffer()
+{
+    // Reuse a buffer released by a thread that has exited.
+    auto head = s_sampleBuffers.load( std::memory_order_acquire );
+    for( auto buf = head; buf; buf = buf->next )
+    {
+        bool expected = false;
+        if( buf->owned.compare_exchange_strong( expected, true, std::memory_order_acquire, std::memory_order_relaxed ) ) return buf;
+    }
+
+    auto buf = (SampleBuffer*)tracy_malloc( sizeof( SampleBuffer ) );
+    buf->next = head;
+    new( &buf->owned ) std::atomic<bool>( true );
+    new( &buf->head ) std::atomic<uint32_t>( 0 );
+    new( &buf->tail ) std::atomic<uint32_t>( 0 );
+    new( &buf->dropped ) std::atomic<uint32_t>( 0 );
+    new( &buf->dropBegin ) std::atomic<int64_t>( 0 );
+    while( !s_sampleBuffers.compare_exchange_weak( head, buf, std::memory_order_release, std::memory_order_acquire ) )
+    {
+        buf->next = head;
+    }
+    return buf;
+}
+
+void StartThreadSampling()
+{
+    if( s_sampleBuffer || s_samplingDisabled ) return;
+    std::call_once( s_samplingOnce, InitSampling );
+    if( s_samplingPeriod == 0 ) return;
+
+    rpmalloc_thread_initialize();
+    auto buf = AcquireSampleBuffer();
+    buf->thread = GetThreadHandle();
+
+    // Timer measures CPU time consumed by this thread only and the signal is
+    // delivered to this thread.
+    struct sigevent sev;
+    memset( &sev, 0, sizeof( sev ) );
+    sev.sigev_notify = SIGEV_THREAD_ID;
+    sev.sigev_signo = SIGPROF;
+#ifdef sigev_notify_thread_id
+    sev.sigev_notify_thread_id = syscall( SYS_gettid );
+#else
+    sev._sigev_un._tid = syscall( SYS_gettid );
+#endif
+    if( timer_create( CLOCK_THREAD_CPUTIME_ID, &sev, &buf->timer ) != 0 )
+    {
+        buf->owned.store( false, std::memory_order_release );
+        return;
+    }
+
+    s_sampleBuffer = buf;
+    std::atomic_signal_fence( std::memory_order_seq_cst );
+
+    struct itimerspec its;
+    its.it_interval.tv_sec = s_samplingPeriod / 1000000000l;
+    its.it_interval.tv_nsec = s_samplingPeriod % 1000000000l;
+    its.it_value = its.it_interval;
+    timer_settime( buf->timer, 0, &its, nullptr );
+}
+
+void StopThreadSampling()
+{
+    auto buf = s_sampleBuffer;
+    if( !buf ) return;
+
+    timer_delete( buf->timer );
+    s_sampleBuffer = nullptr;
+    std::atomic_signal_fence( std::memory_order_seq_cst );
+    buf->owned.store( false, std::memory_order_release );
+}
+
+void DisableThreadSampling()
+{
+    s_samplingDisabled = true;
+    StopThreadSampling();
+}
+
+SampleBuffer* GetSampleBuffers()
+{
+    return s_sampleBuffers.load( std::memory_order_acquire );
+}
+
+}
+
+#endif
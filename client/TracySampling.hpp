@@ -0,0 +1,65 @@
+#ifndef __TRACYSAMPLING_HPP__
+#define __TRACYSAMPLING_HPP__
+
+#include "TracyCallstack.hpp"
+
+#if defined TRACY_SAMPLING && defined __linux__ && TRACY_HAS_CALLSTACK >= 2
+#  define TRACY_HAS_SAMPLING
+#endif
+
+#ifdef TRACY_HAS_SAMPLING
+
+#include <atomic>
+#include <stdint.h>
+#include <time.h>
+
+namespace tracy
+{
+
+enum { SampleDepth = 32 };
+
+// Ring buffer of samples. It is written by the SIGPROF handler running on the
+// owning thread and read by the profiler thread, so nothing here may allocate
+// memory or take a lock. If the profiler thread can't keep up (for example,
+// when there's no server connection), new samples are dropped. The dropped
+// samples are counted from the time of the first one.
+struct SampleBuffer
+{
+    enum { Size = 256 };
+
+    struct Sample
+    {
+        int64_t time;
+        uint64_t thread;
+        // The frame count, followed by the frames, forms a callstack.
+        uintptr_t num;
+        uintptr_t frames[SampleDepth];
+    };
+
+    SampleBuffer* next;
+    std::atomic<bool> owned;
+    uint64_t thread;
+    timer_t timer;
+    std::atomic<uint32_t> head;
+    std::atomic<uint32_t> tail;
+    std::atomic<uint32_t> dropped;
+    std::atomic<int64_t> dropBegin;
+    Sample data[Size];
+};
+
+void StartThreadSampling();
+void StopThreadSampling();
+void DisableThreadSampling();
+SampleBuffer* GetSampleBuffers();
+
+struct SamplingThreadInit
+{
+    SamplingThreadInit() { StartThreadSampling(); }
+    ~SamplingThreadInit() { StopThreadSampling(); }
+};
+
+}
+
+#endif
+
+#endif
@@ -16,13 +16,31 @@ class ScopedZone
 {
 public:
     tracy_force_inline ScopedZone( const SourceLocationData* srcloc, bool is_active = true )
+        : ScopedZone( srcloc, is_active, 2 )
+    {
+    }
+
+    // Zones which send other events before their end count them in events,
+    // so that all of them are reported if the zone is dropped.
+    tracy_force_inline ScopedZone( const SourceLocationData* srcloc, bool is_active, uint32_t events )
+        : m_thread( 0 )
+        , m_srcloc( nullptr )
+        , m_begin( 0 )
 #ifdef TRACY_ON_DEMAND
-        : m_active( s_profiler.IsConnected() )
+        , m_mode( s_profiler.IsConnected() ? ZoneMode( srcloc, events ) : uint8_t( SourceLocationDisabled ) )
 #else
-        : m_active( is_active )
+        , m_mode( is_active ? ZoneMode( srcloc, events ) : uint8_t( SourceLocationDisabled ) )
 #endif
     {
-        if( !m_active ) return;
+        if( m_mode != SourceLocationEnabled )
+        {
+            if( m_mode == SourceLocationAggregated )
+            {
+                m_srcloc = srcloc;
+                m_begin = Profiler::GetTime();
+            }
+            return;
+        }
         const auto thread = GetThreadHandle();
         m_thread = thread;
         Magic magic;
@@ -43,13 +61,24 @@ public:
     }
 
     tracy_force_inline ScopedZone( const SourceLocationData* srcloc, int depth, bool is_active = true )
+        : m_thread( 0 )
+        , m_srcloc( nullptr )
+        , m_begin( 0 )
 #ifdef TRACY_ON_DEMAND
-        : m_active( s_profiler.IsConnected() )
+        , m_mode( s_profiler.IsConnected() ? ZoneMode( srcloc, 2 ) : uint8_t( SourceLocationDisabled ) )
 #else
-        : m_active( is_active )
+        , m_mode( is_active ? ZoneMode( srcloc, 2 ) : uint8_t( SourceLocationDisabled ) )
 #endif
     {
-        if( !m_active ) return;
+        if( m_mode != SourceLocationEnabled )
+        {
+            if( m_mode == SourceLocationAggregated )
+            {
+                m_srcloc = srcloc;
+                m_begin = Profiler::GetTime();
+            }
+            return;
+        }
         const auto thread = GetThreadHandle();
         m_thread = thread;
         Magic magic;
@@ -73,7 +102,11 @@ public:
 
     tracy_force_inline ~ScopedZone()
     {
-        if( !m_active ) return;
+        if( m_mode != SourceLocationEnabled )
+        {
+            if( m_mode == SourceLocationAggregated ) Profiler::AggregateZone( m_srcloc, m_begin, Profiler::GetTime() );
+            return;
+        }
         Magic magic;
         auto& token = s_token.ptr;
         auto& tail = token->get_tail_index();
@@ -92,39 +125,48 @@ public:
 
     tracy_force_inline void Text( const char* txt, size_t size )
     {
-        if( !m_active ) return;
+        if( m_mode != SourceLocationEnabled ) return;
         Magic magic;
         auto& token = s_token.ptr;
-        auto ptr = (char*)tracy_malloc( size+1 );
-        memcpy( ptr, txt, size );
-        ptr[size] = '\0';
+        const auto ptr = Profiler::CopyString( txt, size );
         auto& tail = token->get_tail_index();
         auto item = token->enqueue_begin<tracy::moodycamel::CanAlloc>( magic );
         MemWrite( &item->hdr.type, QueueType::ZoneText );
         MemWrite( &item->zoneText.thread, m_thread );
-        MemWrite( &item->zoneText.text, (uint64_t)ptr );
+        MemWrite( &item->zoneText.text, ptr );
         tail.store( magic + 1, std::memory_order_release );
     }
 
     tracy_force_inline void Name( const char* txt, size_t size )
     {
-        if( !m_active ) return;
+        if( m_mode != SourceLocationEnabled ) return;
         Magic magic;
         auto& token = s_token.ptr;
-        auto ptr = (char*)tracy_malloc( size+1 );
-        memcpy( ptr, txt, size );
-        ptr[size] = '\0';
+        const auto ptr = Profiler::CopyString( txt, size );
         auto& tail = token->get_tail_index();
         auto item = token->enqueue_begin<tracy::moodycamel::CanAlloc>( magic );
         MemWrite( &item->hdr.type, QueueType::ZoneName );
         MemWrite( &item->zoneText.thread, m_thread );
-        MemWrite( &item->zoneText.text, (uint64_t)ptr );
+        MemWrite( &item->zoneText.text, ptr );
         tail.store( magic + 1, std::memory_order_release );
     }
 
+    tracy_force_inline bool IsActive() const { return m_mode == SourceLocationEnabled; }
+
 private:
+    // A zone which is not opened doesn't need to be closed, so dropping it
+    // when the queues are full doesn't leave the zone stack inconsistent.
+    static tracy_force_inline uint8_t ZoneMode( const SourceLocationData* srcloc, uint32_t events )
+    {
+        const auto mode = srcloc->mode.load( std::memory_order_relaxed );
+        if( mode == SourceLocationEnabled && s_profiler.DropEvents( events ) ) return SourceLocationDisabled;
+        return mode;
+    }
+
     uint64_t m_thread;
-    const bool m_active;
+    const SourceLocationData* m_srcloc;
+    int64_t m_begin;
+    const uint8_t m_mode;
 };
 
 }
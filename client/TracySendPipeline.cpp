@@ -0,0 +1,330 @@
+#include <chrono>
+#include <new>
+#include <string.h>
+
+#ifdef _WIN32
+#  include <windows.h>
+#endif
+#ifdef __linux__
+#  include <sys/syscall.h>
+#  include <unistd.h>
+#endif
+
+#include "TracyProfiler.hpp"
+#include "TracySendPipeline.hpp"
+#include "TracyThread.hpp"
+#include "../common/TracyAlloc.hpp"
+#include "../common/TracyProtocol.hpp"
+#include "../common/TracySocket.hpp"
+#include "../common/TracySystem.hpp"
+
+#ifdef TRACY_HAS_SAMPLING
+#  include "TracySampling.hpp"
+#endif
+#include "TracyContextSwitch.hpp"
+
+namespace tracy
+{
+
+struct PipelineCounters
+{
+    std::atomic<uint64_t> frames;
+    std::atomic<uint64_t> bytes;
+    std::atomic<uint64_t> busy;
+    std::atomic<uint64_t> stall;
+
+    void Store( PipelineStats::Stage& stage ) const
+    {
+        stage.frames = frames.load( std::memory_order_relaxed );
+        stage.bytes = bytes.load( std::memory_order_relaxed );
+        stage.busy = busy.load( std::memory_order_relaxed );
+        stage.stall = stall.load( std::memory_order_relaxed );
+    }
+};
+
+// Cumulative over all connections.
+static PipelineCounters s_dequeueStats;
+static PipelineCounters s_compressStats;
+static PipelineCounters s_sendStats;
+
+struct CompressionStep
+{
+    CompressionMode mode;
+    uint8_t level;
+};
+
+// Ordered from the fastest to the strongest setting.
+static const CompressionStep s_compressionSteps[] = {
+    { CompressionModeFast, 16 },
+    { CompressionModeFast, 8 },
+    { CompressionModeFast, 4 },
+    { CompressionModeFast, 2 },
+    { CompressionModeFast, 1 },
+    { CompressionModeHigh, 3 },
+    { CompressionModeHigh, 6 },
+    { CompressionModeHigh, 9 },
+};
+enum { CompressionSteps = sizeof( s_compressionSteps ) / sizeof( *s_compressionSteps ) };
+enum { DefaultCompressionStep = 4 };
+
+// Compression is changed by one step when a stage waited for more than a tenth
+// of this time, in ns.
+enum { CompressionWindow = 100 * 1000 * 1000 };
+
+static uint16_t EncodeCompression( int step )
+{
+    return uint16_t( s_compressionSteps[step].mode | ( s_compressionSteps[step].level << 8 ) );
+}
+
+static tracy_force_inline uint64_t PipelineTime()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::high_resolution_clock::now().time_since_epoch() ).count();
+}
+
+static uint64_t PipelineThreadId()
+{
+#if defined _WIN32
+    return GetCurrentThreadId();
+#elif defined __linux__
+    return syscall( SYS_gettid );
+#else
+    return 0;
+#endif
+}
+
+SendPipeline::SendPipeline( Socket* sock )
+    : m_sock( sock )
+    , m_compress( sock->IsCompressed() )
+    , m_stream( LZ4_createStream() )
+    , m_streamHC( nullptr )
+    , m_step( DefaultCompressionStep )
+    , m_compression( EncodeCompression( DefaultCompressionStep ) )
+    , m_windowStart( PipelineTime() )
+    , m_windowProducerStall( s_dequeueStats.stall.load( std::memory_order_relaxed ) )
+    , m_windowCompressorStall( s_compressStats.stall.load( std::memory_order_relaxed ) )
+    , m_produced( 0 )
+    , m_compressed( 0 )
+    , m_sent( 0 )
+    , m_exit( false )
+    , m_lost( false )
+    , m_stall( 0 )
+{
+    for( int i=0; i<Slots; i++ ) m_slot[i] = (char*)tracy_malloc( TargetFrameSize );
+    for( int i=0; i<Outputs; i++ ) m_out[i] = (char*)tracy_malloc( LZ4Size + sizeof( lz4sz_t ) );
+    m_tid[0].store( 0, std::memory_order_relaxed );
+    m_tid[1].store( 0, std::memory_order_relaxed );
+
+    m_compressor = (Thread*)tracy_malloc( sizeof( Thread ) );
+    new(m_compressor) Thread( LaunchCompressor, this );
+    SetThreadName( m_compressor->Handle(), "Tracy Compressor" );
+    m_sender = (Thread*)tracy_malloc( sizeof( Thread ) );
+    new(m_sender) Thread( LaunchSender, this );
+    SetThreadName( m_sender->Handle(), "Tracy Sender" );
+}
+
+// Frames which were already submitted are sent before the threads exit.
+SendPipeline::~SendPipeline()
+{
+    {
+        std::lock_guard<std::mutex> lock( m_lock );
+        m_exit = true;
+    }
+    m_cvProduced.notify_all();
+    m_cvCompressed.notify_all();
+
+    m_sender->~Thread();
+    tracy_free( m_sender );
+    m_compressor->~Thread();
+    tracy_free( m_compressor );
+
+    for( int i=0; i<Outputs; i++ ) tracy_free( m_out[i] );
+    for( int i=0; i<Slots; i++ ) tracy_free( m_slot[i] );
+    LZ4_freeStream( m_stream );
+    if( m_streamHC ) LZ4_freeStreamHC( m_streamHC );
+}
+
+// The compressor uses the previous frame as the stream dictionary, so a slot
+// can only be reused after the frame following it was compressed.
+bool SendPipeline::Submit( size_t len )
+{
+    s_dequeueStats.frames.fetch_add( 1, std::memory_order_relaxed );
+    s_dequeueStats.bytes.fetch_add( len, std::memory_order_relaxed );
+
+    std::unique_lock<std::mutex> lock( m_lock );
+    m_slotSize[m_produced % Slots] = len;
+    m_produced++;
+    m_cvProduced.notify_one();
+    if( m_compressed + Slots < m_produced + 2 )
+    {
+        const auto t0 = PipelineTime();
+        m_cvReleased.wait( lock, [this] { return m_compressed + Slots >= m_produced + 2; } );
+        const auto stall = PipelineTime() - t0;
+        m_stall += stall;
+        s_dequeueStats.stall.fetch_add( stall, std::memory_order_relaxed );
+    }
+    return !m_lost.load( std::memory_order_relaxed );
+}
+
+// Time spent waiting for a free slot is reported as stall, not as busy time.
+void SendPipeline::AccountDequeue( uint64_t ns )
+{
+    uint64_t stall;
+    {
+        std::lock_guard<std::mutex> lock( m_lock );
+        stall = m_stall;
+        m_stall = 0;
+    }
+    s_dequeueStats.busy.fetch_add( ns > stall ? ns - stall : 0, std::memory_order_relaxed );
+}
+
+void SendPipeline::Compressor()
+{
+#ifdef TRACY_HAS_SAMPLING
+    DisableThreadSampling();
+#endif
+#ifdef TRACY_HAS_CONTEXT_SWITCH
+    DisableThreadContextSwitch();
+#endif
+    m_tid[0].store( PipelineThreadId(), std::memory_order_relaxed );
+
+    std::unique_lock<std::mutex> lock( m_lock );
+    for(;;)
+    {
+        m_cvProduced.wait( lock, [this] { return m_compressed != m_produced || m_exit; } );
+        if( m_compressed == m_produced ) break;
+        if( m_compressed - m_sent == Outputs )
+        {
+            const auto t0 = PipelineTime();
+            m_cvReleased.wait( lock, [this] { return m_compressed - m_sent < Outputs; } );
+            s_compressStats.stall.fetch_add( PipelineTime() - t0, std::memory_order_relaxed );
+        }
+        const auto idx = m_compressed;
+        lock.unlock();
+
+        const auto t0 = PipelineTime();
+        auto src = m_slot[idx % Slots];
+        const auto len = m_slotSize[idx % Slots];
+        auto dst = m_out[idx % Outputs];
+        lz4sz_t sz;
+        if( !m_compress )
+        {
+            sz = lz4sz_t( len );
+            memcpy( dst + sizeof( lz4sz_t ), src, len );
+        }
+        else if( s_compressionSteps[m_step].mode == CompressionModeFast )
+        {
+            sz = LZ4_compress_fast_continue( m_stream, src, dst + sizeof( lz4sz_t ), (int)len, LZ4Size, s_compressionSteps[m_step].level );
+        }
+        else
+        {
+            sz = LZ4_compress_HC_continue( m_streamHC, src, dst + sizeof( lz4sz_t ), (int)len, LZ4Size );
+        }
+        memcpy( dst, &sz, sizeof( sz ) );
+        m_outSize[idx % Outputs] = sz + sizeof( lz4sz_t );
+        s_compressStats.frames.fetch_add( 1, std::memory_order_relaxed );
+        s_compressStats.bytes.fetch_add( sz + sizeof( lz4sz_t ), std::memory_order_relaxed );
+        s_compressStats.busy.fetch_add( PipelineTime() - t0, std::memory_order_relaxed );
+        if( m_compress ) AdaptCompression( src, len );
+
+        lock.lock();
+        m_compressed++;
+        m_cvCompressed.notify_one();
+        m_cvReleased.notify_all();
+    }
+}
+
+// Waiting for a free output buffer means that the network is the bottleneck,
+// and waiting for the compressor while all slots are full means it's the
+// compression. The slot which was just compressed stays intact until the next
+// frame is compressed, so it seeds the dictionary when the stream is switched.
+void SendPipeline::AdaptCompression( const char* dict, size_t dictSize )
+{
+    const auto now = PipelineTime();
+    const auto window = now - m_windowStart;
+    if( window < CompressionWindow ) return;
+
+    const auto producerStall = s_dequeueStats.stall.load( std::memory_order_relaxed );
+    const auto compressorStall = s_compressStats.stall.load( std::memory_order_relaxed );
+    const auto waitNetwork = compressorStall - m_windowCompressorStall;
+    const auto waitCompressor = producerStall - m_windowProducerStall;
+    m_windowStart = now;
+    m_windowProducerStall = producerStall;
+    m_windowCompressorStall = compressorStall;
+
+    auto step = m_step;
+    if( waitNetwork * 10 > window )
+    {
+        if( step < CompressionSteps - 1 ) step++;
+    }
+    else if( waitCompressor * 10 > window )
+    {
+        if( step > 0 ) step--;
+    }
+    if( step == m_step ) return;
+
+    const auto& next = s_compressionSteps[step];
+    if( next.mode == CompressionModeHigh )
+    {
+        if( !m_streamHC ) m_streamHC = LZ4_createStreamHC();
+        LZ4_resetStreamHC( m_streamHC, next.level );
+        LZ4_loadDictHC( m_streamHC, dict, int( dictSize ) );
+    }
+    else if( s_compressionSteps[m_step].mode == CompressionModeHigh )
+    {
+        LZ4_resetStream( m_stream );
+        LZ4_loadDict( m_stream, dict, int( dictSize ) );
+    }
+    m_step = step;
+    m_compression.store( EncodeCompression( step ), std::memory_order_relaxed );
+}
+
+// After the connection is lost the remaining frames are discarded, so that
+// the other stages don't block.
+void SendPipeline::Sender()
+{
+#ifdef TRACY_HAS_SAMPLING
+    DisableThreadSampling();
+#endif
+#ifdef TRACY_HAS_CONTEXT_SWITCH
+    DisableThreadContextSwitch();
+#endif
+    m_tid[1].store( PipelineThreadId(), std::memory_order_relaxed );
+
+    std::unique_lock<std::mutex> lock( m_lock );
+    for(;;)
+    {
+        m_cvCompressed.wait( lock, [this] { return m_sent != m_compressed || ( m_exit && m_compressed == m_produced ); } );
+        if( m_sent == m_compressed ) break;
+        const auto idx = m_sent;
+        lock.unlock();
+
+        if( !m_lost.load( std::memory_order_relaxed ) )
+        {
+            const auto t0 = PipelineTime();
+            const auto sz = m_outSize[idx % Outputs];
+            if( m_sock->Send( m_out[idx % Outputs], int( sz ) ) == -1 )
+            {
+                m_lost.store( true, std::memory_order_relaxed );
+            }
+            else
+            {
+                s_sendStats.frames.fetch_add( 1, std::memory_order_relaxed );
+                s_sendStats.bytes.fetch_add( sz, std::memory_order_relaxed );
+            }
+            s_sendStats.busy.fetch_add( PipelineTime() - t0, std::memory_order_relaxed );
+        }
+
+        lock.lock();
+        m_sent++;
+        m_cvReleased.notify_all();
+    }
+}
+
+void SendPipeline::GetStats( PipelineStats& stats )
+{
+    s_dequeueStats.Store( stats.dequeue );
+    s_compressStats.Store( stats.compress );
+    s_sendStats.Store( stats.send );
+}
+
+}
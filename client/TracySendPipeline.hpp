@@ -0,0 +1,90 @@
+#ifndef __TRACYSENDPIPELINE_HPP__
+#define __TRACYSENDPIPELINE_HPP__
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../common/tracy_lz4.hpp"
+#include "../common/tracy_lz4hc.hpp"
+
+namespace tracy
+{
+
+class Socket;
+class Thread;
+struct PipelineStats;
+
+// Compresses and sends the data frames on separate threads, so that the
+// profiler thread only has to drain the event queues. Frames are handed over
+// through a fixed number of slots, and the profiler thread blocks when all of
+// them are in use.
+//
+// Compression is adjusted to the stage which limits the throughput. When the
+// profiler thread waits for the compressor, the LZ4 acceleration factor is
+// raised. When the compressor waits for the network, it moves to LZ4HC.
+class SendPipeline
+{
+public:
+    enum { Slots = 8 };
+    enum { Outputs = 4 };
+
+    SendPipeline( Socket* sock );
+    ~SendPipeline();
+
+    SendPipeline( const SendPipeline& ) = delete;
+    SendPipeline& operator=( const SendPipeline& ) = delete;
+
+    char* Frame() const { return m_slot[m_produced % Slots]; }
+    bool Submit( size_t len );
+    void AccountDequeue( uint64_t ns );
+
+    bool IsStageThread( uint64_t tid ) const { return tid == m_tid[0] || tid == m_tid[1]; }
+    // Mode in the low byte, level in the high byte.
+    uint16_t GetCompression() const { return m_compression.load( std::memory_order_relaxed ); }
+
+    static void GetStats( PipelineStats& stats );
+
+private:
+    static void LaunchCompressor( void* ptr ) { ((SendPipeline*)ptr)->Compressor(); }
+    static void LaunchSender( void* ptr ) { ((SendPipeline*)ptr)->Sender(); }
+    void Compressor();
+    void Sender();
+    void AdaptCompression( const char* dict, size_t dictSize );
+
+    Socket* m_sock;
+    bool m_compress;
+    LZ4_stream_t* m_stream;
+    LZ4_streamHC_t* m_streamHC;
+    int m_step;
+    std::atomic<uint16_t> m_compression;
+    uint64_t m_windowStart;
+    uint64_t m_windowProducerStall;
+    uint64_t m_windowCompressorStall;
+
+    char* m_slot[Slots];
+    size_t m_slotSize[Slots];
+    char* m_out[Outputs];
+    size_t m_outSize[Outputs];
+
+    std::mutex m_lock;
+    std::condition_variable m_cvProduced;
+    std::condition_variable m_cvCompressed;
+    std::condition_variable m_cvReleased;
+    uint64_t m_produced;
+    uint64_t m_compressed;
+    uint64_t m_sent;
+    bool m_exit;
+    std::atomic<bool> m_lost;
+    uint64_t m_stall;
+
+    std::atomic<uint64_t> m_tid[2];
+    Thread* m_compressor;
+    Thread* m_sender;
+};
+
+}
+
+#endif
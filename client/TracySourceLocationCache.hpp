@@ -0,0 +1,210 @@
+#ifndef __TRACYSOURCELOCATIONCACHE_HPP__
+#define __TRACYSOURCELOCATIONCACHE_HPP__
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "../common/TracyAlloc.hpp"
+#include "../common/TracyForceInline.hpp"
+#include "TracyProfiler.hpp"
+
+namespace tracy
+{
+
+// Source locations of zones which are described at run time (Lua zones), so
+// that repeated zones can reference a stable SourceLocationData, like the
+// static ones of ScopedZone do. Entries are keyed by the source file pointer
+// provided by the caller, the line, and the name contents. Chunk sources may
+// be whole scripts, released and their memory reused, so the source is
+// verified by its length and a hash of its contents, rather than compared.
+// The caller computes the hash with HashSource, once per chunk. The table is
+// bounded, and entries live until the program exits, as the server
+// may query them at any time. A second table indexes the entries by their
+// address, so that pointers can be recognized as ones handed out here.
+class SourceLocationCache
+{
+public:
+    enum { Size = 1024 };           // power of two
+    enum { Probes = 8 };
+    enum { AddressSize = Size * 2 };
+
+    SourceLocationCache()
+    {
+        for( int i=0; i<Size; i++ ) m_entries[i].store( nullptr, std::memory_order_relaxed );
+        for( int i=0; i<AddressSize; i++ ) m_addresses[i].store( nullptr, std::memory_order_relaxed );
+    }
+
+    SourceLocationCache( const SourceLocationCache& ) = delete;
+    SourceLocationCache( SourceLocationCache&& ) = delete;
+
+    ~SourceLocationCache()
+    {
+        for( int i=0; i<Size; i++ )
+        {
+            auto e = m_entries[i].load( std::memory_order_relaxed );
+            if( e ) tracy_free( e );
+        }
+    }
+
+    SourceLocationCache& operator=( const SourceLocationCache& ) = delete;
+    SourceLocationCache& operator=( SourceLocationCache&& ) = delete;
+
+    // Name is optional (nullptr). Returns nullptr if the location is not cached.
+    tracy_force_inline const SourceLocationData* Find( const char* file, size_t fsz, uint64_t fileHash, uint32_t line, const char* name, size_t nsz ) const
+    {
+        const auto nameHash = HashName( name, nsz );
+        const auto hash = Hash( file, line, nameHash );
+        for( unsigned int i=0; i<Probes; i++ )
+        {
+            auto e = m_entries[( hash + i ) & ( Size - 1 )].load( std::memory_order_acquire );
+            if( !e ) return nullptr;
+            if( Matches( e, file, fsz, fileHash, line, name, nsz, nameHash ) ) return &e->srcloc;
+        }
+        return nullptr;
+    }
+
+    // Returns nullptr if the table is full.
+    const SourceLocationData* Insert( const char* function, const char* file, size_t fsz, uint64_t fileHash, uint32_t line, const char* name, size_t nsz, uint32_t color )
+    {
+        const auto nameHash = HashName( name, nsz );
+        const auto hash = Hash( file, line, nameHash );
+        const auto sz = strlen( function );
+
+        auto e = (Entry*)tracy_malloc( sizeof( Entry ) + sz + 1 + fsz + 1 + ( name ? nsz + 1 : 0 ) );
+        auto data = (char*)( e + 1 );
+        memcpy( data, function, sz + 1 );
+        memcpy( data + sz + 1, file, fsz );
+        data[sz + 1 + fsz] = '\0';
+        e->srcloc.function = data;
+        e->srcloc.file = data + sz + 1;
+        if( name )
+        {
+            auto dst = data + sz + 1 + fsz + 1;
+            memcpy( dst, name, nsz );
+            dst[nsz] = '\0';
+            e->srcloc.name = dst;
+        }
+        else
+        {
+            e->srcloc.name = nullptr;
+        }
+        e->srcloc.line = line;
+        e->srcloc.color = color;
+        e->srcloc.mode.store( SourceLocationEnabled, std::memory_order_relaxed );
+        e->fileKey = file;
+        e->fileSize = fsz;
+        e->fileHash = fileHash;
+        e->nameSize = nsz;
+        e->nameHash = nameHash;
+
+        for( unsigned int i=0; i<Probes; i++ )
+        {
+            auto& slot = m_entries[( hash + i ) & ( Size - 1 )];
+            Entry* expected = nullptr;
+            if( slot.compare_exchange_strong( expected, e, std::memory_order_acq_rel ) )
+            {
+                AddAddress( e );
+                return &e->srcloc;
+            }
+            if( Matches( expected, file, fsz, fileHash, line, name, nsz, nameHash ) )
+            {
+                tracy_free( e );
+                return &expected->srcloc;
+            }
+        }
+        tracy_free( e );
+        return nullptr;
+    }
+
+    // Tells if ptr was returned by Find or Insert.
+    bool Contains( uint64_t ptr ) const
+    {
+        for( auto i = HashAddress( ptr ); ; i++ )
+        {
+            auto e = m_addresses[i & ( AddressSize - 1 )].load( std::memory_order_acquire );
+            if( !e ) return false;
+            if( uint64_t( &e->srcloc ) == ptr ) return true;
+        }
+    }
+
+    static tracy_force_inline uint64_t HashSource( const char* file, size_t fsz )
+    {
+        uint64_t hash = fsz;
+        uint64_t v;
+        for( ; fsz >= 8; fsz -= 8, file += 8 )
+        {
+            memcpy( &v, file, 8 );
+            hash = ( hash ^ v ) * 0x9E3779B97F4A7C15;
+            hash ^= hash >> 29;
+        }
+        v = 0;
+        memcpy( &v, file, fsz );
+        hash = ( hash ^ v ) * 0xC2B2AE3D27D4EB4F;
+        return hash ^ ( hash >> 29 );
+    }
+
+private:
+    struct Entry
+    {
+        SourceLocationData srcloc;
+        const char* fileKey;
+        size_t fileSize;
+        uint64_t fileHash;
+        size_t nameSize;
+        uint64_t nameHash;
+    };
+
+    // There are at most Size entries, so the address table never fills up.
+    void AddAddress( Entry* e )
+    {
+        for( auto i = HashAddress( uint64_t( &e->srcloc ) ); ; i++ )
+        {
+            Entry* expected = nullptr;
+            if( m_addresses[i & ( AddressSize - 1 )].compare_exchange_strong( expected, e, std::memory_order_acq_rel ) ) return;
+        }
+    }
+
+    static tracy_force_inline uint64_t HashAddress( uint64_t ptr )
+    {
+        return ( ( ptr >> 4 ) * 0x9E3779B97F4A7C15 ) >> 40;
+    }
+
+    static tracy_force_inline uint64_t Hash( const char* file, uint32_t line, uint64_t nameHash )
+    {
+        uint64_t hash = uint64_t( file ) ^ nameHash ^ ( uint64_t( line ) * 0xC2B2AE3D27D4EB4F );
+        return hash ^ ( hash >> 29 );
+    }
+
+    // Names passed to ZoneBeginN may be built at run time, so their pointers
+    // don't identify them.
+    static tracy_force_inline uint64_t HashName( const char* name, size_t nsz )
+    {
+        if( !name ) return 0;
+        uint64_t hash = 0xcbf29ce484222325;
+        for( size_t i=0; i<nsz; i++ )
+        {
+            hash ^= (uint8_t)name[i];
+            hash *= 0x100000001b3;
+        }
+        return hash * 0x9E3779B97F4A7C15;
+    }
+
+    static tracy_force_inline bool Matches( const Entry* e, const char* file, size_t fsz, uint64_t fileHash, uint32_t line, const char* name, size_t nsz, uint64_t nameHash )
+    {
+        if( e->fileKey != file || e->srcloc.line != line || e->fileSize != fsz || e->fileHash != fileHash || e->nameHash != nameHash ) return false;
+        if( !name ) return !e->srcloc.name;
+        return e->srcloc.name && e->nameSize == nsz && memcmp( e->srcloc.name, name, nsz ) == 0;
+    }
+
+    std::atomic<Entry*> m_entries[Size];
+    std::atomic<Entry*> m_addresses[AddressSize];
+};
+
+extern SourceLocationCache& s_luaSourceLocations;
+extern SourceLocationCache& s_luaSampleFrames;
+
+}
+
+#endif
@@ -0,0 +1,121 @@
+#ifndef __TRACYSTRINGINTERN_HPP__
+#define __TRACYSTRINGINTERN_HPP__
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "../common/TracyAlloc.hpp"
+#include "../common/TracyForceInline.hpp"
+
+namespace tracy
+{
+
+// Bounded table of dynamic strings (messages, zone texts and names) which are
+// used repeatedly. A string is copied to the table the second time it is
+// seen, and from then on events reference the copy, which lives until the
+// program exits. Interned strings are passed as entry pointers with the lowest
+// bit set, which the profiler thread sends to the server once per connection.
+class StringIntern
+{
+public:
+    enum { Size = 4096 };           // power of two
+    enum { MaxLength = 256 };       // longer strings are not interned
+    enum { Probes = 8 };
+
+    struct Entry
+    {
+        uint64_t hash;
+        uint32_t size;
+        const char* Data() const { return (const char*)( this + 1 ); }
+    };
+
+    StringIntern()
+        : m_enabled( true )
+    {
+        for( int i=0; i<Size; i++ )
+        {
+            m_entries[i].store( nullptr, std::memory_order_relaxed );
+            m_candidates[i].store( 0, std::memory_order_relaxed );
+        }
+    }
+
+    StringIntern( const StringIntern& ) = delete;
+    StringIntern( StringIntern&& ) = delete;
+
+    ~StringIntern()
+    {
+        for( int i=0; i<Size; i++ )
+        {
+            auto e = m_entries[i].load( std::memory_order_relaxed );
+            if( e ) tracy_free( e );
+        }
+    }
+
+    StringIntern& operator=( const StringIntern& ) = delete;
+    StringIntern& operator=( StringIntern&& ) = delete;
+
+    void Disable() { m_enabled = false; }
+
+    static tracy_force_inline bool IsInterned( uint64_t ptr ) { return ( ptr & 1 ) != 0; }
+    static tracy_force_inline const Entry* GetEntry( uint64_t ptr ) { return (const Entry*)( ptr & ~uint64_t( 1 ) ); }
+
+    // Returns the tagged entry pointer, or 0 if the string is not interned.
+    tracy_force_inline uint64_t Lookup( const char* txt, size_t size )
+    {
+        if( !m_enabled || size > MaxLength ) return 0;
+        const auto hash = Hash( txt, size );
+        for( unsigned int i=0; i<Probes; i++ )
+        {
+            auto& slot = m_entries[( hash + i ) & ( Size - 1 )];
+            auto e = slot.load( std::memory_order_acquire );
+            if( !e ) return Insert( slot, hash, txt, size );
+            if( e->hash == hash && e->size == size && memcmp( e->Data(), txt, size ) == 0 ) return uint64_t( e ) | 1;
+        }
+        return 0;
+    }
+
+private:
+    static tracy_force_inline uint64_t Hash( const char* txt, size_t size )
+    {
+        uint64_t hash = 0xcbf29ce484222325;
+        for( size_t i=0; i<size; i++ )
+        {
+            hash ^= (uint8_t)txt[i];
+            hash *= 0x100000001b3;
+        }
+        return hash | 1;    // 0 marks an empty candidate slot
+    }
+
+    // One-off strings would fill the table, so only strings which were seen
+    // before (as far as the candidate slot remembers) are admitted.
+    uint64_t Insert( std::atomic<Entry*>& slot, uint64_t hash, const char* txt, size_t size )
+    {
+        auto& candidate = m_candidates[hash & ( Size - 1 )];
+        if( candidate.exchange( hash, std::memory_order_relaxed ) != hash ) return 0;
+
+        auto e = (Entry*)tracy_malloc( sizeof( Entry ) + size + 1 );
+        e->hash = hash;
+        e->size = uint32_t( size );
+        auto data = (char*)( e + 1 );
+        memcpy( data, txt, size );
+        data[size] = '\0';
+
+        Entry* expected = nullptr;
+        if( slot.compare_exchange_strong( expected, e, std::memory_order_acq_rel ) ) return uint64_t( e ) | 1;
+        tracy_free( e );
+        if( expected->hash == hash && expected->size == size && memcmp( expected->Data(), txt, size ) == 0 ) return uint64_t( expected ) | 1;
+        return 0;
+    }
+
+    bool m_enabled;
+    std::atomic<Entry*> m_entries[Size];
+    std::atomic<uint64_t> m_candidates[Size];
+};
+
+static_assert( alignof( StringIntern::Entry ) > 1, "Interned string tag bit would be lost" );
+
+}
+
+#endif
@@ -0,0 +1,145 @@
+#include "TracyZoneCounters.hpp"
+
+#ifdef TRACY_HAS_ZONE_COUNTERS
+
+#include <atomic>
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace tracy
+{
+
+// Counters are opened in two groups, as hardware counters may be unavailable
+// (for example in virtual machines), or taken by other users of the PMU.
+enum { ZoneCountersSwNum = 3, ZoneCountersHwNum = 2 };
+
+struct ZoneCountersThread
+{
+    ZoneCountersThread()
+        : init( false )
+    {
+        for( auto& v : sw ) v = -1;
+        for( auto& v : hw ) v = -1;
+    }
+
+    ~ZoneCountersThread()
+    {
+        for( auto& v : sw ) if( v >= 0 ) close( v );
+        for( auto& v : hw ) if( v >= 0 ) close( v );
+    }
+
+    int sw[ZoneCountersSwNum];
+    int hw[ZoneCountersHwNum];
+    bool init;
+};
+
+static thread_local ZoneCountersThread s_zoneCounters;
+static std::atomic<bool> s_zoneCountersSw( true );
+static std::atomic<bool> s_zoneCountersHw( true );
+
+static int OpenZoneCounter( uint32_t type, uint64_t config, int group, bool excludeKernel )
+{
+    struct perf_event_attr attr;
+    memset( &attr, 0, sizeof( attr ) );
+    attr.size = sizeof( attr );
+    attr.type = type;
+    attr.config = config;
+    attr.read_format = PERF_FORMAT_GROUP;
+    attr.exclude_kernel = excludeKernel;
+    attr.exclude_hv = 1;
+    // A hardware group that can't be scheduled goes into error state and
+    // reads end of file, instead of returning stale values.
+    attr.pinned = group < 0 && type == PERF_TYPE_HARDWARE;
+    // Members added to an enabled group would only start counting after the
+    // thread is scheduled again.
+    attr.disabled = group < 0;
+    return (int)syscall( SYS_perf_event_open, &attr, 0, -1, group, PERF_FLAG_FD_CLOEXEC );
+}
+
+static bool OpenZoneCounterGroup( int* fd, uint32_t type, const uint64_t* config, int num )
+{
+    // Kernel side of the counters is not permitted if perf_event_paranoid is
+    // above 1. Context switches are then not counted.
+    for( int excludeKernel=0; excludeKernel<2; excludeKernel++ )
+    {
+        int i;
+        for( i=0; i<num; i++ )
+        {
+            fd[i] = OpenZoneCounter( type, config[i], i == 0 ? -1 : fd[0], excludeKernel );
+            if( fd[i] < 0 ) break;
+        }
+        if( i == num )
+        {
+            ioctl( fd[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP );
+            return true;
+        }
+        const auto err = errno;
+        while( i > 0 ) close( fd[--i] );
+        fd[0] = -1;
+        errno = err;
+        if( err != EACCES ) break;
+    }
+    return false;
+}
+
+static void InitZoneCounters( ZoneCountersThread& tc )
+{
+    tc.init = true;
+    if( !s_zoneCountersSw.load( std::memory_order_relaxed ) ) return;
+    static const uint64_t sw[] = { PERF_COUNT_SW_TASK_CLOCK, PERF_COUNT_SW_PAGE_FAULTS, PERF_COUNT_SW_CONTEXT_SWITCHES };
+    if( !OpenZoneCounterGroup( tc.sw, PERF_TYPE_SOFTWARE, sw, ZoneCountersSwNum ) )
+    {
+        if( errno != EMFILE && errno != ENFILE ) s_zoneCountersSw.store( false, std::memory_order_relaxed );
+        return;
+    }
+
+    if( !s_zoneCountersHw.load( std::memory_order_relaxed ) ) return;
+    static const uint64_t hw[] = { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS };
+    if( !OpenZoneCounterGroup( tc.hw, PERF_TYPE_HARDWARE, hw, ZoneCountersHwNum ) )
+    {
+        if( errno != EMFILE && errno != ENFILE ) s_zoneCountersHw.store( false, std::memory_order_relaxed );
+    }
+}
+
+uint8_t StartZoneCounters()
+{
+    auto& tc = s_zoneCounters;
+    if( !tc.init ) InitZoneCounters( tc );
+    if( tc.sw[0] < 0 ) return ZoneCountersNone;
+    return tc.hw[0] < 0 ? ZoneCountersSoftware : ZoneCountersHardware;
+}
+
+uint8_t ReadZoneCounters( ZoneCounterValues& val )
+{
+    auto& tc = s_zoneCounters;
+    if( tc.sw[0] < 0 ) return ZoneCountersNone;
+
+    struct
+    {
+        uint64_t num;
+        uint64_t values[ZoneCountersSwNum];
+    } sw;
+    if( read( tc.sw[0], &sw, sizeof( sw ) ) != sizeof( sw ) ) return ZoneCountersNone;
+    val.taskClock = sw.values[0];
+    val.pageFaults = sw.values[1];
+    val.contextSwitches = sw.values[2];
+
+    if( tc.hw[0] < 0 ) return ZoneCountersSoftware;
+    struct
+    {
+        uint64_t num;
+        uint64_t values[ZoneCountersHwNum];
+    } hw;
+    if( read( tc.hw[0], &hw, sizeof( hw ) ) != sizeof( hw ) ) return ZoneCountersSoftware;
+    val.cycles = hw.values[0];
+    val.instructions = hw.values[1];
+    return ZoneCountersHardware;
+}
+
+}
+
+#endif
@@ -0,0 +1,99 @@
+#ifndef __TRACYZONECOUNTERS_HPP__
+#define __TRACYZONECOUNTERS_HPP__
+
+#if defined __linux__
+#  define TRACY_HAS_ZONE_COUNTERS
+#endif
+
+#ifdef TRACY_HAS_ZONE_COUNTERS
+
+#include <algorithm>
+#include <stdint.h>
+
+#include "../common/TracySystem.hpp"
+#include "TracyProfiler.hpp"
+#include "TracyScoped.hpp"
+
+namespace tracy
+{
+
+// Also the number of events sent with a zone, besides its begin and end.
+enum ZoneCountersMode : uint8_t
+{
+    ZoneCountersNone,
+    ZoneCountersSoftware,
+    ZoneCountersHardware
+};
+
+struct ZoneCounterValues
+{
+    uint64_t taskClock;
+    uint64_t pageFaults;
+    uint64_t contextSwitches;
+    uint64_t cycles;
+    uint64_t instructions;
+};
+
+// Opens the performance counters of the calling thread on first use. Returns
+// which of them are available.
+uint8_t StartZoneCounters();
+// Returns which of the values are valid.
+uint8_t ReadZoneCounters( ZoneCounterValues& val );
+
+// Zone which also reports the counter deltas between its begin and end. Each
+// read is a system call, so this is meant for zones longer than a few
+// microseconds.
+class ScopedZoneCounters
+{
+public:
+    tracy_force_inline ScopedZoneCounters( const SourceLocationData* srcloc, bool is_active = true )
+        : m_available( StartZoneCounters() )
+        , m_zone( srcloc, is_active, uint32_t( 2 + m_available ) )
+        , m_mode( m_available != ZoneCountersNone && m_zone.IsActive() ? ReadZoneCounters( m_begin ) : uint8_t( ZoneCountersNone ) )
+    {
+    }
+
+    tracy_force_inline ~ScopedZoneCounters()
+    {
+        if( m_mode == ZoneCountersNone ) return;
+        ZoneCounterValues end;
+        const auto mode = std::min( m_mode, ReadZoneCounters( end ) );
+        if( mode == ZoneCountersNone ) return;
+
+        const auto thread = GetThreadHandle();
+        Magic magic;
+        auto& token = s_token.ptr;
+        auto& tail = token->get_tail_index();
+        auto item = token->enqueue_begin<tracy::moodycamel::CanAlloc>( magic );
+        MemWrite( &item->hdr.type, QueueType::ZoneCounters );
+        MemWrite( &item->zoneCounters.thread, thread );
+        MemWrite( &item->zoneCounters.taskClock, end.taskClock - m_begin.taskClock );
+        MemWrite( &item->zoneCounters.pageFaults, uint32_t( end.pageFaults - m_begin.pageFaults ) );
+        MemWrite( &item->zoneCounters.contextSwitches, uint32_t( end.contextSwitches - m_begin.contextSwitches ) );
+        tail.store( magic + 1, std::memory_order_release );
+
+        if( mode != ZoneCountersHardware ) return;
+        item = token->enqueue_begin<tracy::moodycamel::CanAlloc>( magic );
+        MemWrite( &item->hdr.type, QueueType::ZoneCountersHw );
+        MemWrite( &item->zoneCountersHw.thread, thread );
+        MemWrite( &item->zoneCountersHw.cycles, end.cycles - m_begin.cycles );
+        MemWrite( &item->zoneCountersHw.instructions, end.instructions - m_begin.instructions );
+        tail.store( magic + 1, std::memory_order_release );
+    }
+
+    tracy_force_inline void Text( const char* txt, size_t size ) { m_zone.Text( txt, size ); }
+    tracy_force_inline void Name( const char* txt, size_t size ) { m_zone.Name( txt, size ); }
+
+private:
+    // Opening the counters is not included in the zone.
+    const uint8_t m_available;
+    ScopedZone m_zone;
+    ZoneCounterValues m_begin;
+    const uint8_t m_mode;
+};
+
+}
+
+#endif
+
+#endif
@@ -32,6 +32,7 @@
 
 #include "../common/TracyAlloc.hpp"
 #include "../common/TracyForceInline.hpp"
+#include "TracyQueueLimit.hpp"
 
 #if defined(__GNUC__)
 // Disable -Wconversion warnings (spuriously triggered when Traits::size_t and
@@ -3075,16 +3076,16 @@ private:
 	Block* requisition_block()
 	{
 		auto block = try_get_block_from_initial_pool();
-		if (block != nullptr) {
-			return block;
+		if (block == nullptr) {
+			block = try_get_block_from_free_list();
+		}
+		if (block == nullptr) {
+			block = create<Block>();
 		}
-		
-		block = try_get_block_from_free_list();
 		if (block != nullptr) {
-			return block;
+			QueueBacklogCheck();
 		}
-		
-		return create<Block>();
+		return block;
 	}
 	
 
@@ -5,6 +5,7 @@
 #include <stdint.h>
 
 #include "../common/tracy_lz4.hpp"
+#include "../common/TracyForceInline.hpp"
 
 namespace tracy
 {
@@ -16,6 +17,37 @@ enum { LZ4Size = LZ4_COMPRESSBOUND( TargetFrameSize ) };
 static_assert( LZ4Size <= std::numeric_limits<lz4sz_t>::max(), "LZ4Size greater than lz4sz_t" );
 static_assert( TargetFrameSize * 2 >= 64 * 1024, "Not enough space for LZ4 stream buffer" );
 
+// Server announces the highest protocol revision it understands in the
+// handshake message. Client replies with the revision it will use in the
+// welcome message.
+enum ProtocolRevision : uint8_t
+{
+    ProtocolBase = 1,
+    ProtocolCompact = 2,        // thread context, delta-encoded zone timestamps, source location ids
+    ProtocolCallstackId = 3,    // cached callstacks are referenced by 32-bit ids
+    ProtocolSampling = 4,       // sampled callstacks
+    ProtocolSourceLocationToggle = 5,   // server may disable zone source locations
+    ProtocolZoneAggregate = 6,  // server may switch zone source locations to summaries
+    ProtocolFlightRecorder = 7, // keyed source locations in flight recorder dumps
+    ProtocolDroppedEvents = 8,  // time ranges in which the client dropped events
+    ProtocolCompressionMode = 9,    // client reports changes of the compression setting
+    ProtocolStringIntern = 10,  // repeated custom strings are sent once per connection
+    ProtocolPlotBatch = 11,     // plot values submitted together are sent in one payload
+    ProtocolGpuTimeBatch = 12,  // gpu timestamps read together are sent in one payload
+    ProtocolLockContention = 13,    // lock announce carries the contention-only flag
+    ProtocolContextSwitch = 14, // thread context switches
+    ProtocolZoneCounters = 15,  // per-zone performance counter deltas
+    ProtocolSamplePayload = 16, // sampled callstacks missing the callstack cache are sent in full
+};
+
+enum { ProtocolVersion = ProtocolSamplePayload };
+
+enum CompressionMode : uint8_t
+{
+    CompressionModeFast,        // LZ4, level is the acceleration factor
+    CompressionModeHigh,        // LZ4HC, level is the compression level
+};
+
 enum ServerQuery : uint8_t
 {
     ServerQueryTerminate,
@@ -25,15 +57,38 @@ enum ServerQuery : uint8_t
     ServerQueryPlotName,
     ServerQueryCallstackFrame,
     ServerQueryFrameName,
+    ServerQueryDisableSourceLocation,
+    ServerQueryEnableSourceLocation,
+    ServerQueryAggregateSourceLocation,
 };
 
+// Direct-to-file capture starts with this header, followed by the welcome
+// message and the data stream, exactly as it would be sent to the server.
+enum { RawCaptureHeaderSize = 8 };
+static const char RawCaptureHeader[RawCaptureHeaderSize] = { 't', 'r', 'a', 'c', 'y', 'r', 'a', 'w' };
+// Flight recorder dumps have the same layout. All definitions are placed
+// before the events, which start at an arbitrary point of the stream.
+static const char FlightCaptureHeader[RawCaptureHeaderSize] = { 't', 'r', 'a', 'c', 'y', 'f', 'l', 't' };
+// Streams recorded by the server also have the same layout, but the frames are
+// stored after decompression.
+static const char RecordCaptureHeader[RawCaptureHeaderSize] = { 't', 'r', 'a', 'c', 'y', 'r', 'e', 'c' };
+
 enum { WelcomeMessageProgramNameSize = 64 };
 enum { WelcomeMessageHostInfoSize = 1024 };
 
 #pragma pack( 1 )
 
+struct HandshakeMessage
+{
+    uint8_t protocol;
+};
+
+enum { HandshakeMessageSize = sizeof( HandshakeMessage ) };
+
+
 struct WelcomeMessage
 {
+    uint8_t protocol;
     double timerMul;
     int64_t initBegin;
     int64_t initEnd;
@@ -57,6 +112,45 @@ enum { OnDemandPayloadMessageSize = sizeof( OnDemandPayloadMessage ) };
 
 #pragma pack()
 
+
+// Variable length integer encoding used by the compact protocol.
+enum { VarintMaxSize = 10 };
+
+static tracy_force_inline char* WriteVarint( char* ptr, uint64_t val )
+{
+    while( val >= 0x80 )
+    {
+        *ptr++ = char( uint8_t( val ) | 0x80 );
+        val >>= 7;
+    }
+    *ptr++ = char( val );
+    return ptr;
+}
+
+static tracy_force_inline char* WriteVarintSigned( char* ptr, int64_t val )
+{
+    return WriteVarint( ptr, ( uint64_t( val ) << 1 ) ^ uint64_t( val >> 63 ) );
+}
+
+static tracy_force_inline uint64_t ReadVarint( const char*& ptr )
+{
+    uint64_t val = 0;
+    int shift = 0;
+    for(;;)
+    {
+        const auto b = uint8_t( *ptr++ );
+        val |= uint64_t( b & 0x7F ) << shift;
+        if( b < 0x80 ) return val;
+        shift += 7;
+    }
+}
+
+static tracy_force_inline int64_t ReadVarintSigned( const char*& ptr )
+{
+    const auto val = ReadVarint( ptr );
+    return int64_t( val >> 1 ) ^ -int64_t( val & 1 );
+}
+
 }
 
 #endif
@@ -52,6 +52,32 @@ enum class QueueType : uint8_t
     SourceLocationPayload,
     CallstackPayload,
     FrameName,
+    // Types added by later protocol revisions. The ids are sent over the
+    // wire, so new types must be appended at the end of this list, never
+    // inserted, or peers using older revisions can't be decoded.
+    ThreadContext,
+    ZoneBeginCompact,
+    ZoneBeginCallstackCompact,
+    ZoneEndCompact,
+    CallstackCached,
+    CallstackMemoryCached,
+    CallstackPayloadCached,
+    CallstackSample,
+    ZoneAggregate,
+    SourceLocationKey,
+    DroppedEvents,
+    CompressionMode,
+    InternedStringData,
+    PlotBatchPayload,
+    GpuTimePayload,
+    ContextSwitch,
+    ZoneCounters,
+    ZoneCountersHw,
+    CallstackSamplePayload,
+    // Client-only types, converted by the profiler thread and never sent.
+    PlotDataBatch,
+    LuaSample,
+    GpuTimeBatch,
     NUM_TYPES
 };
 
@@ -111,6 +137,7 @@ struct QueueLockAnnounce
     uint32_t id;
     uint64_t lckloc;    // ptr
     LockType type;
+    uint8_t contention; // only contended acquisitions are reported
 };
 
 struct QueueLockWait
@@ -162,6 +189,24 @@ struct QueuePlotData
     } data;
 };
 
+// Plot values submitted in one call. The payload starts with the 32-bit
+// sample count.
+struct QueuePlotDataBatch
+{
+    uint64_t name;      // ptr
+    uint64_t ptr;
+};
+
+// Element of a plot batch payload. Time is in the client timer ticks.
+struct PlotSample
+{
+    int64_t time;
+    double val;
+};
+
+// Maximum number of samples in a single payload.
+enum { PlotBatchSize = 4095 };
+
 struct QueueMessage
 {
     int64_t time;
@@ -202,6 +247,19 @@ struct QueueGpuTime
     uint8_t context;
 };
 
+// Timestamps of consecutive queries, read together. Sent as a payload keyed by
+// the context and the first query id (context << 16 | queryId).
+struct QueueGpuTimeBatch
+{
+    uint64_t ptr;
+    uint16_t queryId;
+    uint16_t count;
+    uint8_t context;
+};
+
+// Maximum number of timestamps in a single payload.
+enum { GpuTimeBatchSize = 8191 };
+
 struct QueueMemAlloc
 {
     int64_t time;
@@ -228,6 +286,115 @@ struct QueueCallstack
     uint64_t thread;
 };
 
+// Cached callstacks are sent with ProtocolCallstackId. The payload is sent
+// only once, as CallstackPayloadCached, with the id in the pointer field.
+struct QueueCallstackMemoryCached
+{
+    uint32_t id;
+};
+
+struct QueueCallstackCached
+{
+    uint32_t id;
+    uint64_t thread;
+};
+
+// Sent with ProtocolSampling. Sampled callstacks are always cached.
+struct QueueCallstackSample
+{
+    int64_t time;
+    uint64_t thread;
+    uint32_t id;
+};
+
+// Sample with a callstack which didn't fit in the callstack cache. The
+// callstack is sent before it, as CallstackPayload.
+struct QueueCallstackSamplePayload
+{
+    int64_t time;
+    uint64_t thread;
+    uint64_t ptr;
+};
+
+// Lua callstack sample, taken by the interpreter hook. Sent as
+// CallstackSample.
+struct QueueLuaSample
+{
+    int64_t time;
+    uint64_t thread;
+    uint64_t ptr;
+};
+
+// Sent with ProtocolZoneAggregate. Summary of zones collected since the
+// previous summary of the same source location, in one thread.
+struct QueueZoneAggregate
+{
+    int64_t time;
+    uint64_t srcloc;    // ptr
+    int64_t total;
+    uint32_t count;
+};
+
+// Sent with ProtocolFlightRecorder, only in flight recorder dumps. Source
+// location definitions are not preceded by a query, so the next source
+// location item is identified by this key.
+struct QueueSourceLocationKey
+{
+    uint64_t ptr;
+};
+
+// Sent with ProtocolDroppedEvents. Events were dropped in this time range,
+// because the client queues reached their memory limit.
+struct QueueDroppedEvents
+{
+    int64_t begin;
+    int64_t end;
+    uint64_t count;
+};
+
+// Sent with ProtocolCompressionMode, when the client changes the compression
+// of the data stream.
+struct QueueCompressionMode
+{
+    uint8_t mode;
+    uint8_t level;
+};
+
+enum class ContextSwitchState : uint8_t
+{
+    Running,            // switched in
+    Preempted,          // switched out, still runnable
+    Waiting,            // switched out, blocked
+    Unknown             // records were lost, state until the next switch is not known
+};
+
+// Sent with ProtocolContextSwitch. The thread was switched in or out of the
+// cpu at the given time.
+struct QueueContextSwitch
+{
+    int64_t time;
+    uint64_t thread;
+    uint32_t cpu;
+    ContextSwitchState state;
+};
+
+// Sent with ProtocolZoneCounters, before the end of the zone. Counter deltas
+// of the thread in the zone.
+struct QueueZoneCounters
+{
+    uint64_t thread;
+    uint64_t taskClock;     // ns
+    uint32_t pageFaults;
+    uint32_t contextSwitches;
+};
+
+struct QueueZoneCountersHw
+{
+    uint64_t thread;
+    uint64_t cycles;
+    uint64_t instructions;
+};
+
 struct QueueCallstackFrame
 {
     uint64_t ptr;
@@ -243,6 +410,21 @@ struct QueueCrashReport
     uint64_t text;      // ptr
 };
 
+struct QueueThreadContext
+{
+    uint64_t thread;
+};
+
+// Compact zone events are never stored in the queues. They are produced
+// during serialization, if ProtocolCompact was negotiated, and have variable
+// length payload following the header:
+//   ZoneBegin(Callstack)Compact: time delta (signed varint), cpu + 1 (varint),
+//     source location id + 1 (varint). Id value of 0 is followed by 64-bit
+//     source location pointer, which is assigned the next free id.
+//   ZoneEndCompact: time delta (signed varint), cpu + 1 (varint).
+// Time delta is relative to the previous compact event. Thread is set by the
+// preceding ThreadContext event.
+
 struct QueueHeader
 {
     union
@@ -269,17 +451,32 @@ struct QueueItem
         QueueLockRelease lockRelease;
         QueueLockMark lockMark;
         QueuePlotData plotData;
+        QueuePlotDataBatch plotDataBatch;
         QueueMessage message;
         QueueGpuNewContext gpuNewContext;
         QueueGpuZoneBegin gpuZoneBegin;
         QueueGpuZoneEnd gpuZoneEnd;
         QueueGpuTime gpuTime;
+        QueueGpuTimeBatch gpuTimeBatch;
         QueueMemAlloc memAlloc;
         QueueMemFree memFree;
         QueueCallstackMemory callstackMemory;
         QueueCallstack callstack;
+        QueueCallstackMemoryCached callstackMemoryCached;
+        QueueCallstackCached callstackCached;
+        QueueCallstackSample callstackSample;
+        QueueCallstackSamplePayload callstackSamplePayload;
+        QueueLuaSample luaSample;
+        QueueZoneAggregate zoneAggregate;
+        QueueSourceLocationKey srclocKey;
+        QueueDroppedEvents droppedEvents;
+        QueueCompressionMode compressionMode;
+        QueueContextSwitch contextSwitch;
+        QueueZoneCounters zoneCounters;
+        QueueZoneCountersHw zoneCountersHw;
         QueueCallstackFrame callstackFrame;
         QueueCrashReport crashReport;
+        QueueThreadContext threadCtx;
     };
 };
 
@@ -294,7 +491,6 @@ static const size_t QueueDataSize[] = {
     sizeof( QueueHeader ) + sizeof( QueueZoneBegin ),       // allocated source location
     sizeof( QueueHeader ) + sizeof( QueueCallstackMemory ),
     sizeof( QueueHeader ) + sizeof( QueueCallstack ),
-    // above items must be first
     sizeof( QueueHeader ),                                  // terminate
     sizeof( QueueHeader ),                                  // keep alive
     sizeof( QueueHeader ),                                  // crash
@@ -326,7 +522,6 @@ static const size_t QueueDataSize[] = {
     sizeof( QueueHeader ) + sizeof( QueueMemAlloc ),        // callstack
     sizeof( QueueHeader ) + sizeof( QueueMemFree ),         // callstack
     sizeof( QueueHeader ) + sizeof( QueueCallstackFrame ),
-    // keep all QueueStringTransfer below
     sizeof( QueueHeader ) + sizeof( QueueStringTransfer ),  // string data
     sizeof( QueueHeader ) + sizeof( QueueStringTransfer ),  // thread name
     sizeof( QueueHeader ) + sizeof( QueueStringTransfer ),  // custom string data
@@ -334,10 +529,85 @@ static const size_t QueueDataSize[] = {
     sizeof( QueueHeader ) + sizeof( QueueStringTransfer ),  // allocated source location payload
     sizeof( QueueHeader ) + sizeof( QueueStringTransfer ),  // callstack payload
     sizeof( QueueHeader ) + sizeof( QueueStringTransfer ),  // frame name
+    sizeof( QueueHeader ) + sizeof( QueueThreadContext ),
+    // compact events have variable length payload, only header size is given
+    sizeof( QueueHeader ),                                  // zone begin, compact
+    sizeof( QueueHeader ),                                  // zone begin callstack, compact
+    sizeof( QueueHeader ),                                  // zone end, compact
+    sizeof( QueueHeader ) + sizeof( QueueCallstackCached ),
+    sizeof( QueueHeader ) + sizeof( QueueCallstackMemoryCached ),
+    sizeof( QueueHeader ) + sizeof( QueueStringTransfer ),  // cached callstack payload
+    sizeof( QueueHeader ) + sizeof( QueueCallstackSample ),
+    sizeof( QueueHeader ) + sizeof( QueueZoneAggregate ),
+    sizeof( QueueHeader ) + sizeof( QueueSourceLocationKey ),
+    sizeof( QueueHeader ) + sizeof( QueueDroppedEvents ),
+    sizeof( QueueHeader ) + sizeof( QueueCompressionMode ),
+    sizeof( QueueHeader ) + sizeof( QueueStringTransfer ),  // interned string data
+    sizeof( QueueHeader ) + sizeof( QueueStringTransfer ),  // plot batch payload
+    sizeof( QueueHeader ) + sizeof( QueueStringTransfer ),  // gpu time batch payload
+    sizeof( QueueHeader ) + sizeof( QueueContextSwitch ),
+    sizeof( QueueHeader ) + sizeof( QueueZoneCounters ),
+    sizeof( QueueHeader ) + sizeof( QueueZoneCountersHw ),
+    sizeof( QueueHeader ) + sizeof( QueueCallstackSamplePayload ),
+    sizeof( QueueHeader ) + sizeof( QueuePlotDataBatch ),   // not sent, converted to payload
+    sizeof( QueueHeader ) + sizeof( QueueLuaSample ),       // not sent, converted to callstack sample
+    sizeof( QueueHeader ) + sizeof( QueueGpuTimeBatch ),    // not sent, converted to payload
 };
 
+// Items referencing client memory, which is sent (or freed) by the profiler
+// thread.
+static inline bool IsQueueItemWithPayload( QueueType type )
+{
+    switch( type )
+    {
+    case QueueType::ZoneText:
+    case QueueType::ZoneName:
+    case QueueType::Message:
+    case QueueType::ZoneBeginAllocSrcLoc:
+    case QueueType::CallstackMemory:
+    case QueueType::Callstack:
+    case QueueType::PlotDataBatch:
+    case QueueType::LuaSample:
+    case QueueType::GpuTimeBatch:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// QueueStringTransfer items, followed on the wire by 16-bit size and data.
+static inline bool IsQueueStringTransfer( QueueType type )
+{
+    switch( type )
+    {
+    case QueueType::StringData:
+    case QueueType::ThreadName:
+    case QueueType::CustomStringData:
+    case QueueType::PlotName:
+    case QueueType::SourceLocationPayload:
+    case QueueType::CallstackPayload:
+    case QueueType::FrameName:
+    case QueueType::CallstackPayloadCached:
+    case QueueType::InternedStringData:
+    case QueueType::PlotBatchPayload:
+    case QueueType::GpuTimePayload:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Compact items, followed on the wire by variable length data.
+static inline bool IsQueueCompact( QueueType type )
+{
+    return type == QueueType::ZoneBeginCompact || type == QueueType::ZoneBeginCallstackCompact || type == QueueType::ZoneEndCompact;
+}
+
 static_assert( QueueItemSize == 32, "Queue item size not 32 bytes" );
+static_assert( (uint8_t)QueueType::FrameName == 43, "Wire ids of the base protocol changed" );
 static_assert( sizeof( QueueDataSize ) / sizeof( size_t ) == (uint8_t)QueueType::NUM_TYPES, "QueueDataSize mismatch" );
+static_assert( PlotBatchSize * sizeof( PlotSample ) <= 0xFFFF, "Plot batch payload too large for string transfer" );
+static_assert( GpuTimeBatchSize * sizeof( int64_t ) <= 0xFFFF, "GPU time batch payload too large for string transfer" );
 static_assert( sizeof( void* ) <= sizeof( uint64_t ), "Pointer size > 8 bytes" );
 static_assert( sizeof( void* ) == sizeof( uintptr_t ), "Pointer size != uintptr_t" );
 
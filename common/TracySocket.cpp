@@ -1,5 +1,6 @@
 #include <algorithm>
 #include <assert.h>
+#include <atomic>
 #include <new>
 #include <stdio.h>
 #include <stdlib.h>
@@ -20,6 +21,15 @@
 #  include <unistd.h>
 #endif
 
+#ifdef __linux__
+#  include <errno.h>
+#  include <fcntl.h>
+#  include <signal.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <time.h>
+#endif
+
 #ifndef MSG_NOSIGNAL
 #  define MSG_NOSIGNAL 0
 #endif
@@ -53,8 +63,165 @@ void InitWinSock()
 }
 #endif
 
+#ifdef __linux__
+// The shared memory channel is a file in /dev/shm, created by the client.
+// It holds two single producer, single consumer rings: event data sent by
+// the client, and queries sent by the server. Each end records its process
+// id, so that the other end can detect when it was killed without closing
+// the channel.
+enum { ShmMagic = 0x79636172 };
+enum { ShmDataSize = 32 * 1024 * 1024 };
+enum { ShmQuerySize = 64 * 1024 };
+
+enum ShmState : uint32_t
+{
+    ShmListening,
+    ShmConnected,
+    ShmClientClosed,
+    ShmServerClosed,
+    ShmConnecting
+};
+
+struct ShmRing
+{
+    alignas( 64 ) std::atomic<uint64_t> head;
+    alignas( 64 ) std::atomic<uint64_t> tail;
+};
+
+struct ShmHeader
+{
+    uint32_t magic;
+    uint32_t compress;
+    std::atomic<uint32_t> state;
+    uint32_t clientPid;
+    uint32_t serverPid;
+    ShmRing data;
+    ShmRing query;
+};
+
+enum { ShmMapSize = sizeof( ShmHeader ) + ShmDataSize + ShmQuerySize };
+
+struct ShmChannel
+{
+    ShmHeader* hdr;
+    char* data;
+    char* query;
+    bool server;
+    uint32_t peer;
+    uint32_t stalls;
+    char path[64];
+};
+
+static void ShmPath( char* path, const char* name )
+{
+    snprintf( path, 64, "/dev/shm/tracy-%s", name );
+}
+
+static ShmChannel* ShmMap( int fd, const char* path, bool server )
+{
+    auto ptr = (char*)mmap( nullptr, ShmMapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+    if( ptr == MAP_FAILED ) return nullptr;
+    auto shm = (ShmChannel*)tracy_malloc( sizeof( ShmChannel ) );
+    shm->hdr = (ShmHeader*)ptr;
+    shm->data = ptr + sizeof( ShmHeader );
+    shm->query = shm->data + ShmDataSize;
+    shm->server = server;
+    shm->peer = 0;
+    shm->stalls = 0;
+    memcpy( shm->path, path, sizeof( shm->path ) );
+    return shm;
+}
+
+static void ShmUnmap( ShmChannel* shm )
+{
+    munmap( shm->hdr, ShmMapSize );
+    tracy_free( shm );
+}
+
+static void ShmReset( ShmHeader* hdr )
+{
+    hdr->data.head.store( 0, std::memory_order_relaxed );
+    hdr->data.tail.store( 0, std::memory_order_relaxed );
+    hdr->query.head.store( 0, std::memory_order_relaxed );
+    hdr->query.tail.store( 0, std::memory_order_relaxed );
+}
+
+static void ShmWait()
+{
+    timespec ts = { 0, 20000 };
+    nanosleep( &ts, nullptr );
+}
+
+static bool ShmAlive( uint32_t pid )
+{
+    return kill( pid_t( pid ), 0 ) == 0 || errno != ESRCH;
+}
+
+// Called while the channel is stalled. A killed peer leaves the state as it
+// was, so its process is also checked, every 64 stalls.
+static bool ShmPeerLost( ShmChannel* shm )
+{
+    if( shm->hdr->state.load( std::memory_order_acquire ) != ShmConnected ) return true;
+    if( ++shm->stalls % 64 != 0 ) return false;
+    return !ShmAlive( shm->peer );
+}
+
+static int ShmSend( ShmChannel* shm, const char* buf, int len )
+{
+    auto& ring = shm->server ? shm->hdr->query : shm->hdr->data;
+    auto data = shm->server ? shm->query : shm->data;
+    const auto size = shm->server ? uint64_t( ShmQuerySize ) : uint64_t( ShmDataSize );
+
+    const auto start = buf;
+    auto head = ring.head.load( std::memory_order_relaxed );
+    while( len > 0 )
+    {
+        const auto space = size - ( head - ring.tail.load( std::memory_order_acquire ) );
+        if( space == 0 )
+        {
+            if( ShmPeerLost( shm ) ) return -1;
+            ShmWait();
+            continue;
+        }
+        const auto pos = head % size;
+        const auto sz = std::min<uint64_t>( std::min<uint64_t>( space, size - pos ), len );
+        memcpy( data + pos, buf, sz );
+        head += sz;
+        ring.head.store( head, std::memory_order_release );
+        buf += sz;
+        len -= sz;
+    }
+    return int( buf - start );
+}
+
+static int ShmRecv( ShmChannel* shm, char* buf, int len )
+{
+    auto& ring = shm->server ? shm->hdr->data : shm->hdr->query;
+    auto data = shm->server ? shm->data : shm->query;
+    const auto size = shm->server ? uint64_t( ShmDataSize ) : uint64_t( ShmQuerySize );
+
+    const auto tail = ring.tail.load( std::memory_order_relaxed );
+    const auto avail = ring.head.load( std::memory_order_acquire ) - tail;
+    if( avail == 0 ) return 0;
+    const auto pos = tail % size;
+    const auto sz = std::min<uint64_t>( std::min<uint64_t>( avail, size - pos ), len );
+    memcpy( buf, data + pos, sz );
+    ring.tail.store( tail + sz, std::memory_order_release );
+    return int( sz );
+}
+
+static bool ShmHasData( ShmChannel* shm )
+{
+    auto& ring = shm->server ? shm->hdr->data : shm->hdr->query;
+    return ring.head.load( std::memory_order_acquire ) != ring.tail.load( std::memory_order_relaxed );
+}
+#else
+struct ShmChannel {};
+#endif
+
 Socket::Socket()
     : m_sock( -1 )
+    , m_shm( nullptr )
     , m_buf( (char*)tracy_malloc( BufSize ) )
     , m_bufPtr( nullptr )
     , m_bufLeft( 0 )
@@ -66,6 +233,16 @@ Socket::Socket()
 
 Socket::Socket( int sock )
     : m_sock( sock )
+    , m_shm( nullptr )
+    , m_buf( (char*)tracy_malloc( BufSize ) )
+    , m_bufPtr( nullptr )
+    , m_bufLeft( 0 )
+{
+}
+
+Socket::Socket( ShmChannel* shm )
+    : m_sock( -1 )
+    , m_shm( shm )
     , m_buf( (char*)tracy_malloc( BufSize ) )
     , m_bufPtr( nullptr )
     , m_bufLeft( 0 )
@@ -75,7 +252,7 @@ Socket::Socket( int sock )
 Socket::~Socket()
 {
     tracy_free( m_buf );
-    if( m_sock != -1 )
+    if( m_sock != -1 || m_shm )
     {
         Close();
     }
@@ -119,8 +296,56 @@ bool Socket::Connect( const char* addr, const char* port )
     return true;
 }
 
+bool Socket::ConnectShm( const char* name )
+{
+    assert( m_sock == -1 && !m_shm );
+#ifdef __linux__
+    char path[64];
+    ShmPath( path, name );
+    const auto fd = open( path, O_RDWR );
+    if( fd == -1 ) return false;
+    struct stat st;
+    ShmChannel* shm = nullptr;
+    if( fstat( fd, &st ) == 0 && st.st_size == ShmMapSize ) shm = ShmMap( fd, path, true );
+    close( fd );
+    if( !shm ) return false;
+
+    uint32_t expected = ShmListening;
+    if( shm->hdr->magic != ShmMagic || !shm->hdr->state.compare_exchange_strong( expected, ShmConnecting, std::memory_order_acq_rel ) )
+    {
+        ShmUnmap( shm );
+        return false;
+    }
+    shm->peer = shm->hdr->clientPid;
+    shm->hdr->serverPid = uint32_t( getpid() );
+    shm->hdr->state.store( ShmConnected, std::memory_order_release );
+    m_shm = shm;
+    return true;
+#else
+    return false;
+#endif
+}
+
 void Socket::Close()
 {
+#ifdef __linux__
+    if( m_shm )
+    {
+        if( m_shm->server )
+        {
+            m_shm->hdr->state.store( ShmServerClosed, std::memory_order_release );
+        }
+        else
+        {
+            // The server still has to read the remaining data.
+            uint32_t expected = ShmConnected;
+            m_shm->hdr->state.compare_exchange_strong( expected, ShmClientClosed, std::memory_order_acq_rel );
+        }
+        ShmUnmap( m_shm );
+        m_shm = nullptr;
+        return;
+    }
+#endif
     assert( m_sock != -1 );
 #ifdef _MSC_VER
     closesocket( m_sock );
@@ -130,9 +355,20 @@ void Socket::Close()
     m_sock = -1;
 }
 
+bool Socket::IsCompressed() const
+{
+#ifdef __linux__
+    if( m_shm ) return m_shm->hdr->compress != 0;
+#endif
+    return true;
+}
+
 int Socket::Send( const void* _buf, int len )
 {
     auto buf = (const char*)_buf;
+#ifdef __linux__
+    if( m_shm ) return ShmSend( m_shm, buf, len );
+#endif
     assert( m_sock != -1 );
     auto start = buf;
     while( len > 0 )
@@ -203,6 +439,26 @@ bool Socket::Read( void* _buf, int len, const timeval* tv, std::function<bool()>
 {
     auto buf = (char*)_buf;
 
+#ifdef __linux__
+    if( m_shm )
+    {
+        while( len > 0 )
+        {
+            if( exitCb() ) return false;
+            const auto sz = ShmRecv( m_shm, buf, len );
+            if( sz == 0 )
+            {
+                // Data written before the peer has closed the channel is still valid.
+                if( ShmPeerLost( m_shm ) && !ShmHasData( m_shm ) ) return false;
+                ShmWait();
+            }
+            len -= sz;
+            buf += sz;
+        }
+        return true;
+    }
+#endif
+
     while( len > 0 )
     {
         if( exitCb() ) return false;
@@ -231,6 +487,9 @@ bool Socket::Read( void* _buf, int len, const timeval* tv, std::function<bool()>
 
 bool Socket::HasData()
 {
+#ifdef __linux__
+    if( m_shm ) return ShmHasData( m_shm );
+#endif
     if( m_bufLeft > 0 ) return true;
 
     struct timeval tv;
@@ -246,6 +505,7 @@ bool Socket::HasData()
 
 ListenSocket::ListenSocket()
     : m_sock( -1 )
+    , m_shm( nullptr )
 {
 #ifdef _MSC_VER
     InitWinSock();
@@ -254,6 +514,13 @@ ListenSocket::ListenSocket()
 
 ListenSocket::~ListenSocket()
 {
+#ifdef __linux__
+    if( m_shm )
+    {
+        unlink( m_shm->path );
+        ShmUnmap( m_shm );
+    }
+#endif
 }
 
 bool ListenSocket::Listen( const char* port, int backlog )
@@ -283,8 +550,83 @@ bool ListenSocket::Listen( const char* port, int backlog )
     return true;
 }
 
+bool ListenSocket::ListenShm( const char* name, bool compress )
+{
+    assert( m_sock == -1 && !m_shm );
+#ifdef __linux__
+    char path[64];
+    ShmPath( path, name );
+    unlink( path );
+    const auto fd = open( path, O_RDWR | O_CREAT | O_EXCL, 0600 );
+    if( fd == -1 ) return false;
+    if( ftruncate( fd, ShmMapSize ) != 0 )
+    {
+        close( fd );
+        unlink( path );
+        return false;
+    }
+    m_shm = ShmMap( fd, path, false );
+    close( fd );
+    if( !m_shm )
+    {
+        unlink( path );
+        return false;
+    }
+    auto hdr = m_shm->hdr;
+    hdr->compress = compress ? 1 : 0;
+    hdr->clientPid = uint32_t( getpid() );
+    hdr->serverPid = 0;
+    ShmReset( hdr );
+    hdr->state.store( ShmListening, std::memory_order_relaxed );
+    hdr->magic = ShmMagic;
+    return true;
+#else
+    return false;
+#endif
+}
+
+Socket* ListenSocket::AcceptShm()
+{
+#ifdef __linux__
+    auto hdr = m_shm->hdr;
+    for( int i=0; i<500; i++ )
+    {
+        switch( hdr->state.load( std::memory_order_acquire ) )
+        {
+        case ShmConnected:
+        {
+            // Each end of the connection has its own mapping.
+            const auto fd = open( m_shm->path, O_RDWR );
+            if( fd == -1 ) return nullptr;
+            auto shm = ShmMap( fd, m_shm->path, false );
+            close( fd );
+            if( !shm ) return nullptr;
+            shm->peer = hdr->serverPid;
+            auto ptr = (Socket*)tracy_malloc( sizeof( Socket ) );
+            new(ptr) Socket( shm );
+            return ptr;
+        }
+        case ShmClientClosed:
+            // The server was killed before it read the remaining data.
+            if( ShmAlive( hdr->serverPid ) ) break;
+            // fallthrough
+        case ShmServerClosed:
+            ShmReset( hdr );
+            hdr->state.store( ShmListening, std::memory_order_release );
+            break;
+        default:
+            break;
+        }
+        ShmWait();
+    }
+#endif
+    return nullptr;
+}
+
 Socket* ListenSocket::Accept()
 {
+    if( m_shm ) return AcceptShm();
+
     struct sockaddr_storage remote;
     socklen_t sz = sizeof( remote );
 
@@ -12,6 +12,8 @@ namespace tracy
 void InitWinSock();
 #endif
 
+struct ShmChannel;
+
 class Socket
 {
     enum { BufSize = 128 * 1024 };
@@ -19,11 +21,17 @@ class Socket
 public:
     Socket();
     Socket( int sock );
+    Socket( ShmChannel* shm );
     ~Socket();
 
     bool Connect( const char* addr, const char* port );
+    // Attaches to a client listening on a shared memory channel (Linux only).
+    bool ConnectShm( const char* name );
     void Close();
 
+    // Frames sent over a shared memory channel may be left uncompressed.
+    bool IsCompressed() const;
+
     int Send( const void* buf, int len );
 
     bool Read( void* buf, int len, const timeval* tv, std::function<bool()> exitCb );
@@ -39,6 +47,7 @@ private:
     int Recv( void* buf, int len, const timeval* tv );
 
     int m_sock;
+    ShmChannel* m_shm;
 
     char* m_buf;
     char* m_bufPtr;
@@ -52,6 +61,8 @@ public:
     ~ListenSocket();
 
     bool Listen( const char* port, int backlog );
+    // Same-host alternative to TCP, which skips the network stack (Linux only).
+    bool ListenShm( const char* name, bool compress );
     Socket* Accept();
     void Close();
 
@@ -61,7 +72,10 @@ public:
     ListenSocket& operator=( ListenSocket&& ) = delete;
 
 private:
+    Socket* AcceptShm();
+
     int m_sock;
+    ShmChannel* m_shm;
 };
 
 }
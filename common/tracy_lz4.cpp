@@ -197,6 +197,10 @@
 namespace tracy
 {
 
+/* The client build includes tracy_lz4hc.cpp in the same translation unit. */
+#ifndef TRACY_LZ4_COMMONDEFS
+#define TRACY_LZ4_COMMONDEFS
+
 /*-************************************
 *  Reading and writing into memory
 **************************************/
@@ -444,6 +448,10 @@ unsigned LZ4_count(const BYTE* pIn, const BYTE* pMatch, const BYTE* pInLimit)
     return (unsigned)(pIn - pStart);
 }
 
+/* shared with tracy_lz4hc.cpp */
+typedef enum { notLimited = 0, limitedOutput = 1, fillOutput = 2 } limitedOutput_directive;
+
+#endif   /* TRACY_LZ4_COMMONDEFS */
 
 #ifndef LZ4_COMMONDEFS_ONLY
 /*-************************************
@@ -456,7 +464,6 @@ static const U32 LZ4_skipTrigger = 6;  /* Increase this value ==> compression ru
 /*-************************************
 *  Local Structures and types
 **************************************/
-typedef enum { notLimited = 0, limitedOutput = 1, fillOutput = 2 } limitedOutput_directive;
 typedef enum { clearedTable = 0, byPtr, byU32, byU16 } tableType_t;
 
 /**
@@ -181,6 +181,23 @@ struct CallstackFrameTree
 
 enum { CallstackFrameTreeSize = sizeof( CallstackFrameTree ) };
 
+struct SampleData
+{
+    int64_t time;
+    uint32_t callstack;
+};
+
+enum { SampleDataSize = sizeof( SampleData ) };
+
+
+struct ZoneAggregateData
+{
+    uint64_t count;
+    int64_t total;
+};
+
+enum { ZoneAggregateDataSize = sizeof( ZoneAggregateData ) };
+
 
 struct CrashEvent
 {
@@ -192,9 +209,58 @@ struct CrashEvent
 
 enum { CrashEventSize = sizeof( CrashEvent ) };
 
+
+struct DroppedEventsData
+{
+    int64_t begin;
+    int64_t end;
+    uint64_t count;
+};
+
+enum { DroppedEventsDataSize = sizeof( DroppedEventsData ) };
+
+
+// Interval in which the thread was running on a cpu. The time until the next
+// interval was spent off the cpu, for the reason stored with the interval, or
+// is unknown if records were lost.
+struct ContextSwitchData
+{
+    int64_t start;
+    int64_t end;        // -1 while running
+    uint8_t cpu;
+    uint8_t reason;     // ContextSwitchState of the switch out
+};
+
+enum { ContextSwitchDataSize = sizeof( ContextSwitchData ) };
+
+// Performance counter deltas of the thread in a zone.
+struct ZoneCounters
+{
+    uint64_t taskClock;
+    uint64_t cycles;
+    uint64_t instructions;
+    uint32_t pageFaults;
+    uint32_t contextSwitches;
+    uint8_t hardware;   // cycles and instructions are valid
+};
+
+enum { ZoneCountersSize = sizeof( ZoneCounters ) };
+
 #pragma pack()
 
 
+// Counters of all zones of a source location, which reported them.
+struct ZoneCountersSum
+{
+    uint64_t count = 0;
+    uint64_t hwCount = 0;
+    uint64_t taskClock = 0;
+    uint64_t pageFaults = 0;
+    uint64_t contextSwitches = 0;
+    uint64_t cycles = 0;
+    uint64_t instructions = 0;
+};
+
 struct MessageData
 {
     int64_t time;
@@ -209,6 +275,8 @@ struct ThreadData
     Vector<ZoneEvent*> timeline;
     Vector<ZoneEvent*> stack;
     Vector<MessageData*> messages;
+    Vector<SampleData> samples;
+    Vector<ContextSwitchData> ctxSwitch;
 };
 
 struct GpuCtxData
@@ -231,6 +299,7 @@ struct LockMap
     std::vector<uint64_t> threadList;
     LockType type;
     bool valid;
+    bool contention;    // uncontended acquisitions were not recorded
 };
 
 struct LockHighlight
@@ -17,6 +17,7 @@ public:
     tracy_force_inline const Vector<T>& Data() const { return m_data; }
 
     tracy_force_inline bool IsPending() const { return !m_pending.empty(); }
+    tracy_force_inline bool IsPending( uint64_t name ) const { return m_pending.find( name ) != m_pending.end(); }
 
     // Merge( destination, postponed )
     template<typename U>
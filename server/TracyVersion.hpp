@@ -7,7 +7,7 @@ namespace Version
 {
 enum { Major = 0 };
 enum { Minor = 3 };
-enum { Patch = 205 };
+enum { Patch = 211 };
 }
 }
 
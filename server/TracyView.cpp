@@ -331,9 +331,12 @@ View::View( const char* addr, ImFont* fixedWidth, SetTitleCallback stcb )
     , m_drawZones( true )
     , m_drawLocks( true )
     , m_drawPlots( true )
+    , m_drawContextSwitches( true )
     , m_onlyContendedLocks( true )
     , m_statSort( 0 )
     , m_statSelf( false )
+    , m_throttleRate( 100000 )
+    , m_throttleTime( 1000 )
     , m_showCallstackFrameAddress( false )
     , m_namespace( Namespace::Full )
     , m_textEditorFont( fixedWidth )
@@ -377,9 +380,12 @@ View::View( FileRead& f, ImFont* fixedWidth, SetTitleCallback stcb )
     , m_drawZones( true )
     , m_drawLocks( true )
     , m_drawPlots( true )
+    , m_drawContextSwitches( true )
     , m_onlyContendedLocks( true )
     , m_statSort( 0 )
     , m_statSelf( false )
+    , m_throttleRate( 100000 )
+    , m_throttleTime( 1000 )
     , m_showCallstackFrameAddress( false )
     , m_namespace( Namespace::Full )
     , m_textEditorFont( fixedWidth )
@@ -610,6 +616,12 @@ bool View::DrawImpl()
     if( ImGui::Button( "Memory" ) ) m_memInfo.show = true;
 #endif
     ImGui::SameLine();
+#ifdef TRACY_EXTENDED_FONT
+    if( ImGui::Button( ICON_FA_EYE_DROPPER " Samples" ) ) m_sampleInfo.show = true;
+#else
+    if( ImGui::Button( "Samples" ) ) m_sampleInfo.show = true;
+#endif
+    ImGui::SameLine();
 #ifdef TRACY_EXTENDED_FONT
     if( ImGui::Button( ICON_FA_BALANCE_SCALE " Compare" ) ) m_compare.show = true;
 #else
@@ -680,6 +692,7 @@ bool View::DrawImpl()
     if( m_findZone.show ) DrawFindZone();
     if( m_showStatistics ) DrawStatistics();
     if( m_memInfo.show ) DrawMemory();
+    if( m_sampleInfo.show ) DrawSamples();
     if( m_compare.show ) DrawCompare();
     if( m_callstackInfoWindow != 0 ) DrawCallstackWindow();
     if( m_memoryAllocInfoWindow >= 0 ) DrawMemoryAllocWindow();
@@ -737,6 +750,14 @@ void View::DrawConnection()
         ImGui::SameLine();
         ImGui::PlotLines( buf, mbpsVector.data(), mbpsVector.size(), 0, nullptr, 0, std::numeric_limits<float>::max(), ImVec2( 150, 0 ) );
         ImGui::Text( "Ratio %.1f%%  Real: %6.2f Mbps", m_worker.GetCompRatio() * 100.f, mbps / m_worker.GetCompRatio() );
+        if( m_worker.GetCompressionLevel() == 0 )
+        {
+            ImGui::Text( "Compression: %s", m_worker.GetCompressionName() );
+        }
+        else
+        {
+            ImGui::Text( "Compression: %s, level %i", m_worker.GetCompressionName(), m_worker.GetCompressionLevel() );
+        }
     }
 
     ImGui::Text( "Memory usage: %s", MemSizeToString( memUsage.load( std::memory_order_relaxed ) ) );
@@ -1696,6 +1717,12 @@ void View::DrawZones()
 
         if( showFull )
         {
+            if( m_drawContextSwitches && !v->ctxSwitch.empty() )
+            {
+                DrawContextSwitches( v, hover, pxns, wpos, offset, yMin, yMax );
+                offset += ostep;
+            }
+
             m_lastCpu = -1;
             if( m_drawZones )
             {
@@ -1746,6 +1773,26 @@ void View::DrawZones()
         draw->AddRect( ImVec2( wpos.x + px0, linepos.y ), ImVec2( wpos.x + px1, linepos.y + lineh ), 0x4488DD88 );
     }
 
+    // Data in these ranges is incomplete, because the client dropped events.
+    auto& dropped = m_worker.GetDroppedEvents();
+    auto dit = std::lower_bound( dropped.begin(), dropped.end(), m_zvStart, [] ( const auto& l, const auto& r ) { return l.end < r; } );
+    while( dit != dropped.end() && dit->begin <= m_zvEnd )
+    {
+        const auto px0 = ( dit->begin - m_zvStart ) * pxns;
+        const auto px1 = std::max( px0 + 1.0, ( dit->end - m_zvStart ) * pxns );
+        draw->AddRectFilled( ImVec2( wpos.x + px0, linepos.y ), ImVec2( wpos.x + px1, linepos.y + lineh ), 0x182222DD );
+        draw->AddRect( ImVec2( wpos.x + px0, linepos.y ), ImVec2( wpos.x + px1, linepos.y + lineh ), 0x442222DD );
+        if( hover && ImGui::IsMouseHoveringRect( ImVec2( wpos.x + px0, linepos.y ), ImVec2( wpos.x + px1, linepos.y + lineh ) ) )
+        {
+            ImGui::BeginTooltip();
+            ImGui::TextColored( ImVec4( 1.f, 0.2f, 0.2f, 1.f ), "Events dropped by the client" );
+            TextFocused( "Dropped events:", RealToString( dit->count, true ) );
+            TextFocused( "Duration:", TimeToString( dit->end - dit->begin ) );
+            ImGui::EndTooltip();
+        }
+        ++dit;
+    }
+
     if( m_highlight.active && m_highlight.start != m_highlight.end )
     {
         const auto s = std::min( m_highlight.start, m_highlight.end );
@@ -1778,6 +1825,168 @@ void View::DrawZones()
     }
 }
 
+static const char* ContextSwitchReason( uint8_t reason )
+{
+    switch( (ContextSwitchState)reason )
+    {
+    case ContextSwitchState::Preempted:
+        return "Preempted";
+    case ContextSwitchState::Waiting:
+        return "Waiting";
+    default:
+        return "Unknown";
+    }
+}
+
+void View::DrawContextSwitches( const ThreadData* td, bool hover, double pxns, const ImVec2& wpos, int offset, float yMin, float yMax )
+{
+    const auto ty = ImGui::GetFontSize();
+    const auto ostep = ty + 1;
+    const auto yPos = wpos.y + offset;
+    if( yPos + ostep < yMin || yPos > yMax ) return;
+
+    auto& vec = td->ctxSwitch;
+    auto it = std::lower_bound( vec.begin(), vec.end(), m_zvStart, [this] ( const auto& l, const auto& r ) { return m_worker.GetContextSwitchEnd( l ) < r; } );
+    // Off-cpu time at the start of the view follows the previous interval.
+    if( it != vec.begin() ) --it;
+    const auto citend = std::lower_bound( it, vec.end(), m_zvEnd, [] ( const auto& l, const auto& r ) { return l.start < r; } );
+
+    const uint32_t RunningColor = 0xFF22BB22;
+    const uint32_t PreemptedColor = 0xFF2222CC;
+    const uint32_t WaitingColor = 0xFF777777;
+    const uint32_t UnknownColor = 0x66777777;
+
+    const auto w = ImGui::GetWindowContentRegionWidth() - 1;
+    auto draw = ImGui::GetWindowDrawList();
+    const auto y0 = offset + round( ty * 0.25f );
+    const auto y1 = offset + round( ty * 0.75f );
+    const auto yc = offset + round( ty * 0.5f );
+
+    while( it < citend )
+    {
+        const auto start = it->start;
+        auto end = m_worker.GetContextSwitchEnd( *it );
+        const auto px0 = ( start - m_zvStart ) * pxns;
+        auto px1 = ( end - m_zvStart ) * pxns;
+        if( px1 - px0 < MinVisSize )
+        {
+            int num = 1;
+            auto running = end - start;
+            for(;;)
+            {
+                auto next = it + 1;
+                if( next == citend ) break;
+                const auto nend = m_worker.GetContextSwitchEnd( *next );
+                const auto pxnext = ( nend - m_zvStart ) * pxns;
+                if( pxnext - px1 >= MinVisSize * 2 ) break;
+                running += nend - next->start;
+                px1 = pxnext;
+                end = nend;
+                it = next;
+                num++;
+            }
+            const auto rx0 = std::max( px0, -10.0 );
+            const auto rx1 = std::min( std::max( px1, px0 + MinVisSize ), double( w + 10 ) );
+            draw->AddRectFilled( wpos + ImVec2( rx0, y0 ), wpos + ImVec2( rx1, y1 ), DarkenColor( RunningColor ) );
+            if( hover && ImGui::IsMouseHoveringRect( wpos + ImVec2( rx0, offset ), wpos + ImVec2( rx1, offset + ty ) ) )
+            {
+                ImGui::BeginTooltip();
+                TextFocused( "Context switches too small to display:", RealToString( num, true ) );
+                ImGui::Separator();
+                TextFocused( "Time range:", TimeToString( end - start ) );
+                TextFocused( "Running time:", TimeToString( running ) );
+                if( end > start )
+                {
+                    ImGui::SameLine();
+                    ImGui::TextDisabled( "(%.2f%%)", 100.f * running / ( end - start ) );
+                }
+                ImGui::EndTooltip();
+
+                if( ImGui::IsMouseClicked( 2 ) && end > start )
+                {
+                    ZoomToRange( start, end );
+                }
+            }
+        }
+        else
+        {
+            const auto rx0 = std::max( px0, -10.0 );
+            const auto rx1 = std::min( px1, double( w + 10 ) );
+            draw->AddRectFilled( wpos + ImVec2( rx0, y0 ), wpos + ImVec2( rx1, y1 ), RunningColor );
+            if( hover && ImGui::IsMouseHoveringRect( wpos + ImVec2( rx0, offset ), wpos + ImVec2( rx1, offset + ty ) ) )
+            {
+                ImGui::BeginTooltip();
+                ImGui::Text( "Running on CPU %i", it->cpu );
+                if( it != vec.begin() && (it-1)->cpu != it->cpu )
+                {
+                    ImGui::SameLine();
+                    ImGui::TextDisabled( "(migrated from CPU %i)", (it-1)->cpu );
+                }
+                ImGui::Separator();
+                TextFocused( "Running time:", TimeToString( end - start ) );
+                if( it->end < 0 )
+                {
+                    ImGui::TextDisabled( "Still running" );
+                }
+                else
+                {
+                    TextFocused( "Switched out:", ContextSwitchReason( it->reason ) );
+                }
+                ImGui::EndTooltip();
+
+                if( ImGui::IsMouseClicked( 2 ) && end > start )
+                {
+                    ZoomToRange( start, end );
+                }
+            }
+        }
+
+        auto next = it + 1;
+        if( next != vec.end() && it->end >= 0 )
+        {
+            const auto gx0 = std::max( px1, -10.0 );
+            const auto gx1 = std::min( ( next->start - m_zvStart ) * pxns, double( w + 10 ) );
+            if( gx1 > gx0 )
+            {
+                const auto preempted = it->reason == (uint8_t)ContextSwitchState::Preempted;
+                const auto unknown = it->reason == (uint8_t)ContextSwitchState::Unknown;
+                draw->AddLine( wpos + ImVec2( gx0, yc ), wpos + ImVec2( gx1, yc ), preempted ? PreemptedColor : ( unknown ? UnknownColor : WaitingColor ), preempted ? 2.f : 1.f );
+                if( hover && ImGui::IsMouseHoveringRect( wpos + ImVec2( gx0, offset ), wpos + ImVec2( gx1, offset + ty ) ) )
+                {
+                    ImGui::BeginTooltip();
+                    ImGui::Text( "%s", ContextSwitchReason( it->reason ) );
+                    ImGui::SameLine();
+                    if( preempted )
+                    {
+                        ImGui::TextDisabled( "(ready to run, but not scheduled)" );
+                    }
+                    else if( unknown )
+                    {
+                        ImGui::TextDisabled( "(context switch records were lost)" );
+                    }
+                    else
+                    {
+                        ImGui::TextDisabled( "(blocked)" );
+                    }
+                    ImGui::Separator();
+                    TextFocused( unknown ? "Time:" : "Off-CPU time:", TimeToString( next->start - end ) );
+                    if( next->cpu != it->cpu )
+                    {
+                        ImGui::Text( "Migrated from CPU %i to CPU %i", it->cpu, next->cpu );
+                    }
+                    ImGui::EndTooltip();
+
+                    if( ImGui::IsMouseClicked( 2 ) && next->start > end )
+                    {
+                        ZoomToRange( end, next->start );
+                    }
+                }
+            }
+        }
+        ++it;
+    }
+}
+
 int View::DispatchZoneLevel( const Vector<ZoneEvent*>& vec, bool hover, double pxns, const ImVec2& wpos, int _offset, int depth, float yMin, float yMax )
 {
     const auto ty = ImGui::GetFontSize();
@@ -2304,7 +2513,8 @@ enum class LockState
     WaitLock            // red
 };
 
-static Vector<LockEvent*>::const_iterator GetNextLockEvent( const Vector<LockEvent*>::const_iterator& it, const Vector<LockEvent*>::const_iterator& end, LockState& nextState, uint64_t threadBit )
+// In contention-only locks a thread may wait while no holder is recorded.
+static Vector<LockEvent*>::const_iterator GetNextLockEvent( const Vector<LockEvent*>::const_iterator& it, const Vector<LockEvent*>::const_iterator& end, LockState& nextState, uint64_t threadBit, bool contention )
 {
     auto next = it;
     next++;
@@ -2327,6 +2537,11 @@ static Vector<LockEvent*>::const_iterator GetNextLockEvent( const Vector<LockEve
                     break;
                 }
             }
+            else if( contention && IsThreadWaiting( (*next)->waitList, threadBit ) )
+            {
+                nextState = LockState::WaitLock;
+                break;
+            }
             next++;
         }
         break;
@@ -2371,7 +2586,7 @@ static Vector<LockEvent*>::const_iterator GetNextLockEvent( const Vector<LockEve
     case LockState::WaitLock:
         while( next < end )
         {
-            if( GetThreadBit( (*next)->lockingThread ) == threadBit )
+            if( GetThreadBit( (*next)->lockingThread ) == threadBit && !IsThreadWaiting( (*next)->waitList, threadBit ) )
             {
                 nextState = AreOtherWaiting( (*next)->waitList, threadBit ) ? LockState::HasBlockingLock : LockState::HasLock;
                 break;
@@ -2395,7 +2610,7 @@ static Vector<LockEvent*>::const_iterator GetNextLockEvent( const Vector<LockEve
     return next;
 }
 
-static Vector<LockEvent*>::const_iterator GetNextLockEventShared( const Vector<LockEvent*>::const_iterator& it, const Vector<LockEvent*>::const_iterator& end, LockState& nextState, uint64_t threadBit )
+static Vector<LockEvent*>::const_iterator GetNextLockEventShared( const Vector<LockEvent*>::const_iterator& it, const Vector<LockEvent*>::const_iterator& end, LockState& nextState, uint64_t threadBit, bool contention )
 {
     const auto itptr = (const LockEventShared*)*it;
     auto next = it;
@@ -2426,7 +2641,7 @@ static Vector<LockEvent*>::const_iterator GetNextLockEventShared( const Vector<L
                 nextState = ( ptr->waitList != 0 ) ? LockState::HasBlockingLock : LockState::HasLock;
                 break;
             }
-            else if( ptr->sharedList != 0 && IsThreadWaiting( ptr->waitList, threadBit ) )
+            else if( ( ptr->sharedList != 0 || contention ) && IsThreadWaiting( ptr->waitList, threadBit ) )
             {
                 nextState = LockState::WaitLock;
                 break;
@@ -2483,7 +2698,7 @@ static Vector<LockEvent*>::const_iterator GetNextLockEventShared( const Vector<L
         while( next < end )
         {
             const auto ptr = (const LockEventShared*)*next;
-            if( GetThreadBit( ptr->lockingThread ) == threadBit )
+            if( GetThreadBit( ptr->lockingThread ) == threadBit && !IsThreadWaiting( ptr->waitList, threadBit ) )
             {
                 const auto wait = ptr->waitList | ptr->waitShared;
                 nextState = AreOtherWaiting( wait, threadBit ) ? LockState::HasBlockingLock : LockState::HasLock;
@@ -2568,6 +2783,10 @@ int View::DrawLocks( uint64_t tid, bool hover, double pxns, const ImVec2& wpos,
                     state = LockState::WaitLock;
                 }
             }
+            else if( lockmap.contention && IsThreadWaiting( (*vbegin)->waitList, threadBit ) )
+            {
+                state = LockState::WaitLock;
+            }
         }
         else
         {
@@ -2587,7 +2806,7 @@ int View::DrawLocks( uint64_t tid, bool hover, double pxns, const ImVec2& wpos,
             {
                 state = ptr->waitList != 0 ? LockState::HasBlockingLock : LockState::HasLock;
             }
-            else if( ptr->sharedList != 0 && IsThreadWaiting( ptr->waitList, threadBit ) )
+            else if( ( ptr->sharedList != 0 || lockmap.contention ) && IsThreadWaiting( ptr->waitList, threadBit ) )
             {
                 state = LockState::WaitLock;
             }
@@ -2604,7 +2823,7 @@ int View::DrawLocks( uint64_t tid, bool hover, double pxns, const ImVec2& wpos,
             {
                 while( vbegin < vend && ( state == LockState::Nothing || ( m_onlyContendedLocks && state == LockState::HasLock ) ) )
                 {
-                    vbegin = GetNextLockFunc( vbegin, vend, state, threadBit );
+                    vbegin = GetNextLockFunc( vbegin, vend, state, threadBit, lockmap.contention );
                 }
                 if( vbegin >= vend ) break;
 
@@ -2612,7 +2831,7 @@ int View::DrawLocks( uint64_t tid, bool hover, double pxns, const ImVec2& wpos,
                 drawn = true;
 
                 LockState drawState = state;
-                auto next = GetNextLockFunc( vbegin, vend, state, threadBit );
+                auto next = GetNextLockFunc( vbegin, vend, state, threadBit, lockmap.contention );
 
                 const auto t0 = (*vbegin)->time;
                 int64_t t1 = next == tl.end() ? m_lastTime : (*next)->time;
@@ -2628,12 +2847,12 @@ int View::DrawLocks( uint64_t tid, bool hover, double pxns, const ImVec2& wpos,
                     auto ns = state;
                     while( n < vend && ( ns == LockState::Nothing || ( m_onlyContendedLocks && ns == LockState::HasLock ) ) )
                     {
-                        n = GetNextLockFunc( n, vend, ns, threadBit );
+                        n = GetNextLockFunc( n, vend, ns, threadBit, lockmap.contention );
                     }
                     if( n >= vend ) break;
                     if( n == next )
                     {
-                        n = GetNextLockFunc( n, vend, ns, threadBit );
+                        n = GetNextLockFunc( n, vend, ns, threadBit, lockmap.contention );
                     }
                     drawState = CombineLockState( drawState, state );
                     condensed++;
@@ -2779,6 +2998,11 @@ int View::DrawLocks( uint64_t tid, bool hover, double pxns, const ImVec2& wpos,
                                 {
                                     ImGui::Text( "Thread \"%s\" is blocked by other thread:", m_worker.GetThreadString( tid ) );
                                 }
+                                else if( lockmap.contention )
+                                {
+                                    ImGui::Text( "Thread \"%s\" is blocked by a thread which obtained the lock without contention.", m_worker.GetThreadString( tid ) );
+                                    break;
+                                }
                                 else
                                 {
                                     ImGui::Text( "Thread \"%s\" waits to obtain lock after release by thread:", m_worker.GetThreadString( tid ) );
@@ -2892,6 +3116,11 @@ int View::DrawLocks( uint64_t tid, bool hover, double pxns, const ImVec2& wpos,
                                 {
                                     ImGui::Text( "Thread \"%s\" is blocked by other threads (%i):", m_worker.GetThreadString( tid ), ptr->lockCount + TracyCountBits( ptr->sharedList ) );
                                 }
+                                else if( lockmap.contention )
+                                {
+                                    ImGui::Text( "Thread \"%s\" is blocked by a thread which obtained the lock without contention.", m_worker.GetThreadString( tid ) );
+                                    break;
+                                }
                                 else
                                 {
                                     ImGui::Text( "Thread \"%s\" waits to obtain lock after release by thread:", m_worker.GetThreadString( tid ) );
@@ -2976,6 +3205,10 @@ int View::DrawLocks( uint64_t tid, bool hover, double pxns, const ImVec2& wpos,
                         assert( false );
                         break;
                     }
+                    if( v.second.contention )
+                    {
+                        ImGui::TextDisabled( "Only contended exclusive acquisitions are recorded." );
+                    }
                     ImGui::Text( "Thread list:" );
                     ImGui::Separator();
                     ImGui::Indent( ty );
@@ -2995,7 +3228,7 @@ int View::DrawLocks( uint64_t tid, bool hover, double pxns, const ImVec2& wpos,
         {
             while( vbegin < vend && ( state == LockState::Nothing || ( m_onlyContendedLocks && state == LockState::HasLock ) ) )
             {
-                vbegin = GetNextLockFunc( vbegin, vend, state, threadBit );
+                vbegin = GetNextLockFunc( vbegin, vend, state, threadBit, lockmap.contention );
             }
             if( vbegin < vend ) cnt++;
         }
@@ -3572,6 +3805,19 @@ void View::DrawZoneInfoWindow()
     {
         m_findZone.ShowZone( ev.srcloc, m_worker.GetString( srcloc.name.active ? srcloc.name : srcloc.function ) );
     }
+    if( m_worker.CanToggleSourceLocation( ev.srcloc ) )
+    {
+        ImGui::SameLine();
+        const auto enabled = m_worker.GetSourceLocationState( ev.srcloc ) == Worker::SourceLocationState::Enabled;
+#ifdef TRACY_EXTENDED_FONT
+        if( ImGui::Button( enabled ? ICON_FA_PAUSE " Disable zone" : ICON_FA_PLAY " Enable zone" ) )
+#else
+        if( ImGui::Button( enabled ? "Disable zone" : "Enable zone" ) )
+#endif
+        {
+            m_worker.SetSourceLocationState( ev.srcloc, enabled ? Worker::SourceLocationState::Disabled : Worker::SourceLocationState::Enabled );
+        }
+    }
     if( ev.callstack != 0 )
     {
         ImGui::SameLine();
@@ -3674,6 +3920,71 @@ void View::DrawZoneInfoWindow()
         TextFocused( "Without profiling:", TimeToString( ztime - m_worker.GetDelay() * dmul ) );
         ImGui::EndTooltip();
     }
+    int64_t running;
+    uint64_t switches;
+    if( m_worker.GetRunningTime( tid, ev.start, end, running, switches ) )
+    {
+        TextFocused( "Running time:", TimeToString( running ) );
+        if( ztime > 0 )
+        {
+            ImGui::SameLine();
+            ImGui::TextDisabled( "(%.2f%%)", 100.f * running / ztime );
+        }
+        TextFocused( "Off-CPU time:", TimeToString( ztime - running ) );
+        ImGui::SameLine();
+        TextFocused( "Context switches:", RealToString( switches, true ) );
+    }
+    if( auto counters = m_worker.GetZoneCounters( ev ) )
+    {
+        ImGui::Separator();
+
+        const auto& zc = *counters;
+        TextFocused( "Task clock:", TimeToString( zc.taskClock ) );
+        if( ztime > 0 )
+        {
+            ImGui::SameLine();
+            ImGui::TextDisabled( "(%.2f%%)", 100.f * zc.taskClock / ztime );
+        }
+        TextFocused( "Page faults:", RealToString( zc.pageFaults, true ) );
+        ImGui::SameLine();
+        TextFocused( "Counted context switches:", RealToString( zc.contextSwitches, true ) );
+        if( zc.hardware )
+        {
+            TextFocused( "Cycles:", RealToString( zc.cycles, true ) );
+            ImGui::SameLine();
+            TextFocused( "Instructions:", RealToString( zc.instructions, true ) );
+            ImGui::SameLine();
+            ImGui::TextDisabled( "IPC:" );
+            ImGui::SameLine();
+            ImGui::Text( "%.2f", zc.cycles == 0 ? 0. : double( zc.instructions ) / zc.cycles );
+        }
+#ifndef TRACY_NO_STATISTICS
+        const auto& sum = m_worker.GetZonesForSourceLocation( ev.srcloc ).counters;
+        if( sum.count > 1 && ImGui::TreeNode( "Source location mean" ) )
+        {
+            TextFocused( "Zones with counters:", RealToString( sum.count, true ) );
+            TextFocused( "Task clock:", TimeToString( sum.taskClock / sum.count ) );
+            ImGui::TextDisabled( "Page faults:" );
+            ImGui::SameLine();
+            ImGui::Text( "%.2f", double( sum.pageFaults ) / sum.count );
+            ImGui::SameLine();
+            ImGui::TextDisabled( "Counted context switches:" );
+            ImGui::SameLine();
+            ImGui::Text( "%.2f", double( sum.contextSwitches ) / sum.count );
+            if( sum.hwCount != 0 )
+            {
+                TextFocused( "Cycles:", RealToString( sum.cycles / sum.hwCount, true ) );
+                ImGui::SameLine();
+                TextFocused( "Instructions:", RealToString( sum.instructions / sum.hwCount, true ) );
+                ImGui::SameLine();
+                ImGui::TextDisabled( "IPC:" );
+                ImGui::SameLine();
+                ImGui::Text( "%.2f", sum.cycles == 0 ? 0. : double( sum.instructions ) / sum.cycles );
+            }
+            ImGui::TreePop();
+        }
+#endif
+    }
 
     auto& mem = m_worker.GetMemData();
     if( mem.plot )
@@ -4203,6 +4514,14 @@ void View::DrawOptions()
     int ns = (int)m_namespace;
     ImGui::Combo( "Namespaces", &ns, "Full\0Shortened\0None\0" );
     m_namespace = (Namespace)ns;
+    if( m_worker.GetContextSwitchCount() != 0 )
+    {
+#ifdef TRACY_EXTENDED_FONT
+        ImGui::Checkbox( ICON_FA_HOURGLASS_HALF " Draw context switches", &m_drawContextSwitches );
+#else
+        ImGui::Checkbox( "Draw context switches", &m_drawContextSwitches );
+#endif
+    }
 
     if( !m_worker.GetLockMap().empty() )
     {
@@ -6086,6 +6405,42 @@ void View::DrawStatistics()
 #else
     ImGui::Checkbox( "Show self times", &m_statSelf );
 #endif
+    if( !m_worker.IsDataStatic() )
+    {
+        ImGui::SameLine();
+        bool throttle = m_worker.GetZoneThrottleRate() != 0;
+#ifdef TRACY_EXTENDED_FONT
+        if( ImGui::Checkbox( ICON_FA_COMPRESS " Aggregate short zones", &throttle ) )
+#else
+        if( ImGui::Checkbox( "Aggregate short zones", &throttle ) )
+#endif
+        {
+            m_worker.SetZoneThrottle( throttle ? m_throttleRate : 0, m_throttleTime );
+        }
+        ImGui::SameLine();
+        ImGui::TextDisabled( "(?)" );
+        if( ImGui::IsItemHovered() )
+        {
+            ImGui::BeginTooltip();
+            ImGui::Text( "Source locations of zones that are both frequent and short" );
+            ImGui::Text( "will only report zone count and total time." );
+            ImGui::EndTooltip();
+        }
+        if( throttle )
+        {
+            ImGui::PushItemWidth( 120 );
+            bool changed = ImGui::InputInt( "Calls per second", &m_throttleRate, 1000, 10000 );
+            ImGui::SameLine();
+            changed |= ImGui::InputInt( "Max. zone time (ns)", &m_throttleTime, 100, 1000 );
+            ImGui::PopItemWidth();
+            if( changed )
+            {
+                m_throttleRate = std::max( m_throttleRate, 1 );
+                m_throttleTime = std::max( m_throttleTime, 1 );
+                m_worker.SetZoneThrottle( m_throttleRate, m_throttleTime );
+            }
+        }
+    }
 
     auto& slz = m_worker.GetSourceLocationZones();
     Vector<decltype(slz.begin())> srcloc;
@@ -6130,7 +6485,8 @@ void View::DrawStatistics()
 
     TextFocused( "Recorded source locations:", RealToString( srcloc.size(), true ) );
 
-    ImGui::Columns( 5 );
+    const bool counters = m_worker.GetZoneCountersCount() != 0;
+    ImGui::Columns( counters ? 9 : 5 );
     ImGui::Separator();
     ImGui::Text( "Name" );
     ImGui::NextColumn();
@@ -6150,6 +6506,26 @@ void View::DrawStatistics()
         ImGui::EndTooltip();
     }
     ImGui::NextColumn();
+    if( counters )
+    {
+        ImGui::Text( "Task clock" );
+        ImGui::NextColumn();
+        ImGui::Text( "Page faults" );
+        ImGui::NextColumn();
+        ImGui::Text( "Switches" );
+        ImGui::NextColumn();
+        ImGui::Text( "IPC" );
+        ImGui::SameLine();
+        ImGui::TextDisabled( "(?)" );
+        if( ImGui::IsItemHovered() )
+        {
+            ImGui::BeginTooltip();
+            ImGui::Text( "Means per call of zones which reported performance counters." );
+            ImGui::Text( "Instructions per cycle require hardware counters." );
+            ImGui::EndTooltip();
+        }
+        ImGui::NextColumn();
+    }
     ImGui::Separator();
 
     for( auto& v : srcloc )
@@ -6158,10 +6534,30 @@ void View::DrawStatistics()
 
         auto& srcloc = m_worker.GetSourceLocation( v->first );
         auto name = m_worker.GetString( srcloc.name.active ? srcloc.name : srcloc.function );
+        const auto state = m_worker.GetSourceLocationState( v->first );
+        const auto enabled = state == Worker::SourceLocationState::Enabled;
+        if( !enabled ) ImGui::PushStyleColor( ImGuiCol_Text, GImGui->Style.Colors[ImGuiCol_TextDisabled] );
         if( ImGui::Selectable( name, m_findZone.show && !m_findZone.match.empty() && m_findZone.match[m_findZone.selMatch] == v->first, ImGuiSelectableFlags_SpanAllColumns ) )
         {
             m_findZone.ShowZone( v->first, name );
         }
+        if( !enabled ) ImGui::PopStyleColor();
+        if( m_worker.CanToggleSourceLocation( v->first ) && ImGui::BeginPopupContextItem( "##toggle" ) )
+        {
+            if( ImGui::MenuItem( "Collect zones", nullptr, enabled ) )
+            {
+                m_worker.SetSourceLocationState( v->first, enabled ? Worker::SourceLocationState::Disabled : Worker::SourceLocationState::Enabled );
+            }
+            if( m_worker.CanAggregateSourceLocation( v->first ) )
+            {
+                const auto aggregated = state == Worker::SourceLocationState::Aggregated;
+                if( ImGui::MenuItem( "Aggregate zones", nullptr, aggregated ) )
+                {
+                    m_worker.SetSourceLocationState( v->first, aggregated ? Worker::SourceLocationState::Enabled : Worker::SourceLocationState::Aggregated );
+                }
+            }
+            ImGui::EndPopup();
+        }
         ImGui::NextColumn();
         ImGui::Text( "%s:%i", m_worker.GetString( srcloc.file ), srcloc.line );
         ImGui::NextColumn();
@@ -6171,10 +6567,81 @@ void View::DrawStatistics()
         ImGui::NextColumn();
         ImGui::Text( "%s", TimeToString( ( m_statSelf ? v->second.selfTotal : v->second.total ) / v->second.zones.size() ) );
         ImGui::NextColumn();
+        if( counters )
+        {
+            const auto& sum = v->second.counters;
+            if( sum.count != 0 )
+            {
+                ImGui::Text( "%s", TimeToString( sum.taskClock / sum.count ) );
+                ImGui::NextColumn();
+                ImGui::Text( "%.2f", double( sum.pageFaults ) / sum.count );
+                ImGui::NextColumn();
+                ImGui::Text( "%.2f", double( sum.contextSwitches ) / sum.count );
+                ImGui::NextColumn();
+                if( sum.cycles != 0 )
+                {
+                    ImGui::Text( "%.2f", double( sum.instructions ) / sum.cycles );
+                }
+                ImGui::NextColumn();
+            }
+            else
+            {
+                ImGui::NextColumn();
+                ImGui::NextColumn();
+                ImGui::NextColumn();
+                ImGui::NextColumn();
+            }
+        }
 
         ImGui::PopID();
     }
     ImGui::EndColumns();
+
+    auto& agg = m_worker.GetZoneAggregates();
+    if( !agg.empty() )
+    {
+        ImGui::Separator();
+        const auto expand = ImGui::TreeNode( "Aggregated zones" );
+        ImGui::SameLine();
+        ImGui::TextDisabled( "(%zu)", agg.size() );
+        if( expand )
+        {
+            Vector<decltype(agg.begin())> list;
+            list.reserve( agg.size() );
+            for( auto it = agg.begin(); it != agg.end(); ++it ) list.push_back_no_space_check( it );
+            pdqsort_branchless( list.begin(), list.end(), []( const auto& lhs, const auto& rhs ) { return lhs->second.total > rhs->second.total; } );
+
+            ImGui::Columns( 5 );
+            ImGui::Separator();
+            ImGui::Text( "Name" );
+            ImGui::NextColumn();
+            ImGui::Text( "Location" );
+            ImGui::NextColumn();
+            ImGui::Text( "Total time" );
+            ImGui::NextColumn();
+            ImGui::Text( "Counts" );
+            ImGui::NextColumn();
+            ImGui::Text( "MTPC" );
+            ImGui::NextColumn();
+            ImGui::Separator();
+            for( auto& v : list )
+            {
+                auto& srcloc = m_worker.GetSourceLocation( v->first );
+                ImGui::Text( "%s", m_worker.GetString( srcloc.name.active ? srcloc.name : srcloc.function ) );
+                ImGui::NextColumn();
+                ImGui::Text( "%s:%i", m_worker.GetString( srcloc.file ), srcloc.line );
+                ImGui::NextColumn();
+                ImGui::Text( "%s", TimeToString( v->second.total ) );
+                ImGui::NextColumn();
+                ImGui::Text( "%s", RealToString( v->second.count, true ) );
+                ImGui::NextColumn();
+                ImGui::Text( "%s", TimeToString( v->second.total / std::max<uint64_t>( v->second.count, 1 ) ) );
+                ImGui::NextColumn();
+            }
+            ImGui::EndColumns();
+            ImGui::TreePop();
+        }
+    }
 #endif
     ImGui::End();
 }
@@ -6443,6 +6910,7 @@ void View::DrawInfo()
     ImGui::Separator();
     TextFocused( "Zones:", RealToString( m_worker.GetZoneCount(), true ) );
     TextFocused( "Lock events:", RealToString( m_worker.GetLockCount(), true ) );
+    TextFocused( "Context switches:", RealToString( m_worker.GetContextSwitchCount(), true ) );
     TextFocused( "Plot data points:", RealToString( m_worker.GetPlotCount(), true ) );
     TextFocused( "Memory allocations:", RealToString( m_worker.GetMemData().data.size(), true ) );
     TextFocused( "Source locations:", RealToString( m_worker.GetSrcLocCount(), true ) );
@@ -6803,6 +7271,16 @@ void View::DrawInfo()
     }
     ImGui::Separator();
     TextFocused( "Host info:", m_worker.GetHostInfo().c_str() );
+    auto& dropped = m_worker.GetDroppedEvents();
+    if( !dropped.empty() )
+    {
+        uint64_t cnt = 0;
+        for( auto& v : dropped ) cnt += v.count;
+        ImGui::Separator();
+        TextFocused( "Dropped events:", RealToString( cnt, true ) );
+        ImGui::SameLine();
+        ImGui::TextDisabled( "(in %s time ranges)", RealToString( dropped.size(), true ) );
+    }
     auto& crash = m_worker.GetCrashEvent();
     if( crash.thread != 0 )
     {
@@ -7286,7 +7764,8 @@ void View::DrawMemory()
             {
                 for( auto& v : mem.data )
                 {
-                    if( v.ptr <= m_memInfo.ptrFind && v.ptr + v.size > m_memInfo.ptrFind && v.timeAlloc < zvMid )
+                    const auto ptr = Worker::GetMemoryAddress( v.ptr );
+                    if( ptr <= m_memInfo.ptrFind && ptr + v.size > m_memInfo.ptrFind && v.timeAlloc < zvMid )
                     {
                         match.emplace_back( &v );
                     }
@@ -7296,7 +7775,8 @@ void View::DrawMemory()
             {
                 for( auto& v : mem.data )
                 {
-                    if( v.ptr <= m_memInfo.ptrFind && v.ptr + v.size > m_memInfo.ptrFind )
+                    const auto ptr = Worker::GetMemoryAddress( v.ptr );
+                    if( ptr <= m_memInfo.ptrFind && ptr + v.size > m_memInfo.ptrFind )
                     {
                         match.emplace_back( &v );
                     }
@@ -7311,13 +7791,14 @@ void View::DrawMemory()
             {
                 ListMemData<decltype( match.begin() )>( match.begin(), match.end(), [this]( auto& it ) {
                     auto& v = *it;
-                    if( v->ptr == m_memInfo.ptrFind )
+                    const auto ptr = Worker::GetMemoryAddress( v->ptr );
+                    if( ptr == m_memInfo.ptrFind )
                     {
-                        ImGui::Text( "0x%" PRIx64, m_memInfo.ptrFind );
+                        ImGui::Text( "0x%" PRIx64, v->ptr );
                     }
                     else
                     {
-                        ImGui::Text( "0x%" PRIx64 "+%" PRIu64, v->ptr, m_memInfo.ptrFind - v->ptr );
+                        ImGui::Text( "0x%" PRIx64 "+%" PRIu64, v->ptr, m_memInfo.ptrFind - ptr );
                     }
                 }, "##allocations" );
             }
@@ -7596,6 +8077,224 @@ void View::DrawFrameTreeLevel( std::vector<CallstackFrameTree>& tree, int& idx )
     }
 }
 
+std::vector<CallstackFrameTree> View::GetSampleFrameTree( uint32_t& total ) const
+{
+    std::vector<CallstackFrameTree> root;
+    flat_hash_map<uint32_t, uint32_t, nohash<uint32_t>> pathSum;
+    pathSum.reserve( m_worker.GetCallstackPayloadCount() );
+
+    total = 0;
+    for( auto& td : m_worker.GetThreadData() )
+    {
+        auto it = td->samples.begin();
+        auto end = td->samples.end();
+        if( m_sampleInfo.limitView )
+        {
+            it = std::lower_bound( it, end, m_zvStart, [] ( const auto& l, const auto& r ) { return l.time < r; } );
+            end = std::lower_bound( it, end, m_zvEnd, [] ( const auto& l, const auto& r ) { return l.time < r; } );
+        }
+        total += end - it;
+        while( it != end )
+        {
+            pathSum[it->callstack]++;
+            ++it;
+        }
+    }
+
+    for( auto& path : pathSum )
+    {
+        auto& cs = m_worker.GetCallstack( path.first );
+        if( cs.size() == 0 ) continue;
+
+        auto treePtr = GetFrameTreeItem( root, cs.back() );
+        treePtr->countInclusive += path.second;
+
+        for( int i = int( cs.size() ) - 2; i >= 0; i-- )
+        {
+            treePtr = GetFrameTreeItem( treePtr->children, cs[i] );
+            treePtr->countInclusive += path.second;
+        }
+
+        treePtr->countExclusive += path.second;
+    }
+    return root;
+}
+
+void View::DrawSamples()
+{
+    ImGui::SetNextWindowSize( ImVec2( 800, 500 ), ImGuiCond_FirstUseEver );
+    ImGui::Begin( "Samples", &m_sampleInfo.show );
+
+    if( m_worker.GetSampleCount() == 0 )
+    {
+        ImGui::TextWrapped( "No sampling data collected. Build the client with TRACY_SAMPLING defined, or call tracy::LuaStartSampling() to sample Lua code." );
+        ImGui::End();
+        return;
+    }
+
+    uint32_t total;
+    auto tree = GetSampleFrameTree( total );
+
+    ImGui::Checkbox( "Limit to view", &m_sampleInfo.limitView );
+    ImGui::SameLine();
+    ImGui::Text( "Samples: %s", RealToString( total, true ) );
+    if( total == 0 )
+    {
+        ImGui::End();
+        return;
+    }
+
+    ImGui::Separator();
+#ifdef TRACY_EXTENDED_FONT
+    if( ImGui::TreeNode( ICON_FA_ALIGN_JUSTIFY " Top-down tree" ) )
+#else
+    if( ImGui::TreeNode( "Top-down tree" ) )
+#endif
+    {
+        ImGui::TextDisabled( "Right click on file name to open source file." );
+
+        int idx = 0;
+        DrawSampleTreeLevel( tree, idx, total );
+
+        ImGui::TreePop();
+    }
+
+    ImGui::Separator();
+#ifdef TRACY_EXTENDED_FONT
+    if( ImGui::TreeNode( ICON_FA_FIRE " Hot spots" ) )
+#else
+    if( ImGui::TreeNode( "Hot spots" ) )
+#endif
+    {
+        // Self time of a frame is the number of samples in which it was on top of the stack.
+        flat_hash_map<uint64_t, uint32_t, nohash<uint64_t>> self;
+        std::vector<CallstackFrameTree*> stack;
+        for( auto& v : tree ) stack.push_back( &v );
+        while( !stack.empty() )
+        {
+            auto v = stack.back();
+            stack.pop_back();
+            if( v->countExclusive != 0 ) self[v->frame] += v->countExclusive;
+            for( auto& c : v->children ) stack.push_back( &c );
+        }
+
+        std::vector<std::pair<uint64_t, uint32_t>> sorted( self.begin(), self.end() );
+        pdqsort_branchless( sorted.begin(), sorted.end(), [] ( const auto& lhs, const auto& rhs ) { return lhs.second > rhs.second; } );
+
+        ImGui::Columns( 3 );
+        ImGui::Text( "Function" );
+        ImGui::NextColumn();
+        ImGui::Text( "Location" );
+        ImGui::NextColumn();
+        ImGui::Text( "Samples" );
+        ImGui::NextColumn();
+        ImGui::Separator();
+        for( auto& v : sorted )
+        {
+            auto frame = m_worker.GetCallstackFrame( v.first );
+            if( frame )
+            {
+                ImGui::TextUnformatted( m_worker.GetString( frame->name ) );
+                ImGui::NextColumn();
+                ImGui::TextDisabled( "%s:%i", m_worker.GetString( frame->file ), frame->line );
+            }
+            else
+            {
+                ImGui::Text( "0x%" PRIX64, v.first );
+                ImGui::NextColumn();
+            }
+            ImGui::NextColumn();
+            ImGui::Text( "%s (%.2f%%)", RealToString( v.second, true ), 100.f * v.second / total );
+            ImGui::NextColumn();
+        }
+        ImGui::EndColumns();
+
+        ImGui::TreePop();
+    }
+
+    ImGui::End();
+}
+
+void View::DrawSampleTreeLevel( std::vector<CallstackFrameTree>& tree, int& idx, uint32_t total )
+{
+    int lidx = 0;
+    pdqsort_branchless( tree.begin(), tree.end(), [] ( const auto& lhs, const auto& rhs ) { return lhs.countInclusive > rhs.countInclusive; } );
+    for( auto& v : tree )
+    {
+        idx++;
+        auto frame = m_worker.GetCallstackFrame( v.frame );
+        char buf[32];
+        const char* name = buf;
+        if( frame )
+        {
+            name = m_worker.GetString( frame->name );
+        }
+        else
+        {
+            sprintf( buf, "0x%" PRIX64, v.frame );
+        }
+
+        bool expand = false;
+        if( v.children.empty() )
+        {
+            ImGui::Indent( ImGui::GetTreeNodeToLabelSpacing() );
+            ImGui::TextUnformatted( name );
+            ImGui::Unindent( ImGui::GetTreeNodeToLabelSpacing() );
+        }
+        else
+        {
+            ImGui::PushID( lidx++ );
+            expand = ImGui::TreeNodeEx( name, tree.size() == 1 ? ImGuiTreeNodeFlags_DefaultOpen : 0 );
+            ImGui::PopID();
+        }
+
+        if( frame )
+        {
+            if( m_callstackTreeBuzzAnim.Match( idx ) )
+            {
+                const auto time = m_callstackTreeBuzzAnim.Time();
+                const auto indentVal = sin( time * 60.f ) * 10.f * time;
+                ImGui::SameLine( 0, ImGui::GetStyle().ItemSpacing.x + indentVal );
+            }
+            else
+            {
+                ImGui::SameLine();
+            }
+            const auto fileName = m_worker.GetString( frame->file );
+            ImGui::TextDisabled( "%s:%i", fileName, frame->line );
+            if( ImGui::IsItemClicked( 1 ) )
+            {
+                if( FileExists( fileName ) )
+                {
+                    SetTextEditorFile( fileName, frame->line );
+                }
+                else
+                {
+                    m_callstackTreeBuzzAnim.Enable( idx, 0.5f );
+                }
+            }
+        }
+
+        ImGui::SameLine();
+        ImGui::TextColored( ImVec4( 0.4, 0.4, 0.1, 1.0 ), "I:" );
+        ImGui::SameLine();
+        ImGui::TextColored( ImVec4( 0.8, 0.8, 0.2, 1.0 ), "%.2f%% (%s)", 100.f * v.countInclusive / total, RealToString( v.countInclusive, true ) );
+        if( v.countExclusive != 0 )
+        {
+            ImGui::SameLine();
+            ImGui::TextColored( ImVec4( 0.1, 0.4, 0.4, 1.0 ), "E:" );
+            ImGui::SameLine();
+            ImGui::TextColored( ImVec4( 0.2, 0.8, 0.8, 1.0 ), "%.2f%% (%s)", 100.f * v.countExclusive / total, RealToString( v.countExclusive, true ) );
+        }
+
+        if( expand )
+        {
+            DrawSampleTreeLevel( v.children, idx, total );
+            ImGui::TreePop();
+        }
+    }
+}
+
 std::pair<int8_t*, size_t> View::GetMemoryPages() const
 {
     const auto& mem = m_worker.GetMemData();
@@ -7616,7 +8315,7 @@ std::pair<int8_t*, size_t> View::GetMemoryPages() const
         {
             if( m_memInfo.restrictTime && alloc.timeAlloc > zvMid ) break;
 
-            const auto a0 = alloc.ptr - memlow;
+            const auto a0 = Worker::GetMemoryAddress( alloc.ptr ) - memlow;
             const auto a1 = a0 + alloc.size;
             int8_t val = alloc.timeFree < 0 ?
                 int8_t( std::max( int64_t( 1 ), 127 - ( ( zvMid - alloc.timeAlloc ) >> 24 ) ) ) :
@@ -7642,7 +8341,7 @@ std::pair<int8_t*, size_t> View::GetMemoryPages() const
         const auto lastTime = m_worker.GetLastTime();
         for( auto& alloc : mem.data )
         {
-            const auto a0 = alloc.ptr - memlow;
+            const auto a0 = Worker::GetMemoryAddress( alloc.ptr ) - memlow;
             const auto a1 = a0 + alloc.size;
             const int8_t val = alloc.timeFree < 0 ?
                 int8_t( std::max( int64_t( 1 ), 127 - ( ( lastTime - std::min( lastTime, alloc.timeAlloc ) ) >> 24 ) ) ) :
@@ -7918,6 +8617,17 @@ void View::ZoneTooltip( const ZoneEvent& ev )
     ImGui::TextDisabled( "(0x%" PRIX64 ")", tid );
     ImGui::Separator();
     TextFocused( "Execution time:", TimeToString( end - ev.start ) );
+    int64_t running;
+    uint64_t switches;
+    if( m_worker.GetRunningTime( tid, ev.start, end, running, switches ) )
+    {
+        TextFocused( "Running time:", TimeToString( running ) );
+        if( end > ev.start )
+        {
+            ImGui::SameLine();
+            ImGui::TextDisabled( "(%.2f%%)", 100.f * running / ( end - ev.start ) );
+        }
+    }
     if( ev.cpu_start >= 0 )
     {
         ImGui::TextDisabled( "CPU:" );
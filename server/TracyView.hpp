@@ -84,6 +84,7 @@ private:
     int DispatchGpuZoneLevel( const Vector<GpuEvent*>& vec, bool hover, double pxns, const ImVec2& wpos, int offset, int depth, uint64_t thread, float yMin, float yMax, int64_t begin, int drift );
     int DrawGpuZoneLevel( const Vector<GpuEvent*>& vec, bool hover, double pxns, const ImVec2& wpos, int offset, int depth, uint64_t thread, float yMin, float yMax, int64_t begin, int drift );
     int SkipGpuZoneLevel( const Vector<GpuEvent*>& vec, bool hover, double pxns, const ImVec2& wpos, int offset, int depth, uint64_t thread, float yMin, float yMax, int64_t begin, int drift );
+    void DrawContextSwitches( const ThreadData* td, bool hover, double pxns, const ImVec2& wpos, int offset, float yMin, float yMax );
     int DrawLocks( uint64_t tid, bool hover, double pxns, const ImVec2& wpos, int offset, LockHighlight& highlight, float yMin, float yMax );
     int DrawPlots( int offset, double pxns, const ImVec2& wpos, bool hover, float yMin, float yMax );
     void DrawPlotPoint( const ImVec2& wpos, float x, float y, int offset, uint32_t color, bool hover, bool hasPrev, const PlotItem* item, double prev, bool merged, PlotType type, float PlotHeight );
@@ -93,6 +94,7 @@ private:
     void DrawFindZone();
     void DrawStatistics();
     void DrawMemory();
+    void DrawSamples();
     void DrawCompare();
     void DrawCallstackWindow();
     void DrawMemoryAllocWindow();
@@ -104,6 +106,8 @@ private:
 
     std::vector<CallstackFrameTree> GetCallstackFrameTree( const MemData& mem ) const;
     void DrawFrameTreeLevel( std::vector<CallstackFrameTree>& tree, int& idx );
+    std::vector<CallstackFrameTree> GetSampleFrameTree( uint32_t& total ) const;
+    void DrawSampleTreeLevel( std::vector<CallstackFrameTree>& tree, int& idx, uint32_t total );
 
     void DrawInfoWindow();
     void DrawZoneInfoWindow();
@@ -241,10 +245,13 @@ private:
     bool m_drawZones;
     bool m_drawLocks;
     bool m_drawPlots;
+    bool m_drawContextSwitches;
     bool m_onlyContendedLocks;
 
     int m_statSort;
     bool m_statSelf;
+    int m_throttleRate;
+    int m_throttleTime;
     bool m_showCallstackFrameAddress;
 
     Namespace m_namespace;
@@ -385,6 +392,11 @@ private:
         bool restrictTime = false;
     } m_memInfo;
 
+    struct {
+        bool show = false;
+        bool limitView = false;
+    } m_sampleInfo;
+
     struct {
         std::vector<int64_t> data;
         const FrameData* frameSet = nullptr;
@@ -183,11 +183,35 @@ static inline void UpdateLockCount( LockMap& lockmap, size_t pos )
     }
 }
 
+#ifndef TRACY_NO_STATISTICS
+static inline void AddZoneCountersHw( ZoneCountersSum& sum, const ZoneCounters& zc )
+{
+    sum.hwCount++;
+    sum.cycles += zc.cycles;
+    sum.instructions += zc.instructions;
+}
+
+static inline void AddZoneCounters( ZoneCountersSum& sum, const ZoneCounters& zc )
+{
+    sum.count++;
+    sum.taskClock += zc.taskClock;
+    sum.pageFaults += zc.pageFaults;
+    sum.contextSwitches += zc.contextSwitches;
+    if( zc.hardware ) AddZoneCountersHw( sum, zc );
+}
+#endif
+
 
 LoadProgress Worker::s_loadProgress;
 
-Worker::Worker( const char* addr )
+Worker::Worker( const char* addr, const char* port, FILE* record )
     : m_addr( addr )
+    , m_port( port )
+    , m_rawFile( nullptr )
+    , m_rawCompressed( true )
+    , m_flightRecord( false )
+    , m_record( record )
+    , m_ingestStats( nullptr )
     , m_connected( false )
     , m_hasData( false )
     , m_shutdown( false )
@@ -196,6 +220,12 @@ Worker::Worker( const char* addr )
     , m_stream( LZ4_createStreamDecode() )
     , m_buffer( new char[TargetFrameSize*3 + 1] )
     , m_bufferOffset( 0 )
+    , m_protocol( ProtocolBase )
+    , m_refTime( 0 )
+    , m_threadCtx( 0 )
+    , m_throttleRate( 0 )
+    , m_throttleDuration( 0 )
+    , m_sourceLocationKey( 0 )
     , m_pendingStrings( 0 )
     , m_pendingThreads( 0 )
     , m_pendingSourceLocation( 0 )
@@ -216,14 +246,84 @@ Worker::Worker( const char* addr )
     SetThreadName( m_thread, "Tracy Worker" );
 }
 
+Worker::Worker( FILE* raw, IngestStats* stats )
+    : m_rawFile( raw )
+    , m_rawCompressed( true )
+    , m_flightRecord( false )
+    , m_record( nullptr )
+    , m_ingestStats( stats )
+    , m_connected( false )
+    , m_hasData( false )
+    , m_shutdown( false )
+    , m_terminate( false )
+    , m_crashed( false )
+    , m_stream( LZ4_createStreamDecode() )
+    , m_buffer( new char[TargetFrameSize*3 + 1] )
+    , m_bufferOffset( 0 )
+    , m_protocol( ProtocolBase )
+    , m_refTime( 0 )
+    , m_threadCtx( 0 )
+    , m_throttleRate( 0 )
+    , m_throttleDuration( 0 )
+    , m_sourceLocationKey( 0 )
+    , m_pendingStrings( 0 )
+    , m_pendingThreads( 0 )
+    , m_pendingSourceLocation( 0 )
+    , m_pendingCallstackFrames( 0 )
+    , m_traceVersion( CurrentVersion )
+{
+    char hdr[RawCaptureHeaderSize];
+    WelcomeMessage welcome;
+    if( fread( hdr, 1, RawCaptureHeaderSize, raw ) != RawCaptureHeaderSize ||
+        ( memcmp( hdr, RawCaptureHeader, RawCaptureHeaderSize ) != 0 && memcmp( hdr, FlightCaptureHeader, RawCaptureHeaderSize ) != 0 && memcmp( hdr, RecordCaptureHeader, RawCaptureHeaderSize ) != 0 ) ||
+        fread( &welcome, 1, sizeof( welcome ), raw ) != sizeof( welcome ) )
+    {
+        delete[] m_buffer;
+        LZ4_freeStreamDecode( m_stream );
+        throw NotTracyDump();
+    }
+    if( welcome.protocol > ProtocolVersion )
+    {
+        delete[] m_buffer;
+        LZ4_freeStreamDecode( m_stream );
+        throw UnsupportedVersion( 0 );
+    }
+    fseek( raw, RawCaptureHeaderSize, SEEK_SET );
+    m_flightRecord = memcmp( hdr, FlightCaptureHeader, RawCaptureHeaderSize ) == 0;
+    m_rawCompressed = memcmp( hdr, RecordCaptureHeader, RawCaptureHeaderSize ) != 0;
+
+    m_data.sourceLocationExpand.push_back( 0 );
+    m_data.threadExpand.push_back( 0 );
+    m_data.callstackPayload.push_back( nullptr );
+
+    memset( m_gpuCtxMap, 0, sizeof( m_gpuCtxMap ) );
+
+#ifndef TRACY_NO_STATISTICS
+    m_data.sourceLocationZonesReady = true;
+#endif
+
+    // The stream is processed just like a live connection, without a
+    // separate thread, as there's nothing to wait for.
+    Exec();
+    m_rawFile = nullptr;
+}
+
 Worker::Worker( FileRead& f, EventType::Type eventMask )
-    : m_connected( false )
+    : m_rawFile( nullptr )
+    , m_rawCompressed( true )
+    , m_flightRecord( false )
+    , m_record( nullptr )
+    , m_ingestStats( nullptr )
+    , m_connected( false )
     , m_hasData( true )
     , m_shutdown( false )
     , m_terminate( false )
     , m_crashed( false )
     , m_stream( nullptr )
     , m_buffer( nullptr )
+    , m_throttleRate( 0 )
+    , m_throttleDuration( 0 )
+    , m_sourceLocationKey( 0 )
 {
     m_data.threadExpand.push_back( 0 );
     m_data.callstackPayload.push_back( nullptr );
@@ -501,6 +601,14 @@ Worker::Worker( FileRead& f, EventType::Type eventMask )
             f.Read( lockmap.srcloc );
             f.Read( lockmap.type );
             f.Read( lockmap.valid );
+            if( fileVer >= FileVersion( 0, 3, 209 ) )
+            {
+                f.Read( lockmap.contention );
+            }
+            else
+            {
+                lockmap.contention = false;
+            }
             f.Read( tsz );
             for( uint64_t i=0; i<tsz; i++ )
             {
@@ -573,6 +681,7 @@ Worker::Worker( FileRead& f, EventType::Type eventMask )
             f.Skip( sizeof( uint32_t ) + sizeof( LockMap::srcloc ) );
             f.Read( type );
             f.Skip( sizeof( LockMap::valid ) );
+            if( fileVer >= FileVersion( 0, 3, 209 ) ) f.Skip( sizeof( LockMap::contention ) );
             f.Read( tsz );
             f.Skip( tsz * sizeof( uint64_t ) );
             f.Read( tsz );
@@ -618,6 +727,20 @@ Worker::Worker( FileRead& f, EventType::Type eventMask )
         }
     }
 
+    m_loadZoneIdx = 0;
+    if( fileVer >= FileVersion( 0, 3, 211 ) )
+    {
+        f.Read( sz );
+        m_data.zoneCounters.reserve( sz );
+        m_loadZoneCounters.resize( sz );
+        for( uint64_t i=0; i<sz; i++ )
+        {
+            auto& v = m_loadZoneCounters[sz-1-i];
+            f.Read( v.first );
+            f.Read( &v.second, sizeof( ZoneCounters ) );
+        }
+    }
+
     s_loadProgress.progress.store( LoadProgress::Zones, std::memory_order_relaxed );
     f.Read( sz );
     m_data.threads.reserve_exact( sz );
@@ -662,6 +785,8 @@ Worker::Worker( FileRead& f, EventType::Type eventMask )
         }
         m_data.threads[i] = td;
     }
+    assert( m_loadZoneCounters.empty() );
+    std::vector<std::pair<uint64_t, ZoneCounters>>().swap( m_loadZoneCounters );
 
 #ifndef TRACY_NO_STATISTICS
     m_threadZones = std::thread( [this] {
@@ -889,6 +1014,54 @@ Worker::Worker( FileRead& f, EventType::Type eventMask )
         m_data.callstackFrameMap.emplace( ptr, frame );
     }
 
+    if( fileVer >= FileVersion( 0, 3, 206 ) )
+    {
+        for( auto& td : m_data.threads )
+        {
+            f.Read( sz );
+            if( sz == 0 ) continue;
+            td->samples.reserve_exact( sz );
+            f.Read( td->samples.data(), sz * sizeof( SampleData ) );
+            m_data.samplesCnt += sz;
+        }
+    }
+
+    if( fileVer >= FileVersion( 0, 3, 207 ) )
+    {
+        f.Read( sz );
+        m_data.zoneAggregates.reserve( sz );
+        for( uint64_t i=0; i<sz; i++ )
+        {
+            int32_t srcloc;
+            f.Read( srcloc );
+            ZoneAggregateData agg;
+            f.Read( &agg, sizeof( ZoneAggregateData ) );
+            m_data.zoneAggregates.emplace( srcloc, agg );
+        }
+    }
+
+    if( fileVer >= FileVersion( 0, 3, 208 ) )
+    {
+        f.Read( sz );
+        if( sz != 0 )
+        {
+            m_data.droppedEvents.reserve_exact( sz );
+            f.Read( m_data.droppedEvents.data(), sz * sizeof( DroppedEventsData ) );
+        }
+    }
+
+    if( fileVer >= FileVersion( 0, 3, 210 ) )
+    {
+        for( auto& td : m_data.threads )
+        {
+            f.Read( sz );
+            if( sz == 0 ) continue;
+            td->ctxSwitch.reserve_exact( sz );
+            f.Read( td->ctxSwitch.data(), sz * sizeof( ContextSwitchData ) );
+            m_data.ctxSwitchCnt += sz;
+        }
+    }
+
 finishLoading:
     if( reconstructMemAllocPlot )
     {
@@ -1069,6 +1242,12 @@ const CallstackFrame* Worker::GetCallstackFrame( uint64_t ptr ) const
     }
 }
 
+const ZoneCounters* Worker::GetZoneCounters( const ZoneEvent& ev ) const
+{
+    auto it = m_data.zoneCounters.find( &ev );
+    return it != m_data.zoneCounters.end() ? &it->second : nullptr;
+}
+
 int64_t Worker::GetZoneEnd( const ZoneEvent& ev )
 {
     auto ptr = &ev;
@@ -1091,6 +1270,26 @@ int64_t Worker::GetZoneEnd( const GpuEvent& ev )
     }
 }
 
+bool Worker::GetRunningTime( uint64_t thread, int64_t start, int64_t end, int64_t& running, uint64_t& switches ) const
+{
+    auto tit = std::find_if( m_data.threads.begin(), m_data.threads.end(), [thread] ( const auto& v ) { return v->id == thread; } );
+    if( tit == m_data.threads.end() ) return false;
+    auto& vec = (*tit)->ctxSwitch;
+    if( vec.empty() || vec.front().start > start ) return false;
+
+    running = 0;
+    switches = 0;
+    auto it = std::lower_bound( vec.begin(), vec.end(), start, [this] ( const auto& l, const auto& r ) { return GetContextSwitchEnd( l ) < r; } );
+    while( it != vec.end() && it->start < end )
+    {
+        const auto csEnd = GetContextSwitchEnd( *it );
+        running += std::min( csEnd, end ) - std::max( it->start, start );
+        if( it->end >= 0 && it->end < end ) switches++;
+        ++it;
+    }
+    return true;
+}
+
 const char* Worker::GetString( uint64_t ptr ) const
 {
     const auto it = m_data.strings.find( ptr );
@@ -1270,20 +1469,52 @@ void Worker::Exec()
 
     auto ShouldExit = [this]
     {
+        // Called while waiting for data, so that queries requested by the
+        // user don't wait for the next frame.
+        SendPendingQueries();
         return m_shutdown.load( std::memory_order_relaxed );
     };
 
+    auto Read = [this, &tv, &ShouldExit] ( void* buf, int len )
+    {
+        if( m_rawFile ) return fread( buf, 1, len, m_rawFile ) == size_t( len );
+        return m_sock.Read( buf, len, &tv, ShouldExit );
+    };
+
     auto lz4buf = std::make_unique<char[]>( LZ4Size );
     for(;;)
     {
         if( m_shutdown.load( std::memory_order_relaxed ) ) return;
-        if( !m_sock.Connect( m_addr.c_str(), "8086" ) ) continue;
+        if( !m_rawFile )
+        {
+            if( m_addr.compare( 0, 4, "shm:" ) == 0 )
+            {
+                if( !m_sock.ConnectShm( m_addr.c_str() + 4 ) )
+                {
+                    std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+                    continue;
+                }
+            }
+            else if( !m_sock.Connect( m_addr.c_str(), m_port.c_str() ) )
+            {
+                continue;
+            }
+        }
+        const auto compressed = m_rawFile ? m_rawCompressed : m_sock.IsCompressed();
+        m_mbpsData.compressed = compressed;
 
         std::chrono::time_point<std::chrono::high_resolution_clock> t0;
 
         uint64_t bytes = 0;
         uint64_t decBytes = 0;
 
+        if( !m_rawFile )
+        {
+            HandshakeMessage handshake;
+            handshake.protocol = ProtocolVersion;
+            m_sock.Send( &handshake, sizeof( handshake ) );
+        }
+
         m_data.framesBase = m_data.frames.Retrieve( 0, [this] ( uint64_t name ) {
             auto fd = m_slab.AllocInit<FrameData>();
             fd->name = name;
@@ -1297,7 +1528,21 @@ void Worker::Exec()
 
         {
             WelcomeMessage welcome;
-            if( !m_sock.Read( &welcome, sizeof( welcome ), &tv, ShouldExit ) ) goto close;
+            if( !Read( &welcome, sizeof( welcome ) ) ) goto close;
+            m_protocol.store( welcome.protocol, std::memory_order_relaxed );
+            {
+                std::lock_guard<TracyMutex> lock( m_data.lock );
+                m_srclocState.clear();
+                m_zoneThrottle.clear();
+            }
+            {
+                std::lock_guard<TracyMutex> lock( m_pendingQueriesLock );
+                m_pendingQueries.clear();
+            }
+            m_refTime = 0;
+            m_threadCtx = 0;
+            m_srclocIds.clear();
+            m_callstackIds.clear();
             m_timerMul = welcome.timerMul;
             const auto initEnd = TscTime( welcome.initEnd );
             m_data.framesBase->frames.push_back( FrameEvent{ TscTime( welcome.initBegin ), -1 } );
@@ -1319,11 +1564,18 @@ void Worker::Exec()
 
             m_hostInfo = welcome.hostInfo;
 
+            if( m_record )
+            {
+                fwrite( RecordCaptureHeader, 1, RawCaptureHeaderSize, m_record );
+                fwrite( &welcome, 1, sizeof( welcome ), m_record );
+            }
+
             if( welcome.onDemand != 0 )
             {
                 OnDemandPayloadMessage onDemand;
-                if( !m_sock.Read( &onDemand, sizeof( onDemand ), &tv, ShouldExit ) ) goto close;
+                if( !Read( &onDemand, sizeof( onDemand ) ) ) goto close;
                 m_data.frameOffset = onDemand.frames;
+                if( m_record ) fwrite( &onDemand, 1, sizeof( onDemand ), m_record );
             }
         }
 
@@ -1340,30 +1592,93 @@ void Worker::Exec()
 
             auto buf = m_buffer + m_bufferOffset;
             lz4sz_t lz4sz;
-            if( !m_sock.Read( &lz4sz, sizeof( lz4sz ), &tv, ShouldExit ) ) goto close;
-            if( !m_sock.Read( lz4buf.get(), lz4sz, &tv, ShouldExit ) ) goto close;
+            if( !Read( &lz4sz, sizeof( lz4sz ) ) ) goto close;
+            int sz;
+            if( compressed )
+            {
+                if( lz4sz > LZ4Size || !Read( lz4buf.get(), lz4sz ) ) goto close;
+                sz = LZ4_decompress_safe_continue( m_stream, lz4buf.get(), buf, lz4sz, TargetFrameSize );
+                assert( sz >= 0 );
+            }
+            else
+            {
+                if( lz4sz > TargetFrameSize || !Read( buf, lz4sz ) ) goto close;
+                sz = lz4sz;
+            }
             bytes += sizeof( lz4sz ) + lz4sz;
-
-            auto sz = LZ4_decompress_safe_continue( m_stream, lz4buf.get(), buf, lz4sz, TargetFrameSize );
-            assert( sz >= 0 );
             decBytes += sz;
 
+            if( m_record )
+            {
+                const lz4sz_t recsz = sz;
+                fwrite( &recsz, 1, sizeof( recsz ), m_record );
+                fwrite( buf, 1, sz, m_record );
+            }
+
             char* ptr = buf;
             const char* end = buf + sz;
 
+            if( m_flightRecord )
+            {
+                // Each frame of a flight record starts from scratch, as the
+                // previous one may have been dropped.
+                m_refTime = 0;
+                m_threadCtx = 0;
+                m_srclocIds.clear();
+            }
+
             {
                 std::lock_guard<TracyMutex> lock( m_data.lock );
-                while( ptr < end )
+                if( !m_ingestStats || !m_ingestStats->timeEvents )
+                {
+                    while( ptr < end )
+                    {
+                        auto ev = (const QueueItem*)ptr;
+                        DispatchProcess( *ev, ptr );
+                    }
+                }
+                else
+                {
+                    while( ptr < end )
+                    {
+                        auto ev = (const QueueItem*)ptr;
+                        const auto idx = ev->hdr.idx;
+                        const auto t0 = std::chrono::high_resolution_clock::now();
+                        DispatchProcess( *ev, ptr );
+                        const auto t1 = std::chrono::high_resolution_clock::now();
+                        m_ingestStats->count[idx]++;
+                        m_ingestStats->time[idx] += std::chrono::duration_cast<std::chrono::nanoseconds>( t1 - t0 ).count();
+                    }
+                }
+
+                for( auto& v : m_flightQueries )
                 {
-                    auto ev = (const QueueItem*)ptr;
-                    DispatchProcess( *ev, ptr );
+                    auto it = m_flightNames.find( v.second );
+                    if( it == m_flightNames.end() ) continue;
+                    if( v.first == ServerQueryPlotName )
+                    {
+                        HandlePlotName( v.second, (char*)it->second, strlen( it->second ) );
+                    }
+                    else
+                    {
+                        HandleFrameName( v.second, (char*)it->second, strlen( it->second ) );
+                    }
                 }
+                m_flightQueries.clear();
 
                 m_bufferOffset += sz;
                 if( m_bufferOffset > TargetFrameSize * 2 ) m_bufferOffset = 0;
 
                 HandlePostponedPlots();
+
+                if( m_ingestStats )
+                {
+                    m_ingestStats->frames++;
+                    m_ingestStats->bytes += sz;
+                    m_ingestStats->peakMemory = std::max( m_ingestStats->peakMemory, memUsage.load( std::memory_order_relaxed ) );
+                }
             }
+            SendPendingQueries();
 
             auto t1 = std::chrono::high_resolution_clock::now();
             auto td = std::chrono::duration_cast<std::chrono::milliseconds>( t1 - t0 ).count();
@@ -1405,9 +1720,73 @@ void Worker::Exec()
         }
 
 close:
+        // Only the first connection is recorded.
+        if( m_record )
+        {
+            fflush( m_record );
+            m_record = nullptr;
+        }
         m_sock.Close();
         m_connected.store( false, std::memory_order_relaxed );
+        if( m_rawFile ) return;
+    }
+}
+
+Worker::SourceLocationState Worker::GetSourceLocationState( int32_t srcloc ) const
+{
+    auto it = m_srclocState.find( srcloc );
+    return it == m_srclocState.end() ? SourceLocationState::Enabled : it->second;
+}
+
+void Worker::SetSourceLocationState( int32_t srcloc, SourceLocationState state )
+{
+    assert( CanToggleSourceLocation( srcloc ) );
+    assert( state != SourceLocationState::Aggregated || CanAggregateSourceLocation( srcloc ) );
+    if( GetSourceLocationState( srcloc ) == state ) return;
+
+    uint8_t query;
+    switch( state )
+    {
+    case SourceLocationState::Enabled:
+        m_srclocState.erase( srcloc );
+        m_zoneThrottle.erase( srcloc );
+        query = ServerQueryEnableSourceLocation;
+        break;
+    case SourceLocationState::Disabled:
+        m_srclocState[srcloc] = state;
+        query = ServerQueryDisableSourceLocation;
+        break;
+    case SourceLocationState::Aggregated:
+        m_srclocState[srcloc] = state;
+        query = ServerQueryAggregateSourceLocation;
+        break;
+    default:
+        assert( false );
+        return;
+    }
+    // Sent by the network thread, as soon as it's idle or done with the
+    // current batch of data.
+    std::lock_guard<TracyMutex> lock( m_pendingQueriesLock );
+    m_pendingQueries.emplace_back( query, m_data.sourceLocationExpand[srcloc] );
+}
+
+void Worker::SendPendingQueries()
+{
+    if( !m_connected.load( std::memory_order_relaxed ) ) return;
+    std::vector<std::pair<uint8_t, uint64_t>> queries;
+    {
+        std::lock_guard<TracyMutex> lock( m_pendingQueriesLock );
+        if( m_pendingQueries.empty() ) return;
+        std::swap( queries, m_pendingQueries );
     }
+    for( auto& v : queries ) ServerQuery( v.first, v.second );
+}
+
+void Worker::SetZoneThrottle( uint32_t rate, int64_t duration )
+{
+    m_throttleRate = rate;
+    m_throttleDuration = duration;
+    m_zoneThrottle.clear();
 }
 
 void Worker::ServerQuery( uint8_t type, uint64_t data )
@@ -1416,12 +1795,19 @@ void Worker::ServerQuery( uint8_t type, uint64_t data )
     char tmp[DataSize];
     memcpy( tmp, &type, sizeof( type ) );
     memcpy( tmp + sizeof( type ), &data, sizeof( data ) );
+    if( m_rawFile )
+    {
+        // Plot and frame names are defined at the start of a flight record,
+        // but the plots and frames can only be created by their events.
+        if( m_flightRecord && ( type == ServerQueryPlotName || type == ServerQueryFrameName ) ) m_flightQueries.emplace_back( type, data );
+        return;
+    }
     m_sock.Send( tmp, DataSize );
 }
 
 void Worker::DispatchProcess( const QueueItem& ev, char*& ptr )
 {
-    if( ev.hdr.idx >= (int)QueueType::StringData )
+    if( IsQueueStringTransfer( ev.hdr.type ) )
     {
         ptr += sizeof( QueueHeader ) + sizeof( QueueStringTransfer );
         uint16_t sz;
@@ -1432,6 +1818,15 @@ void Worker::DispatchProcess( const QueueItem& ev, char*& ptr )
         case QueueType::CustomStringData:
             AddCustomString( ev.stringTransfer.ptr, ptr, sz );
             break;
+        case QueueType::InternedStringData:
+            AddInternedString( ev.stringTransfer.ptr, ptr, sz );
+            break;
+        case QueueType::PlotBatchPayload:
+            ProcessPlotBatch( ev.stringTransfer.ptr, ptr, sz );
+            break;
+        case QueueType::GpuTimePayload:
+            ProcessGpuTimeBatch( ev.stringTransfer.ptr, ptr, sz );
+            break;
         case QueueType::StringData:
             AddString( ev.stringTransfer.ptr, ptr, sz );
             break;
@@ -1447,6 +1842,9 @@ void Worker::DispatchProcess( const QueueItem& ev, char*& ptr )
         case QueueType::CallstackPayload:
             AddCallstackPayload( ev.stringTransfer.ptr, ptr, sz );
             break;
+        case QueueType::CallstackPayloadCached:
+            AddCallstackPayloadCached( ev.stringTransfer.ptr, ptr, sz );
+            break;
         case QueueType::FrameName:
             HandleFrameName( ev.stringTransfer.ptr, ptr, sz );
             break;
@@ -1456,6 +1854,12 @@ void Worker::DispatchProcess( const QueueItem& ev, char*& ptr )
         }
         ptr += sz;
     }
+    else if( IsQueueCompact( ev.hdr.type ) )
+    {
+        const char* cptr = ptr + sizeof( QueueHeader );
+        DispatchCompact( ev.hdr.type, cptr );
+        ptr = (char*)cptr;
+    }
     else
     {
         ptr += QueueDataSize[ev.hdr.idx];
@@ -1463,6 +1867,57 @@ void Worker::DispatchProcess( const QueueItem& ev, char*& ptr )
     }
 }
 
+void Worker::DispatchCompact( QueueType type, const char*& ptr )
+{
+    m_refTime += ReadVarintSigned( ptr );
+    const auto cpu = uint32_t( ReadVarint( ptr ) ) - 1;
+
+    switch( type )
+    {
+    case QueueType::ZoneBeginCompact:
+    case QueueType::ZoneBeginCallstackCompact:
+    {
+        QueueZoneBegin ev;
+        ev.time = m_refTime;
+        ev.thread = m_threadCtx;
+        ev.cpu = cpu;
+        const auto id = ReadVarint( ptr );
+        if( id == 0 )
+        {
+            memcpy( &ev.srcloc, ptr, sizeof( ev.srcloc ) );
+            ptr += sizeof( ev.srcloc );
+            m_srclocIds.push_back( ev.srcloc );
+        }
+        else
+        {
+            assert( id <= m_srclocIds.size() );
+            ev.srcloc = m_srclocIds[id-1];
+        }
+        if( type == QueueType::ZoneBeginCompact )
+        {
+            ProcessZoneBegin( ev );
+        }
+        else
+        {
+            ProcessZoneBeginCallstack( ev );
+        }
+        break;
+    }
+    case QueueType::ZoneEndCompact:
+    {
+        QueueZoneEnd ev;
+        ev.time = m_refTime;
+        ev.thread = m_threadCtx;
+        ev.cpu = cpu;
+        ProcessZoneEnd( ev );
+        break;
+    }
+    default:
+        assert( false );
+        break;
+    }
+}
+
 void Worker::CheckSourceLocation( uint64_t ptr )
 {
     if( m_data.sourceLocation.find( ptr ) == m_data.sourceLocation.end() )
@@ -1601,6 +2056,13 @@ void Worker::NewZone( ZoneEvent* zone, uint64_t thread )
     }
 }
 
+// A flight record may start while a lock is held. Each thread's lock events are
+// accepted only after its first wait event, so that the lock state is valid.
+bool Worker::IsLockThreadKnown( const LockMap& lockmap, uint64_t thread ) const
+{
+    return lockmap.threadMap.find( thread ) != lockmap.threadMap.end();
+}
+
 void Worker::InsertLockEvent( LockMap& lockmap, LockEvent* lev, uint64_t thread )
 {
     m_data.lastTime = std::max( m_data.lastTime, lev->time );
@@ -1658,11 +2120,27 @@ void Worker::CheckThreadString( uint64_t id )
 
 void Worker::AddSourceLocation( const QueueSourceLocation& srcloc )
 {
-    assert( m_pendingSourceLocation > 0 );
-    m_pendingSourceLocation--;
+    uint64_t ptr;
+    if( m_sourceLocationKey != 0 )
+    {
+        ptr = m_sourceLocationKey;
+        m_sourceLocationKey = 0;
+        auto qit = std::find( m_sourceLocationQueue.begin(), m_sourceLocationQueue.end(), ptr );
+        if( qit != m_sourceLocationQueue.end() )
+        {
+            m_sourceLocationQueue.erase( qit );
+            m_pendingSourceLocation--;
+        }
+        m_data.sourceLocation.emplace( ptr, SourceLocation {} );
+    }
+    else
+    {
+        assert( m_pendingSourceLocation > 0 );
+        m_pendingSourceLocation--;
 
-    const auto ptr = m_sourceLocationQueue.front();
-    m_sourceLocationQueue.erase( m_sourceLocationQueue.begin() );
+        ptr = m_sourceLocationQueue.front();
+        m_sourceLocationQueue.erase( m_sourceLocationQueue.begin() );
+    }
 
     auto it = m_data.sourceLocation.find( ptr );
     assert( it != m_data.sourceLocation.end() );
@@ -1724,21 +2202,35 @@ void Worker::AddSourceLocationPayload( uint64_t ptr, char* data, size_t sz )
 
 void Worker::AddString( uint64_t ptr, char* str, size_t sz )
 {
+    const auto sl = StoreString( str, sz );
+    auto it = m_data.strings.find( ptr );
+    if( it == m_data.strings.end() )
+    {
+        // Defined ahead of use in a flight record.
+        assert( m_flightRecord );
+        m_data.strings.emplace( ptr, sl.ptr );
+        return;
+    }
     assert( m_pendingStrings > 0 );
     m_pendingStrings--;
-    auto it = m_data.strings.find( ptr );
-    assert( it != m_data.strings.end() && strcmp( it->second, "???" ) == 0 );
-    const auto sl = StoreString( str, sz );
+    assert( strcmp( it->second, "???" ) == 0 );
     it->second = sl.ptr;
 }
 
 void Worker::AddThreadString( uint64_t id, char* str, size_t sz )
 {
+    const auto sl = StoreString( str, sz );
+    auto it = m_data.threadNames.find( id );
+    if( it == m_data.threadNames.end() )
+    {
+        // Defined ahead of use in a flight record.
+        assert( m_flightRecord );
+        m_data.threadNames.emplace( id, sl.ptr );
+        return;
+    }
     assert( m_pendingThreads > 0 );
     m_pendingThreads--;
-    auto it = m_data.threadNames.find( id );
-    assert( it != m_data.threadNames.end() && strcmp( it->second, "???" ) == 0 );
-    const auto sl = StoreString( str, sz );
+    assert( strcmp( it->second, "???" ) == 0 );
     it->second = sl.ptr;
 }
 
@@ -1748,10 +2240,43 @@ void Worker::AddCustomString( uint64_t ptr, char* str, size_t sz )
     m_pendingCustomStrings.emplace( ptr, StoreString( str, sz ) );
 }
 
-void Worker::AddCallstackPayload( uint64_t ptr, char* _data, size_t sz )
+void Worker::AddInternedString( uint64_t ptr, char* str, size_t sz )
+{
+    assert( m_internedStrings.find( ptr ) == m_internedStrings.end() );
+    m_internedStrings.emplace( ptr, StoreString( str, sz ) );
+}
+
+// Interned strings (pointers with the lowest bit set) are defined once and
+// used by any number of events. Other custom strings are used by one event.
+StringLocation Worker::GetCustomString( uint64_t ptr )
+{
+    if( ptr & 1 )
+    {
+        auto it = m_internedStrings.find( ptr );
+        assert( it != m_internedStrings.end() );
+        return it->second;
+    }
+    auto it = m_pendingCustomStrings.find( ptr );
+    assert( it != m_pendingCustomStrings.end() );
+    const auto ret = it->second;
+    m_pendingCustomStrings.erase( it );
+    return ret;
+}
+
+void Worker::AddCallstackPayload( uint64_t ptr, char* data, size_t sz )
 {
     assert( m_pendingCallstacks.find( ptr ) == m_pendingCallstacks.end() );
+    m_pendingCallstacks.emplace( ptr, InsertCallstackPayload( data, sz ) );
+}
+
+void Worker::AddCallstackPayloadCached( uint64_t id, char* data, size_t sz )
+{
+    assert( id == m_callstackIds.size() );
+    m_callstackIds.push_back( InsertCallstackPayload( data, sz ) );
+}
 
+uint32_t Worker::InsertCallstackPayload( char* _data, size_t sz )
+{
     const auto memsize = sizeof( VarArray<uint64_t> ) + sz;
     auto mem = (char*)m_slab.AllocRaw( memsize );
 
@@ -1785,7 +2310,7 @@ void Worker::AddCallstackPayload( uint64_t ptr, char* _data, size_t sz )
         m_slab.Unalloc( memsize );
     }
 
-    m_pendingCallstacks.emplace( ptr, idx );
+    return idx;
 }
 
 void Worker::InsertPlot( PlotData* plot, int64_t time, double val )
@@ -1818,9 +2343,57 @@ void Worker::InsertPlot( PlotData* plot, int64_t time, double val )
     }
 }
 
+// Samples which are in order (equal times included, as batches are often
+// filled faster than the timer resolution) are appended in bulk. The rest go
+// through the postponed sorting of InsertPlot.
+void Worker::ProcessPlotBatch( uint64_t name, const char* data, size_t sz )
+{
+    assert( sz % sizeof( PlotSample ) == 0 );
+    const auto cnt = sz / sizeof( PlotSample );
+    if( cnt == 0 ) return;
+
+    PlotData* plot = RetrievePlot( name );
+    auto& dst = plot->data;
+    dst.reserve( dst.size() + cnt );
+    auto last = dst.empty() ? std::numeric_limits<int64_t>::min() : dst.back().time;
+    auto lastTime = m_data.lastTime;
+    for( size_t i=0; i<cnt; i++ )
+    {
+        PlotSample sample;
+        memcpy( &sample, data + i * sizeof( PlotSample ), sizeof( PlotSample ) );
+        const auto time = TscTime( sample.time );
+        lastTime = std::max( lastTime, time );
+        if( time >= last )
+        {
+            if( dst.empty() )
+            {
+                plot->min = sample.val;
+                plot->max = sample.val;
+            }
+            else
+            {
+                plot->min = std::min( plot->min, sample.val );
+                plot->max = std::max( plot->max, sample.val );
+            }
+            dst.push_back_no_space_check( { time, sample.val } );
+            last = time;
+        }
+        else
+        {
+            InsertPlot( plot, time, sample.val );
+        }
+    }
+    m_data.lastTime = lastTime;
+}
+
 void Worker::HandlePlotName( uint64_t name, char* str, size_t sz )
 {
     const auto sl = StoreString( str, sz );
+    if( m_flightRecord && !m_data.plots.IsPending( name ) )
+    {
+        m_flightNames.emplace( name, sl.ptr );
+        return;
+    }
     m_data.plots.StringDiscovered( name, sl, m_data.strings, [this] ( PlotData* dst, PlotData* src ) {
         for( auto& v : src->data )
         {
@@ -1832,6 +2405,11 @@ void Worker::HandlePlotName( uint64_t name, char* str, size_t sz )
 void Worker::HandleFrameName( uint64_t name, char* str, size_t sz )
 {
     const auto sl = StoreString( str, sz );
+    if( m_flightRecord && !m_data.frames.IsPending( name ) )
+    {
+        m_flightNames.emplace( name, sl.ptr );
+        return;
+    }
     m_data.frames.StringDiscovered( name, sl, m_data.strings, [this] ( FrameData* dst, FrameData* src ) {
         auto sz = dst->frames.size();
         dst->frames.insert( dst->frames.end(), src->frames.begin(), src->frames.end() );
@@ -1987,6 +2565,39 @@ void Worker::Process( const QueueItem& ev )
     case QueueType::Callstack:
         ProcessCallstack( ev.callstack );
         break;
+    case QueueType::CallstackMemoryCached:
+        ProcessCallstackMemoryCached( ev.callstackMemoryCached );
+        break;
+    case QueueType::CallstackCached:
+        ProcessCallstackCached( ev.callstackCached );
+        break;
+    case QueueType::CallstackSample:
+        ProcessCallstackSample( ev.callstackSample );
+        break;
+    case QueueType::CallstackSamplePayload:
+        ProcessCallstackSamplePayload( ev.callstackSamplePayload );
+        break;
+    case QueueType::ZoneAggregate:
+        ProcessZoneAggregate( ev.zoneAggregate );
+        break;
+    case QueueType::SourceLocationKey:
+        ProcessSourceLocationKey( ev.srclocKey );
+        break;
+    case QueueType::DroppedEvents:
+        ProcessDroppedEvents( ev.droppedEvents );
+        break;
+    case QueueType::CompressionMode:
+        ProcessCompressionMode( ev.compressionMode );
+        break;
+    case QueueType::ContextSwitch:
+        ProcessContextSwitch( ev.contextSwitch );
+        break;
+    case QueueType::ZoneCounters:
+        ProcessZoneCounters( ev.zoneCounters );
+        break;
+    case QueueType::ZoneCountersHw:
+        ProcessZoneCountersHw( ev.zoneCountersHw );
+        break;
     case QueueType::CallstackFrame:
         ProcessCallstackFrame( ev.callstackFrame );
         break;
@@ -2001,6 +2612,9 @@ void Worker::Process( const QueueItem& ev )
     case QueueType::CrashReport:
         ProcessCrashReport( ev.crashReport );
         break;
+    case QueueType::ThreadContext:
+        m_threadCtx = ev.threadCtx.thread;
+        break;
     default:
         assert( false );
         break;
@@ -2065,11 +2679,15 @@ void Worker::ProcessZoneBeginAllocSrcLoc( const QueueZoneBegin& ev )
 void Worker::ProcessZoneEnd( const QueueZoneEnd& ev )
 {
     auto tit = m_threadMap.find( ev.thread );
-    assert( tit != m_threadMap.end() );
+    if( tit == m_threadMap.end() || tit->second->stack.empty() )
+    {
+        // The zone has started before the beginning of a flight record.
+        assert( m_flightRecord );
+        return;
+    }
 
     auto td = tit->second;
     auto& stack = td->stack;
-    assert( !stack.empty() );
     auto zone = stack.back_and_pop();
     assert( zone->end == -1 );
     zone->end = TscTime( ev.time );
@@ -2079,6 +2697,8 @@ void Worker::ProcessZoneEnd( const QueueZoneEnd& ev )
 
     m_data.lastTime = std::max( m_data.lastTime, zone->end );
 
+    if( m_throttleRate != 0 ) CheckZoneThrottle( zone );
+
 #ifndef TRACY_NO_STATISTICS
     auto timeSpan = zone->end - zone->start;
     if( timeSpan > 0 )
@@ -2152,7 +2772,7 @@ void Worker::ProcessFrameMarkEnd( const QueueFrameMark& ev )
     const auto time = TscTime( ev.time );
     if( fd->frames.empty() )
     {
-        assert( m_onDemand );
+        assert( m_onDemand || m_flightRecord );
         return;
     }
     assert( fd->frames.back().end == -1 );
@@ -2162,32 +2782,81 @@ void Worker::ProcessFrameMarkEnd( const QueueFrameMark& ev )
 
 void Worker::ProcessZoneText( const QueueZoneText& ev )
 {
+    const auto str = GetCustomString( ev.text );
+
     auto tit = m_threadMap.find( ev.thread );
-    assert( tit != m_threadMap.end() );
+    if( tit == m_threadMap.end() || tit->second->stack.empty() )
+    {
+        assert( m_flightRecord );
+        return;
+    }
 
-    auto td = tit->second;
-    auto& stack = td->stack;
-    assert( !stack.empty() );
-    auto zone = stack.back();
-    auto it = m_pendingCustomStrings.find( ev.text );
-    assert( it != m_pendingCustomStrings.end() );
-    zone->text = StringIdx( it->second.idx );
-    m_pendingCustomStrings.erase( it );
+    auto zone = tit->second->stack.back();
+    zone->text = StringIdx( str.idx );
+}
+
+void Worker::ProcessZoneCounters( const QueueZoneCounters& ev )
+{
+    auto tit = m_threadMap.find( ev.thread );
+    if( tit == m_threadMap.end() || tit->second->stack.empty() )
+    {
+        assert( m_flightRecord );
+        return;
+    }
+
+    auto zone = tit->second->stack.back();
+    auto& zc = m_data.zoneCounters[zone];
+    zc.taskClock = ev.taskClock;
+    zc.cycles = 0;
+    zc.instructions = 0;
+    zc.pageFaults = ev.pageFaults;
+    zc.contextSwitches = ev.contextSwitches;
+    zc.hardware = 0;
+
+#ifndef TRACY_NO_STATISTICS
+    auto it = m_data.sourceLocationZones.find( zone->srcloc );
+    assert( it != m_data.sourceLocationZones.end() );
+    AddZoneCounters( it->second.counters, zc );
+#endif
+}
+
+void Worker::ProcessZoneCountersHw( const QueueZoneCountersHw& ev )
+{
+    auto tit = m_threadMap.find( ev.thread );
+    if( tit == m_threadMap.end() || tit->second->stack.empty() )
+    {
+        assert( m_flightRecord );
+        return;
+    }
+
+    auto zone = tit->second->stack.back();
+    auto zit = m_data.zoneCounters.find( zone );
+    if( zit == m_data.zoneCounters.end() ) return;
+    auto& zc = zit->second;
+    zc.cycles = ev.cycles;
+    zc.instructions = ev.instructions;
+    zc.hardware = 1;
+
+#ifndef TRACY_NO_STATISTICS
+    auto it = m_data.sourceLocationZones.find( zone->srcloc );
+    assert( it != m_data.sourceLocationZones.end() );
+    AddZoneCountersHw( it->second.counters, zc );
+#endif
 }
 
 void Worker::ProcessZoneName( const QueueZoneText& ev )
 {
+    const auto str = GetCustomString( ev.text );
+
     auto tit = m_threadMap.find( ev.thread );
-    assert( tit != m_threadMap.end() );
+    if( tit == m_threadMap.end() || tit->second->stack.empty() )
+    {
+        assert( m_flightRecord );
+        return;
+    }
 
-    auto td = tit->second;
-    auto& stack = td->stack;
-    assert( !stack.empty() );
-    auto zone = stack.back();
-    auto it = m_pendingCustomStrings.find( ev.text );
-    assert( it != m_pendingCustomStrings.end() );
-    zone->name = StringIdx( it->second.idx );
-    m_pendingCustomStrings.erase( it );
+    auto zone = tit->second->stack.back();
+    zone->name = StringIdx( str.idx );
 }
 
 void Worker::ProcessLockAnnounce( const QueueLockAnnounce& ev )
@@ -2199,6 +2868,7 @@ void Worker::ProcessLockAnnounce( const QueueLockAnnounce& ev )
         lm.srcloc = ShrinkSourceLocation( ev.lckloc );
         lm.type = ev.type;
         lm.valid = true;
+        lm.contention = m_protocol >= ProtocolLockContention && ev.contention != 0;
         m_data.lockMap.emplace( ev.id, std::move( lm ) );
     }
     else
@@ -2206,6 +2876,7 @@ void Worker::ProcessLockAnnounce( const QueueLockAnnounce& ev )
         it->second.srcloc = ShrinkSourceLocation( ev.lckloc );
         assert( it->second.type == ev.type );
         it->second.valid = true;
+        it->second.contention = m_protocol >= ProtocolLockContention && ev.contention != 0;
     }
     CheckSourceLocation( ev.lckloc );
 }
@@ -2217,6 +2888,7 @@ void Worker::ProcessLockWait( const QueueLockWait& ev )
     {
         LockMap lm;
         lm.valid = false;
+        lm.contention = false;
         lm.type = ev.type;
         it = m_data.lockMap.emplace( ev.id, std::move( lm ) ).first;
     }
@@ -2233,6 +2905,7 @@ void Worker::ProcessLockObtain( const QueueLockObtain& ev )
 {
     assert( m_data.lockMap.find( ev.id ) != m_data.lockMap.end() );
     auto& lock = m_data.lockMap[ev.id];
+    if( m_flightRecord && !IsLockThreadKnown( lock, ev.thread ) ) return;
 
     auto lev = lock.type == LockType::Lockable ? m_slab.Alloc<LockEvent>() : m_slab.Alloc<LockEventShared>();
     lev->time = TscTime( ev.time );
@@ -2246,6 +2919,7 @@ void Worker::ProcessLockRelease( const QueueLockRelease& ev )
 {
     assert( m_data.lockMap.find( ev.id ) != m_data.lockMap.end() );
     auto& lock = m_data.lockMap[ev.id];
+    if( m_flightRecord && !IsLockThreadKnown( lock, ev.thread ) ) return;
 
     auto lev = lock.type == LockType::Lockable ? m_slab.Alloc<LockEvent>() : m_slab.Alloc<LockEventShared>();
     lev->time = TscTime( ev.time );
@@ -2262,6 +2936,7 @@ void Worker::ProcessLockSharedWait( const QueueLockWait& ev )
     {
         LockMap lm;
         lm.valid = false;
+        lm.contention = false;
         lm.type = ev.type;
         it = m_data.lockMap.emplace( ev.id, std::move( lm ) ).first;
     }
@@ -2279,6 +2954,7 @@ void Worker::ProcessLockSharedObtain( const QueueLockObtain& ev )
 {
     assert( m_data.lockMap.find( ev.id ) != m_data.lockMap.end() );
     auto& lock = m_data.lockMap[ev.id];
+    if( m_flightRecord && !IsLockThreadKnown( lock, ev.thread ) ) return;
 
     assert( lock.type == LockType::SharedLockable );
     auto lev = m_slab.Alloc<LockEventShared>();
@@ -2293,6 +2969,7 @@ void Worker::ProcessLockSharedRelease( const QueueLockRelease& ev )
 {
     assert( m_data.lockMap.find( ev.id ) != m_data.lockMap.end() );
     auto& lock = m_data.lockMap[ev.id];
+    if( m_flightRecord && !IsLockThreadKnown( lock, ev.thread ) ) return;
 
     assert( lock.type == LockType::SharedLockable );
     auto lev = m_slab.Alloc<LockEventShared>();
@@ -2310,11 +2987,20 @@ void Worker::ProcessLockMark( const QueueLockMark& ev )
     assert( lit != m_data.lockMap.end() );
     auto& lockmap = lit->second;
     auto tid = lockmap.threadMap.find( ev.thread );
-    assert( tid != lockmap.threadMap.end() );
+    if( tid == lockmap.threadMap.end() )
+    {
+        assert( m_flightRecord || lockmap.contention );
+        return;
+    }
     const auto thread = tid->second;
     auto it = lockmap.timeline.end();
     for(;;)
     {
+        if( it == lockmap.timeline.begin() )
+        {
+            assert( m_flightRecord );
+            return;
+        }
         --it;
         if( (*it)->thread == thread )
         {
@@ -2333,9 +3019,9 @@ void Worker::ProcessLockMark( const QueueLockMark& ev )
     }
 }
 
-void Worker::ProcessPlotData( const QueuePlotData& ev )
+PlotData* Worker::RetrievePlot( uint64_t name )
 {
-    PlotData* plot = m_data.plots.Retrieve( ev.name, [this] ( uint64_t name ) {
+    return m_data.plots.Retrieve( name, [this] ( uint64_t name ) {
         auto plot = m_slab.AllocInit<PlotData>();
         plot->name = name;
         plot->type = PlotType::User;
@@ -2343,6 +3029,11 @@ void Worker::ProcessPlotData( const QueuePlotData& ev )
     }, [this]( uint64_t name ) {
         ServerQuery( ServerQueryPlotName, name );
     } );
+}
+
+void Worker::ProcessPlotData( const QueuePlotData& ev )
+{
+    PlotData* plot = RetrievePlot( ev.name );
 
     const auto time = TscTime( ev.time );
     m_data.lastTime = std::max( m_data.lastTime, time );
@@ -2365,15 +3056,13 @@ void Worker::ProcessPlotData( const QueuePlotData& ev )
 
 void Worker::ProcessMessage( const QueueMessage& ev )
 {
-    auto it = m_pendingCustomStrings.find( ev.text );
-    assert( it != m_pendingCustomStrings.end() );
+    const auto str = GetCustomString( ev.text );
     auto msg = m_slab.Alloc<MessageData>();
     msg->time = TscTime( ev.time );
-    msg->ref = StringRef( StringRef::Type::Idx, it->second.idx );
+    msg->ref = StringRef( StringRef::Type::Idx, str.idx );
     msg->thread = ev.thread;
     m_data.lastTime = std::max( m_data.lastTime, msg->time );
     InsertMessageData( msg, ev.thread );
-    m_pendingCustomStrings.erase( it );
 }
 
 void Worker::ProcessMessageLiteral( const QueueMessage& ev )
@@ -2482,7 +3171,11 @@ void Worker::ProcessGpuZoneEnd( const QueueGpuZoneEnd& ev )
     auto ctx = m_gpuCtxMap[ev.context];
     assert( ctx );
 
-    assert( !ctx->stack.empty() );
+    if( ctx->stack.empty() )
+    {
+        assert( m_flightRecord );
+        return;
+    }
     auto zone = ctx->stack.back_and_pop();
 
     assert( !ctx->query[ev.queryId] );
@@ -2508,7 +3201,11 @@ void Worker::ProcessGpuTime( const QueueGpuTime& ev )
     }
 
     auto zone = ctx->query[ev.queryId];
-    assert( zone );
+    if( !zone )
+    {
+        assert( m_flightRecord );
+        return;
+    }
     ctx->query[ev.queryId] = nullptr;
 
     if( zone->gpuStart == std::numeric_limits<int64_t>::max() )
@@ -2529,6 +3226,20 @@ void Worker::ProcessGpuTime( const QueueGpuTime& ev )
     }
 }
 
+void Worker::ProcessGpuTimeBatch( uint64_t key, const char* data, size_t sz )
+{
+    assert( sz % sizeof( int64_t ) == 0 );
+    QueueGpuTime ev;
+    ev.context = uint8_t( key >> 16 );
+    ev.queryId = uint16_t( key );
+    for( size_t i=0; i<sz; i+=sizeof( int64_t ) )
+    {
+        memcpy( &ev.gpuTime, data + i, sizeof( int64_t ) );
+        ProcessGpuTime( ev );
+        ev.queryId++;
+    }
+}
+
 void Worker::ProcessMemAlloc( const QueueMemAlloc& ev )
 {
     const auto time = TscTime( ev.time );
@@ -2569,12 +3280,10 @@ void Worker::ProcessMemAlloc( const QueueMemAlloc& ev )
 
 bool Worker::ProcessMemFree( const QueueMemFree& ev )
 {
+    // The allocation may also have been dropped by the client, when its
+    // queues were full.
     auto it = m_data.memory.active.find( ev.ptr );
-    if( it == m_data.memory.active.end() )
-    {
-        assert( m_onDemand );
-        return false;
-    }
+    if( it == m_data.memory.active.end() ) return false;
 
     const auto time = TscTime( ev.time );
     NoticeThread( ev.thread );
@@ -2614,55 +3323,215 @@ void Worker::ProcessCallstackMemory( const QueueCallstackMemory& ev )
 {
     auto it = m_pendingCallstacks.find( ev.ptr );
     assert( it != m_pendingCallstacks.end() );
+    SetMemoryCallstack( it->second );
+    m_pendingCallstacks.erase( it );
+}
+
+void Worker::ProcessCallstack( const QueueCallstack& ev )
+{
+    auto it = m_pendingCallstacks.find( ev.ptr );
+    assert( it != m_pendingCallstacks.end() );
+    SetNextCallstack( ev.thread, it->second );
+    m_pendingCallstacks.erase( it );
+}
+
+void Worker::ProcessCallstackMemoryCached( const QueueCallstackMemoryCached& ev )
+{
+    assert( ev.id < m_callstackIds.size() );
+    SetMemoryCallstack( m_callstackIds[ev.id] );
+}
+
+void Worker::ProcessCallstackCached( const QueueCallstackCached& ev )
+{
+    assert( ev.id < m_callstackIds.size() );
+    SetNextCallstack( ev.thread, m_callstackIds[ev.id] );
+}
+
+void Worker::ProcessCallstackSample( const QueueCallstackSample& ev )
+{
+    assert( ev.id < m_callstackIds.size() );
+    AddCallstackSample( ev.time, ev.thread, m_callstackIds[ev.id] );
+}
+
+void Worker::ProcessCallstackSamplePayload( const QueueCallstackSamplePayload& ev )
+{
+    auto it = m_pendingCallstacks.find( ev.ptr );
+    assert( it != m_pendingCallstacks.end() );
+    AddCallstackSample( ev.time, ev.thread, it->second );
+    m_pendingCallstacks.erase( it );
+}
+
+void Worker::AddCallstackSample( int64_t _time, uint64_t thread, uint32_t callstack )
+{
+    const auto time = TscTime( _time );
+    auto td = NoticeThread( thread );
+    const auto sample = SampleData { time, callstack };
+    if( td->samples.empty() || td->samples.back().time <= time )
+    {
+        td->samples.push_back( sample );
+    }
+    else
+    {
+        // Native and Lua samples of a thread are sent by separate queues.
+        auto it = std::upper_bound( td->samples.begin(), td->samples.end(), time, [] ( const auto& l, const auto& r ) { return l < r.time; } );
+        td->samples.insert( it, sample );
+    }
+    m_data.samplesCnt++;
+    m_data.lastTime = std::max( m_data.lastTime, time );
+}
+
+void Worker::ProcessZoneAggregate( const QueueZoneAggregate& ev )
+{
+    CheckSourceLocation( ev.srcloc );
+    const auto srcloc = ShrinkSourceLocation( ev.srcloc );
+    auto& agg = m_data.zoneAggregates.emplace( srcloc, ZoneAggregateData { 0, 0 } ).first->second;
+    agg.count += ev.count;
+    agg.total += TscTime( ev.total );
+    m_data.lastTime = std::max( m_data.lastTime, TscTime( ev.time ) );
+}
+
+void Worker::ProcessSourceLocationKey( const QueueSourceLocationKey& ev )
+{
+    assert( m_sourceLocationKey == 0 );
+    m_sourceLocationKey = ev.ptr;
+}
 
+void Worker::ProcessDroppedEvents( const QueueDroppedEvents& ev )
+{
+    const auto end = TscTime( ev.end );
+    m_data.droppedEvents.push_back( DroppedEventsData { TscTime( ev.begin ), end, ev.count } );
+    m_data.lastTime = std::max( m_data.lastTime, end );
+}
+
+void Worker::ProcessCompressionMode( const QueueCompressionMode& ev )
+{
+    m_mbpsData.compMode = ev.mode;
+    m_mbpsData.compLevel = ev.level;
+}
+
+void Worker::ProcessContextSwitch( const QueueContextSwitch& ev )
+{
+    auto td = NoticeThread( ev.thread );
+    auto& vec = td->ctxSwitch;
+    const auto running = !vec.empty() && vec.back().end < 0;
+    // Timestamps are converted from another clock by the client, so they
+    // are clamped to keep the intervals ordered.
+    auto time = TscTime( ev.time );
+    if( !vec.empty() ) time = std::max( time, running ? vec.back().start : vec.back().end );
+    const auto cpu = uint8_t( std::min<uint32_t>( ev.cpu, std::numeric_limits<uint8_t>::max() ) );
+
+    if( ev.state == ContextSwitchState::Running )
+    {
+        if( running ) return;
+        vec.push_back( ContextSwitchData { time, -1, cpu, 0 } );
+    }
+    else if( ev.state == ContextSwitchState::Unknown )
+    {
+        // Records were lost. The thread may have been switched in and out
+        // any number of times until the next interval.
+        if( vec.empty() ) return;
+        if( running ) vec.back().end = time;
+        vec.back().reason = (uint8_t)ev.state;
+        return;
+    }
+    else if( running )
+    {
+        vec.back().end = time;
+        vec.back().reason = (uint8_t)ev.state;
+    }
+    else
+    {
+        // The switch in was not seen. Only the reason of the switch out is
+        // known.
+        vec.push_back( ContextSwitchData { time, time, cpu, (uint8_t)ev.state } );
+    }
+    m_data.ctxSwitchCnt++;
+    m_data.lastTime = std::max( m_data.lastTime, time );
+}
+
+void Worker::CheckZoneThrottle( const ZoneEvent* zone )
+{
+    if( !CanAggregateSourceLocation( zone->srcloc ) ) return;
+
+    auto it = m_zoneThrottle.find( zone->srcloc );
+    if( it == m_zoneThrottle.end() )
+    {
+        m_zoneThrottle.emplace( zone->srcloc, ZoneThrottle { zone->end, 0, 0 } );
+        return;
+    }
+
+    auto& t = it->second;
+    t.count++;
+    t.total += zone->end - zone->start;
+
+    // The decision is made once per second of program run time, for each
+    // source location.
+    const auto span = zone->end - t.start;
+    if( span < 1000 * 1000 * 1000 ) return;
+    if( t.count >= uint64_t( m_throttleRate ) * span / ( 1000 * 1000 * 1000 ) &&
+        t.total < t.count * m_throttleDuration &&
+        GetSourceLocationState( zone->srcloc ) == SourceLocationState::Enabled )
+    {
+        SetSourceLocationState( zone->srcloc, SourceLocationState::Aggregated );
+    }
+    t = ZoneThrottle { zone->end, 0, 0 };
+}
+
+void Worker::SetMemoryCallstack( uint32_t callstack )
+{
     if( m_lastMemActionCallstack != std::numeric_limits<uint64_t>::max() )
     {
         auto& mem = m_data.memory.data[m_lastMemActionCallstack];
         if( m_lastMemActionWasAlloc )
         {
-            mem.csAlloc = it->second;
+            mem.csAlloc = callstack;
         }
         else
         {
-            mem.csFree = it->second;
+            mem.csFree = callstack;
         }
     }
-
-    m_pendingCallstacks.erase( it );
 }
 
-void Worker::ProcessCallstack( const QueueCallstack& ev )
+void Worker::SetNextCallstack( uint64_t thread, uint32_t callstack )
 {
-    auto it = m_pendingCallstacks.find( ev.ptr );
-    assert( it != m_pendingCallstacks.end() );
-
-    auto nit = m_nextCallstack.find( ev.thread );
-    assert( nit != m_nextCallstack.end() );
+    auto nit = m_nextCallstack.find( thread );
+    if( nit == m_nextCallstack.end() )
+    {
+        // The event has been dropped from a flight record.
+        assert( m_flightRecord );
+        return;
+    }
     auto& next = nit->second;
 
     switch( next.type )
     {
     case NextCallstackType::Zone:
-        next.zone->callstack = it->second;
+        next.zone->callstack = callstack;
         break;
     case NextCallstackType::Gpu:
-        next.gpu->callstack = it->second;
+        next.gpu->callstack = callstack;
         break;
     case NextCallstackType::Crash:
-        m_data.m_crashEvent.callstack = it->second;
+        m_data.m_crashEvent.callstack = callstack;
         break;
     default:
         assert( false );
         break;
     }
-
-    m_pendingCallstacks.erase( it );
 }
 
 void Worker::ProcessCallstackFrame( const QueueCallstackFrame& ev )
 {
-    assert( m_pendingCallstackFrames > 0 );
-    m_pendingCallstackFrames--;
+    if( m_pendingCallstackFrames > 0 )
+    {
+        m_pendingCallstackFrames--;
+    }
+    else
+    {
+        // Defined ahead of use in a flight record.
+        assert( m_flightRecord );
+    }
 
     auto fmit = m_data.callstackFrameMap.find( ev.ptr );
     auto nit = m_pendingCustomStrings.find( ev.name );
@@ -2940,6 +3809,18 @@ void Worker::ReadTimelineUpdateStatistics( ZoneEvent* zone, uint16_t thread )
 #endif
 }
 
+void Worker::ReadTimelineZoneCounters( ZoneEvent* zone )
+{
+    const auto& zc = m_loadZoneCounters.back().second;
+#ifndef TRACY_NO_STATISTICS
+    auto it = m_data.sourceLocationZones.find( zone->srcloc );
+    assert( it != m_data.sourceLocationZones.end() );
+    AddZoneCounters( it->second.counters, zc );
+#endif
+    m_data.zoneCounters.emplace( zone, zc );
+    m_loadZoneCounters.pop_back();
+}
+
 void Worker::ReadTimeline( FileRead& f, Vector<ZoneEvent*>& vec, uint16_t thread, uint64_t size )
 {
     assert( size != 0 );
@@ -2952,6 +3833,8 @@ void Worker::ReadTimeline( FileRead& f, Vector<ZoneEvent*>& vec, uint16_t thread
         auto zone = m_slab.Alloc<ZoneEvent>();
         vec[i] = zone;
         f.Read( zone, sizeof( ZoneEvent ) - sizeof( ZoneEvent::child ) );
+        if( !m_loadZoneCounters.empty() && m_loadZoneCounters.back().first == m_loadZoneIdx ) ReadTimelineZoneCounters( zone );
+        m_loadZoneIdx++;
         ReadTimeline( f, zone, thread );
         ReadTimelineUpdateStatistics( zone, thread );
     }
@@ -3030,6 +3913,396 @@ void Worker::ReadTimelinePre032( FileRead& f, Vector<GpuEvent*>& vec, uint64_t s
     }
 }
 
+void Worker::Merge( std::unique_ptr<Worker>&& other )
+{
+    Shutdown();
+    other->Shutdown();
+    if( m_thread.joinable() ) m_thread.join();
+    if( other->m_thread.joinable() ) other->m_thread.join();
+
+    auto& src = other->m_data;
+
+    // Pointers from different processes may collide, so they are tagged with
+    // the index of the merged capture. Lock ids are small counters.
+    const auto mergeIdx = m_merged.size() + 1;
+    assert( mergeIdx < 256 );
+    const auto tag = uint64_t( mergeIdx ) << 56;
+    const auto lockTag = uint32_t( mergeIdx ) << 24;
+
+    // Processes on the same host share the time source, so rescaling with the
+    // timer multiplier is enough. Otherwise, the clocks can only be aligned
+    // with the wall clock time of the capture start.
+    enum { ClockTolerance = 2000000000 };
+    const auto scale = m_timerMul / other->m_timerMul;
+    const auto begin = GetTimeBegin();
+    const auto srcBegin = int64_t( other->GetTimeBegin() * scale );
+    const auto epochDiff = ( int64_t( other->m_captureTime ) - int64_t( m_captureTime ) ) * 1000000000ll;
+    int64_t offset = 0;
+    if( std::abs( srcBegin - begin - epochDiff ) > ClockTolerance ) offset = begin + epochDiff - srcBegin;
+    auto Time = [scale, offset] ( int64_t t ) { return t < 0 ? t : int64_t( t * scale ) + offset; };
+
+    auto Thread = [this, &other] ( uint16_t t ) -> uint16_t { return t == 0 ? 0 : CompressThread( other->DecompressThread( t ) ); };
+
+    std::vector<uint32_t> strIdx( src.stringData.size() );
+    flat_hash_map<uint64_t, const char*, nohash<uint64_t>> strPtr;
+    for( size_t i=0; i<src.stringData.size(); i++ )
+    {
+        auto str = src.stringData[i];
+        const auto sl = StoreString( (char*)str, strlen( str ) );
+        strIdx[i] = sl.idx;
+        strPtr.emplace( uint64_t( str ), sl.ptr );
+    }
+    auto RemapIdx = [&strIdx] ( StringIdx& str ) { if( str.active ) str.idx = strIdx[str.idx]; };
+    auto RemapRef = [&strIdx, tag] ( StringRef& str )
+    {
+        if( !str.active ) return;
+        if( str.isidx ) str.str = strIdx[str.str];
+        else str.str |= tag;
+    };
+    for( auto& v : src.strings )
+    {
+        auto it = strPtr.find( uint64_t( v.second ) );
+        m_data.strings.emplace( v.first | tag, it != strPtr.end() ? it->second : nullptr );
+    }
+
+    // Threads are grouped by process, and their names show which process
+    // they belong to.
+    auto NameThreads = [this] ( const Vector<ThreadData*>& threads, const flat_hash_map<uint64_t, const char*, nohash<uint64_t>>& names, const std::string& program )
+    {
+        for( auto& td : threads )
+        {
+            auto it = names.find( td->id );
+            auto name = program;
+            if( it != names.end() )
+            {
+                name += ": ";
+                name += it->second;
+            }
+            m_data.threadNames[td->id] = StoreString( (char*)name.c_str(), name.size() ).ptr;
+        }
+    };
+    if( m_merged.empty() )
+    {
+        auto names = m_data.threadNames;
+        NameThreads( m_data.threads, names, m_captureProgram );
+    }
+    NameThreads( src.threads, src.threadNames, other->m_captureProgram );
+
+    for( auto& v : src.sourceLocation )
+    {
+        auto srcloc = v.second;
+        RemapRef( srcloc.name );
+        RemapRef( srcloc.function );
+        RemapRef( srcloc.file );
+        m_data.sourceLocation.emplace( v.first | tag, srcloc );
+    }
+    std::vector<int32_t> srclocMap( src.sourceLocationExpand.size() );
+    srclocMap[0] = 0;
+    for( size_t i=1; i<src.sourceLocationExpand.size(); i++ )
+    {
+        srclocMap[i] = int32_t( ShrinkSourceLocation( src.sourceLocationExpand[i] | tag ) );
+    }
+    std::vector<int32_t> payloadMap( src.sourceLocationPayload.size() );
+    for( size_t i=0; i<src.sourceLocationPayload.size(); i++ )
+    {
+        auto srcloc = src.sourceLocationPayload[i];
+        RemapRef( srcloc->name );
+        RemapRef( srcloc->function );
+        RemapRef( srcloc->file );
+        uint32_t idx;
+        auto it = m_data.sourceLocationPayloadMap.find( srcloc );
+        if( it == m_data.sourceLocationPayloadMap.end() )
+        {
+            idx = m_data.sourceLocationPayload.size();
+            m_data.sourceLocationPayload.push_back( srcloc );
+            m_data.sourceLocationPayloadMap.emplace( srcloc, idx );
+        }
+        else
+        {
+            idx = it->second;
+        }
+        payloadMap[i] = -int32_t( idx + 1 );
+    }
+    auto Srcloc = [&srclocMap, &payloadMap] ( int32_t srcloc ) { return srcloc < 0 ? payloadMap[-srcloc-1] : srclocMap[srcloc]; };
+
+    for( auto& v : src.callstackFrameMap )
+    {
+        if( v.second )
+        {
+            RemapIdx( v.second->name );
+            RemapIdx( v.second->file );
+        }
+        m_data.callstackFrameMap.emplace( v.first | tag, v.second );
+    }
+    std::vector<uint32_t> callstackMap( src.callstackPayload.size() );
+    callstackMap[0] = 0;
+    for( size_t i=1; i<src.callstackPayload.size(); i++ )
+    {
+        auto cs = src.callstackPayload[i];
+        const auto sz = cs->size() * sizeof( uint64_t );
+        const auto memsize = sizeof( VarArray<uint64_t> ) + sz;
+        auto mem = (char*)m_slab.AllocRaw( memsize );
+        auto data = (uint64_t*)mem;
+        for( uint8_t j=0; j<cs->size(); j++ ) data[j] = (*cs)[j] | tag;
+        auto arr = (VarArray<uint64_t>*)( mem + sz );
+        new(arr) VarArray<uint64_t>( cs->size(), data );
+
+        auto it = m_data.callstackMap.find( arr );
+        if( it == m_data.callstackMap.end() )
+        {
+            callstackMap[i] = m_data.callstackPayload.size();
+            m_data.callstackMap.emplace( arr, callstackMap[i] );
+            m_data.callstackPayload.push_back( arr );
+        }
+        else
+        {
+            callstackMap[i] = it->second;
+            m_slab.Unalloc( memsize );
+        }
+    }
+
+    for( auto& v : src.zoneCounters ) m_data.zoneCounters.emplace( v.first, v.second );
+
+    const auto zoneChildOffset = int32_t( m_data.m_zoneChildren.size() );
+    for( auto& v : src.m_zoneChildren ) m_data.m_zoneChildren.emplace_back( std::move( v ) );
+    auto MergeZones = [&] ( Vector<ZoneEvent*>& vec )
+    {
+        for( auto& zone : vec )
+        {
+            zone->start = Time( zone->start );
+            zone->end = Time( zone->end );
+            zone->srcloc = Srcloc( zone->srcloc );
+            RemapIdx( zone->text );
+            RemapIdx( zone->name );
+            zone->callstack = callstackMap[zone->callstack];
+            if( zone->child >= 0 ) zone->child += zoneChildOffset;
+        }
+    };
+    for( size_t i=zoneChildOffset; i<m_data.m_zoneChildren.size(); i++ ) MergeZones( m_data.m_zoneChildren[i] );
+    for( auto& td : src.threads )
+    {
+        MergeZones( td->timeline );
+        for( auto& v : td->samples )
+        {
+            v.time = Time( v.time );
+            v.callstack = callstackMap[v.callstack];
+        }
+        for( auto& v : td->ctxSwitch )
+        {
+            v.start = Time( v.start );
+            v.end = Time( v.end );
+        }
+        m_data.threads.push_back( td );
+    }
+    src.threads.clear();
+
+    const auto gpuChildOffset = int32_t( m_data.m_gpuChildren.size() );
+    for( auto& v : src.m_gpuChildren ) m_data.m_gpuChildren.emplace_back( std::move( v ) );
+    auto MergeGpuZones = [&] ( Vector<GpuEvent*>& vec )
+    {
+        for( auto& zone : vec )
+        {
+            zone->cpuStart = Time( zone->cpuStart );
+            zone->cpuEnd = Time( zone->cpuEnd );
+            zone->gpuStart = Time( zone->gpuStart );
+            zone->gpuEnd = Time( zone->gpuEnd );
+            zone->srcloc = Srcloc( zone->srcloc );
+            zone->callstack = callstackMap[zone->callstack];
+            zone->thread = Thread( zone->thread );
+            if( zone->child >= 0 ) zone->child += gpuChildOffset;
+        }
+    };
+    for( size_t i=gpuChildOffset; i<m_data.m_gpuChildren.size(); i++ ) MergeGpuZones( m_data.m_gpuChildren[i] );
+    for( auto& ctx : src.gpuData )
+    {
+        MergeGpuZones( ctx->timeline );
+        m_data.gpuData.push_back( ctx );
+    }
+    src.gpuData.clear();
+
+#ifndef TRACY_NO_STATISTICS
+    for( auto& v : src.sourceLocationZones )
+    {
+        auto& dst = m_data.sourceLocationZones[Srcloc( v.first )];
+        const bool sorted = dst.zones.empty();
+        for( auto& z : v.second.zones ) dst.zones.push_back( ZoneThreadData { z.zone, Thread( z.thread ) } );
+        if( !sorted )
+        {
+#ifdef MY_LIBCPP_SUCKS
+            pdqsort_branchless( dst.zones.begin(), dst.zones.end(), []( const auto& lhs, const auto& rhs ) { return lhs.zone->start < rhs.zone->start; } );
+#else
+            std::sort( std::execution::par_unseq, dst.zones.begin(), dst.zones.end(), []( const auto& lhs, const auto& rhs ) { return lhs.zone->start < rhs.zone->start; } );
+#endif
+        }
+        dst.min = std::min( dst.min, v.second.min );
+        dst.max = std::max( dst.max, v.second.max );
+        dst.total += v.second.total;
+        dst.selfTotal += v.second.selfTotal;
+        dst.counters.count += v.second.counters.count;
+        dst.counters.hwCount += v.second.counters.hwCount;
+        dst.counters.taskClock += v.second.counters.taskClock;
+        dst.counters.pageFaults += v.second.counters.pageFaults;
+        dst.counters.contextSwitches += v.second.counters.contextSwitches;
+        dst.counters.cycles += v.second.counters.cycles;
+        dst.counters.instructions += v.second.counters.instructions;
+    }
+#else
+    for( auto& v : src.sourceLocationZonesCnt )
+    {
+        m_data.sourceLocationZonesCnt[Srcloc( v.first )] += v.second;
+    }
+#endif
+
+    for( auto& v : src.zoneAggregates )
+    {
+        auto& dst = m_data.zoneAggregates[Srcloc( v.first )];
+        dst.count += v.second.count;
+        dst.total += v.second.total;
+    }
+
+    for( auto& v : src.lockMap )
+    {
+        auto& lockmap = v.second;
+        lockmap.srcloc = Srcloc( lockmap.srcloc );
+        for( auto& lev : lockmap.timeline )
+        {
+            lev->time = Time( lev->time );
+            lev->srcloc = Srcloc( lev->srcloc );
+        }
+        m_data.lockMap.emplace( v.first | lockTag, std::move( lockmap ) );
+    }
+
+    if( !src.messages.empty() )
+    {
+        for( auto& msg : src.messages )
+        {
+            msg->time = Time( msg->time );
+            RemapRef( msg->ref );
+        }
+        const auto sz = m_data.messages.size();
+        m_data.messages.insert( m_data.messages.end(), src.messages.begin(), src.messages.end() );
+        std::inplace_merge( m_data.messages.begin(), m_data.messages.begin() + sz, m_data.messages.end(), [] ( const auto& lhs, const auto& rhs ) { return lhs->time < rhs->time; } );
+    }
+
+    if( !src.droppedEvents.empty() )
+    {
+        for( auto& v : src.droppedEvents )
+        {
+            v.begin = Time( v.begin );
+            v.end = Time( v.end );
+        }
+        const auto sz = m_data.droppedEvents.size();
+        m_data.droppedEvents.insert( m_data.droppedEvents.end(), src.droppedEvents.begin(), src.droppedEvents.end() );
+        std::inplace_merge( m_data.droppedEvents.begin(), m_data.droppedEvents.begin() + sz, m_data.droppedEvents.end(), [] ( const auto& lhs, const auto& rhs ) { return lhs.begin < rhs.begin; } );
+    }
+
+    auto& srcPlots = src.plots.Data();
+    for( size_t i=0; i<srcPlots.size(); )
+    {
+        auto plot = srcPlots[i];
+        if( plot->type != PlotType::User )
+        {
+            i++;
+            continue;
+        }
+        plot->name |= tag;
+        for( auto& v : plot->data ) v.time = Time( v.time );
+        m_data.plots.Data().push_back( plot );
+        srcPlots.erase( srcPlots.begin() + i );
+    }
+
+    // Each process has its own set of frames. The default frame set is named
+    // after the program.
+    auto NameFrames = [this] ( uint64_t name, const std::string& program )
+    {
+        auto str = std::string( "Frame (" ) + program + ")";
+        m_data.strings[name] = StoreString( (char*)str.c_str(), str.size() ).ptr;
+    };
+    if( m_merged.empty() ) NameFrames( 0, m_captureProgram );
+    for( auto& fd : src.frames.Data() )
+    {
+        for( auto& fe : fd->frames )
+        {
+            fe.start = Time( fe.start );
+            fe.end = Time( fe.end );
+        }
+        if( fd->name == 0 ) NameFrames( tag, other->m_captureProgram );
+        fd->name |= tag;
+        m_data.frames.Data().push_back( fd );
+    }
+    src.frames.Data().clear();
+
+    // Address spaces of the processes overlap, so the allocations are tagged
+    // like the other pointers. The address range is kept untagged.
+    if( !src.memory.data.empty() )
+    {
+        auto& mem = m_data.memory;
+        for( auto& v : src.memory.data )
+        {
+            auto ev = v;
+            ev.ptr |= tag;
+            ev.timeAlloc = Time( ev.timeAlloc );
+            ev.timeFree = Time( ev.timeFree );
+            ev.csAlloc = callstackMap[ev.csAlloc];
+            ev.csFree = callstackMap[ev.csFree];
+            ev.threadAlloc = Thread( ev.threadAlloc );
+            ev.threadFree = Thread( ev.threadFree );
+            mem.data.push_back( ev );
+        }
+#ifdef MY_LIBCPP_SUCKS
+        pdqsort_branchless( mem.data.begin(), mem.data.end(), [] ( const auto& lhs, const auto& rhs ) { return lhs.timeAlloc < rhs.timeAlloc; } );
+#else
+        std::sort( std::execution::par_unseq, mem.data.begin(), mem.data.end(), [] ( const auto& lhs, const auto& rhs ) { return lhs.timeAlloc < rhs.timeAlloc; } );
+#endif
+        mem.frees.clear();
+        mem.active.clear();
+        for( size_t i=0; i<mem.data.size(); i++ )
+        {
+            if( mem.data[i].timeFree >= 0 )
+            {
+                mem.frees.push_back( i );
+            }
+            else
+            {
+                mem.active.emplace( mem.data[i].ptr, i );
+            }
+        }
+        mem.high = std::max( mem.high, src.memory.high );
+        mem.low = std::min( mem.low, src.memory.low );
+        mem.usage += src.memory.usage;
+
+        if( mem.plot )
+        {
+            auto& plots = m_data.plots.Data();
+            plots.erase( std::find( plots.begin(), plots.end(), mem.plot ) );
+            mem.plot->~PlotData();
+            mem.plot = nullptr;
+        }
+        ReconstructMemAllocPlot();
+    }
+
+    if( m_data.m_crashEvent.thread == 0 && src.m_crashEvent.thread != 0 )
+    {
+        m_data.m_crashEvent = src.m_crashEvent;
+        m_data.m_crashEvent.time = Time( m_data.m_crashEvent.time );
+        m_data.m_crashEvent.message |= tag;
+        m_data.m_crashEvent.callstack = callstackMap[m_data.m_crashEvent.callstack];
+    }
+
+    m_data.zonesCnt += src.zonesCnt;
+    m_data.samplesCnt += src.samplesCnt;
+    m_data.ctxSwitchCnt += src.ctxSwitchCnt;
+    m_data.lastTime = std::max( m_data.lastTime, Time( src.lastTime ) );
+    m_delay = std::max( m_delay, other->m_delay );
+    m_resolution = std::max( m_resolution, other->m_resolution );
+
+    const auto at = m_captureName.rfind( " @ " );
+    m_captureProgram += ", " + other->m_captureProgram;
+    m_captureName = m_captureProgram + ( at != std::string::npos ? m_captureName.substr( at ) : std::string() );
+
+    m_merged.emplace_back( std::move( other ) );
+}
+
 void Worker::Write( FileWrite& f )
 {
     f.Write( FileHeader, sizeof( FileHeader ) );
@@ -3161,6 +4434,7 @@ void Worker::Write( FileWrite& f )
         f.Write( &v.second.srcloc, sizeof( v.second.srcloc ) );
         f.Write( &v.second.type, sizeof( v.second.type ) );
         f.Write( &v.second.valid, sizeof( v.second.valid ) );
+        f.Write( &v.second.contention, sizeof( v.second.contention ) );
         sz = v.second.threadList.size();
         f.Write( &sz, sizeof( sz ) );
         for( auto& t : v.second.threadList )
@@ -3184,6 +4458,22 @@ void Worker::Write( FileWrite& f )
         f.Write( v, sizeof( MessageData::time ) + sizeof( MessageData::ref ) );
     }
 
+    // Counters are saved with the position of their zone in the timelines.
+    std::vector<std::pair<uint64_t, const ZoneCounters*>> zoneCounters;
+    if( !m_data.zoneCounters.empty() )
+    {
+        zoneCounters.reserve( m_data.zoneCounters.size() );
+        uint64_t idx = 0;
+        for( auto& thread : m_data.threads ) CollectZoneCounters( thread->timeline, idx, zoneCounters );
+    }
+    sz = zoneCounters.size();
+    f.Write( &sz, sizeof( sz ) );
+    for( auto& v : zoneCounters )
+    {
+        f.Write( &v.first, sizeof( v.first ) );
+        f.Write( v.second, sizeof( ZoneCounters ) );
+    }
+
     sz = m_data.threads.size();
     f.Write( &sz, sizeof( sz ) );
     for( auto& thread : m_data.threads )
@@ -3260,6 +4550,32 @@ void Worker::Write( FileWrite& f )
         f.Write( &frame.first, sizeof( uint64_t ) );
         f.Write( frame.second, sizeof( CallstackFrame ) );
     }
+
+    for( auto& td : m_data.threads )
+    {
+        sz = td->samples.size();
+        f.Write( &sz, sizeof( sz ) );
+        f.Write( td->samples.data(), sizeof( SampleData ) * sz );
+    }
+
+    sz = m_data.zoneAggregates.size();
+    f.Write( &sz, sizeof( sz ) );
+    for( auto& v : m_data.zoneAggregates )
+    {
+        f.Write( &v.first, sizeof( v.first ) );
+        f.Write( &v.second, sizeof( ZoneAggregateData ) );
+    }
+
+    sz = m_data.droppedEvents.size();
+    f.Write( &sz, sizeof( sz ) );
+    f.Write( m_data.droppedEvents.data(), sizeof( DroppedEventsData ) * sz );
+
+    for( auto& td : m_data.threads )
+    {
+        sz = td->ctxSwitch.size();
+        f.Write( &sz, sizeof( sz ) );
+        f.Write( td->ctxSwitch.data(), sizeof( ContextSwitchData ) * sz );
+    }
 }
 
 void Worker::WriteTimeline( FileWrite& f, const Vector<ZoneEvent*>& vec )
@@ -3282,6 +4598,18 @@ void Worker::WriteTimeline( FileWrite& f, const Vector<ZoneEvent*>& vec )
     }
 }
 
+// Zones are numbered in the order in which WriteTimeline saves them.
+void Worker::CollectZoneCounters( const Vector<ZoneEvent*>& vec, uint64_t& idx, std::vector<std::pair<uint64_t, const ZoneCounters*>>& out ) const
+{
+    for( auto& v : vec )
+    {
+        auto it = m_data.zoneCounters.find( v );
+        if( it != m_data.zoneCounters.end() ) out.emplace_back( idx, &it->second );
+        idx++;
+        if( v->child >= 0 ) CollectZoneCounters( GetZoneChildren( v->child ), idx, out );
+    }
+}
+
 void Worker::WriteTimeline( FileWrite& f, const Vector<GpuEvent*>& vec )
 {
     uint64_t sz = vec.size();
@@ -4,6 +4,8 @@
 #include <atomic>
 #include <limits>
 #include <map>
+#include <memory>
+#include <stdio.h>
 #include <stdexcept>
 #include <string>
 #include <thread>
@@ -12,6 +14,7 @@
 #include "../common/tracy_lz4.hpp"
 #include "../common/TracyForceInline.hpp"
 #include "../common/TracyMutex.hpp"
+#include "../common/TracyProtocol.hpp"
 #include "../common/TracyQueue.hpp"
 #include "../common/TracySocket.hpp"
 #include "tracy_flat_hash_map.hpp"
@@ -94,11 +97,12 @@ private:
         int64_t max;
         int64_t total;
         int64_t selfTotal;
+        ZoneCountersSum counters;
     };
 
     struct DataBlock
     {
-        DataBlock() : zonesCnt( 0 ), lastTime( 0 ), frameOffset( 0 ), threadLast( std::numeric_limits<uint64_t>::max(), 0 ) {}
+        DataBlock() : zonesCnt( 0 ), samplesCnt( 0 ), ctxSwitchCnt( 0 ), lastTime( 0 ), frameOffset( 0 ), threadLast( std::numeric_limits<uint64_t>::max(), 0 ) {}
 
         TracyMutex lock;
         StringDiscovery<FrameData*> frames;
@@ -109,6 +113,8 @@ private:
         Vector<ThreadData*> threads;
         MemData memory;
         uint64_t zonesCnt;
+        uint64_t samplesCnt;
+        uint64_t ctxSwitchCnt;
         int64_t lastTime;
         uint64_t frameOffset;
 
@@ -130,8 +136,12 @@ private:
 
         flat_hash_map<VarArray<uint64_t>*, uint32_t, VarArrayHasherPOT<uint64_t>, VarArrayComparator<uint64_t>> callstackMap;
         Vector<VarArray<uint64_t>*> callstackPayload;
+        flat_hash_map<const ZoneEvent*, ZoneCounters, nohash<const ZoneEvent*>> zoneCounters;
         flat_hash_map<uint64_t, CallstackFrame*> callstackFrameMap;
 
+        flat_hash_map<int32_t, ZoneAggregateData, nohash<int32_t>> zoneAggregates;
+        Vector<DroppedEventsData> droppedEvents;
+
         std::map<uint32_t, LockMap> lockMap;
 
         flat_hash_map<uint64_t, uint16_t, nohash<uint64_t>> threadMap;
@@ -146,11 +156,14 @@ private:
 
     struct MbpsBlock
     {
-        MbpsBlock() : mbps( 64 ), compRatio( 1.0 ) {}
+        MbpsBlock() : mbps( 64 ), compRatio( 1.0 ), compressed( false ), compMode( CompressionModeFast ), compLevel( 1 ) {}
 
         TracyMutex lock;
         std::vector<float> mbps;
         float compRatio;
+        bool compressed;
+        uint8_t compMode;
+        uint8_t compLevel;
     };
 
     enum class NextCallstackType
@@ -160,6 +173,13 @@ private:
         Crash
     };
 
+    struct ZoneThrottle
+    {
+        int64_t start;
+        int64_t total;
+        uint32_t count;
+    };
+
     struct NextCallstack
     {
         NextCallstackType type;
@@ -171,8 +191,32 @@ private:
     };
 
 public:
-    Worker( const char* addr );
+    enum class SourceLocationState : uint8_t
+    {
+        Enabled,
+        Disabled,
+        Aggregated
+    };
+
+    // Ingest statistics of a replayed stream. Event counts and processing
+    // times are only gathered if timeEvents is set, as timing each event has
+    // a significant cost.
+    struct IngestStats
+    {
+        bool timeEvents;
+        uint64_t frames;
+        uint64_t bytes;
+        size_t peakMemory;
+        uint64_t count[(int)QueueType::NUM_TYPES];
+        uint64_t time[(int)QueueType::NUM_TYPES];   // ns
+    };
+
+    // The decompressed stream is written to the record file, if given.
+    Worker( const char* addr, const char* port = "8086", FILE* record = nullptr );
     Worker( FileRead& f, EventType::Type eventMask = EventType::All );
+    // Replays a stream written by a client in direct-to-file capture mode, or
+    // recorded by the server. The stats are accumulated, if given.
+    Worker( FILE* raw, IngestStats* stats = nullptr );
     ~Worker();
 
     const std::string& GetAddr() const { return m_addr; }
@@ -189,6 +233,9 @@ public:
     int64_t GetTimeBegin() const { return GetFrameBegin( *m_data.framesBase, 0 ); }
     int64_t GetLastTime() const { return m_data.lastTime; }
     uint64_t GetZoneCount() const { return m_data.zonesCnt; }
+    uint64_t GetSampleCount() const { return m_data.samplesCnt; }
+    uint64_t GetContextSwitchCount() const { return m_data.ctxSwitchCnt; }
+    uint64_t GetZoneCountersCount() const { return m_data.zoneCounters.size(); }
     uint64_t GetLockCount() const;
     uint64_t GetPlotCount() const;
     uint64_t GetSrcLocCount() const { return m_data.sourceLocationPayload.size() + m_data.sourceLocation.size(); }
@@ -209,8 +256,11 @@ public:
     const Vector<PlotData*>& GetPlots() const { return m_data.plots.Data(); }
     const Vector<ThreadData*>& GetThreadData() const { return m_data.threads; }
     const MemData& GetMemData() const { return m_data.memory; }
+    // Allocations of merged captures carry the capture index in the top byte.
+    static uint64_t GetMemoryAddress( uint64_t ptr ) { return ptr & ( ( uint64_t( 1 ) << 56 ) - 1 ); }
 
     const VarArray<uint64_t>& GetCallstack( uint32_t idx ) const { return *m_data.callstackPayload[idx]; }
+    const ZoneCounters* GetZoneCounters( const ZoneEvent& ev ) const;
     const CallstackFrame* GetCallstackFrame( uint64_t ptr ) const;
 
     const CrashEvent& GetCrashEvent() const { return m_data.m_crashEvent; }
@@ -221,6 +271,11 @@ public:
     // GetZoneEndDirect() will only return zone's direct timing data, without looking at children.
     int64_t GetZoneEnd( const ZoneEvent& ev );
     int64_t GetZoneEnd( const GpuEvent& ev );
+    int64_t GetContextSwitchEnd( const ContextSwitchData& cs ) const { return cs.end >= 0 ? cs.end : m_data.lastTime; }
+    // Time spent running on a cpu by the thread in the given range, and the
+    // number of times it was switched out. Returns false if the context
+    // switches of the thread don't cover the range.
+    bool GetRunningTime( uint64_t thread, int64_t start, int64_t end, int64_t& running, uint64_t& switches ) const;
     static tracy_force_inline int64_t GetZoneEndDirect( const ZoneEvent& ev ) { return ev.end >= 0 ? ev.end : ev.start; }
     static tracy_force_inline int64_t GetZoneEndDirect( const GpuEvent& ev ) { return ev.gpuEnd >= 0 ? ev.gpuEnd : ev.gpuStart; }
 
@@ -256,12 +311,35 @@ public:
     TracyMutex& GetMbpsDataLock() { return m_mbpsData.lock; }
     const std::vector<float>& GetMbpsData() const { return m_mbpsData.mbps; }
     float GetCompRatio() const { return m_mbpsData.compRatio; }
+    // Compression which the client currently uses for the data stream. The
+    // level is the LZ4 acceleration factor, or the LZ4HC compression level, and
+    // 0 if the stream is not compressed.
+    const char* GetCompressionName() const { return !m_mbpsData.compressed ? "none" : m_mbpsData.compMode == CompressionModeHigh ? "LZ4HC" : "LZ4"; }
+    int GetCompressionLevel() const { return m_mbpsData.compressed ? m_mbpsData.compLevel : 0; }
 
     bool HasData() const { return m_hasData.load( std::memory_order_acquire ); }
     bool IsConnected() const { return m_connected.load( std::memory_order_relaxed ); }
     bool IsDataStatic() const { return !m_thread.joinable(); }
     void Shutdown() { m_shutdown.store( true, std::memory_order_relaxed ); }
 
+    // Must be called with the data lock held.
+    bool CanToggleSourceLocation( int32_t srcloc ) const { return srcloc > 0 && m_protocol.load( std::memory_order_relaxed ) >= ProtocolSourceLocationToggle && IsConnected(); }
+    bool CanAggregateSourceLocation( int32_t srcloc ) const { return CanToggleSourceLocation( srcloc ) && m_protocol.load( std::memory_order_relaxed ) >= ProtocolZoneAggregate; }
+    SourceLocationState GetSourceLocationState( int32_t srcloc ) const;
+    void SetSourceLocationState( int32_t srcloc, SourceLocationState state );
+    // Zones shorter than duration, appearing more than rate times per second,
+    // get aggregated on the client. Rate of 0 disables throttling.
+    void SetZoneThrottle( uint32_t rate, int64_t duration );
+    uint32_t GetZoneThrottleRate() const { return m_throttleRate; }
+    int64_t GetZoneThrottleDuration() const { return m_throttleDuration; }
+    const flat_hash_map<int32_t, ZoneAggregateData, nohash<int32_t>>& GetZoneAggregates() const { return m_data.zoneAggregates; }
+    // Time ranges in which the client dropped events, because its queues were full.
+    const Vector<DroppedEventsData>& GetDroppedEvents() const { return m_data.droppedEvents; }
+
+    // Moves the data of another finished capture into this one, so that
+    // several processes running on the same host can be viewed together.
+    void Merge( std::unique_ptr<Worker>&& other );
+
     void Write( FileWrite& f );
     int GetTraceVersion() const { return m_traceVersion; }
 
@@ -270,8 +348,10 @@ public:
 private:
     void Exec();
     void ServerQuery( uint8_t type, uint64_t data );
+    void SendPendingQueries();
 
     tracy_force_inline void DispatchProcess( const QueueItem& ev, char*& ptr );
+    tracy_force_inline void DispatchCompact( QueueType type, const char*& ptr );
     tracy_force_inline void Process( const QueueItem& ev );
     tracy_force_inline void ProcessZoneBegin( const QueueZoneBegin& ev );
     tracy_force_inline void ProcessZoneBeginCallstack( const QueueZoneBegin& ev );
@@ -298,16 +378,32 @@ private:
     tracy_force_inline void ProcessGpuZoneBeginCallstack( const QueueGpuZoneBegin& ev );
     tracy_force_inline void ProcessGpuZoneEnd( const QueueGpuZoneEnd& ev );
     tracy_force_inline void ProcessGpuTime( const QueueGpuTime& ev );
+    void ProcessGpuTimeBatch( uint64_t key, const char* data, size_t sz );
     tracy_force_inline void ProcessMemAlloc( const QueueMemAlloc& ev );
     tracy_force_inline bool ProcessMemFree( const QueueMemFree& ev );
     tracy_force_inline void ProcessMemAllocCallstack( const QueueMemAlloc& ev );
     tracy_force_inline void ProcessMemFreeCallstack( const QueueMemFree& ev );
     tracy_force_inline void ProcessCallstackMemory( const QueueCallstackMemory& ev );
     tracy_force_inline void ProcessCallstack( const QueueCallstack& ev );
+    tracy_force_inline void ProcessCallstackMemoryCached( const QueueCallstackMemoryCached& ev );
+    tracy_force_inline void ProcessCallstackCached( const QueueCallstackCached& ev );
+    tracy_force_inline void ProcessCallstackSample( const QueueCallstackSample& ev );
+    tracy_force_inline void ProcessCallstackSamplePayload( const QueueCallstackSamplePayload& ev );
+    tracy_force_inline void ProcessZoneAggregate( const QueueZoneAggregate& ev );
+    tracy_force_inline void ProcessSourceLocationKey( const QueueSourceLocationKey& ev );
+    tracy_force_inline void ProcessDroppedEvents( const QueueDroppedEvents& ev );
+    tracy_force_inline void ProcessCompressionMode( const QueueCompressionMode& ev );
+    tracy_force_inline void ProcessContextSwitch( const QueueContextSwitch& ev );
+    tracy_force_inline void ProcessZoneCounters( const QueueZoneCounters& ev );
+    tracy_force_inline void ProcessZoneCountersHw( const QueueZoneCountersHw& ev );
+    tracy_force_inline void SetMemoryCallstack( uint32_t callstack );
+    tracy_force_inline void SetNextCallstack( uint64_t thread, uint32_t callstack );
+    void AddCallstackSample( int64_t time, uint64_t thread, uint32_t callstack );
     tracy_force_inline void ProcessCallstackFrame( const QueueCallstackFrame& ev );
     tracy_force_inline void ProcessCrashReport( const QueueCrashReport& ev );
 
     tracy_force_inline void ProcessZoneBeginImpl( ZoneEvent* zone, const QueueZoneBegin& ev );
+    void CheckZoneThrottle( const ZoneEvent* zone );
     tracy_force_inline void ProcessGpuZoneBeginImpl( GpuEvent* zone, const QueueGpuZoneBegin& ev );
 
     tracy_force_inline void CheckSourceLocation( uint64_t ptr );
@@ -327,6 +423,7 @@ private:
     tracy_force_inline void NewZone( ZoneEvent* zone, uint64_t thread );
 
     void InsertLockEvent( LockMap& lockmap, LockEvent* lev, uint64_t thread );
+    bool IsLockThreadKnown( const LockMap& lockmap, uint64_t thread ) const;
 
     void CheckString( uint64_t ptr );
     void CheckThreadString( uint64_t id );
@@ -337,10 +434,16 @@ private:
     void AddString( uint64_t ptr, char* str, size_t sz );
     void AddThreadString( uint64_t id, char* str, size_t sz );
     void AddCustomString( uint64_t ptr, char* str, size_t sz );
+    void AddInternedString( uint64_t ptr, char* str, size_t sz );
+    StringLocation GetCustomString( uint64_t ptr );
 
     tracy_force_inline void AddCallstackPayload( uint64_t ptr, char* data, size_t sz );
+    tracy_force_inline void AddCallstackPayloadCached( uint64_t id, char* data, size_t sz );
+    uint32_t InsertCallstackPayload( char* data, size_t sz );
 
     void InsertPlot( PlotData* plot, int64_t time, double val );
+    PlotData* RetrievePlot( uint64_t name );
+    void ProcessPlotBatch( uint64_t name, const char* data, size_t sz );
     void HandlePlotName( uint64_t name, char* str, size_t sz );
     void HandleFrameName( uint64_t name, char* str, size_t sz );
 
@@ -356,6 +459,7 @@ private:
     tracy_force_inline void ReadTimelinePre032( FileRead& f, GpuEvent* zone );
 
     tracy_force_inline void ReadTimelineUpdateStatistics( ZoneEvent* zone, uint16_t thread );
+    void ReadTimelineZoneCounters( ZoneEvent* zone );
 
     void ReadTimeline( FileRead& f, Vector<ZoneEvent*>& vec, uint16_t thread, uint64_t size );
     void ReadTimelinePre033( FileRead& f, Vector<ZoneEvent*>& vec, uint16_t thread, uint64_t size, int fileVer );
@@ -364,12 +468,19 @@ private:
 
     void WriteTimeline( FileWrite& f, const Vector<ZoneEvent*>& vec );
     void WriteTimeline( FileWrite& f, const Vector<GpuEvent*>& vec );
+    void CollectZoneCounters( const Vector<ZoneEvent*>& vec, uint64_t& idx, std::vector<std::pair<uint64_t, const ZoneCounters*>>& out ) const;
 
     int64_t TscTime( int64_t tsc ) { return int64_t( tsc * m_timerMul ); }
     int64_t TscTime( uint64_t tsc ) { return int64_t( tsc * m_timerMul ); }
 
     Socket m_sock;
     std::string m_addr;
+    std::string m_port;
+    FILE* m_rawFile;
+    bool m_rawCompressed;
+    bool m_flightRecord;
+    FILE* m_record;
+    IngestStats* m_ingestStats;
 
     std::thread m_thread;
     std::atomic<bool> m_connected;
@@ -391,15 +502,31 @@ private:
     char* m_buffer;
     int m_bufferOffset;
     bool m_onDemand;
+    std::atomic<uint8_t> m_protocol;
+
+    int64_t m_refTime;
+    uint64_t m_threadCtx;
+    Vector<uint64_t> m_srclocIds;
+    Vector<uint32_t> m_callstackIds;
 
     GpuCtxData* m_gpuCtxMap[256];
     flat_hash_map<uint64_t, StringLocation, nohash<uint64_t>> m_pendingCustomStrings;
+    flat_hash_map<uint64_t, StringLocation, nohash<uint64_t>> m_internedStrings;
     flat_hash_map<uint64_t, uint32_t> m_pendingCallstacks;
     flat_hash_map<uint64_t, int32_t, nohash<uint64_t>> m_pendingSourceLocationPayload;
     Vector<uint64_t> m_sourceLocationQueue;
     flat_hash_map<uint64_t, uint32_t, nohash<uint64_t>> m_sourceLocationShrink;
     flat_hash_map<uint64_t, ThreadData*, nohash<uint64_t>> m_threadMap;
     flat_hash_map<uint64_t, NextCallstack, nohash<uint64_t>> m_nextCallstack;
+    flat_hash_map<int32_t, SourceLocationState, nohash<int32_t>> m_srclocState;
+    TracyMutex m_pendingQueriesLock;
+    std::vector<std::pair<uint8_t, uint64_t>> m_pendingQueries;
+    flat_hash_map<uint64_t, const char*, nohash<uint64_t>> m_flightNames;
+    std::vector<std::pair<uint8_t, uint64_t>> m_flightQueries;
+    flat_hash_map<int32_t, ZoneThrottle, nohash<int32_t>> m_zoneThrottle;
+    uint32_t m_throttleRate;
+    int64_t m_throttleDuration;
+    uint64_t m_sourceLocationKey;
 
     uint32_t m_pendingStrings;
     uint32_t m_pendingThreads;
@@ -409,6 +536,11 @@ private:
     uint64_t m_lastMemActionCallstack;
     bool m_lastMemActionWasAlloc;
 
+    // Counters of a file being loaded, keyed by the position of the zone in
+    // the saved timelines, in reverse order.
+    std::vector<std::pair<uint64_t, ZoneCounters>> m_loadZoneCounters;
+    uint64_t m_loadZoneIdx;
+
     Slab<64*1024*1024> m_slab;
 
     DataBlock m_data;
@@ -416,6 +548,8 @@ private:
 
     int m_traceVersion;
 
+    std::vector<std::unique_ptr<Worker>> m_merged;
+
     static LoadProgress s_loadProgress;
 };
 
@@ -0,0 +1,98 @@
+#ifndef __BENCHSINK_HPP__
+#define __BENCHSINK_HPP__
+
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <thread>
+#include <vector>
+
+#include "../client/tracy_rpmalloc.hpp"
+#include "../common/TracyProtocol.hpp"
+#include "../common/TracySocket.hpp"
+
+// Connects to the profiled program in place of the server, and reads and
+// discards the data stream, so that benchmarks measure the client with its
+// queue being drained.
+class Sink
+{
+public:
+    Sink() : m_connected( false ), m_stop( false ), m_bytes( 0 ), m_thread( [this] { Run(); } ) {}
+
+    ~Sink()
+    {
+        m_stop.store( true, std::memory_order_relaxed );
+        m_thread.join();
+    }
+
+    void WaitConnected() const
+    {
+        while( !m_connected.load( std::memory_order_acquire ) ) std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+    }
+
+    // Compressed size of the data received so far.
+    uint64_t GetBytes() const { return m_bytes.load( std::memory_order_relaxed ); }
+
+    // Returns when no data was received for a while, so that the events of
+    // the previous run don't compete with the next one.
+    void WaitIdle() const
+    {
+        uint64_t prev;
+        do
+        {
+            prev = m_bytes.load( std::memory_order_relaxed );
+            std::this_thread::sleep_for( std::chrono::milliseconds( 100 ) );
+        }
+        while( m_bytes.load( std::memory_order_relaxed ) != prev );
+    }
+
+private:
+    void Run()
+    {
+        // The socket buffer is allocated by the client allocator.
+        tracy::rpmalloc_thread_initialize();
+        const char* port = getenv( "TRACY_PORT" );
+        tracy::Socket sock;
+        while( !sock.Connect( "127.0.0.1", port ? port : "8086" ) )
+        {
+            if( m_stop.load( std::memory_order_relaxed ) ) return;
+            std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+        }
+
+        tracy::HandshakeMessage handshake;
+        handshake.protocol = tracy::ProtocolVersion;
+        sock.Send( &handshake, sizeof( handshake ) );
+
+        timeval tv;
+        tv.tv_sec = 0;
+        tv.tv_usec = 10000;
+        auto ShouldStop = [this] { return m_stop.load( std::memory_order_relaxed ); };
+
+        tracy::WelcomeMessage welcome;
+        if( !sock.Read( &welcome, sizeof( welcome ), &tv, ShouldStop ) ) return;
+        if( welcome.onDemand != 0 )
+        {
+            tracy::OnDemandPayloadMessage onDemand;
+            if( !sock.Read( &onDemand, sizeof( onDemand ), &tv, ShouldStop ) ) return;
+        }
+        m_connected.store( true, std::memory_order_release );
+
+        std::vector<char> buf( tracy::LZ4Size );
+        for(;;)
+        {
+            tracy::lz4sz_t sz;
+            if( !sock.Read( &sz, sizeof( sz ), &tv, ShouldStop ) ) break;
+            if( sz > buf.size() || !sock.Read( buf.data(), sz, &tv, ShouldStop ) ) break;
+            m_bytes.fetch_add( sizeof( sz ) + sz, std::memory_order_relaxed );
+        }
+    }
+
+    std::atomic<bool> m_connected;
+    std::atomic<bool> m_stop;
+    std::atomic<uint64_t> m_bytes;
+    std::thread m_thread;
+};
+
+#endif
@@ -0,0 +1,88 @@
+// Measures the cost of collecting OpenGL GPU zone timestamps. Build with
+// "make gpubench" (Linux only, requires EGL with surfaceless platform and
+// no-config context support, e.g. Mesa llvmpipe) and run without arguments,
+// optionally passing the number of GPU zones per frame. Each frame issues the
+// zones, waits for the GPU to finish and calls TracyGpuCollect, so that all
+// queries of the frame are ready. The data stream is read and discarded by a
+// local sink, in place of the server.
+
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+#include "../TracyOpenGL.hpp"
+#include "benchsink.hpp"
+
+static bool CreateContext()
+{
+    auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress( "eglGetPlatformDisplayEXT" );
+    if( !getPlatformDisplay ) return false;
+    auto display = getPlatformDisplay( EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr );
+    if( display == EGL_NO_DISPLAY || !eglInitialize( display, nullptr, nullptr ) ) return false;
+    if( !eglBindAPI( EGL_OPENGL_API ) ) return false;
+
+    // Nothing is drawn to a surface, so no config is needed.
+    const EGLint contextAttr[] = { EGL_CONTEXT_MAJOR_VERSION, 3, EGL_CONTEXT_MINOR_VERSION, 2, EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT, EGL_NONE };
+    auto context = eglCreateContext( display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, contextAttr );
+    if( context == EGL_NO_CONTEXT ) return false;
+    return eglMakeCurrent( display, EGL_NO_SURFACE, EGL_NO_SURFACE, context );
+}
+
+enum { Frames = 200 };
+
+int main( int argc, char** argv )
+{
+    const int zones = argc > 1 ? atoi( argv[1] ) : 1000;
+    if( zones <= 0 || zones * 2 >= 64 * 1024 )
+    {
+        fprintf( stderr, "Zone count must be between 1 and 32767\n" );
+        return 1;
+    }
+    if( !CreateContext() )
+    {
+        fprintf( stderr, "Cannot create an OpenGL 3.2 context\n" );
+        return 1;
+    }
+    printf( "%s, %d zones per frame\n", glGetString( GL_RENDERER ), zones );
+
+    Sink sink;
+    sink.WaitConnected();
+    TracyGpuContext;
+    sink.WaitIdle();
+    const auto bytes = sink.GetBytes();
+
+    std::vector<double> times;
+    times.reserve( Frames );
+    for( int frame=0; frame<Frames; frame++ )
+    {
+        for( int i=0; i<zones; i++ )
+        {
+            TracyGpuZone( "gpubench" );
+            glClear( GL_COLOR_BUFFER_BIT );
+        }
+        glFinish();
+
+        const auto t0 = std::chrono::high_resolution_clock::now();
+        TracyGpuCollect;
+        const auto t1 = std::chrono::high_resolution_clock::now();
+        times.push_back( std::chrono::duration_cast<std::chrono::duration<double>>( t1 - t0 ).count() );
+    }
+    sink.WaitIdle();
+
+    // The GPU driver threads compete for the CPU, so the fastest and median
+    // frames are reported.
+    std::sort( times.begin(), times.end() );
+    const auto queries = double( Frames ) * zones * 2;
+    printf( "Collect (min):    %8.1f us/frame %8.1f ns/query\n", times.front() * 1000000., times.front() / ( zones * 2 ) * 1000000000. );
+    printf( "Collect (median): %8.1f us/frame %8.1f ns/query\n", times[times.size() / 2] * 1000000., times[times.size() / 2] / ( zones * 2 ) * 1000000000. );
+    printf( "Stream:           %8.2f bytes/query (compressed, including zone events)\n", ( sink.GetBytes() - bytes ) / queries );
+    return 0;
+}
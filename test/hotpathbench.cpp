@@ -0,0 +1,194 @@
+// Measures the cost of the client instrumentation hot path: zones, zones with
+// callstacks, locks, plots, messages (repeated and unique) and memory events,
+// with an increasing number of producer threads. Build with "make
+// hotpathbench" (Linux only) and run without arguments, optionally passing
+// the maximum number of threads. The tracy_hotpathbench binary is connected
+// to a local sink, which reads and discards the data stream, in place of the
+// server. The on-demand variant, tracy_hotpathbench_ondemand, is
+// additionally measured before the sink is connected, when all events are
+// discarded by the client.
+//
+// ns/event is the average time a producer thread spends per event, and
+// M events/s is the combined rate of all threads. A zone, a lock and unlock
+// pair, an allocation and free pair, or a plot value (whether it is sent or
+// not) is counted as one event.
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+
+#include "../Tracy.hpp"
+#include "benchsink.hpp"
+
+struct Bench
+{
+    const char* name;
+    void(*run)( unsigned int thread, unsigned int count );
+    unsigned int events;    // total for all threads
+};
+
+static void Zone( unsigned int, unsigned int count )
+{
+    for( unsigned int i=0; i<count; i++ )
+    {
+        ZoneScoped;
+    }
+}
+
+static void ZoneCallstack( unsigned int, unsigned int count )
+{
+    for( unsigned int i=0; i<count; i++ )
+    {
+        ZoneScopedS( 8 );
+    }
+}
+
+static void Lock( unsigned int, unsigned int count )
+{
+    TracyLockable( std::mutex, lock );
+    for( unsigned int i=0; i<count; i++ )
+    {
+        lock.lock();
+        lock.unlock();
+    }
+}
+
+static void Plot( unsigned int, unsigned int count )
+{
+    for( unsigned int i=0; i<count; i++ )
+    {
+        TracyPlot( "hotpathbench", int64_t( i ) );
+    }
+}
+
+// Values are collected in a buffer and submitted 256 at a time.
+static void PlotBatch( unsigned int, unsigned int count )
+{
+    tracy::PlotSample buf[256];
+    for( unsigned int i=0; i<count; i++ )
+    {
+        buf[i%256] = { tracy::Profiler::GetTime(), double( i ) };
+        if( i%256 == 255 ) TracyPlotBatch( "hotpathbench batch", buf, 256 );
+    }
+}
+
+// The value changes every 64 iterations, and is sent at most every 10 us.
+static void PlotSampled( unsigned int, unsigned int count )
+{
+    for( unsigned int i=0; i<count; i++ )
+    {
+        TracyPlotSampled( "hotpathbench sampled", double( i / 64 ), 10 );
+    }
+}
+
+static void Message( unsigned int, unsigned int count )
+{
+    for( unsigned int i=0; i<count; i++ )
+    {
+        TracyMessage( "hotpathbench message", 20 );
+    }
+}
+
+// Every message text is different, so none of them is interned and each one
+// is copied.
+static void MessageCopy( unsigned int, unsigned int count )
+{
+    char buf[] = "hotpathbench 00000000";
+    for( unsigned int i=0; i<count; i++ )
+    {
+        for( int j=0; j<8; j++ ) buf[13+j] = "0123456789abcdef"[( i >> ( j*4 ) ) & 0xF];
+        TracyMessage( buf, 21 );
+    }
+}
+
+// Only the instrumentation is measured, so the pointers are made up.
+static void Alloc( unsigned int thread, unsigned int count )
+{
+    const auto base = ( uint64_t( thread ) + 1 ) << 40;
+    for( unsigned int i=0; i<count; i++ )
+    {
+        const auto ptr = (void*)( base + uint64_t( i ) * 16 );
+        TracyAlloc( ptr, 16 );
+        TracyFree( ptr );
+    }
+}
+
+static const Bench s_benches[] = {
+    { "ScopedZone", Zone, 1 << 21 },
+#ifdef TRACY_HAS_CALLSTACK
+    { "ZoneCallstack", ZoneCallstack, 1 << 16 },
+#endif
+    { "Lockable::lock", Lock, 1 << 21 },
+    { "PlotData", Plot, 1 << 21 },
+    { "PlotBatch", PlotBatch, 1 << 21 },
+    { "PlotSampled", PlotSampled, 1 << 21 },
+    { "Message", Message, 1 << 20 },
+    { "MessageCopy", MessageCopy, 1 << 20 },
+    { "MemAlloc", Alloc, 1 << 20 },
+};
+
+static void Run( const Bench& bench, unsigned int num )
+{
+    const auto count = bench.events / num;
+    std::vector<double> times( num );
+    std::atomic<unsigned int> ready( 0 );
+
+    std::vector<std::thread> threads;
+    for( unsigned int i=0; i<num; i++ )
+    {
+        threads.emplace_back( [&bench, &times, &ready, count, num, i] {
+            ready.fetch_add( 1, std::memory_order_relaxed );
+            while( ready.load( std::memory_order_relaxed ) != num ) {}
+            const auto t0 = std::chrono::high_resolution_clock::now();
+            bench.run( i, count );
+            const auto t1 = std::chrono::high_resolution_clock::now();
+            times[i] = std::chrono::duration_cast<std::chrono::duration<double>>( t1 - t0 ).count();
+        } );
+    }
+    for( auto& t : threads ) t.join();
+
+    double sum = 0;
+    double wall = 0;
+    for( auto& t : times )
+    {
+        sum += t;
+        if( t > wall ) wall = t;
+    }
+    const auto events = double( count ) * num;
+    printf( "%-16s %3u threads: %8.1f ns/event %8.2f M events/s\n", bench.name, num, sum / events * 1000000000., events / wall / 1000000. );
+}
+
+static void RunAll( unsigned int maxThreads, const Sink* sink )
+{
+    for( auto& bench : s_benches )
+    {
+        for( unsigned int num = 1; num <= maxThreads; num *= 2 )
+        {
+            Run( bench, num );
+            if( sink ) sink->WaitIdle();
+        }
+    }
+}
+
+int main( int argc, char** argv )
+{
+    unsigned int maxThreads = argc > 1 ? atoi( argv[1] ) : std::thread::hardware_concurrency();
+    if( maxThreads == 0 ) maxThreads = 1;
+
+#ifdef TRACY_ON_DEMAND
+    printf( "Disconnected (on-demand)\n" );
+    RunAll( maxThreads, nullptr );
+    printf( "\n" );
+#endif
+
+    Sink sink;
+    sink.WaitConnected();
+    printf( "Connected (local sink)\n" );
+    RunAll( maxThreads, &sink );
+    return 0;
+}
@@ -0,0 +1,130 @@
+// Measures the per-zone cost of Lua instrumentation. Build with "make luabench"
+// (Linux only; set LUA to the pkg-config name of the Lua library if it is not
+// "lua", e.g. "make luabench LUA=lua5.3") and run without arguments. Zones
+// are measured with the source location cached per call site (tracy.ZoneBegin,
+// tracy.ZoneBeginN), and sent with every zone, as it was done before the cache
+// was added (uncached.ZoneBegin, uncached.ZoneBeginN). The data stream is read
+// and discarded by a local sink, in place of the server.
+//
+// ns/zone includes the Lua loop and the two C function calls, which are
+// measured separately as the baseline.
+
+#include <chrono>
+#include <stdio.h>
+#include <string>
+
+extern "C"
+{
+#include <lua.h>
+#include <lualib.h>
+#include <lauxlib.h>
+}
+
+#include "../TracyLua.hpp"
+#include "benchsink.hpp"
+
+static int Nop( lua_State* )
+{
+    return 0;
+}
+
+static int UncachedZoneBegin( lua_State* L )
+{
+    lua_Debug dbg;
+    lua_getstack( L, 1, &dbg );
+    lua_getinfo( L, "Sl", &dbg );
+    tracy::detail::LuaZoneBeginAlloc( L, dbg, nullptr, 0 );
+    return 0;
+}
+
+static int UncachedZoneBeginN( lua_State* L )
+{
+    size_t nsz;
+    const auto name = lua_tolstring( L, 1, &nsz );
+    lua_Debug dbg;
+    lua_getstack( L, 1, &dbg );
+    lua_getinfo( L, "Sl", &dbg );
+    tracy::detail::LuaZoneBeginAlloc( L, dbg, name, nsz );
+    return 0;
+}
+
+static const char* s_script = R"(
+function baseline( n ) for i = 1, n do nop() nop() end end
+function zone( n ) for i = 1, n do tracy.ZoneBegin() tracy.ZoneEnd() end end
+function zonen( n ) for i = 1, n do tracy.ZoneBeginN( "luabench" ) tracy.ZoneEnd() end end
+function zoneuncached( n ) for i = 1, n do uncached.ZoneBegin() tracy.ZoneEnd() end end
+function zonenuncached( n ) for i = 1, n do uncached.ZoneBeginN( "luabench" ) tracy.ZoneEnd() end end
+)";
+
+struct Bench
+{
+    const char* name;
+    const char* function;
+};
+
+static const Bench s_benches[] = {
+    { "Baseline", "baseline" },
+    { "ZoneBegin", "zone" },
+    { "ZoneBeginN", "zonen" },
+    { "ZoneBegin (uncached)", "zoneuncached" },
+    { "ZoneBeginN (uncached)", "zonenuncached" },
+    { "ZoneBegin (16 KB chunk)", "zonelarge" },
+    { "ZoneBeginN (16 KB chunk)", "zonenlarge" },
+};
+
+enum { Count = 1 << 20 };
+
+// Chunks loaded from strings have the whole script as their source. This one
+// is padded with a comment to the size of a typical script.
+static const char* s_largeScript = R"(
+function zonelarge( n ) for i = 1, n do tracy.ZoneBegin() tracy.ZoneEnd() end end
+function zonenlarge( n ) for i = 1, n do tracy.ZoneBeginN( "luabench" ) tracy.ZoneEnd() end end
+)";
+enum { LargeScriptSize = 16 * 1024 };
+
+int main()
+{
+    Sink sink;
+    sink.WaitConnected();
+
+    auto L = luaL_newstate();
+    luaL_openlibs( L );
+    tracy::LuaRegister( L );
+    lua_newtable( L );
+    lua_pushcfunction( L, UncachedZoneBegin );
+    lua_setfield( L, -2, "ZoneBegin" );
+    lua_pushcfunction( L, UncachedZoneBeginN );
+    lua_setfield( L, -2, "ZoneBeginN" );
+    lua_setglobal( L, "uncached" );
+    lua_pushcfunction( L, Nop );
+    lua_setglobal( L, "nop" );
+
+    std::string largeScript( s_largeScript );
+    largeScript += "--";
+    largeScript.append( LargeScriptSize - largeScript.size(), '-' );
+    if( luaL_loadstring( L, s_script ) != 0 || lua_pcall( L, 0, 0, 0 ) != 0 ||
+        luaL_loadstring( L, largeScript.c_str() ) != 0 || lua_pcall( L, 0, 0, 0 ) != 0 )
+    {
+        fprintf( stderr, "%s\n", lua_tostring( L, -1 ) );
+        return 1;
+    }
+
+    for( auto& bench : s_benches )
+    {
+        lua_getglobal( L, bench.function );
+        lua_pushinteger( L, Count );
+        const auto t0 = std::chrono::high_resolution_clock::now();
+        if( lua_pcall( L, 1, 0, 0 ) != 0 )
+        {
+            fprintf( stderr, "%s\n", lua_tostring( L, -1 ) );
+            return 1;
+        }
+        const auto t1 = std::chrono::high_resolution_clock::now();
+        const auto time = std::chrono::duration_cast<std::chrono::duration<double>>( t1 - t0 ).count();
+        printf( "%-24s %8.1f ns/zone\n", bench.name, time / Count * 1000000000. );
+        sink.WaitIdle();
+    }
+
+    lua_close( L );
+    return 0;
+}
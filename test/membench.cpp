@@ -0,0 +1,60 @@
+// Measures the throughput of instrumented memory allocations with an
+// increasing number of threads. Build with "make membench" and run without
+// arguments, optionally passing the maximum number of threads. Memory events
+// are retained until a server connects, so the per-thread workload is kept
+// small.
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+
+#include "../Tracy.hpp"
+
+enum { Iterations = 100000 };
+enum { Live = 64 };
+
+static void Work()
+{
+    void* ptrs[Live] = {};
+    for( int i=0; i<Iterations; i++ )
+    {
+        auto& slot = ptrs[i % Live];
+        if( slot )
+        {
+            TracyFree( slot );
+            free( slot );
+        }
+        slot = malloc( 16 + i % 256 );
+        TracyAlloc( slot, 16 + i % 256 );
+    }
+    for( auto& slot : ptrs )
+    {
+        if( slot )
+        {
+            TracyFree( slot );
+            free( slot );
+        }
+    }
+}
+
+int main( int argc, char** argv )
+{
+    unsigned int maxThreads = argc > 1 ? atoi( argv[1] ) : std::thread::hardware_concurrency();
+    if( maxThreads == 0 ) maxThreads = 1;
+
+    for( unsigned int num = 1; num <= maxThreads; num *= 2 )
+    {
+        std::vector<std::thread> threads;
+        const auto t0 = std::chrono::high_resolution_clock::now();
+        for( unsigned int i=0; i<num; i++ ) threads.emplace_back( Work );
+        for( auto& t : threads ) t.join();
+        const auto t1 = std::chrono::high_resolution_clock::now();
+
+        const auto s = std::chrono::duration_cast<std::chrono::duration<double>>( t1 - t0 ).count();
+        const auto events = double( num ) * Iterations * 2;
+        printf( "%3u threads: %8.2f M events/s (%.2f M events/s per thread)\n", num, events / s / 1000000., events / s / 1000000. / num );
+    }
+    return 0;
+}
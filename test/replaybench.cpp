@@ -0,0 +1,176 @@
+// Measures how fast the server processes the data stream, without the network
+// and decompression. Record a stream with "capture -a address -o out.tracy
+// -r stream.rec", build with "make replaybench" (Linux only) and run with the
+// recording as argument. The stream is replayed from memory twice: first at
+// full speed, to measure the event rate and peak memory usage, and then with
+// each event timed, to show the cost of the individual event types.
+
+#include <algorithm>
+#include <chrono>
+#include <inttypes.h>
+#include <memory>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "../server/TracyMemory.hpp"
+#include "../server/TracyWorker.hpp"
+
+using namespace tracy;
+
+static const char* s_typeNames[] = {
+    "ZoneText",
+    "ZoneName",
+    "Message",
+    "ZoneBeginAllocSrcLoc",
+    "CallstackMemory",
+    "Callstack",
+    "Terminate",
+    "KeepAlive",
+    "Crash",
+    "CrashReport",
+    "ZoneBegin",
+    "ZoneBeginCallstack",
+    "ZoneEnd",
+    "FrameMarkMsg",
+    "FrameMarkMsgStart",
+    "FrameMarkMsgEnd",
+    "SourceLocation",
+    "LockAnnounce",
+    "LockWait",
+    "LockObtain",
+    "LockRelease",
+    "LockSharedWait",
+    "LockSharedObtain",
+    "LockSharedRelease",
+    "LockMark",
+    "PlotData",
+    "MessageLiteral",
+    "GpuNewContext",
+    "GpuZoneBegin",
+    "GpuZoneBeginCallstack",
+    "GpuZoneEnd",
+    "GpuTime",
+    "MemAlloc",
+    "MemFree",
+    "MemAllocCallstack",
+    "MemFreeCallstack",
+    "CallstackFrame",
+    "StringData",
+    "ThreadName",
+    "CustomStringData",
+    "PlotName",
+    "SourceLocationPayload",
+    "CallstackPayload",
+    "FrameName",
+    "ThreadContext",
+    "ZoneBeginCompact",
+    "ZoneBeginCallstackCompact",
+    "ZoneEndCompact",
+    "CallstackCached",
+    "CallstackMemoryCached",
+    "CallstackPayloadCached",
+    "CallstackSample",
+    "ZoneAggregate",
+    "SourceLocationKey",
+    "DroppedEvents",
+    "CompressionMode",
+    "InternedStringData",
+    "PlotBatchPayload",
+    "GpuTimePayload",
+    "ContextSwitch",
+    "ZoneCounters",
+    "ZoneCountersHw",
+    "CallstackSamplePayload",
+    "PlotDataBatch",
+    "LuaSample",
+    "GpuTimeBatch",
+};
+
+static_assert( sizeof( s_typeNames ) / sizeof( *s_typeNames ) == (int)QueueType::NUM_TYPES, "Queue type names mismatch" );
+
+// Returns the replay time in seconds.
+static double Replay( const std::vector<char>& data, Worker::IngestStats& stats )
+{
+    auto f = fmemopen( (void*)data.data(), data.size(), "rb" );
+    if( !f )
+    {
+        fprintf( stderr, "Cannot open the stream in memory\n" );
+        exit( 1 );
+    }
+    const auto t0 = std::chrono::high_resolution_clock::now();
+    auto worker = std::make_unique<Worker>( f, &stats );
+    const auto t1 = std::chrono::high_resolution_clock::now();
+    worker.reset();
+    fclose( f );
+    return std::chrono::duration_cast<std::chrono::duration<double>>( t1 - t0 ).count();
+}
+
+int main( int argc, char** argv )
+{
+    if( argc != 2 )
+    {
+        printf( "Usage: tracy_replaybench stream.rec\n" );
+        return 1;
+    }
+
+    FILE* f = fopen( argv[1], "rb" );
+    if( !f )
+    {
+        fprintf( stderr, "Cannot open %s\n", argv[1] );
+        return 1;
+    }
+    char hdr[RawCaptureHeaderSize];
+    if( fread( hdr, 1, RawCaptureHeaderSize, f ) != RawCaptureHeaderSize || memcmp( hdr, RecordCaptureHeader, RawCaptureHeaderSize ) != 0 )
+    {
+        fprintf( stderr, "%s is not a stream recorded by capture -r\n", argv[1] );
+        return 1;
+    }
+    fseek( f, 0, SEEK_END );
+    std::vector<char> data( ftell( f ) );
+    fseek( f, 0, SEEK_SET );
+    if( fread( data.data(), 1, data.size(), f ) != data.size() )
+    {
+        fprintf( stderr, "Cannot read %s\n", argv[1] );
+        return 1;
+    }
+    fclose( f );
+
+    Worker::IngestStats fast = {};
+    const auto memBase = memUsage.load( std::memory_order_relaxed );
+    const auto fastTime = Replay( data, fast );
+
+    Worker::IngestStats timed = {};
+    timed.timeEvents = true;
+    const auto timedTime = Replay( data, timed );
+
+    uint64_t events = 0;
+    uint64_t eventTime = 0;
+    for( int i=0; i<(int)QueueType::NUM_TYPES; i++ )
+    {
+        events += timed.count[i];
+        eventTime += timed.time[i];
+    }
+
+    printf( "Frames:        %" PRIu64 " (%.2f MB)\n", fast.frames, fast.bytes / ( 1024. * 1024. ) );
+    printf( "Events:        %" PRIu64 "\n", events );
+    printf( "Replay time:   %.3f s\n", fastTime );
+    printf( "Ingest rate:   %.2f M events/s, %.2f MB/s\n", events / fastTime / 1000000., fast.bytes / fastTime / ( 1024. * 1024. ) );
+    printf( "Peak memory:   %.2f MB\n", ( fast.peakMemory - memBase ) / ( 1024. * 1024. ) );
+    printf( "Timed replay:  %.3f s (%.3f s in events)\n\n", timedTime, eventTime / 1000000000. );
+
+    std::vector<int> order;
+    for( int i=0; i<(int)QueueType::NUM_TYPES; i++ )
+    {
+        if( timed.count[i] != 0 ) order.push_back( i );
+    }
+    std::sort( order.begin(), order.end(), [&timed] ( int lhs, int rhs ) { return timed.time[lhs] > timed.time[rhs]; } );
+
+    printf( "%-26s %12s %10s %10s %7s\n", "Event type", "Count", "Time (ms)", "ns/event", "Time %" );
+    for( auto i : order )
+    {
+        printf( "%-26s %12" PRIu64 " %10.2f %10.1f %6.1f%%\n", s_typeNames[i], timed.count[i], timed.time[i] / 1000000., double( timed.time[i] ) / timed.count[i], 100. * timed.time[i] / eventTime );
+    }
+    return 0;
+}
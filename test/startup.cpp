@@ -0,0 +1,79 @@
+// Measures the time it takes for an instrumented program to reach main().
+// Build both variants with "make startup" and run each of them without
+// arguments. The program will spawn itself repeatedly and report the average
+// time-to-main and total process run time.
+
+#include <inttypes.h>
+#include <spawn.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../Tracy.hpp"
+
+extern char** environ;
+
+static int64_t Now()
+{
+    timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return int64_t( ts.tv_sec ) * 1000000000ll + ts.tv_nsec;
+}
+
+int main( int argc, char** argv )
+{
+    if( argc > 1 && strcmp( argv[1], "child" ) == 0 )
+    {
+        const auto t = Now();
+        ZoneScoped;
+        write( STDOUT_FILENO, &t, sizeof( t ) );
+        return 0;
+    }
+
+    enum { Runs = 10 };
+
+    int64_t toMain = 0;
+    int64_t total = 0;
+    for( int i=0; i<Runs; i++ )
+    {
+        int fd[2];
+        if( pipe( fd ) != 0 ) return 1;
+
+        posix_spawn_file_actions_t actions;
+        posix_spawn_file_actions_init( &actions );
+        posix_spawn_file_actions_adddup2( &actions, fd[1], STDOUT_FILENO );
+        posix_spawn_file_actions_addclose( &actions, fd[0] );
+
+        char child[] = "child";
+        char* args[] = { argv[0], child, nullptr };
+
+        const auto t0 = Now();
+        pid_t pid;
+        if( posix_spawn( &pid, argv[0], &actions, nullptr, args, environ ) != 0 ) return 1;
+        close( fd[1] );
+
+        int64_t t1;
+        const auto rd = read( fd[0], &t1, sizeof( t1 ) );
+        int status;
+        waitpid( pid, &status, 0 );
+        const auto t2 = Now();
+        close( fd[0] );
+        posix_spawn_file_actions_destroy( &actions );
+        if( rd != sizeof( t1 ) ) return 1;
+
+        toMain += t1 - t0;
+        total += t2 - t0;
+    }
+
+#ifdef TRACY_ASYNC_CALIBRATION
+    const char* mode = "async calibration";
+#else
+    const char* mode = "blocking calibration";
+#endif
+    printf( "%s: time to main %.2f ms, run time %.2f ms (%i runs)\n", mode, toMain / ( Runs * 1000000. ), total / ( Runs * 1000000. ), Runs );
+    return 0;
+}
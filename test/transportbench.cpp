@@ -0,0 +1,163 @@
+// Measures the sustained throughput of the client to server transports:
+// loopback TCP with LZ4 compression, and the shared memory channel, with and
+// without compression. Frames of zone events are produced and sent the same
+// way the client does it, and decompressed on the receiving side, but the
+// events are not processed. Build with "make transportbench" (Linux only)
+// and run without arguments, optionally passing the number of frames.
+
+#include <chrono>
+#include <memory>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <thread>
+
+#include "../common/TracyProtocol.hpp"
+#include "../common/TracyQueue.hpp"
+#include "../common/TracySocket.hpp"
+#include "../common/tracy_lz4.hpp"
+
+using namespace tracy;
+
+enum { DefaultFrames = 4000 };
+
+static int FillFrame( char* buf, int64_t& time )
+{
+    const auto beginSize = sizeof( QueueHeader ) + sizeof( QueueZoneBegin );
+    const auto endSize = sizeof( QueueHeader ) + sizeof( QueueZoneEnd );
+
+    int events = 0;
+    auto ptr = buf;
+    while( ptr + beginSize + endSize <= buf + TargetFrameSize )
+    {
+        QueueItem item;
+        item.hdr.type = QueueType::ZoneBegin;
+        item.zoneBegin.time = time;
+        item.zoneBegin.thread = 0x1234 + ( events & 3 );
+        item.zoneBegin.srcloc = 0x400000 + ( events & 0xF0 );
+        item.zoneBegin.cpu = events & 7;
+        memcpy( ptr, &item, beginSize );
+        ptr += beginSize;
+        time += 17 + ( events * 7 ) % 23;
+
+        item.hdr.type = QueueType::ZoneEnd;
+        item.zoneEnd.time = time;
+        item.zoneEnd.thread = 0x1234 + ( events & 3 );
+        item.zoneEnd.cpu = events & 7;
+        memcpy( ptr, &item, endSize );
+        ptr += endSize;
+        time += 5 + ( events * 3 ) % 11;
+
+        events += 2;
+    }
+    return events;
+}
+
+static void Produce( Socket* sock, int frames, uint64_t& events )
+{
+    auto stream = LZ4_createStream();
+    auto buffer = std::make_unique<char[]>( TargetFrameSize * 3 );
+    auto lz4buf = std::make_unique<char[]>( LZ4Size + sizeof( lz4sz_t ) );
+    const auto compress = sock->IsCompressed();
+
+    int64_t time = 0;
+    int offset = 0;
+    for( int i=0; i<frames; i++ )
+    {
+        auto frame = buffer.get() + offset;
+        events += FillFrame( frame, time );
+        if( compress )
+        {
+            const lz4sz_t lz4sz = LZ4_compress_fast_continue( stream, frame, lz4buf.get() + sizeof( lz4sz_t ), TargetFrameSize, LZ4Size, 1 );
+            memcpy( lz4buf.get(), &lz4sz, sizeof( lz4sz ) );
+            sock->Send( lz4buf.get(), lz4sz + sizeof( lz4sz_t ) );
+        }
+        else
+        {
+            const lz4sz_t sz = TargetFrameSize;
+            sock->Send( &sz, sizeof( sz ) );
+            sock->Send( frame, TargetFrameSize );
+        }
+        offset += TargetFrameSize;
+        if( offset > TargetFrameSize * 2 ) offset = 0;
+    }
+    LZ4_freeStream( stream );
+}
+
+static void Consume( Socket* sock, int frames, uint64_t& bytes )
+{
+    auto stream = LZ4_createStreamDecode();
+    auto buffer = std::make_unique<char[]>( TargetFrameSize * 3 );
+    auto lz4buf = std::make_unique<char[]>( LZ4Size );
+    const auto compress = sock->IsCompressed();
+
+    timeval tv;
+    tv.tv_sec = 0;
+    tv.tv_usec = 10000;
+    auto DontExit = [] { return false; };
+
+    int offset = 0;
+    for( int i=0; i<frames; i++ )
+    {
+        auto frame = buffer.get() + offset;
+        lz4sz_t lz4sz;
+        if( !sock->Read( &lz4sz, sizeof( lz4sz ), &tv, DontExit ) ) break;
+        if( compress )
+        {
+            if( !sock->Read( lz4buf.get(), lz4sz, &tv, DontExit ) ) break;
+            LZ4_decompress_safe_continue( stream, lz4buf.get(), frame, lz4sz, TargetFrameSize );
+        }
+        else
+        {
+            if( !sock->Read( frame, lz4sz, &tv, DontExit ) ) break;
+        }
+        bytes += sizeof( lz4sz ) + lz4sz;
+        offset += TargetFrameSize;
+        if( offset > TargetFrameSize * 2 ) offset = 0;
+    }
+    LZ4_freeStreamDecode( stream );
+}
+
+static void Run( const char* name, int frames, bool shm, bool compress )
+{
+    ListenSocket listen;
+    if( shm ? !listen.ListenShm( "transportbench", compress ) : !listen.Listen( "8099", 1 ) )
+    {
+        printf( "%-14s unavailable\n", name );
+        return;
+    }
+
+    uint64_t bytes = 0;
+    std::chrono::time_point<std::chrono::high_resolution_clock> t0;
+    std::thread consumer( [&] {
+        Socket sock;
+        while( shm ? !sock.ConnectShm( "transportbench" ) : !sock.Connect( "127.0.0.1", "8099" ) ) {}
+        Consume( &sock, frames, bytes );
+    } );
+
+    Socket* sock = nullptr;
+    while( !sock ) sock = listen.Accept();
+
+    uint64_t events = 0;
+    t0 = std::chrono::high_resolution_clock::now();
+    Produce( sock, frames, events );
+    consumer.join();
+    const auto t1 = std::chrono::high_resolution_clock::now();
+
+    sock->~Socket();
+    free( sock );
+
+    const auto s = std::chrono::duration_cast<std::chrono::duration<double>>( t1 - t0 ).count();
+    printf( "%-14s %8.2f M events/s, %8.2f MB/s sent (%.1f%% of raw)\n", name, events / s / 1000000., bytes / s / ( 1024 * 1024 ), 100. * bytes / ( double( frames ) * TargetFrameSize ) );
+}
+
+int main( int argc, char** argv )
+{
+    const int frames = argc > 1 ? atoi( argv[1] ) : DefaultFrames;
+
+    Run( "TCP + LZ4", frames, false, true );
+    Run( "shm + LZ4", frames, true, true );
+    Run( "shm", frames, true, false );
+    return 0;
+}
@@ -2,9 +2,11 @@
 #  include <windows.h>
 #endif
 
+#include <memory>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "../../server/TracyFileRead.hpp"
 #include "../../server/TracyFileWrite.hpp"
@@ -15,6 +17,8 @@ void Usage()
 {
     printf( "Usage: update [--hc] input.tracy output.tracy\n\n" );
     printf( "  --hc: enable LZ4HC compression\n" );
+    printf( "  input may also be a raw stream saved by a client in direct-to-file capture mode,\n" );
+    printf( "  a flight recorder dump, or a stream recorded by capture -r\n" );
     exit( 1 );
 }
 
@@ -41,16 +45,40 @@ int main( int argc, char** argv )
     const char* input = argv[1];
     const char* output = argv[2];
 
-    auto f = std::unique_ptr<tracy::FileRead>( tracy::FileRead::Open( input ) );
-    if( !f )
+    // Raw streams written by clients in direct-to-file capture mode, flight
+    // recorder dumps and recorded streams are replayed as if they were received over the
+    // network.
+    bool raw = false;
+    FILE* rf = fopen( input, "rb" );
+    if( rf )
     {
-        fprintf( stderr, "Cannot open input file!\n" );
-        exit( 1 );
+        char hdr[tracy::RawCaptureHeaderSize];
+        raw = fread( hdr, 1, sizeof( hdr ), rf ) == sizeof( hdr ) &&
+            ( memcmp( hdr, tracy::RawCaptureHeader, sizeof( hdr ) ) == 0 || memcmp( hdr, tracy::FlightCaptureHeader, sizeof( hdr ) ) == 0 || memcmp( hdr, tracy::RecordCaptureHeader, sizeof( hdr ) ) == 0 );
+        rewind( rf );
+        if( !raw )
+        {
+            fclose( rf );
+            rf = nullptr;
+        }
+    }
+
+    std::unique_ptr<tracy::FileRead> f;
+    if( !raw )
+    {
+        f.reset( tracy::FileRead::Open( input ) );
+        if( !f )
+        {
+            fprintf( stderr, "Cannot open input file!\n" );
+            exit( 1 );
+        }
     }
 
     try
     {
-        tracy::Worker worker( *f );
+        auto workerPtr = raw ? std::make_unique<tracy::Worker>( rf ) : std::make_unique<tracy::Worker>( *f );
+        auto& worker = *workerPtr;
+        if( rf ) fclose( rf );
 
         auto w = std::unique_ptr<tracy::FileWrite>( tracy::FileWrite::Open( output, hc ? tracy::FileWrite::Compression::Slow : tracy::FileWrite::Compression::Fast ) );
         if( !w )